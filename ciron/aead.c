@@ -0,0 +1,513 @@
+#include <string.h>
+#include <stdint.h>
+#include "aead.h"
+#include "aes.h"
+#include "random.h"
+#include "registry.h"
+
+#ifdef CIRON_X86_INTRINSICS
+#include <immintrin.h>
+#endif
+
+#define POLY1305_BLOCK_BYTES 16
+
+static void cleanse(void *p, size_t len) {
+	volatile unsigned char *v = p;
+
+	while (len-- > 0) {
+		*v++ = 0;
+	}
+}
+
+static uint64_t load_be64(const unsigned char *p) {
+	return ((uint64_t) p[0] << 56) | ((uint64_t) p[1] << 48)
+			| ((uint64_t) p[2] << 40) | ((uint64_t) p[3] << 32)
+			| ((uint64_t) p[4] << 24) | ((uint64_t) p[5] << 16)
+			| ((uint64_t) p[6] << 8) | (uint64_t) p[7];
+}
+
+static void store_be64(unsigned char *p, uint64_t v) {
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		p[i] = (unsigned char) v;
+		v >>= 8;
+	}
+}
+
+static uint32_t load_le32(const unsigned char *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8)
+			| ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char) v;
+	p[1] = (unsigned char) (v >> 8);
+	p[2] = (unsigned char) (v >> 16);
+	p[3] = (unsigned char) (v >> 24);
+}
+
+static void store_le64(unsigned char *p, uint64_t v) {
+	store_le32(p, (uint32_t) v);
+	store_le32(p + 4, (uint32_t) (v >> 32));
+}
+
+/*
+ * Compares tags without returning early, returns 0 if they are equal.
+ */
+static unsigned int tags_differ(const unsigned char *a, const unsigned char *b) {
+	unsigned int d = 0;
+	int i;
+
+	for (i = 0; i < CIRON_AEAD_TAG_BYTES; i++) {
+		d |= a[i] ^ b[i];
+	}
+	return d;
+}
+
+/*
+ * Multiplication in GF(2^128) as defined for GCM, bit by bit and with masks
+ * instead of branches so that the time does not depend on the values.
+ */
+void ciron_ghash_generic(unsigned char *x, const unsigned char *h,
+		const unsigned char *data, size_t nblocks) {
+	uint64_t zh, zl, vh, vl, mask;
+	unsigned char b;
+	int i, j;
+
+	while (nblocks-- > 0) {
+		zh = 0;
+		zl = 0;
+		vh = load_be64(h);
+		vl = load_be64(h + 8);
+		for (i = 0; i < CIRON_GHASH_BLOCK_BYTES; i++) {
+			b = x[i] ^ data[i];
+			for (j = 7; j >= 0; j--) {
+				mask = (uint64_t) 0 - ((b >> j) & 1);
+				zh ^= vh & mask;
+				zl ^= vl & mask;
+				mask = (uint64_t) 0 - (vl & 1);
+				vl = (vl >> 1) | (vh << 63);
+				vh = (vh >> 1) ^ (0xe100000000000000ULL & mask);
+			}
+		}
+		store_be64(x, zh);
+		store_be64(x + 8, zl);
+		data += CIRON_GHASH_BLOCK_BYTES;
+	}
+}
+
+#ifdef CIRON_X86_INTRINSICS
+
+#define PCLMUL __attribute__((target("pclmul,ssse3")))
+
+/*
+ * Carry-less multiplication of byte reflected operands followed by the
+ * reduction modulo x^128 + x^7 + x^2 + x + 1, after Gueron and Kounavis,
+ * "Intel Carry-Less Multiplication Instruction and its Usage for Computing
+ * the GCM Mode".
+ */
+PCLMUL static __m128i gfmul(__m128i a, __m128i b) {
+	__m128i t2, t3, t4, t5, t6, t7, t8, t9;
+
+	t3 = _mm_clmulepi64_si128(a, b, 0x00);
+	t4 = _mm_clmulepi64_si128(a, b, 0x10);
+	t5 = _mm_clmulepi64_si128(a, b, 0x01);
+	t6 = _mm_clmulepi64_si128(a, b, 0x11);
+	t4 = _mm_xor_si128(t4, t5);
+	t5 = _mm_slli_si128(t4, 8);
+	t4 = _mm_srli_si128(t4, 8);
+	t3 = _mm_xor_si128(t3, t5);
+	t6 = _mm_xor_si128(t6, t4);
+
+	/* Shift the 256 bit product left by one for the reflected bit order */
+	t7 = _mm_srli_epi32(t3, 31);
+	t8 = _mm_srli_epi32(t6, 31);
+	t3 = _mm_slli_epi32(t3, 1);
+	t6 = _mm_slli_epi32(t6, 1);
+	t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	t3 = _mm_or_si128(t3, t7);
+	t6 = _mm_or_si128(t6, t8);
+	t6 = _mm_or_si128(t6, t9);
+
+	/* Reduction */
+	t7 = _mm_slli_epi32(t3, 31);
+	t8 = _mm_slli_epi32(t3, 30);
+	t9 = _mm_slli_epi32(t3, 25);
+	t7 = _mm_xor_si128(t7, t8);
+	t7 = _mm_xor_si128(t7, t9);
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	t3 = _mm_xor_si128(t3, t7);
+	t2 = _mm_srli_epi32(t3, 1);
+	t4 = _mm_srli_epi32(t3, 2);
+	t5 = _mm_srli_epi32(t3, 7);
+	t2 = _mm_xor_si128(t2, t4);
+	t2 = _mm_xor_si128(t2, t5);
+	t2 = _mm_xor_si128(t2, t8);
+	t3 = _mm_xor_si128(t3, t2);
+	return _mm_xor_si128(t6, t3);
+}
+
+PCLMUL void ciron_ghash_pclmul(unsigned char *x, const unsigned char *h,
+		const unsigned char *data, size_t nblocks) {
+	const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+			11, 12, 13, 14, 15);
+	__m128i hv = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) h), reverse);
+	__m128i xv = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) x), reverse);
+	__m128i d;
+
+	while (nblocks-- > 0) {
+		d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), reverse);
+		xv = gfmul(_mm_xor_si128(xv, d), hv);
+		data += CIRON_GHASH_BLOCK_BYTES;
+	}
+	_mm_storeu_si128((__m128i *) x, _mm_shuffle_epi8(xv, reverse));
+}
+
+#endif /* CIRON_X86_INTRINSICS */
+
+struct ghash_functions {
+	void (*ghash)(unsigned char *x, const unsigned char *h,
+			const unsigned char *data, size_t nblocks);
+};
+
+static const struct ghash_functions generic = { ciron_ghash_generic };
+
+#ifdef CIRON_X86_INTRINSICS
+static const struct ghash_functions pclmul = { ciron_ghash_pclmul };
+#endif
+
+static const struct CironImplementation implementations[] = {
+#ifdef CIRON_X86_INTRINSICS
+	{ "pclmul", CIRON_CPU_PCLMUL | CIRON_CPU_SSSE3, &pclmul },
+#endif
+	{ "generic", 0, &generic },
+	{ NULL, 0, NULL }
+};
+
+struct CironPrimitive ciron_ghash_primitive = { "ghash", implementations, NULL };
+
+void ciron_ghash(unsigned char *x, const unsigned char *h,
+		const unsigned char *data, size_t nblocks) {
+	const struct ghash_functions *f = ciron_primitive_functions(&ciron_ghash_primitive);
+
+	f->ghash(x, h, data, nblocks);
+}
+
+/*
+ * Absorbs len bytes, padding the last block with zeros.
+ */
+static void ghash_padded(const struct ghash_functions *f, unsigned char *x,
+		const unsigned char *h, const unsigned char *data, size_t len) {
+	unsigned char last[CIRON_GHASH_BLOCK_BYTES];
+	size_t rest = len % CIRON_GHASH_BLOCK_BYTES;
+
+	f->ghash(x, h, data, len / CIRON_GHASH_BLOCK_BYTES);
+	if (rest > 0) {
+		memset(last, 0, sizeof(last));
+		memcpy(last, data + len - rest, rest);
+		f->ghash(x, h, last, 1);
+	}
+}
+
+/*
+ * Computes the GCM tag of aad and the ciphertext. counter is J0 on entry
+ * and J0 + 1, the counter of the first block of data, on return.
+ */
+static void gcm_tag(const struct CironAesKey *k, unsigned char *counter,
+		const unsigned char *aad, size_t aad_len, const unsigned char *ciphertext,
+		size_t len, unsigned char *tag) {
+	const struct ghash_functions *f = ciron_primitive_functions(&ciron_ghash_primitive);
+	unsigned char h[CIRON_GHASH_BLOCK_BYTES];
+	unsigned char x[CIRON_GHASH_BLOCK_BYTES];
+	unsigned char lengths[CIRON_GHASH_BLOCK_BYTES];
+	unsigned char ej0[CIRON_AES_BLOCK_BYTES];
+	unsigned char zero[CIRON_AES_BLOCK_BYTES];
+	int i;
+
+	/* H is the encryption of the zero block, which counter mode yields for a zero counter */
+	memset(zero, 0, sizeof(zero));
+	memset(h, 0, sizeof(h));
+	ciron_aes_ctr32_encrypt(k, zero, h, h, sizeof(h));
+	memset(zero, 0, sizeof(zero));
+	ciron_aes_ctr32_encrypt(k, counter, zero, ej0, sizeof(ej0));
+
+	memset(x, 0, sizeof(x));
+	ghash_padded(f, x, h, aad, aad_len);
+	ghash_padded(f, x, h, ciphertext, len);
+	store_be64(lengths, (uint64_t) aad_len * 8);
+	store_be64(lengths + 8, (uint64_t) len * 8);
+	f->ghash(x, h, lengths, 1);
+
+	for (i = 0; i < CIRON_AEAD_TAG_BYTES; i++) {
+		tag[i] = x[i] ^ ej0[i];
+	}
+	cleanse(h, sizeof(h));
+	cleanse(ej0, sizeof(ej0));
+}
+
+/*
+ * J0 of a 96 bit IV is the IV followed by the 32 bit block number 1.
+ */
+static void gcm_j0(const unsigned char *iv, unsigned char *counter) {
+	memcpy(counter, iv, CIRON_AEAD_IV_BYTES);
+	memset(counter + CIRON_AEAD_IV_BYTES, 0, CIRON_AES_BLOCK_BYTES - CIRON_AEAD_IV_BYTES);
+	counter[CIRON_AES_BLOCK_BYTES - 1] = 1;
+}
+
+void ciron_aes_gcm_encrypt(const unsigned char *key, unsigned int key_bits,
+		const unsigned char *iv, const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag) {
+	struct CironAesKey k;
+	unsigned char j0[CIRON_AES_BLOCK_BYTES];
+	unsigned char counter[CIRON_AES_BLOCK_BYTES];
+
+	ciron_aes_set_key(&k, key, key_bits);
+	gcm_j0(iv, j0);
+	memcpy(counter, j0, sizeof(counter));
+	counter[CIRON_AES_BLOCK_BYTES - 1] = 2;
+	ciron_aes_ctr32_encrypt(&k, counter, data, buf, data_len);
+	gcm_tag(&k, j0, aad, aad_len, buf, data_len, tag);
+	cleanse(&k, sizeof(k));
+}
+
+int ciron_aes_gcm_decrypt(const unsigned char *key, unsigned int key_bits,
+		const unsigned char *iv, const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf) {
+	struct CironAesKey k;
+	unsigned char counter[CIRON_AES_BLOCK_BYTES];
+	unsigned char expected[CIRON_AEAD_TAG_BYTES];
+
+	ciron_aes_set_key(&k, key, key_bits);
+	gcm_j0(iv, counter);
+	gcm_tag(&k, counter, aad, aad_len, data, data_len, expected);
+	if (tags_differ(tag, expected)) {
+		cleanse(&k, sizeof(k));
+		return -1;
+	}
+	ciron_aes_ctr32_encrypt(&k, counter, data, buf, data_len);
+	cleanse(&k, sizeof(k));
+	return 0;
+}
+
+/*
+ * Poly1305 with 26 bit limbs (after poly1305-donna). Only full blocks are
+ * processed because the AEAD construction pads everything to 16 bytes.
+ */
+struct poly1305 {
+	uint32_t r[5];
+	uint32_t h[5];
+	uint32_t pad[4];
+};
+
+static void poly1305_init(struct poly1305 *p, const unsigned char *key) {
+	p->r[0] = load_le32(key) & 0x3ffffff;
+	p->r[1] = (load_le32(key + 3) >> 2) & 0x3ffff03;
+	p->r[2] = (load_le32(key + 6) >> 4) & 0x3ffc0ff;
+	p->r[3] = (load_le32(key + 9) >> 6) & 0x3f03fff;
+	p->r[4] = (load_le32(key + 12) >> 8) & 0x00fffff;
+	memset(p->h, 0, sizeof(p->h));
+	p->pad[0] = load_le32(key + 16);
+	p->pad[1] = load_le32(key + 20);
+	p->pad[2] = load_le32(key + 24);
+	p->pad[3] = load_le32(key + 28);
+}
+
+static void poly1305_blocks(struct poly1305 *p, const unsigned char *m, size_t nblocks) {
+	const uint32_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2], r3 = p->r[3], r4 = p->r[4];
+	const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+	uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4];
+	uint64_t d0, d1, d2, d3, d4;
+	uint32_t c;
+
+	while (nblocks-- > 0) {
+		h0 += load_le32(m) & 0x3ffffff;
+		h1 += (load_le32(m + 3) >> 2) & 0x3ffffff;
+		h2 += (load_le32(m + 6) >> 4) & 0x3ffffff;
+		h3 += (load_le32(m + 9) >> 6) & 0x3ffffff;
+		h4 += (load_le32(m + 12) >> 8) | (1 << 24);
+
+		d0 = (uint64_t) h0 * r0 + (uint64_t) h1 * s4 + (uint64_t) h2 * s3
+				+ (uint64_t) h3 * s2 + (uint64_t) h4 * s1;
+		d1 = (uint64_t) h0 * r1 + (uint64_t) h1 * r0 + (uint64_t) h2 * s4
+				+ (uint64_t) h3 * s3 + (uint64_t) h4 * s2;
+		d2 = (uint64_t) h0 * r2 + (uint64_t) h1 * r1 + (uint64_t) h2 * r0
+				+ (uint64_t) h3 * s4 + (uint64_t) h4 * s3;
+		d3 = (uint64_t) h0 * r3 + (uint64_t) h1 * r2 + (uint64_t) h2 * r1
+				+ (uint64_t) h3 * r0 + (uint64_t) h4 * s4;
+		d4 = (uint64_t) h0 * r4 + (uint64_t) h1 * r3 + (uint64_t) h2 * r2
+				+ (uint64_t) h3 * r1 + (uint64_t) h4 * r0;
+
+		c = (uint32_t) (d0 >> 26);
+		h0 = (uint32_t) d0 & 0x3ffffff;
+		d1 += c;
+		c = (uint32_t) (d1 >> 26);
+		h1 = (uint32_t) d1 & 0x3ffffff;
+		d2 += c;
+		c = (uint32_t) (d2 >> 26);
+		h2 = (uint32_t) d2 & 0x3ffffff;
+		d3 += c;
+		c = (uint32_t) (d3 >> 26);
+		h3 = (uint32_t) d3 & 0x3ffffff;
+		d4 += c;
+		c = (uint32_t) (d4 >> 26);
+		h4 = (uint32_t) d4 & 0x3ffffff;
+		h0 += c * 5;
+		c = h0 >> 26;
+		h0 &= 0x3ffffff;
+		h1 += c;
+
+		m += POLY1305_BLOCK_BYTES;
+	}
+	p->h[0] = h0;
+	p->h[1] = h1;
+	p->h[2] = h2;
+	p->h[3] = h3;
+	p->h[4] = h4;
+}
+
+static void poly1305_padded(struct poly1305 *p, const unsigned char *m, size_t len) {
+	unsigned char last[POLY1305_BLOCK_BYTES];
+	size_t rest = len % POLY1305_BLOCK_BYTES;
+
+	poly1305_blocks(p, m, len / POLY1305_BLOCK_BYTES);
+	if (rest > 0) {
+		memset(last, 0, sizeof(last));
+		memcpy(last, m + len - rest, rest);
+		poly1305_blocks(p, last, 1);
+	}
+}
+
+static void poly1305_finish(struct poly1305 *p, unsigned char *mac) {
+	uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4];
+	uint32_t g0, g1, g2, g3, g4;
+	uint32_t c, mask;
+	uint64_t f;
+
+	/* Fully carry h */
+	c = h1 >> 26;
+	h1 &= 0x3ffffff;
+	h2 += c;
+	c = h2 >> 26;
+	h2 &= 0x3ffffff;
+	h3 += c;
+	c = h3 >> 26;
+	h3 &= 0x3ffffff;
+	h4 += c;
+	c = h4 >> 26;
+	h4 &= 0x3ffffff;
+	h0 += c * 5;
+	c = h0 >> 26;
+	h0 &= 0x3ffffff;
+	h1 += c;
+
+	/* g = h + 5 - 2^130, selected instead of h if it is not negative */
+	g0 = h0 + 5;
+	c = g0 >> 26;
+	g0 &= 0x3ffffff;
+	g1 = h1 + c;
+	c = g1 >> 26;
+	g1 &= 0x3ffffff;
+	g2 = h2 + c;
+	c = g2 >> 26;
+	g2 &= 0x3ffffff;
+	g3 = h3 + c;
+	c = g3 >> 26;
+	g3 &= 0x3ffffff;
+	g4 = h4 + c - (1UL << 26);
+
+	mask = (g4 >> 31) - 1;
+	h0 = (h0 & ~mask) | (g0 & mask);
+	h1 = (h1 & ~mask) | (g1 & mask);
+	h2 = (h2 & ~mask) | (g2 & mask);
+	h3 = (h3 & ~mask) | (g3 & mask);
+	h4 = (h4 & ~mask) | (g4 & mask);
+
+	/* h % 2^128 + pad */
+	h0 = h0 | (h1 << 26);
+	h1 = (h1 >> 6) | (h2 << 20);
+	h2 = (h2 >> 12) | (h3 << 14);
+	h3 = (h3 >> 18) | (h4 << 8);
+	f = (uint64_t) h0 + p->pad[0];
+	store_le32(mac, (uint32_t) f);
+	f = (uint64_t) h1 + p->pad[1] + (f >> 32);
+	store_le32(mac + 4, (uint32_t) f);
+	f = (uint64_t) h2 + p->pad[2] + (f >> 32);
+	store_le32(mac + 8, (uint32_t) f);
+	f = (uint64_t) h3 + p->pad[3] + (f >> 32);
+	store_le32(mac + 12, (uint32_t) f);
+}
+
+/*
+ * The tag of RFC 8439, section 2.8: Poly1305 keyed with the first block
+ * of the key stream over the padded aad and ciphertext and their lengths.
+ */
+static void chacha20_poly1305_tag(const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len, const unsigned char *ciphertext,
+		size_t len, unsigned char *tag) {
+	unsigned char block[CIRON_CHACHA20_BLOCK_BYTES];
+	unsigned char lengths[POLY1305_BLOCK_BYTES];
+	struct poly1305 p;
+
+	ciron_chacha20(key, iv, 0, block, 1);
+	poly1305_init(&p, block);
+	poly1305_padded(&p, aad, aad_len);
+	poly1305_padded(&p, ciphertext, len);
+	store_le64(lengths, (uint64_t) aad_len);
+	store_le64(lengths + 8, (uint64_t) len);
+	poly1305_blocks(&p, lengths, 1);
+	poly1305_finish(&p, tag);
+	cleanse(block, sizeof(block));
+	cleanse(&p, sizeof(p));
+}
+
+/*
+ * XORs data with the key stream starting at block 1.
+ */
+static void chacha20_xor(const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t len, unsigned char *buf) {
+	unsigned char stream[4 * CIRON_CHACHA20_BLOCK_BYTES];
+	uint32_t counter = 1;
+	size_t nblocks, n, i;
+
+	while (len > 0) {
+		n = len < sizeof(stream) ? len : sizeof(stream);
+		nblocks = (n + CIRON_CHACHA20_BLOCK_BYTES - 1) / CIRON_CHACHA20_BLOCK_BYTES;
+		ciron_chacha20(key, iv, counter, stream, nblocks);
+		for (i = 0; i < n; i++) {
+			buf[i] = data[i] ^ stream[i];
+		}
+		counter += (uint32_t) nblocks;
+		data += n;
+		buf += n;
+		len -= n;
+	}
+	cleanse(stream, sizeof(stream));
+}
+
+void ciron_chacha20_poly1305_encrypt(const unsigned char *key,
+		const unsigned char *iv, const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag) {
+	chacha20_xor(key, iv, data, data_len, buf);
+	chacha20_poly1305_tag(key, iv, aad, aad_len, buf, data_len, tag);
+}
+
+int ciron_chacha20_poly1305_decrypt(const unsigned char *key,
+		const unsigned char *iv, const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf) {
+	unsigned char expected[CIRON_AEAD_TAG_BYTES];
+
+	chacha20_poly1305_tag(key, iv, aad, aad_len, data, data_len, expected);
+	if (tags_differ(tag, expected)) {
+		return -1;
+	}
+	chacha20_xor(key, iv, data, data_len, buf);
+	return 0;
+}
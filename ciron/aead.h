@@ -0,0 +1,78 @@
+#ifndef CIRON_AEAD_H
+#define CIRON_AEAD_H 1
+
+#include <stddef.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * AES-GCM (NIST SP 800-38D) and ChaCha20-Poly1305 (RFC 8439) for the
+ * native crypto implementation.
+ *
+ * Both encrypt and authenticate in one pass with a single key, a 96 bit
+ * IV and a 128 bit tag. AES-GCM uses aes.h for the counter mode, the
+ * GHASH multiplication is the "ghash" primitive of the registry
+ * (registry.h): a carry-less multiplication with PCLMULQDQ or a portable
+ * constant time one. ChaCha20-Poly1305 uses the ChaCha20 of random.h and
+ * needs no special instructions.
+ */
+
+#define CIRON_AEAD_IV_BYTES 12
+#define CIRON_AEAD_TAG_BYTES 16
+#define CIRON_GHASH_BLOCK_BYTES 16
+
+/** Absorb nblocks 16 byte blocks of data into the GHASH state x with the
+ * hash key h: x = (x ^ block) * h for every block.
+ */
+void ciron_ghash(unsigned char *x, const unsigned char *h,
+		const unsigned char *data, size_t nblocks);
+void ciron_ghash_generic(unsigned char *x, const unsigned char *h,
+		const unsigned char *data, size_t nblocks);
+
+/** Encrypt data_len bytes of data to buf with AES-GCM and write the tag
+ * of buf and aad to tag.
+ *
+ * key_bits is 128 or 256. buf is as long as data and may be the same.
+ */
+void ciron_aes_gcm_encrypt(const unsigned char *key, unsigned int key_bits,
+		const unsigned char *iv, const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag);
+
+/** Check the tag of data and aad and decrypt data_len bytes of data to buf.
+ *
+ * Returns 0 on success and -1 if the tag does not match, in which case
+ * nothing is written to buf.
+ */
+int ciron_aes_gcm_decrypt(const unsigned char *key, unsigned int key_bits,
+		const unsigned char *iv, const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf);
+
+/** Like ciron_aes_gcm_encrypt() with ChaCha20-Poly1305 and a 256 bit key.
+ */
+void ciron_chacha20_poly1305_encrypt(const unsigned char *key,
+		const unsigned char *iv, const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag);
+
+/** Like ciron_aes_gcm_decrypt() with ChaCha20-Poly1305 and a 256 bit key.
+ */
+int ciron_chacha20_poly1305_decrypt(const unsigned char *key,
+		const unsigned char *iv, const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf);
+
+#ifdef CIRON_X86_INTRINSICS
+void ciron_ghash_pclmul(unsigned char *x, const unsigned char *h,
+		const unsigned char *data, size_t nblocks);
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_AEAD_H */
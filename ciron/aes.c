@@ -0,0 +1,777 @@
+#include <string.h>
+#include "aes.h"
+#include "registry.h"
+
+#ifdef CIRON_X86_INTRINSICS
+#include <immintrin.h>
+#endif
+
+static const unsigned char SBOX[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const unsigned char INV_SBOX[256] = {
+	0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+	0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+	0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+	0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+	0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+	0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+	0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+	0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+	0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+	0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+	0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+	0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+	0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+	0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+	0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+	0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
+};
+
+static const unsigned char RCON[10] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+};
+
+/*
+ * Multiplication by x in GF(2^8).
+ */
+static unsigned char xtime(unsigned char b) {
+	return (unsigned char) ((b << 1) ^ ((b & 0x80) ? 0x1b : 0x00));
+}
+
+static unsigned char gmul(unsigned char a, unsigned char b) {
+	unsigned char p = 0;
+
+	while (b != 0) {
+		if (b & 1) {
+			p ^= a;
+		}
+		a = xtime(a);
+		b >>= 1;
+	}
+	return p;
+}
+
+int ciron_aes_set_key_generic(struct CironAesKey *key,
+		const unsigned char *key_bytes, unsigned int key_bits) {
+	unsigned char *w = key->round_keys;
+	unsigned char t[4];
+	unsigned char tmp;
+	unsigned int nk;
+	unsigned int i;
+	int j;
+
+	if (key_bits != 128 && key_bits != 256) {
+		return -1;
+	}
+	nk = key_bits / 32;
+	key->rounds = nk + 6;
+	memcpy(w, key_bytes, 4 * nk);
+
+	for (i = nk; i < 4 * (key->rounds + 1); i++) {
+		memcpy(t, w + 4 * (i - 1), 4);
+		if (i % nk == 0) {
+			tmp = t[0];
+			t[0] = SBOX[t[1]] ^ RCON[i / nk - 1];
+			t[1] = SBOX[t[2]];
+			t[2] = SBOX[t[3]];
+			t[3] = SBOX[tmp];
+		} else if (nk > 6 && i % nk == 4) {
+			for (j = 0; j < 4; j++) {
+				t[j] = SBOX[t[j]];
+			}
+		}
+		for (j = 0; j < 4; j++) {
+			w[4 * i + j] = w[4 * (i - nk) + j] ^ t[j];
+		}
+	}
+	return 0;
+}
+
+static void add_round_key(unsigned char *s, const unsigned char *rk) {
+	int i;
+
+	for (i = 0; i < CIRON_AES_BLOCK_BYTES; i++) {
+		s[i] ^= rk[i];
+	}
+}
+
+/*
+ * SubBytes and ShiftRows in one step. The state is stored column by
+ * column, so row r of column c is s[4 * c + r].
+ */
+static void sub_shift_rows(unsigned char *s) {
+	unsigned char t[CIRON_AES_BLOCK_BYTES];
+	int c, r;
+
+	for (c = 0; c < 4; c++) {
+		for (r = 0; r < 4; r++) {
+			t[4 * c + r] = SBOX[s[4 * ((c + r) % 4) + r]];
+		}
+	}
+	memcpy(s, t, sizeof(t));
+}
+
+static void inv_sub_shift_rows(unsigned char *s) {
+	unsigned char t[CIRON_AES_BLOCK_BYTES];
+	int c, r;
+
+	for (c = 0; c < 4; c++) {
+		for (r = 0; r < 4; r++) {
+			t[4 * ((c + r) % 4) + r] = INV_SBOX[s[4 * c + r]];
+		}
+	}
+	memcpy(s, t, sizeof(t));
+}
+
+static void mix_columns(unsigned char *s) {
+	unsigned char a0, a1, a2, a3, all;
+	int c;
+
+	for (c = 0; c < 4; c++, s += 4) {
+		a0 = s[0];
+		a1 = s[1];
+		a2 = s[2];
+		a3 = s[3];
+		all = a0 ^ a1 ^ a2 ^ a3;
+		s[0] ^= all ^ xtime(a0 ^ a1);
+		s[1] ^= all ^ xtime(a1 ^ a2);
+		s[2] ^= all ^ xtime(a2 ^ a3);
+		s[3] ^= all ^ xtime(a3 ^ a0);
+	}
+}
+
+static void inv_mix_columns(unsigned char *s) {
+	unsigned char a0, a1, a2, a3;
+	int c;
+
+	for (c = 0; c < 4; c++, s += 4) {
+		a0 = s[0];
+		a1 = s[1];
+		a2 = s[2];
+		a3 = s[3];
+		s[0] = gmul(a0, 14) ^ gmul(a1, 11) ^ gmul(a2, 13) ^ gmul(a3, 9);
+		s[1] = gmul(a0, 9) ^ gmul(a1, 14) ^ gmul(a2, 11) ^ gmul(a3, 13);
+		s[2] = gmul(a0, 13) ^ gmul(a1, 9) ^ gmul(a2, 14) ^ gmul(a3, 11);
+		s[3] = gmul(a0, 11) ^ gmul(a1, 13) ^ gmul(a2, 9) ^ gmul(a3, 14);
+	}
+}
+
+static void encrypt_block(const struct CironAesKey *key, unsigned char *s) {
+	const unsigned char *rk = key->round_keys;
+	unsigned int r;
+
+	add_round_key(s, rk);
+	for (r = 1; r < key->rounds; r++) {
+		sub_shift_rows(s);
+		mix_columns(s);
+		add_round_key(s, rk + CIRON_AES_BLOCK_BYTES * r);
+	}
+	sub_shift_rows(s);
+	add_round_key(s, rk + CIRON_AES_BLOCK_BYTES * key->rounds);
+}
+
+static void decrypt_block(const struct CironAesKey *key, unsigned char *s) {
+	const unsigned char *rk = key->round_keys;
+	unsigned int r;
+
+	add_round_key(s, rk + CIRON_AES_BLOCK_BYTES * key->rounds);
+	for (r = key->rounds - 1; r > 0; r--) {
+		inv_sub_shift_rows(s);
+		add_round_key(s, rk + CIRON_AES_BLOCK_BYTES * r);
+		inv_mix_columns(s);
+	}
+	inv_sub_shift_rows(s);
+	add_round_key(s, rk);
+}
+
+void ciron_aes_cbc_encrypt_generic(const struct CironAesKey *key,
+		unsigned char *iv, const unsigned char *in, unsigned char *out,
+		size_t nblocks) {
+	int i;
+
+	while (nblocks-- > 0) {
+		for (i = 0; i < CIRON_AES_BLOCK_BYTES; i++) {
+			iv[i] ^= in[i];
+		}
+		encrypt_block(key, iv);
+		memcpy(out, iv, CIRON_AES_BLOCK_BYTES);
+		in += CIRON_AES_BLOCK_BYTES;
+		out += CIRON_AES_BLOCK_BYTES;
+	}
+}
+
+void ciron_aes_cbc_decrypt_generic(const struct CironAesKey *key,
+		unsigned char *iv, const unsigned char *in, unsigned char *out,
+		size_t nblocks) {
+	unsigned char s[CIRON_AES_BLOCK_BYTES];
+	unsigned char c[CIRON_AES_BLOCK_BYTES];
+	int i;
+
+	while (nblocks-- > 0) {
+		memcpy(c, in, CIRON_AES_BLOCK_BYTES);
+		memcpy(s, in, CIRON_AES_BLOCK_BYTES);
+		decrypt_block(key, s);
+		for (i = 0; i < CIRON_AES_BLOCK_BYTES; i++) {
+			out[i] = s[i] ^ iv[i];
+		}
+		memcpy(iv, c, CIRON_AES_BLOCK_BYTES);
+		in += CIRON_AES_BLOCK_BYTES;
+		out += CIRON_AES_BLOCK_BYTES;
+	}
+}
+
+/*
+ * Increments the last 4 bytes of a counter block as a big endian number.
+ */
+static void increment_counter(unsigned char *counter) {
+	int i;
+
+	for (i = CIRON_AES_BLOCK_BYTES - 1; i >= CIRON_AES_BLOCK_BYTES - 4; i--) {
+		if (++counter[i] != 0) {
+			break;
+		}
+	}
+}
+
+void ciron_aes_ctr32_encrypt_generic(const struct CironAesKey *key,
+		unsigned char *counter, const unsigned char *in, unsigned char *out,
+		size_t len) {
+	unsigned char s[CIRON_AES_BLOCK_BYTES];
+	size_t i, n;
+
+	while (len > 0) {
+		memcpy(s, counter, CIRON_AES_BLOCK_BYTES);
+		encrypt_block(key, s);
+		increment_counter(counter);
+		n = len < CIRON_AES_BLOCK_BYTES ? len : CIRON_AES_BLOCK_BYTES;
+		for (i = 0; i < n; i++) {
+			out[i] = in[i] ^ s[i];
+		}
+		in += n;
+		out += n;
+		len -= n;
+	}
+}
+
+#ifdef CIRON_X86_INTRINSICS
+
+#define AESNI __attribute__((target("aes,sse2")))
+
+/*
+ * Key expansion steps as in Intel's AES-NI white paper. assist is the
+ * result of aeskeygenassist on the previous round key, already shuffled
+ * to the word to be mixed in.
+ */
+AESNI static __m128i expand_step(__m128i key, __m128i assist) {
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+#define EXPAND128(i, rcon) \
+	rk[i] = expand_step(rk[(i) - 1], \
+			_mm_shuffle_epi32(_mm_aeskeygenassist_si128(rk[(i) - 1], rcon), 0xff))
+
+#define EXPAND256(i, rcon) \
+	do { \
+		rk[i] = expand_step(rk[(i) - 2], \
+				_mm_shuffle_epi32(_mm_aeskeygenassist_si128(rk[(i) - 1], rcon), 0xff)); \
+		if ((i) < 14) { \
+			rk[(i) + 1] = expand_step(rk[(i) - 1], \
+					_mm_shuffle_epi32(_mm_aeskeygenassist_si128(rk[i], 0x00), 0xaa)); \
+		} \
+	} while (0)
+
+AESNI int ciron_aes_set_key_aesni(struct CironAesKey *key,
+		const unsigned char *key_bytes, unsigned int key_bits) {
+	__m128i rk[CIRON_AES_MAX_ROUNDS + 1];
+	unsigned int i;
+
+	if (key_bits == 128) {
+		key->rounds = 10;
+		rk[0] = _mm_loadu_si128((const __m128i *) key_bytes);
+		EXPAND128(1, 0x01);
+		EXPAND128(2, 0x02);
+		EXPAND128(3, 0x04);
+		EXPAND128(4, 0x08);
+		EXPAND128(5, 0x10);
+		EXPAND128(6, 0x20);
+		EXPAND128(7, 0x40);
+		EXPAND128(8, 0x80);
+		EXPAND128(9, 0x1b);
+		EXPAND128(10, 0x36);
+	} else if (key_bits == 256) {
+		key->rounds = 14;
+		rk[0] = _mm_loadu_si128((const __m128i *) key_bytes);
+		rk[1] = _mm_loadu_si128((const __m128i *) (key_bytes + 16));
+		EXPAND256(2, 0x01);
+		EXPAND256(4, 0x02);
+		EXPAND256(6, 0x04);
+		EXPAND256(8, 0x08);
+		EXPAND256(10, 0x10);
+		EXPAND256(12, 0x20);
+		EXPAND256(14, 0x40);
+	} else {
+		return -1;
+	}
+	for (i = 0; i <= key->rounds; i++) {
+		_mm_storeu_si128((__m128i *) (key->round_keys + CIRON_AES_BLOCK_BYTES * i),
+				rk[i]);
+	}
+	return 0;
+}
+
+AESNI void ciron_aes_cbc_encrypt_aesni(const struct CironAesKey *key,
+		unsigned char *iv, const unsigned char *in, unsigned char *out,
+		size_t nblocks) {
+	__m128i rk[CIRON_AES_MAX_ROUNDS + 1];
+	__m128i x;
+	unsigned int i;
+	unsigned int rounds = key->rounds;
+
+	for (i = 0; i <= rounds; i++) {
+		rk[i] = _mm_loadu_si128(
+				(const __m128i *) (key->round_keys + CIRON_AES_BLOCK_BYTES * i));
+	}
+	x = _mm_loadu_si128((const __m128i *) iv);
+	while (nblocks-- > 0) {
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *) in));
+		x = _mm_xor_si128(x, rk[0]);
+		for (i = 1; i < rounds; i++) {
+			x = _mm_aesenc_si128(x, rk[i]);
+		}
+		x = _mm_aesenclast_si128(x, rk[rounds]);
+		_mm_storeu_si128((__m128i *) out, x);
+		in += CIRON_AES_BLOCK_BYTES;
+		out += CIRON_AES_BLOCK_BYTES;
+	}
+	_mm_storeu_si128((__m128i *) iv, x);
+}
+
+/*
+ * Unlike encryption, CBC decryption of the blocks is independent, so
+ * four blocks are decrypted at once to fill the AES pipeline.
+ */
+AESNI void ciron_aes_cbc_decrypt_aesni(const struct CironAesKey *key,
+		unsigned char *iv, const unsigned char *in, unsigned char *out,
+		size_t nblocks) {
+	__m128i dk[CIRON_AES_MAX_ROUNDS + 1];
+	__m128i c0, c1, c2, c3, x0, x1, x2, x3, prev;
+	unsigned int i;
+	unsigned int rounds = key->rounds;
+
+	/* Round keys for the equivalent inverse cipher */
+	dk[0] = _mm_loadu_si128(
+			(const __m128i *) (key->round_keys + CIRON_AES_BLOCK_BYTES * rounds));
+	for (i = 1; i < rounds; i++) {
+		dk[i] = _mm_aesimc_si128(_mm_loadu_si128((const __m128i *) (key->round_keys
+				+ CIRON_AES_BLOCK_BYTES * (rounds - i))));
+	}
+	dk[rounds] = _mm_loadu_si128((const __m128i *) key->round_keys);
+
+	prev = _mm_loadu_si128((const __m128i *) iv);
+	for (; nblocks >= 4; nblocks -= 4) {
+		c0 = _mm_loadu_si128((const __m128i *) in);
+		c1 = _mm_loadu_si128((const __m128i *) (in + 16));
+		c2 = _mm_loadu_si128((const __m128i *) (in + 32));
+		c3 = _mm_loadu_si128((const __m128i *) (in + 48));
+		x0 = _mm_xor_si128(c0, dk[0]);
+		x1 = _mm_xor_si128(c1, dk[0]);
+		x2 = _mm_xor_si128(c2, dk[0]);
+		x3 = _mm_xor_si128(c3, dk[0]);
+		for (i = 1; i < rounds; i++) {
+			x0 = _mm_aesdec_si128(x0, dk[i]);
+			x1 = _mm_aesdec_si128(x1, dk[i]);
+			x2 = _mm_aesdec_si128(x2, dk[i]);
+			x3 = _mm_aesdec_si128(x3, dk[i]);
+		}
+		x0 = _mm_aesdeclast_si128(x0, dk[rounds]);
+		x1 = _mm_aesdeclast_si128(x1, dk[rounds]);
+		x2 = _mm_aesdeclast_si128(x2, dk[rounds]);
+		x3 = _mm_aesdeclast_si128(x3, dk[rounds]);
+		_mm_storeu_si128((__m128i *) out, _mm_xor_si128(x0, prev));
+		_mm_storeu_si128((__m128i *) (out + 16), _mm_xor_si128(x1, c0));
+		_mm_storeu_si128((__m128i *) (out + 32), _mm_xor_si128(x2, c1));
+		_mm_storeu_si128((__m128i *) (out + 48), _mm_xor_si128(x3, c2));
+		prev = c3;
+		in += 4 * CIRON_AES_BLOCK_BYTES;
+		out += 4 * CIRON_AES_BLOCK_BYTES;
+	}
+	for (; nblocks > 0; nblocks--) {
+		c0 = _mm_loadu_si128((const __m128i *) in);
+		x0 = _mm_xor_si128(c0, dk[0]);
+		for (i = 1; i < rounds; i++) {
+			x0 = _mm_aesdec_si128(x0, dk[i]);
+		}
+		x0 = _mm_aesdeclast_si128(x0, dk[rounds]);
+		_mm_storeu_si128((__m128i *) out, _mm_xor_si128(x0, prev));
+		prev = c0;
+		in += CIRON_AES_BLOCK_BYTES;
+		out += CIRON_AES_BLOCK_BYTES;
+	}
+	_mm_storeu_si128((__m128i *) iv, prev);
+}
+
+/*
+ * The counter blocks are built from the first 12 bytes of the counter,
+ * loaded once, and the block number kept in c.
+ */
+#define COUNTER_BLOCK(j) \
+	_mm_xor_si128(_mm_set_epi32((int) __builtin_bswap32(c + (j)), \
+			(int) w[2], (int) w[1], (int) w[0]), rk[0])
+
+AESNI void ciron_aes_ctr32_encrypt_aesni(const struct CironAesKey *key,
+		unsigned char *counter, const unsigned char *in, unsigned char *out,
+		size_t len) {
+	__m128i rk[CIRON_AES_MAX_ROUNDS + 1];
+	__m128i x0, x1, x2, x3;
+	unsigned char last[CIRON_AES_BLOCK_BYTES];
+	unsigned int w[4];
+	unsigned int c;
+	unsigned int i;
+	unsigned int rounds = key->rounds;
+	size_t n;
+
+	for (i = 0; i <= rounds; i++) {
+		rk[i] = _mm_loadu_si128(
+				(const __m128i *) (key->round_keys + CIRON_AES_BLOCK_BYTES * i));
+	}
+	memcpy(w, counter, sizeof(w));
+	c = __builtin_bswap32(w[3]);
+
+	for (; len >= 4 * CIRON_AES_BLOCK_BYTES; len -= 4 * CIRON_AES_BLOCK_BYTES) {
+		x0 = COUNTER_BLOCK(0);
+		x1 = COUNTER_BLOCK(1);
+		x2 = COUNTER_BLOCK(2);
+		x3 = COUNTER_BLOCK(3);
+		for (i = 1; i < rounds; i++) {
+			x0 = _mm_aesenc_si128(x0, rk[i]);
+			x1 = _mm_aesenc_si128(x1, rk[i]);
+			x2 = _mm_aesenc_si128(x2, rk[i]);
+			x3 = _mm_aesenc_si128(x3, rk[i]);
+		}
+		x0 = _mm_aesenclast_si128(x0, rk[rounds]);
+		x1 = _mm_aesenclast_si128(x1, rk[rounds]);
+		x2 = _mm_aesenclast_si128(x2, rk[rounds]);
+		x3 = _mm_aesenclast_si128(x3, rk[rounds]);
+		_mm_storeu_si128((__m128i *) out,
+				_mm_xor_si128(x0, _mm_loadu_si128((const __m128i *) in)));
+		_mm_storeu_si128((__m128i *) (out + 16),
+				_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *) (in + 16))));
+		_mm_storeu_si128((__m128i *) (out + 32),
+				_mm_xor_si128(x2, _mm_loadu_si128((const __m128i *) (in + 32))));
+		_mm_storeu_si128((__m128i *) (out + 48),
+				_mm_xor_si128(x3, _mm_loadu_si128((const __m128i *) (in + 48))));
+		c += 4;
+		in += 4 * CIRON_AES_BLOCK_BYTES;
+		out += 4 * CIRON_AES_BLOCK_BYTES;
+	}
+	while (len > 0) {
+		x0 = COUNTER_BLOCK(0);
+		for (i = 1; i < rounds; i++) {
+			x0 = _mm_aesenc_si128(x0, rk[i]);
+		}
+		x0 = _mm_aesenclast_si128(x0, rk[rounds]);
+		c++;
+		if (len >= CIRON_AES_BLOCK_BYTES) {
+			_mm_storeu_si128((__m128i *) out,
+					_mm_xor_si128(x0, _mm_loadu_si128((const __m128i *) in)));
+			n = CIRON_AES_BLOCK_BYTES;
+		} else {
+			_mm_storeu_si128((__m128i *) last, x0);
+			for (n = 0; n < len; n++) {
+				out[n] = in[n] ^ last[n];
+			}
+		}
+		in += n;
+		out += n;
+		len -= n;
+	}
+	w[3] = __builtin_bswap32(c);
+	memcpy(counter + 12, &w[3], sizeof(w[3]));
+}
+
+#undef COUNTER_BLOCK
+
+/*
+ * Kernel for ciron_aes_cbc_encrypt_multi(). It encrypts one block per
+ * lane in CBC mode, every lane with the key of its own job: x holds the
+ * chaining values of the lanes one after another and is updated, in
+ * points to the plaintext block and rk to the round keys of every lane.
+ */
+
+#define LANE_KEY(l, i) \
+	_mm_loadu_si128((const __m128i *) (rk[l] + CIRON_AES_BLOCK_BYTES * (i)))
+
+/*
+ * 8 lanes keep the AES unit busy while each AESENC waits for the previous
+ * round of its lane.
+ */
+AESNI static void cbc_lanes_aesni(unsigned char *x, const unsigned char *const *rk,
+		unsigned int rounds, const unsigned char *const *in) {
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7;
+	unsigned int i;
+
+	x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) x),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) in[0]), LANE_KEY(0, 0)));
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (x + 16)),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) in[1]), LANE_KEY(1, 0)));
+	x2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (x + 32)),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) in[2]), LANE_KEY(2, 0)));
+	x3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (x + 48)),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) in[3]), LANE_KEY(3, 0)));
+	x4 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (x + 64)),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) in[4]), LANE_KEY(4, 0)));
+	x5 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (x + 80)),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) in[5]), LANE_KEY(5, 0)));
+	x6 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (x + 96)),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) in[6]), LANE_KEY(6, 0)));
+	x7 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (x + 112)),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) in[7]), LANE_KEY(7, 0)));
+	for (i = 1; i < rounds; i++) {
+		x0 = _mm_aesenc_si128(x0, LANE_KEY(0, i));
+		x1 = _mm_aesenc_si128(x1, LANE_KEY(1, i));
+		x2 = _mm_aesenc_si128(x2, LANE_KEY(2, i));
+		x3 = _mm_aesenc_si128(x3, LANE_KEY(3, i));
+		x4 = _mm_aesenc_si128(x4, LANE_KEY(4, i));
+		x5 = _mm_aesenc_si128(x5, LANE_KEY(5, i));
+		x6 = _mm_aesenc_si128(x6, LANE_KEY(6, i));
+		x7 = _mm_aesenc_si128(x7, LANE_KEY(7, i));
+	}
+	_mm_storeu_si128((__m128i *) x, _mm_aesenclast_si128(x0, LANE_KEY(0, rounds)));
+	_mm_storeu_si128((__m128i *) (x + 16), _mm_aesenclast_si128(x1, LANE_KEY(1, rounds)));
+	_mm_storeu_si128((__m128i *) (x + 32), _mm_aesenclast_si128(x2, LANE_KEY(2, rounds)));
+	_mm_storeu_si128((__m128i *) (x + 48), _mm_aesenclast_si128(x3, LANE_KEY(3, rounds)));
+	_mm_storeu_si128((__m128i *) (x + 64), _mm_aesenclast_si128(x4, LANE_KEY(4, rounds)));
+	_mm_storeu_si128((__m128i *) (x + 80), _mm_aesenclast_si128(x5, LANE_KEY(5, rounds)));
+	_mm_storeu_si128((__m128i *) (x + 96), _mm_aesenclast_si128(x6, LANE_KEY(6, rounds)));
+	_mm_storeu_si128((__m128i *) (x + 112), _mm_aesenclast_si128(x7, LANE_KEY(7, rounds)));
+}
+
+#undef LANE_KEY
+
+#endif /* CIRON_X86_INTRINSICS */
+
+/*
+ * Interleaved CBC encryption of several jobs for
+ * ciron_aes_cbc_encrypt_multi().
+ *
+ * Every block of a CBC encryption depends on the previous one, so a
+ * single job waits for the result of every AES round. Here each lane of a
+ * kernel encrypts the blocks of another job, so that the rounds of the
+ * lanes overlap. A lane takes the next job when its job is done; lanes
+ * without a job encrypt zeros whose result is ignored. Because a lane
+ * only runs out of jobs when there are no more, a single active lane is
+ * the last job, which is finished with the single-job function. Jobs
+ * whose key has another number of rounds than the first are encrypted on
+ * their own.
+ */
+
+#define MAX_LANES 8
+
+static const unsigned char zero_block[CIRON_AES_BLOCK_BYTES];
+
+typedef void (*lanes_function)(unsigned char *x, const unsigned char *const *rk,
+		unsigned int rounds, const unsigned char *const *in);
+
+/*
+ * Takes the next job with blocks for a lane and loads its IV and round
+ * keys into the lane. Returns NULL if there is none left.
+ */
+static struct CironAesCbcJob *next_job(struct CironAesCbcJob *jobs,
+		size_t njobs, size_t *next, unsigned int rounds,
+		void (*single)(const struct CironAesKey *, unsigned char *,
+				const unsigned char *, unsigned char *, size_t),
+		unsigned char *x, const unsigned char **rk, unsigned int lane) {
+	struct CironAesCbcJob *job;
+
+	while (*next < njobs) {
+		job = &jobs[(*next)++];
+		if (job->nblocks == 0) {
+			continue;
+		}
+		if (job->key->rounds != rounds) {
+			single(job->key, job->iv, job->in, job->out, job->nblocks);
+			continue;
+		}
+		memcpy(x + CIRON_AES_BLOCK_BYTES * lane, job->iv, CIRON_AES_BLOCK_BYTES);
+		rk[lane] = job->key->round_keys;
+		return job;
+	}
+	return NULL;
+}
+
+static void cbc_encrypt_multi(unsigned int lanes, lanes_function kernel,
+		void (*single)(const struct CironAesKey *, unsigned char *,
+				const unsigned char *, unsigned char *, size_t),
+		struct CironAesCbcJob *jobs, size_t njobs) {
+	unsigned char x[MAX_LANES * CIRON_AES_BLOCK_BYTES];
+	const unsigned char *rk[MAX_LANES];
+	const unsigned char *in[MAX_LANES];
+	struct CironAesCbcJob *current[MAX_LANES];
+	size_t done[MAX_LANES];
+	struct CironAesCbcJob *job;
+	unsigned int rounds;
+	unsigned int active;
+	unsigned int last = 0;
+	unsigned int l;
+	size_t next = 0;
+
+	if (njobs == 0) {
+		return;
+	}
+	rounds = jobs[0].key->rounds;
+	memset(x, 0, sizeof(x));
+	for (l = 0; l < lanes; l++) {
+		rk[l] = jobs[0].key->round_keys;
+		current[l] = next_job(jobs, njobs, &next, rounds, single, x, rk, l);
+		done[l] = 0;
+	}
+	for (;;) {
+		active = 0;
+		for (l = 0; l < lanes; l++) {
+			if ((job = current[l]) == NULL) {
+				in[l] = zero_block;
+				continue;
+			}
+			in[l] = job->in + done[l] * CIRON_AES_BLOCK_BYTES;
+			active++;
+			last = l;
+		}
+		if (active == 0) {
+			break;
+		}
+		if (active == 1) {
+			job = current[last];
+			memcpy(job->iv, x + CIRON_AES_BLOCK_BYTES * last, CIRON_AES_BLOCK_BYTES);
+			single(job->key, job->iv, in[last],
+					job->out + done[last] * CIRON_AES_BLOCK_BYTES,
+					job->nblocks - done[last]);
+			current[last] = next_job(jobs, njobs, &next, rounds, single, x, rk,
+					last);
+			done[last] = 0;
+			continue;
+		}
+		kernel(x, rk, rounds, in);
+		for (l = 0; l < lanes; l++) {
+			if ((job = current[l]) == NULL) {
+				continue;
+			}
+			memcpy(job->out + done[l] * CIRON_AES_BLOCK_BYTES,
+					x + CIRON_AES_BLOCK_BYTES * l, CIRON_AES_BLOCK_BYTES);
+			if (++done[l] < job->nblocks) {
+				continue;
+			}
+			memcpy(job->iv, x + CIRON_AES_BLOCK_BYTES * l, CIRON_AES_BLOCK_BYTES);
+			current[l] = next_job(jobs, njobs, &next, rounds, single, x, rk, l);
+			done[l] = 0;
+		}
+	}
+}
+
+/*
+ * The functions of an implementation.
+ */
+struct aes_functions {
+	int (*set_key)(struct CironAesKey *key, const unsigned char *key_bytes,
+			unsigned int key_bits);
+	void (*cbc_encrypt)(const struct CironAesKey *key, unsigned char *iv,
+			const unsigned char *in, unsigned char *out, size_t nblocks);
+	void (*cbc_decrypt)(const struct CironAesKey *key, unsigned char *iv,
+			const unsigned char *in, unsigned char *out, size_t nblocks);
+	void (*ctr32_encrypt)(const struct CironAesKey *key, unsigned char *counter,
+			const unsigned char *in, unsigned char *out, size_t len);
+	/* Number of lanes of cbc_lanes, 1 to encrypt the jobs one by one */
+	unsigned int cbc_lanes;
+	lanes_function cbc_encrypt_lanes;
+};
+
+static const struct aes_functions generic = {
+	ciron_aes_set_key_generic,
+	ciron_aes_cbc_encrypt_generic,
+	ciron_aes_cbc_decrypt_generic,
+	ciron_aes_ctr32_encrypt_generic,
+	1,
+	NULL
+};
+
+#ifdef CIRON_X86_INTRINSICS
+static const struct aes_functions aesni = {
+	ciron_aes_set_key_aesni,
+	ciron_aes_cbc_encrypt_aesni,
+	ciron_aes_cbc_decrypt_aesni,
+	ciron_aes_ctr32_encrypt_aesni,
+	8,
+	cbc_lanes_aesni
+};
+#endif
+
+static const struct CironImplementation implementations[] = {
+#ifdef CIRON_X86_INTRINSICS
+	{ "aesni", CIRON_CPU_AESNI, &aesni },
+#endif
+	{ "generic", 0, &generic },
+	{ NULL, 0, NULL }
+};
+
+struct CironPrimitive ciron_aes_primitive = { "aes", implementations, NULL };
+
+int ciron_aes_set_key(struct CironAesKey *key, const unsigned char *key_bytes,
+		unsigned int key_bits) {
+	const struct aes_functions *f = ciron_primitive_functions(&ciron_aes_primitive);
+
+	return f->set_key(key, key_bytes, key_bits);
+}
+
+void ciron_aes_cbc_encrypt(const struct CironAesKey *key, unsigned char *iv,
+		const unsigned char *in, unsigned char *out, size_t nblocks) {
+	const struct aes_functions *f = ciron_primitive_functions(&ciron_aes_primitive);
+
+	f->cbc_encrypt(key, iv, in, out, nblocks);
+}
+
+void ciron_aes_cbc_decrypt(const struct CironAesKey *key, unsigned char *iv,
+		const unsigned char *in, unsigned char *out, size_t nblocks) {
+	const struct aes_functions *f = ciron_primitive_functions(&ciron_aes_primitive);
+
+	f->cbc_decrypt(key, iv, in, out, nblocks);
+}
+
+void ciron_aes_ctr32_encrypt(const struct CironAesKey *key, unsigned char *counter,
+		const unsigned char *in, unsigned char *out, size_t len) {
+	const struct aes_functions *f = ciron_primitive_functions(&ciron_aes_primitive);
+
+	f->ctr32_encrypt(key, counter, in, out, len);
+}
+
+void ciron_aes_cbc_encrypt_multi(struct CironAesCbcJob *jobs, size_t njobs) {
+	const struct aes_functions *f = ciron_primitive_functions(&ciron_aes_primitive);
+	size_t i;
+
+	if (f->cbc_lanes <= 1) {
+		for (i = 0; i < njobs; i++) {
+			f->cbc_encrypt(jobs[i].key, jobs[i].iv, jobs[i].in, jobs[i].out,
+					jobs[i].nblocks);
+		}
+		return;
+	}
+	cbc_encrypt_multi(f->cbc_lanes, f->cbc_encrypt_lanes, f->cbc_encrypt, jobs, njobs);
+}
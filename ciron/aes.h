@@ -0,0 +1,113 @@
+#ifndef CIRON_AES_H
+#define CIRON_AES_H 1
+
+#include <stddef.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * AES (FIPS 197) in CBC and counter mode for the native crypto
+ * implementation.
+ *
+ * There is a portable implementation and one using the x86 AES-NI
+ * instructions. The functions without suffix use the one selected for the
+ * "aes" primitive of the registry (registry.h), which is the latter if the
+ * CPU supports it. The portable implementation uses lookup tables and is
+ * therefore not safe against cache timing attacks; it is only meant for
+ * CPUs without AES-NI.
+ */
+
+#define CIRON_AES_BLOCK_BYTES 16
+#define CIRON_AES_MAX_ROUNDS 14
+
+/** Expanded AES key.
+ *
+ * The round keys are stored as bytes in the order of FIPS 197, which
+ * is the same for all implementations. Decryption uses the same schedule.
+ */
+struct CironAesKey {
+	unsigned char round_keys[(CIRON_AES_MAX_ROUNDS + 1) * CIRON_AES_BLOCK_BYTES];
+	unsigned int rounds;
+};
+
+/** Expand a 128 or 256 bit key.
+ *
+ * Returns 0 on success and -1 if key_bits is not supported.
+ */
+int ciron_aes_set_key(struct CironAesKey *key, const unsigned char *key_bytes,
+		unsigned int key_bits);
+int ciron_aes_set_key_generic(struct CironAesKey *key, const unsigned char *key_bytes,
+		unsigned int key_bits);
+
+/** Encrypt nblocks blocks from in to out in CBC mode.
+ *
+ * iv is updated to the last ciphertext block so that encryption can be
+ * continued with another call. in and out may be the same.
+ */
+void ciron_aes_cbc_encrypt(const struct CironAesKey *key, unsigned char *iv,
+		const unsigned char *in, unsigned char *out, size_t nblocks);
+void ciron_aes_cbc_encrypt_generic(const struct CironAesKey *key, unsigned char *iv,
+		const unsigned char *in, unsigned char *out, size_t nblocks);
+
+/** Decrypt nblocks blocks from in to out in CBC mode.
+ *
+ * iv is updated to the last ciphertext block so that decryption can be
+ * continued with another call. in and out may be the same.
+ */
+void ciron_aes_cbc_decrypt(const struct CironAesKey *key, unsigned char *iv,
+		const unsigned char *in, unsigned char *out, size_t nblocks);
+void ciron_aes_cbc_decrypt_generic(const struct CironAesKey *key, unsigned char *iv,
+		const unsigned char *in, unsigned char *out, size_t nblocks);
+
+/** Encrypt or decrypt len bytes from in to out in counter mode.
+ *
+ * The last 4 bytes of counter are incremented as a big endian number
+ * from block to block (inc32 of GCM). counter is left at the block after
+ * the last one used, so that a call can be continued with another one if
+ * len is a multiple of the block size. in and out may be the same.
+ */
+void ciron_aes_ctr32_encrypt(const struct CironAesKey *key, unsigned char *counter,
+		const unsigned char *in, unsigned char *out, size_t len);
+void ciron_aes_ctr32_encrypt_generic(const struct CironAesKey *key, unsigned char *counter,
+		const unsigned char *in, unsigned char *out, size_t len);
+
+/** A CBC encryption for ciron_aes_cbc_encrypt_multi(), with the
+ * parameters of ciron_aes_cbc_encrypt().
+ */
+struct CironAesCbcJob {
+	const struct CironAesKey *key;
+	/** Updated to the last ciphertext block */
+	unsigned char *iv;
+	const unsigned char *in;
+	unsigned char *out;
+	size_t nblocks;
+};
+
+/** Encrypt the blocks of all jobs in CBC mode.
+ *
+ * Gives the same results as calling ciron_aes_cbc_encrypt() for every
+ * job, but the AES-NI implementation interleaves the blocks of 8 jobs,
+ * which is much faster than one job after another. Jobs must not overlap,
+ * except that in and out of a job may be the same.
+ */
+void ciron_aes_cbc_encrypt_multi(struct CironAesCbcJob *jobs, size_t njobs);
+
+#ifdef CIRON_X86_INTRINSICS
+int ciron_aes_set_key_aesni(struct CironAesKey *key, const unsigned char *key_bytes,
+		unsigned int key_bits);
+void ciron_aes_cbc_encrypt_aesni(const struct CironAesKey *key, unsigned char *iv,
+		const unsigned char *in, unsigned char *out, size_t nblocks);
+void ciron_aes_cbc_decrypt_aesni(const struct CironAesKey *key, unsigned char *iv,
+		const unsigned char *in, unsigned char *out, size_t nblocks);
+void ciron_aes_ctr32_encrypt_aesni(const struct CironAesKey *key, unsigned char *counter,
+		const unsigned char *in, unsigned char *out, size_t len);
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_AES_H */
@@ -0,0 +1,483 @@
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "config.h"
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+#include "ciron.h"
+#include "common.h"
+#include "atomics.h"
+
+/*
+ * Asynchronous interface, see struct CironAsync in ciron.h.
+ *
+ * Submitted requests go to a bounded ring that any thread may add to and
+ * any worker take from, completed ones to a second such ring that the
+ * workers add to and ciron_async_reap() takes from. The rings have a
+ * sequence number per cell, which tells a thread whether the cell is free
+ * for the position it claimed, so that neither side takes a lock. A count
+ * of the requests in flight keeps submissions from filling either ring.
+ *
+ * Workers without work wait on a condition variable. A submitter only
+ * takes the mutex when a worker waits: the worker counts itself as
+ * sleeping before it looks at the ring once more, and the submitter adds
+ * to the ring before it looks at the count, so one of them sees the
+ * other.
+ *
+ * Completions are signalled by writing to the descriptor when notified
+ * was 0, and ciron_async_reap() drains the descriptor before it resets
+ * notified and takes the completed requests. A completion that does not
+ * write is therefore either taken by the next reap or covered by the
+ * write of another one.
+ *
+ * As in pwd_store.c all accesses are sequentially consistent, which both
+ * of the arguments above rely on.
+ */
+
+/*
+ * The state, the workers and the rings start on their own cache lines,
+ * and so do the positions of the rings, which different threads update.
+ */
+#define CACHE_LINES(n) (((n) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES)
+
+/*
+ * Most worker threads of an asynchronous interface.
+ */
+#define MAX_ASYNC_WORKERS 64
+
+/*
+ * Requests a worker takes from the ring at a time and seals or unseals
+ * as a batch.
+ */
+#define ASYNC_BATCH_ITEMS 16
+
+struct async_cell {
+	size_t seq;
+	CironAsyncRequest request;
+};
+
+struct async_ring {
+	struct async_cell *cells;
+	size_t mask;
+	unsigned char pad0[CACHE_LINE_BYTES - sizeof(struct async_cell *) - sizeof(size_t)];
+	/* Next position to add to */
+	size_t tail;
+	unsigned char pad1[CACHE_LINE_BYTES - sizeof(size_t)];
+	/* Next position to take from */
+	size_t head;
+	unsigned char pad2[CACHE_LINE_BYTES - sizeof(size_t)];
+};
+
+struct async_worker {
+	struct CironAsyncState *state;
+	struct CironContext context;
+	struct CironSealer sealer;
+	pthread_t thread;
+};
+
+struct CironAsyncState {
+	struct async_ring submitted;
+	struct async_ring completed;
+	/* Requests submitted and not yet reaped, at most depth */
+	size_t outstanding;
+	size_t depth;
+	/* 1 if a worker has written to the descriptor since the last reap */
+	int notified;
+	/* Descriptors to read from and to write to, the same for an eventfd */
+	int read_fd;
+	int write_fd;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	/* Workers waiting for wake */
+	unsigned int sleepers;
+	/* Set by ciron_async_cleanup() */
+	int stop;
+	unsigned int nworkers;
+	struct async_worker *workers;
+};
+
+static size_t ring_capacity(size_t depth) {
+	size_t capacity = 1;
+
+	while (capacity < depth) {
+		capacity *= 2;
+	}
+	return capacity;
+}
+
+static void ring_init(struct async_ring *ring, struct async_cell *cells,
+		size_t capacity) {
+	size_t i;
+
+	for (i = 0; i < capacity; i++) {
+		cells[i].seq = i;
+		cells[i].request = NULL;
+	}
+	ring->cells = cells;
+	ring->mask = capacity - 1;
+	ring->tail = 0;
+	ring->head = 0;
+}
+
+/*
+ * Adds a request to the ring, which the count of outstanding requests
+ * keeps from being full. A cell is free for position pos when its
+ * sequence number is pos and holds a request when it is pos + 1.
+ */
+static void ring_put(struct async_ring *ring, CironAsyncRequest request) {
+	struct async_cell *cell;
+	size_t pos;
+	intptr_t diff;
+
+	pos = LOAD(&ring->tail);
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		diff = (intptr_t) (LOAD(&cell->seq) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+				break;
+			}
+		} else {
+			/*
+			 * Another thread took the position, or the one taking the
+			 * request of the previous round has not freed the cell yet.
+			 */
+			pos = LOAD(&ring->tail);
+		}
+	}
+	cell->request = request;
+	STORE(&cell->seq, pos + 1);
+}
+
+/*
+ * Takes a request from the ring, NULL if it is empty. Frees the cell for
+ * the position one round later.
+ */
+static CironAsyncRequest ring_take(struct async_ring *ring) {
+	struct async_cell *cell;
+	CironAsyncRequest request;
+	size_t pos;
+	intptr_t diff;
+
+	pos = LOAD(&ring->head);
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		diff = (intptr_t) (LOAD(&cell->seq) - (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+				break;
+			}
+		} else if (diff < 0) {
+			/* Not added to yet */
+			return NULL;
+		} else {
+			pos = LOAD(&ring->head);
+		}
+	}
+	request = cell->request;
+	STORE(&cell->seq, pos + ring->mask + 1);
+	return request;
+}
+
+/*
+ * True if a position has been claimed that has not been taken, though
+ * ring_take() may not find the request until its submitter has stored it.
+ */
+static int ring_pending(struct async_ring *ring) {
+	return LOAD(&ring->tail) != LOAD(&ring->head);
+}
+
+static void notify(struct CironAsyncState *s) {
+	uint64_t one = 1;
+
+	if (__atomic_exchange_n(&s->notified, 1, __ATOMIC_SEQ_CST) == 0) {
+		/* A full pipe is readable already */
+		while (write(s->write_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+		}
+	}
+}
+
+/*
+ * Seals or unseals the items of one operation of the requests as a batch
+ * and stores the outcome in the requests.
+ */
+static void async_process(struct async_worker *w, CironAsyncRequest *requests,
+		size_t nrequests, int operation) {
+	struct CironBatchItem items[ASYNC_BATCH_ITEMS];
+	CironAsyncRequest map[ASYNC_BATCH_ITEMS];
+	size_t i, n = 0;
+
+	for (i = 0; i < nrequests; i++) {
+		if (requests[i]->operation == operation) {
+			items[n] = requests[i]->item;
+			map[n] = requests[i];
+			n++;
+		}
+	}
+	if (n == 0) {
+		return;
+	}
+	if (operation == CIRON_ASYNC_SEAL) {
+		ciron_sealer_seal_batch(&w->context, &w->sealer, items, n);
+	} else {
+		ciron_sealer_unseal_batch(&w->context, &w->sealer, items, n);
+	}
+	for (i = 0; i < n; i++) {
+		map[i]->item.error = items[i].error;
+		map[i]->item.result_len = items[i].result_len;
+	}
+}
+
+static void *async_worker_main(void *arg) {
+	struct async_worker *w = arg;
+	struct CironAsyncState *s = w->state;
+	CironAsyncRequest requests[ASYNC_BATCH_ITEMS];
+	size_t n, i;
+
+	for (;;) {
+		for (n = 0; n < ASYNC_BATCH_ITEMS; n++) {
+			if ((requests[n] = ring_take(&s->submitted)) == NULL) {
+				break;
+			}
+		}
+		if (n > 0) {
+			async_process(w, requests, n, CIRON_ASYNC_SEAL);
+			async_process(w, requests, n, CIRON_ASYNC_UNSEAL);
+			for (i = 0; i < n; i++) {
+				ring_put(&s->completed, requests[i]);
+			}
+			notify(s);
+			continue;
+		}
+
+		pthread_mutex_lock(&s->lock);
+		__atomic_add_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+		while (!ring_pending(&s->submitted) && !s->stop) {
+			pthread_cond_wait(&s->wake, &s->lock);
+		}
+		__atomic_sub_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+		if (s->stop && !ring_pending(&s->submitted)) {
+			pthread_mutex_unlock(&s->lock);
+			return NULL;
+		}
+		pthread_mutex_unlock(&s->lock);
+	}
+}
+
+CironError ciron_calculate_async_buffer_length(CironContext context,
+		unsigned int nworkers, size_t depth, size_t *result_len) {
+	size_t fixed;
+
+	fixed = CACHE_LINE_BYTES - 1 + CACHE_LINES(sizeof(struct CironAsyncState))
+			+ MAX_ASYNC_WORKERS * CACHE_LINES(sizeof(struct async_worker));
+	if (nworkers == 0 || nworkers > MAX_ASYNC_WORKERS) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "%u workers not supported, at most %u",
+				nworkers, (unsigned int) MAX_ASYNC_WORKERS);
+	}
+	/* The capacity of the rings is at most twice the depth */
+	if (depth == 0 || depth > (SIZE_MAX - fixed) / (4 * sizeof(struct async_cell))) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Depth of %zu requests not supported", depth);
+	}
+	*result_len = CACHE_LINE_BYTES - 1 + CACHE_LINES(sizeof(struct CironAsyncState))
+			+ nworkers * CACHE_LINES(sizeof(struct async_worker))
+			+ 2 * ring_capacity(depth) * sizeof(struct async_cell);
+	return CIRON_OK;
+}
+
+/*
+ * Creates the descriptor, an eventfd where available and a pipe otherwise,
+ * both not blocking.
+ */
+static int async_open_fd(struct CironAsyncState *s) {
+#ifdef HAVE_EVENTFD
+	s->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	s->write_fd = s->read_fd;
+	return s->read_fd < 0 ? -1 : 0;
+#else
+	int fds[2], i;
+
+	if (pipe(fds) != 0) {
+		return -1;
+	}
+	for (i = 0; i < 2; i++) {
+		if (fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK) != 0
+				|| fcntl(fds[i], F_SETFD, FD_CLOEXEC) != 0) {
+			close(fds[0]);
+			close(fds[1]);
+			return -1;
+		}
+	}
+	s->read_fd = fds[0];
+	s->write_fd = fds[1];
+	return 0;
+#endif
+}
+
+static void async_close_fd(struct CironAsyncState *s) {
+	close(s->read_fd);
+	if (s->write_fd != s->read_fd) {
+		close(s->write_fd);
+	}
+}
+
+/*
+ * Stops the first nstarted workers and releases everything else.
+ */
+static void async_stop(struct CironAsyncState *s, unsigned int nstarted) {
+	unsigned int t;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->wake);
+	pthread_mutex_unlock(&s->lock);
+	for (t = 0; t < nstarted; t++) {
+		pthread_join(s->workers[t].thread, NULL);
+		ciron_sealer_cleanup(&s->workers[t].sealer);
+	}
+	pthread_cond_destroy(&s->wake);
+	pthread_mutex_destroy(&s->lock);
+	async_close_fd(s);
+}
+
+CironError ciron_async_init(CironContext context, CironAsync async,
+		unsigned int nworkers, size_t depth, unsigned char *buffer,
+		size_t buffer_len) {
+	struct CironAsyncState *s;
+	struct async_worker *w;
+	struct async_cell *cells;
+	CironError e;
+	size_t needed = 0, capacity;
+	uintptr_t misalignment;
+	unsigned int t;
+
+	if ((e = ciron_calculate_async_buffer_length(context, nworkers, depth,
+			&needed)) != CIRON_OK) {
+		return e;
+	}
+	if (buffer_len < needed) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR,
+				"Asynchronous buffer of %zu bytes too small, %zu needed",
+				buffer_len, needed);
+	}
+	misalignment = (uintptr_t) buffer % CACHE_LINE_BYTES;
+	if (misalignment != 0) {
+		buffer += CACHE_LINE_BYTES - misalignment;
+	}
+	s = (struct CironAsyncState *) buffer;
+	buffer += CACHE_LINES(sizeof(struct CironAsyncState));
+	memset(s, 0, sizeof(*s));
+	s->workers = (struct async_worker *) buffer;
+	buffer += nworkers * CACHE_LINES(sizeof(struct async_worker));
+	cells = (struct async_cell *) buffer;
+
+	capacity = ring_capacity(depth);
+	ring_init(&s->submitted, cells, capacity);
+	ring_init(&s->completed, cells + capacity, capacity);
+	s->depth = depth;
+	s->nworkers = nworkers;
+	if (async_open_fd(s) != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unable to create descriptor: %s",
+				strerror(errno));
+	}
+	if (pthread_mutex_init(&s->lock, NULL) != 0) {
+		async_close_fd(s);
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unable to create mutex");
+	}
+	if (pthread_cond_init(&s->wake, NULL) != 0) {
+		pthread_mutex_destroy(&s->lock);
+		async_close_fd(s);
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unable to create condition variable");
+	}
+
+	for (t = 0; t < nworkers; t++) {
+		w = &s->workers[t];
+		w->state = s;
+		ciron_context_init(&w->context, context->encryption_options,
+				context->integrity_options);
+		if ((e = ciron_sealer_init(context, &w->sealer)) != CIRON_OK) {
+			async_stop(s, t);
+			return e;
+		}
+		if (pthread_create(&w->thread, NULL, async_worker_main, w) != 0) {
+			ciron_sealer_cleanup(&w->sealer);
+			async_stop(s, t);
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_CRYPTO_ERROR, "Unable to start worker %u of %u",
+					t + 1, nworkers);
+		}
+	}
+	async->state = s;
+	return CIRON_OK;
+}
+
+void ciron_async_cleanup(CironAsync async) {
+	async_stop(async->state, async->state->nworkers);
+	async->state = NULL;
+}
+
+int ciron_async_fd(CironAsync async) {
+	return async->state->read_fd;
+}
+
+static CironError async_submit(CironContext context, CironAsync async,
+		CironAsyncRequest request, int operation) {
+	struct CironAsyncState *s = async->state;
+
+	if (__atomic_add_fetch(&s->outstanding, 1, __ATOMIC_SEQ_CST) > s->depth) {
+		__atomic_sub_fetch(&s->outstanding, 1, __ATOMIC_SEQ_CST);
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "%zu requests in flight already",
+				s->depth);
+	}
+	request->operation = operation;
+	ring_put(&s->submitted, request);
+	if (LOAD(&s->sleepers) > 0) {
+		pthread_mutex_lock(&s->lock);
+		pthread_cond_signal(&s->wake);
+		pthread_mutex_unlock(&s->lock);
+	}
+	return CIRON_OK;
+}
+
+CironError ciron_async_submit_seal(CironContext context, CironAsync async,
+		CironAsyncRequest request) {
+	return async_submit(context, async, request, CIRON_ASYNC_SEAL);
+}
+
+CironError ciron_async_submit_unseal(CironContext context, CironAsync async,
+		CironAsyncRequest request) {
+	return async_submit(context, async, request, CIRON_ASYNC_UNSEAL);
+}
+
+size_t ciron_async_reap(CironAsync async, CironAsyncRequest *requests,
+		size_t max) {
+	struct CironAsyncState *s = async->state;
+	uint64_t count;
+	size_t n;
+
+	for (;;) {
+		if (read(s->read_fd, &count, sizeof(count)) < 0 && errno != EINTR) {
+			break;
+		}
+	}
+	STORE(&s->notified, 0);
+	for (n = 0; n < max; n++) {
+		if ((requests[n] = ring_take(&s->completed)) == NULL) {
+			break;
+		}
+	}
+	__atomic_sub_fetch(&s->outstanding, n, __ATOMIC_SEQ_CST);
+	return n;
+}
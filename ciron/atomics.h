@@ -0,0 +1,28 @@
+#ifndef CIRON_ATOMICS_H
+#define CIRON_ATOMICS_H 1
+
+/*
+ * Atomic accesses for the data shared between threads by the password
+ * store (pwd_store.c), the asynchronous interface (async.c) and the
+ * threads of ciron_unseal_batch() (unseal_batch.c).
+ *
+ * They use the __atomic builtins of GCC and clang.
+ */
+
+#if !defined(__GNUC__)
+#error "ciron needs the __atomic builtins of GCC or clang"
+#endif
+
+/*
+ * Sequentially consistent load and store.
+ */
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+
+/*
+ * Size of a cache line. Data written by different threads is kept on
+ * lines of its own, so that the threads do not contend for them.
+ */
+#define CACHE_LINE_BYTES 64
+
+#endif /* !defined CIRON_ATOMICS_H */
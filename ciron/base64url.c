@@ -35,8 +35,14 @@
 
  #include <stdlib.h>
  */
+#include <string.h>
 #include "base64url.h"
 #include "common.h"
+#include "registry.h"
+
+#ifdef CIRON_X86_INTRINSICS
+#include <immintrin.h>
+#endif
 
 const static unsigned char* b64 =
 		(unsigned char *) "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
@@ -72,16 +78,14 @@ const static unsigned char unb64[]={
 }; /* This array has 255 elements */
 
 
-unsigned char* ciron_base64url_encode(const unsigned char* data, size_t data_len,
-		unsigned char *result, size_t *result_len) {
-
+/*
+ * Encodes the complete three byte groups of data and returns the number of
+ * bytes encoded.
+ */
+static size_t encode_scalar(const unsigned char* data, size_t data_len,
+		unsigned char *result) {
 	size_t rc = 0; /* result counter */
-	size_t byteNo; /* I need this after the loop */
-
-	size_t modulusLen = data_len % 3;
-	size_t pad = ((modulusLen & 1) << 1) + ((modulusLen & 2) >> 1); /* 2 gives 1 and 1 gives 2, but 0 gives 0. */
-
-	*result_len = 4 * (data_len + pad) / 3;
+	size_t byteNo;
 
 	for (byteNo = 0; byteNo+3 <= data_len; byteNo += 3) {
 		unsigned char BYTE0 = data[byteNo];
@@ -92,6 +96,341 @@ unsigned char* ciron_base64url_encode(const unsigned char* data, size_t data_len
 		result[rc++] = b64[((0x0f & BYTE1) << 2) + (BYTE2 >> 6)];
 		result[rc++] = b64[0x3f & BYTE2];
 	}
+	return byteNo;
+}
+
+/*
+ * Decodes the complete four character groups of data and returns the
+ * number of characters decoded.
+ */
+static size_t decode_scalar(const unsigned char* data, size_t data_len,
+		unsigned char *result) {
+	size_t cb = 0;
+	size_t charNo;
+
+	for (charNo = 0; charNo + 4 <= data_len; charNo += 4) {
+		size_t A = unb64[data[charNo]];
+		size_t B = unb64[data[charNo + 1]];
+		size_t C = unb64[data[charNo + 2]];
+		size_t D = unb64[data[charNo + 3]];
+
+		result[cb++] = (A << 2) | (B >> 4);
+		result[cb++] = (B << 4) | (C >> 2);
+		result[cb++] = (C << 6) | (D);
+	}
+	return charNo;
+}
+
+/*
+ * Returns the number of characters at the start of data that are in the
+ * alphabet. 'A' is the only one unb64 maps to 0.
+ */
+static size_t check_scalar(const unsigned char* data, size_t data_len) {
+	size_t charNo;
+
+	for (charNo = 0; charNo < data_len; charNo++) {
+		if (unb64[data[charNo]] == 0 && data[charNo] != 'A') {
+			break;
+		}
+	}
+	return charNo;
+}
+
+#ifdef CIRON_X86_INTRINSICS
+
+/*
+ * The SIMD kernels follow Wojciech Mula and Daniel Lemire, "Faster Base64
+ * Encoding and Decoding using AVX2 Instructions", ACM TOW 2018, adapted
+ * to the URL-safe alphabet.
+ *
+ * Encoding spreads each 3 byte group over 4 bytes holding 6 bits each,
+ * then maps the 6 bit values to characters by adding an offset that
+ * depends on the range of the value.
+ *
+ * Decoding maps characters back by adding an offset that depends on the
+ * character range and packs the 6 bit values. It stops at the first
+ * block containing a character outside the alphabet, which is left to
+ * the scalar code. These are decoded as zero bits there, as before.
+ */
+
+#define SSSE3 __attribute__((target("ssse3")))
+#define AVX2 __attribute__((target("avx2")))
+
+SSSE3 static __m128i encode_block_ssse3(__m128i in) {
+	__m128i t0, t1, t2, t3, indices, reduced;
+	const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+
+	in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7,
+			10, 9, 11, 10));
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	indices = _mm_or_si128(t1, t3);
+
+	/* 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12 */
+	reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	reduced = _mm_or_si128(reduced, _mm_and_si128(
+			_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+	return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, reduced));
+}
+
+SSSE3 static size_t encode_ssse3(const unsigned char *data, size_t data_len,
+		unsigned char *result) {
+	size_t done;
+
+	/* Each step reads 16 bytes but encodes only 12 of them */
+	for (done = 0; data_len - done >= 16; done += 12) {
+		_mm_storeu_si128((__m128i *) result, encode_block_ssse3(
+				_mm_loadu_si128((const __m128i *) (data + done))));
+		result += 16;
+	}
+	return done;
+}
+
+/*
+ * Maps the characters of a block to their 6 bit values. Sets *valid to 0
+ * if there is a character outside the alphabet.
+ */
+SSSE3 static __m128i decode_values_ssse3(__m128i c, int *valid) {
+	__m128i upper, lower, digit, dash, underscore, offsets;
+
+	upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+	lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+	digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	dash = _mm_cmpeq_epi8(c, _mm_set1_epi8('-'));
+	underscore = _mm_cmpeq_epi8(c, _mm_set1_epi8('_'));
+
+	*valid = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(upper, lower),
+			_mm_or_si128(_mm_or_si128(digit, dash), underscore))) == 0xffff;
+
+	offsets = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+	offsets = _mm_or_si128(offsets, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+	offsets = _mm_or_si128(offsets, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+	offsets = _mm_or_si128(offsets, _mm_and_si128(dash, _mm_set1_epi8(62 - '-')));
+	offsets = _mm_or_si128(offsets, _mm_and_si128(underscore, _mm_set1_epi8(63 - '_')));
+	return _mm_add_epi8(c, offsets);
+}
+
+/*
+ * Packs four 6 bit values per 32 bit lane into 3 bytes, which end up in
+ * the first 12 bytes.
+ */
+SSSE3 static __m128i decode_pack_ssse3(__m128i values) {
+	values = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+	values = _mm_madd_epi16(values, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(values, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+			14, 13, 12, -1, -1, -1, -1));
+}
+
+SSSE3 static void store12(unsigned char *result, __m128i x) {
+	int last;
+
+	_mm_storel_epi64((__m128i *) result, x);
+	last = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+	memcpy(result + 8, &last, 4);
+}
+
+/*
+ * Returns the mask of the characters of a block that are in the alphabet.
+ * Bytes from 0x80 are negative and fail all the signed comparisons.
+ */
+SSSE3 static int check_block_ssse3(__m128i c) {
+	__m128i upper, lower, digit, symbol;
+
+	upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+	lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+	digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	symbol = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('-')),
+			_mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+	return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(upper, lower),
+			_mm_or_si128(digit, symbol)));
+}
+
+SSSE3 static size_t check_ssse3(const unsigned char *data, size_t data_len) {
+	size_t done;
+
+	for (done = 0; data_len - done >= 16; done += 16) {
+		if (check_block_ssse3(_mm_loadu_si128((const __m128i *) (data + done)))
+				!= 0xffff) {
+			break;
+		}
+	}
+	return done;
+}
+
+SSSE3 static size_t decode_ssse3(const unsigned char *data, size_t data_len,
+		unsigned char *result) {
+	__m128i values;
+	size_t done;
+	int valid;
+
+	for (done = 0; data_len - done >= 16; done += 16) {
+		values = decode_values_ssse3(
+				_mm_loadu_si128((const __m128i *) (data + done)), &valid);
+		if (!valid) {
+			break;
+		}
+		store12(result, decode_pack_ssse3(values));
+		result += 12;
+	}
+	return done;
+}
+
+AVX2 static size_t encode_avx2(const unsigned char *data, size_t data_len,
+		unsigned char *result) {
+	__m256i in, t0, t1, t2, t3, indices, reduced;
+	const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '-' - 62, '_' - 63, 'A', 0, 0,
+			'a' - 26, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+	const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7,
+			10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	size_t done;
+
+	/* Each step reads 28 bytes but encodes only 24 of them, 12 per lane */
+	for (done = 0; data_len - done >= 28; done += 24) {
+		in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i *) (data + done))),
+				_mm_loadu_si128((const __m128i *) (data + done + 12)), 1);
+		in = _mm256_shuffle_epi8(in, shuffle);
+		t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+		t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+		t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		indices = _mm256_or_si256(t1, t3);
+
+		reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+		reduced = _mm256_or_si256(reduced, _mm256_and_si256(
+				_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+				_mm256_set1_epi8(13)));
+		_mm256_storeu_si256((__m256i *) result,
+				_mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, reduced)));
+		result += 32;
+	}
+	return done + encode_ssse3(data + done, data_len - done, result);
+}
+
+AVX2 static size_t decode_avx2(const unsigned char *data, size_t data_len,
+		unsigned char *result) {
+	__m256i c, upper, lower, digit, dash, underscore, offsets, values;
+	size_t done;
+
+	for (done = 0; data_len - done >= 32; done += 32) {
+		c = _mm256_loadu_si256((const __m256i *) (data + done));
+		upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+		lower = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+		digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+		dash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('-'));
+		underscore = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_'));
+		if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(upper, lower),
+				_mm256_or_si256(_mm256_or_si256(digit, dash), underscore))) != -1) {
+			break;
+		}
+		offsets = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+		offsets = _mm256_or_si256(offsets, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+		offsets = _mm256_or_si256(offsets, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+		offsets = _mm256_or_si256(offsets, _mm256_and_si256(dash, _mm256_set1_epi8(62 - '-')));
+		offsets = _mm256_or_si256(offsets, _mm256_and_si256(underscore, _mm256_set1_epi8(63 - '_')));
+		values = _mm256_add_epi8(c, offsets);
+
+		values = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+		values = _mm256_madd_epi16(values, _mm256_set1_epi32(0x00011000));
+		values = _mm256_shuffle_epi8(values, _mm256_setr_epi8(2, 1, 0, 6, 5, 4,
+				10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8,
+				14, 13, 12, -1, -1, -1, -1));
+		store12(result, _mm256_castsi256_si128(values));
+		store12(result + 12, _mm256_extracti128_si256(values, 1));
+		result += 24;
+	}
+	return done + decode_ssse3(data + done, data_len - done, result);
+}
+
+AVX2 static size_t check_avx2(const unsigned char *data, size_t data_len) {
+	__m256i c, upper, lower, digit, symbol;
+	size_t done;
+
+	for (done = 0; data_len - done >= 32; done += 32) {
+		c = _mm256_loadu_si256((const __m256i *) (data + done));
+		upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+		lower = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+		digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+		symbol = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')),
+				_mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+		if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(upper, lower),
+				_mm256_or_si256(digit, symbol))) != -1) {
+			break;
+		}
+	}
+	return done + check_ssse3(data + done, data_len - done);
+}
+
+#endif /* CIRON_X86_INTRINSICS */
+
+/*
+ * The kernels of an implementation. They process a prefix of the data,
+ * the rest is done by the scalar code.
+ */
+struct base64url_functions {
+	size_t (*encode)(const unsigned char *data, size_t data_len, unsigned char *result);
+	size_t (*decode)(const unsigned char *data, size_t data_len, unsigned char *result);
+	size_t (*check)(const unsigned char *data, size_t data_len);
+};
+
+static const struct base64url_functions scalar = { encode_scalar, decode_scalar,
+		check_scalar };
+
+#ifdef CIRON_X86_INTRINSICS
+static const struct base64url_functions ssse3 = { encode_ssse3, decode_ssse3,
+		check_ssse3 };
+static const struct base64url_functions avx2 = { encode_avx2, decode_avx2,
+		check_avx2 };
+#endif
+
+static const struct CironImplementation implementations[] = {
+#ifdef CIRON_X86_INTRINSICS
+	{ "avx2", CIRON_CPU_AVX2 | CIRON_CPU_SSSE3, &avx2 },
+	{ "ssse3", CIRON_CPU_SSSE3, &ssse3 },
+#endif
+	{ "scalar", 0, &scalar },
+	{ NULL, 0, NULL }
+};
+
+struct CironPrimitive ciron_base64url_primitive = { "base64url", implementations,
+		NULL };
+
+unsigned char* ciron_base64url_encode(const unsigned char* data, size_t data_len,
+		unsigned char *result, size_t *result_len) {
+	const struct base64url_functions *f = ciron_primitive_functions(
+			&ciron_base64url_primitive);
+
+	size_t rc; /* result counter */
+	size_t byteNo; /* I need this after the loop */
+
+	size_t modulusLen = data_len % 3;
+	size_t pad = ((modulusLen & 1) << 1) + ((modulusLen & 2) >> 1); /* 2 gives 1 and 1 gives 2, but 0 gives 0. */
+
+	*result_len = 4 * (data_len + pad) / 3;
+
+	byteNo = f->encode(data, data_len, result);
+	byteNo += encode_scalar(data + byteNo, data_len - byteNo, result + byteNo / 3 * 4);
+	rc = byteNo / 3 * 4;
 
 	if (pad == 2) {
 		result[rc++] = b64[data[byteNo] >> 2];
@@ -119,8 +458,11 @@ unsigned char* ciron_base64url_encode(const unsigned char* data, size_t data_len
 
 CironError ciron_base64url_decode(CironContext context, const unsigned char* data, size_t data_len,
 		unsigned char *result, size_t *result_len) {
-	size_t cb = 0;
+	const struct base64url_functions *f = ciron_primitive_functions(
+			&ciron_base64url_primitive);
+	size_t cb;
 	size_t charNo;
+	size_t groups_len;
 	size_t pad = 0;
 
 	/* Removed from original code because we do not use padding.
@@ -147,19 +489,11 @@ CironError ciron_base64url_decode(CironContext context, const unsigned char* dat
 	}
 
 	*result_len = 3 * data_len / 4 - pad;
-#if 0
-	for (charNo = 0; charNo <= data_len - 4 - pad; charNo += 4) {
-#endif
-	for (charNo = 0; charNo + 4 + pad <= data_len; charNo += 4) {
-		size_t A = unb64[data[charNo]];
-		size_t B = unb64[data[charNo + 1]];
-		size_t C = unb64[data[charNo + 2]];
-		size_t D = unb64[data[charNo + 3]];
+	groups_len = (data_len - pad) / 4 * 4;
+	charNo = f->decode(data, groups_len, result);
+	charNo += decode_scalar(data + charNo, groups_len - charNo, result + charNo / 4 * 3);
+	cb = charNo / 4 * 3;
 
-		result[cb++] = (A << 2) | (B >> 4);
-		result[cb++] = (B << 4) | (C >> 2);
-		result[cb++] = (C << 6) | (D);
-	}
 	if (pad == 1) {
 		size_t A = unb64[data[charNo]];
 		size_t B = unb64[data[charNo + 1]];
@@ -178,3 +512,17 @@ CironError ciron_base64url_decode(CironContext context, const unsigned char* dat
 
 	return CIRON_OK;
 }
+
+int ciron_base64url_valid(const unsigned char* data, size_t data_len) {
+	const struct base64url_functions *f = ciron_primitive_functions(
+			&ciron_base64url_primitive);
+	size_t charNo;
+
+	/* Without padding, a single character is left over for no length */
+	if (data_len % 4 == 1) {
+		return 0;
+	}
+	charNo = f->check(data, data_len);
+	charNo += check_scalar(data + charNo, data_len - charNo);
+	return charNo == data_len;
+}
@@ -37,6 +37,14 @@ unsigned char* CIRONAPI ciron_base64url_encode( const unsigned char *data, size_
  */
 CironError CIRONAPI ciron_base64url_decode(CironContext contex, const unsigned char *data, size_t data_len, unsigned char *result, size_t *result_len );
 
+/** Check that the given data can be base64url decoded.
+ *
+ * Returns 1 if all characters of data are in the URL-safe alphabet and its
+ * length is possible without padding, 0 otherwise. ciron_base64url_decode()
+ * does not check the characters, it decodes any others as zero bits.
+ */
+int CIRONAPI ciron_base64url_valid(const unsigned char *data, size_t data_len);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,392 @@
+#include <string.h>
+#include "blake3.h"
+#include "registry.h"
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define CHUNK_START 1
+#define CHUNK_END 2
+#define PARENT 4
+#define ROOT 8
+#define KEYED_HASH 16
+
+#define ROUNDS 7
+#define CHUNK_BLOCKS (CIRON_BLAKE3_CHUNK_BYTES / CIRON_BLAKE3_BLOCK_BYTES)
+
+/* Number of chunks of 2^64 bytes is 2^54, so the tree is never deeper */
+#define MAX_DEPTH 54
+
+/* Largest number of lanes of any implementation */
+#define MAX_LANES 16
+
+static const uint32_t IV[8] = {
+	0x6a09e667U, 0xbb67ae85U, 0x3c6ef372U, 0xa54ff53aU,
+	0x510e527fU, 0x9b05688cU, 0x1f83d9abU, 0x5be0cd19U
+};
+
+/* Message word order of every round */
+static const unsigned char SCHEDULE[ROUNDS][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+	{ 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+	{ 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+	{ 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+	{ 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+	{ 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 }
+};
+
+/*
+ * The round works on arrays of words as well as on arrays of vectors.
+ */
+#define G(v, a, b, c, d, x, y) \
+	do { \
+		v[a] = v[a] + v[b] + (x); \
+		v[d] = ROR32(v[d] ^ v[a], 16); \
+		v[c] = v[c] + v[d]; \
+		v[b] = ROR32(v[b] ^ v[c], 12); \
+		v[a] = v[a] + v[b] + (y); \
+		v[d] = ROR32(v[d] ^ v[a], 8); \
+		v[c] = v[c] + v[d]; \
+		v[b] = ROR32(v[b] ^ v[c], 7); \
+	} while (0)
+
+#define ROUND(v, m, s) \
+	do { \
+		G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]); \
+		G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]); \
+		G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]); \
+		G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]); \
+		G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]); \
+		G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]); \
+		G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]); \
+		G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]); \
+	} while (0)
+
+typedef void (*chunks_function)(const uint32_t *key, const unsigned char *data,
+		uint64_t counter, uint32_t *cvs);
+
+static void cleanse(void *p, size_t len) {
+	volatile unsigned char *v = p;
+
+	while (len-- > 0) {
+		*v++ = 0;
+	}
+}
+
+static uint32_t load_le32(const unsigned char *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8)
+			| ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char) v;
+	p[1] = (unsigned char) (v >> 8);
+	p[2] = (unsigned char) (v >> 16);
+	p[3] = (unsigned char) (v >> 24);
+}
+
+#ifdef CIRON_X86_INTRINSICS
+
+#define LANES 4
+#define VECTOR vector4
+#define TARGET __attribute__((target("sse4.1")))
+#define HASH_CHUNKS chunks_sse41
+#include "blake3_lanes.h"
+#undef LANES
+#undef VECTOR
+#undef TARGET
+#undef HASH_CHUNKS
+
+#define LANES 8
+#define VECTOR vector8
+#define TARGET __attribute__((target("avx2")))
+#define HASH_CHUNKS chunks_avx2
+#include "blake3_lanes.h"
+#undef LANES
+#undef VECTOR
+#undef TARGET
+#undef HASH_CHUNKS
+
+#define LANES 16
+#define VECTOR vector16
+#define TARGET __attribute__((target("avx512f")))
+#define HASH_CHUNKS chunks_avx512
+#include "blake3_lanes.h"
+#undef LANES
+#undef VECTOR
+#undef TARGET
+#undef HASH_CHUNKS
+
+#endif /* CIRON_X86_INTRINSICS */
+
+struct blake3_functions {
+	unsigned int lanes;
+	chunks_function chunks;
+};
+
+/* A single chunk is always hashed with chunk_cv() */
+static const struct blake3_functions generic = { 1, NULL };
+
+#ifdef CIRON_X86_INTRINSICS
+static const struct blake3_functions sse41 = { 4, chunks_sse41 };
+static const struct blake3_functions avx2 = { 8, chunks_avx2 };
+static const struct blake3_functions avx512 = { 16, chunks_avx512 };
+#endif
+
+static const struct CironImplementation implementations[] = {
+#ifdef CIRON_X86_INTRINSICS
+	{ "avx512", CIRON_CPU_AVX512, &avx512 },
+	{ "avx2", CIRON_CPU_AVX2, &avx2 },
+	{ "sse41", CIRON_CPU_SSE41, &sse41 },
+#endif
+	{ "generic", 0, &generic },
+	{ NULL, 0, NULL }
+};
+
+struct CironPrimitive ciron_blake3_primitive = { "blake3", implementations, NULL };
+
+/*
+ * Compresses the message words m of a block into the chaining value cv.
+ * Only the first half of the output is calculated, which is the chaining
+ * value and, with the ROOT flag, the 32 byte hash.
+ */
+static void compress(uint32_t *cv, const uint32_t *m, uint32_t block_len,
+		uint64_t counter, uint32_t flags) {
+	uint32_t v[16];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		v[i] = cv[i];
+	}
+	for (i = 0; i < 4; i++) {
+		v[8 + i] = IV[i];
+	}
+	v[12] = (uint32_t) counter;
+	v[13] = (uint32_t) (counter >> 32);
+	v[14] = block_len;
+	v[15] = flags;
+	for (i = 0; i < ROUNDS; i++) {
+		ROUND(v, m, SCHEDULE[i]);
+	}
+	for (i = 0; i < 8; i++) {
+		cv[i] = v[i] ^ v[i + 8];
+	}
+	cleanse(v, sizeof(v));
+}
+
+/*
+ * Calculates the chaining value of a chunk of 0 to CIRON_BLAKE3_CHUNK_BYTES
+ * bytes. flags is ROOT if the chunk is the only one.
+ */
+static void chunk_cv(const uint32_t *key, const unsigned char *data,
+		size_t len, uint64_t counter, uint32_t flags, uint32_t *cv) {
+	unsigned char last[CIRON_BLAKE3_BLOCK_BYTES];
+	uint32_t m[16];
+	size_t nblocks, b, block_len;
+	const unsigned char *block;
+	int i;
+
+	nblocks = len == 0 ? 1 : (len + CIRON_BLAKE3_BLOCK_BYTES - 1) / CIRON_BLAKE3_BLOCK_BYTES;
+	memcpy(cv, key, 8 * sizeof(uint32_t));
+	for (b = 0; b < nblocks; b++) {
+		block = data + b * CIRON_BLAKE3_BLOCK_BYTES;
+		block_len = CIRON_BLAKE3_BLOCK_BYTES;
+		if (b == nblocks - 1) {
+			block_len = len - b * CIRON_BLAKE3_BLOCK_BYTES;
+			memset(last, 0, sizeof(last));
+			if (block_len > 0) {
+				memcpy(last, block, block_len);
+			}
+			block = last;
+		}
+		for (i = 0; i < 16; i++) {
+			m[i] = load_le32(block + 4 * i);
+		}
+		compress(cv, m, (uint32_t) block_len, counter, KEYED_HASH
+				| (b == 0 ? CHUNK_START : 0) | (b == nblocks - 1 ? CHUNK_END | flags : 0));
+	}
+	cleanse(last, sizeof(last));
+	cleanse(m, sizeof(m));
+}
+
+/*
+ * Replaces left by the chaining value of the parent of left and right.
+ */
+static void parent_cv(const uint32_t *key, uint32_t *left, const uint32_t *right,
+		uint32_t flags) {
+	uint32_t m[16];
+
+	memcpy(m, left, 8 * sizeof(uint32_t));
+	memcpy(m + 8, right, 8 * sizeof(uint32_t));
+	memcpy(left, key, 8 * sizeof(uint32_t));
+	compress(left, m, CIRON_BLAKE3_BLOCK_BYTES, 0, KEYED_HASH | PARENT | flags);
+	cleanse(m, sizeof(m));
+}
+
+/*
+ * The stack holds the chaining values of the complete subtrees of the
+ * chunks hashed so far. Before the chaining value of another chunk is
+ * pushed, the subtrees of equal size are merged: after nchunks chunks
+ * there is one subtree per bit set in nchunks. Merging lazily like this
+ * keeps the last chunk from being merged before it is known whether it
+ * belongs to the root.
+ */
+static size_t merge(const uint32_t *key, uint32_t (*stack)[8], size_t depth,
+		uint64_t nchunks) {
+	size_t subtrees = 0;
+
+	for (; nchunks > 0; nchunks &= nchunks - 1) {
+		subtrees++;
+	}
+	while (depth > subtrees) {
+		parent_cv(key, stack[depth - 2], stack[depth - 1], 0);
+		depth--;
+	}
+	return depth;
+}
+
+void ciron_blake3_keyed(const unsigned char *key, const unsigned char *data,
+		size_t len, unsigned char *out) {
+	const struct blake3_functions *f = ciron_primitive_functions(&ciron_blake3_primitive);
+	uint32_t k[8];
+	uint32_t stack[MAX_DEPTH][8];
+	uint32_t cvs[MAX_LANES][8];
+	uint32_t cv[8];
+	uint64_t nchunks = 0;
+	size_t depth = 0;
+	size_t i, n;
+
+	for (i = 0; i < 8; i++) {
+		k[i] = load_le32(key + 4 * i);
+	}
+
+	/* All chunks but the last one are full and are never the root */
+	while (len > CIRON_BLAKE3_CHUNK_BYTES) {
+		n = (len - 1) / CIRON_BLAKE3_CHUNK_BYTES;
+		if (f->chunks != NULL && n >= f->lanes) {
+			n = f->lanes;
+			f->chunks(k, data, nchunks, cvs[0]);
+		} else {
+			n = 1;
+			chunk_cv(k, data, CIRON_BLAKE3_CHUNK_BYTES, nchunks, 0, cvs[0]);
+		}
+		for (i = 0; i < n; i++) {
+			depth = merge(k, stack, depth, nchunks);
+			memcpy(stack[depth++], cvs[i], sizeof(cvs[i]));
+			nchunks++;
+		}
+		data += n * CIRON_BLAKE3_CHUNK_BYTES;
+		len -= n * CIRON_BLAKE3_CHUNK_BYTES;
+	}
+
+	if (depth == 0) {
+		chunk_cv(k, data, len, 0, ROOT, cv);
+	} else {
+		depth = merge(k, stack, depth, nchunks);
+		chunk_cv(k, data, len, nchunks, 0, cv);
+		while (depth > 0) {
+			depth--;
+			parent_cv(k, stack[depth], cv, depth == 0 ? ROOT : 0);
+			memcpy(cv, stack[depth], sizeof(cv));
+		}
+	}
+
+	for (i = 0; i < 8; i++) {
+		store_le32(out + 4 * i, cv[i]);
+	}
+	cleanse(k, sizeof(k));
+	cleanse(cv, sizeof(cv));
+	if (nchunks > 0) {
+		cleanse(stack, sizeof(stack));
+		cleanse(cvs, sizeof(cvs));
+	}
+}
+
+void ciron_blake3_init_keyed(struct CironBlake3 *h, const unsigned char *key) {
+	size_t i;
+
+	for (i = 0; i < 8; i++) {
+		h->key[i] = load_le32(key + 4 * i);
+	}
+	h->depth = 0;
+	h->nchunks = 0;
+	h->buf_len = 0;
+}
+
+/*
+ * Pushes the chaining values of n chunks to the stack of the hasher.
+ */
+static void push_chunks(struct CironBlake3 *h, uint32_t (*cvs)[8], size_t n) {
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		h->depth = merge(h->key, h->stack, h->depth, h->nchunks);
+		memcpy(h->stack[h->depth++], cvs[i], sizeof(cvs[i]));
+		h->nchunks++;
+	}
+}
+
+/*
+ * Like ciron_blake3_keyed(), whole chunks are hashed straight from data,
+ * side by side where possible. Only a chunk that might be the last one
+ * is buffered.
+ */
+void ciron_blake3_update(struct CironBlake3 *h, const unsigned char *data, size_t len) {
+	const struct blake3_functions *f = ciron_primitive_functions(&ciron_blake3_primitive);
+	uint32_t cvs[MAX_LANES][8];
+	size_t n;
+
+	while (len > 0) {
+		if (h->buf_len == CIRON_BLAKE3_CHUNK_BYTES) {
+			chunk_cv(h->key, h->buf, CIRON_BLAKE3_CHUNK_BYTES, h->nchunks, 0, cvs[0]);
+			push_chunks(h, cvs, 1);
+			h->buf_len = 0;
+		}
+		if (h->buf_len == 0 && len > CIRON_BLAKE3_CHUNK_BYTES) {
+			n = (len - 1) / CIRON_BLAKE3_CHUNK_BYTES;
+			if (f->chunks != NULL && n >= f->lanes) {
+				n = f->lanes;
+				f->chunks(h->key, data, h->nchunks, cvs[0]);
+			} else {
+				n = 1;
+				chunk_cv(h->key, data, CIRON_BLAKE3_CHUNK_BYTES, h->nchunks, 0, cvs[0]);
+			}
+			push_chunks(h, cvs, n);
+			data += n * CIRON_BLAKE3_CHUNK_BYTES;
+			len -= n * CIRON_BLAKE3_CHUNK_BYTES;
+			continue;
+		}
+		n = CIRON_BLAKE3_CHUNK_BYTES - h->buf_len;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(h->buf + h->buf_len, data, n);
+		h->buf_len += n;
+		data += n;
+		len -= n;
+	}
+	cleanse(cvs, sizeof(cvs));
+}
+
+void ciron_blake3_final(struct CironBlake3 *h, unsigned char *out) {
+	uint32_t cv[8];
+	size_t i;
+
+	if (h->depth == 0) {
+		chunk_cv(h->key, h->buf, h->buf_len, 0, ROOT, cv);
+	} else {
+		h->depth = merge(h->key, h->stack, h->depth, h->nchunks);
+		chunk_cv(h->key, h->buf, h->buf_len, h->nchunks, 0, cv);
+		while (h->depth > 0) {
+			h->depth--;
+			parent_cv(h->key, h->stack[h->depth], cv, h->depth == 0 ? ROOT : 0);
+			memcpy(cv, h->stack[h->depth], sizeof(cv));
+		}
+	}
+
+	for (i = 0; i < 8; i++) {
+		store_le32(out + 4 * i, cv[i]);
+	}
+	cleanse(cv, sizeof(cv));
+	cleanse(h, sizeof(struct CironBlake3));
+}
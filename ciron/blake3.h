@@ -0,0 +1,60 @@
+#ifndef CIRON_BLAKE3_H
+#define CIRON_BLAKE3_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Keyed BLAKE3 for the CIRON_BLAKE3 integrity algorithm.
+ *
+ * BLAKE3 splits its input into 1 KiB chunks whose chaining values are
+ * combined in a binary tree. The chunks are independent, so the "blake3"
+ * primitive of the registry (registry.h) compresses them side by side, one
+ * chunk per 32 bit lane of a vector register: 4 lanes with SSE4.1, 8 with
+ * AVX2 and 16 with AVX-512. Inputs of up to one chunk, which is most
+ * tokens, are hashed with the portable compression function only.
+ */
+
+#define CIRON_BLAKE3_KEY_BYTES 32
+#define CIRON_BLAKE3_OUT_BYTES 32
+#define CIRON_BLAKE3_BLOCK_BYTES 64
+#define CIRON_BLAKE3_CHUNK_BYTES 1024
+
+/** Calculate the 32 byte keyed hash of len bytes of data with a 32 byte key.
+ */
+void ciron_blake3_keyed(const unsigned char *key, const unsigned char *data,
+		size_t len, unsigned char *out);
+
+/** State of a keyed hash calculated in parts.
+ *
+ * stack holds the chaining values of complete subtrees, at most one per
+ * bit of the chunk count, buf the chunk that is not known to be the last
+ * one yet.
+ */
+struct CironBlake3 {
+	uint32_t key[8];
+	uint32_t stack[54][8];
+	size_t depth;
+	uint64_t nchunks;
+	unsigned char buf[CIRON_BLAKE3_CHUNK_BYTES];
+	size_t buf_len;
+};
+
+/** Calculate the keyed hash of data passed to any number of calls of
+ * ciron_blake3_update(). The result is the same as that of
+ * ciron_blake3_keyed() of all the data.
+ */
+void ciron_blake3_init_keyed(struct CironBlake3 *h, const unsigned char *key);
+void ciron_blake3_update(struct CironBlake3 *h, const unsigned char *data, size_t len);
+void ciron_blake3_final(struct CironBlake3 *h, unsigned char *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_BLAKE3_H */
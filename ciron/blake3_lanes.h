@@ -0,0 +1,69 @@
+/*
+ * Compresses the chunks of BLAKE3 side by side for one vector width.
+ * blake3.c includes this file once per width with the following macros
+ * defined:
+ *
+ *   LANES        number of 32 bit lanes of the vectors
+ *   VECTOR       name of the vector type to define
+ *   TARGET       attribute enabling the instruction set for the function
+ *   HASH_CHUNKS  name of the function
+ *
+ * Like sha_mb_lanes.h this uses GCC vector extensions. The function
+ * calculates the chaining values of LANES full chunks following each
+ * other in data, the first of them with the chunk counter counter. Chunk
+ * l is hashed in lane l, its chaining value is stored to cvs[8 * l].
+ */
+
+typedef uint32_t VECTOR __attribute__((vector_size(4 * LANES)));
+
+TARGET static void HASH_CHUNKS(const uint32_t *key, const unsigned char *data,
+		uint64_t counter, uint32_t *cvs) {
+	const VECTOR zero = { 0 };
+	VECTOR h[8];
+	VECTOR v[16];
+	VECTOR m[16];
+	VECTOR counter_low, counter_high;
+	uint32_t flags;
+	int b, i, l, r;
+
+	for (l = 0; l < LANES; l++) {
+		counter_low[l] = (uint32_t) (counter + l);
+		counter_high[l] = (uint32_t) ((counter + l) >> 32);
+	}
+	for (i = 0; i < 8; i++) {
+		h[i] = zero + key[i];
+	}
+
+	for (b = 0; b < CHUNK_BLOCKS; b++) {
+		for (i = 0; i < 16; i++) {
+			for (l = 0; l < LANES; l++) {
+				m[i][l] = load_le32(data + l * CIRON_BLAKE3_CHUNK_BYTES
+						+ b * CIRON_BLAKE3_BLOCK_BYTES + 4 * i);
+			}
+		}
+		flags = KEYED_HASH | (b == 0 ? CHUNK_START : 0)
+				| (b == CHUNK_BLOCKS - 1 ? CHUNK_END : 0);
+		for (i = 0; i < 8; i++) {
+			v[i] = h[i];
+		}
+		for (i = 0; i < 4; i++) {
+			v[8 + i] = zero + IV[i];
+		}
+		v[12] = counter_low;
+		v[13] = counter_high;
+		v[14] = zero + CIRON_BLAKE3_BLOCK_BYTES;
+		v[15] = zero + flags;
+		for (r = 0; r < ROUNDS; r++) {
+			ROUND(v, m, SCHEDULE[r]);
+		}
+		for (i = 0; i < 8; i++) {
+			h[i] = v[i] ^ v[i + 8];
+		}
+	}
+
+	for (l = 0; l < LANES; l++) {
+		for (i = 0; i < 8; i++) {
+			cvs[8 * l + i] = h[i][l];
+		}
+	}
+}
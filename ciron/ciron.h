@@ -7,6 +7,7 @@
 #ifndef CIRON_H
 #define CIRON_H 1
 #include <unistd.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +30,36 @@ extern CironAlgorithm CIRON_SHA_256;
 extern CironOptions CIRON_DEFAULT_ENCRYPTION_OPTIONS;
 extern CironOptions CIRON_DEFAULT_INTEGRITY_OPTIONS;
 
+/** AEAD algorithms and encryption options using them.
+ *
+ * Sealing with these options produces tokens in a format of its own,
+ * prefixed Ci26.G (AES-256-GCM) or Ci26.C (ChaCha20-Poly1305) instead of
+ * Fe26.1, which other iron implementations do not understand:
+ *
+ *     prefix*password-id*salt*iv*encrypted*tag
+ *
+ * A single key is derived from the password and the salt. It encrypts
+ * the data and authenticates it together with everything up to the
+ * encrypted part, so the integrity options are not used and no second
+ * key derivation and HMAC are needed. Contexts and sealers configured
+ * with these options unseal Fe26.1 tokens as well; others reject AEAD
+ * tokens.
+ */
+extern CironAlgorithm CIRON_AES_256_GCM;
+extern CironAlgorithm CIRON_CHACHA20_POLY1305;
+extern CironOptions CIRON_AES_256_GCM_OPTIONS;
+extern CironOptions CIRON_CHACHA20_POLY1305_OPTIONS;
+
+/** Keyed BLAKE3 integrity algorithm and integrity options using it.
+ *
+ * The tokens keep the Fe26.1 format but carry a keyed BLAKE3 hash instead
+ * of the HMAC-SHA256, so only use these options if the peer also is ciron
+ * with the same options. The hash is considerably faster than an HMAC for
+ * large tokens, whose 1 KiB chunks are hashed side by side with SIMD.
+ */
+extern CironAlgorithm CIRON_BLAKE3;
+extern CironOptions CIRON_BLAKE3_INTEGRITY_OPTIONS;
+
 
 /** ciron error codes
  *
@@ -52,6 +83,17 @@ const char* CIRONAPI ciron_strerror(CironError e);
 
 
 
+/** Maximum number of arguments of an error message */
+#define CIRON_ERROR_ARGS 4
+
+/** An argument of an error message, see struct CironContext.
+ */
+union CironErrorArg {
+	long l;
+	unsigned long ul;
+	size_t z;
+};
+
 /** A handle for passing information between calls to ciron functions.
  *
  * Primarily used for propagating errors up the call-chain.
@@ -77,10 +119,27 @@ typedef struct CironContext {
     CironOptions integrity_options;
 	/** Ciron error code */
 	CironError error;
-	/** Error message providing specific error condition details */
-	char error_string[1024];
+	/** Source line the error was reported at */
+	int error_line;
+	/** Source file the error was reported in */
+	const char *error_file;
+	/** printf format of the error message, NULL if there was no error */
+	const char *error_format;
 	/** Error code of underlying crypto library, or 0 if not applicable */
 	unsigned long crypto_error;
+
+	/*
+	 * The fields above fit in 64 bytes on 64 bit platforms. The ones
+	 * below are only written when an error is reported, and the message
+	 * is only formatted by ciron_get_error().
+	 */
+
+	/** Arguments of the error message */
+	union CironErrorArg error_args[CIRON_ERROR_ARGS];
+	/** Copies of the string arguments, which need not outlive the call */
+	char error_chars[64];
+	/** Error message providing specific error condition details */
+	char error_string[256];
 } *CironContext;
 
 
@@ -99,6 +158,132 @@ typedef struct CironPwdTable {
 	struct CironPwdTableEntry *entries;
 } *CironPwdTable;
 
+/** Number of bytes of every password ID stored in the index itself */
+#define CIRON_PWD_INDEX_ID_BYTES 16
+
+/** A hash index of a password table.
+ *
+ * Without an index the password ID of a token is looked up by comparing
+ * it with every entry of the table in turn. The index finds it in
+ * constant time with open addressing: a slot holds the hash of an ID and
+ * the number of its entry plus 1, or 0 if it is empty. The lengths and
+ * the first CIRON_PWD_INDEX_ID_BYTES bytes of the IDs are stored in
+ * arrays of their own, so that IDs of up to that length are compared
+ * without touching the entries.
+ *
+ * The arrays are in a buffer supplied to ciron_pwd_table_index(). Like
+ * CironContext, the struct is exposed so that it can be declared as a
+ * variable; treat its fields as opaque.
+ */
+typedef struct CironPwdIndex {
+	/** Number of slots, a power of two, 0 for a table without index */
+	size_t nslots;
+	/** Hash and entry number plus 1 per slot */
+	uint32_t *slots;
+	/** Length of the ID per entry */
+	size_t *id_lens;
+	/** First CIRON_PWD_INDEX_ID_BYTES bytes of the ID per entry */
+	unsigned char *ids;
+} *CironPwdIndex;
+
+/** A password table together with its hash index and, optionally, the
+ * prepared passwords of its entries.
+ *
+ * Set it up with ciron_pwd_table_index(), optionally followed by
+ * ciron_pwd_table_prepare(), and unseal with
+ * ciron_unseal_indexed(), ciron_unseal_view_indexed() or
+ * ciron_verify_indexed().
+ *
+ * Like CironContext, the struct is exposed so that it can be declared as
+ * a variable; treat its fields as opaque.
+ */
+typedef struct CironIndexedPwdTable {
+	/** Copy of the indexed table */
+	struct CironPwdTable table;
+	/** Hash index of the entries of the table */
+	struct CironPwdIndex index;
+	/** Prepared passwords of the entries set by ciron_pwd_table_prepare(),
+	 * or NULL */
+	struct CironPreparedPassword *prepared;
+} *CironIndexedPwdTable;
+
+/** A password prepared for repeated key derivation.
+ *
+ * ciron derives its keys using PBKDF2 with HMAC-SHA1 and the password as
+ * the HMAC key. The SHA-1 states after hashing the HMAC inner and outer
+ * pad blocks therefore depend on the password only and can be computed
+ * once and reused for every token that is sealed or unsealed with it.
+ *
+ * Like CironContext, the struct is exposed so that API users can declare
+ * a variable of type 'struct CironPreparedPassword' instead of having to
+ * allocate one. Treat the fields as opaque and set them up using
+ * ciron_password_prepare().
+ *
+ * Note that the prepared states are as sensitive as the password itself.
+ */
+typedef struct CironPreparedPassword {
+	/** SHA-1 state after hashing the HMAC inner pad block */
+	uint32_t inner_state[5];
+	/** SHA-1 state after hashing the HMAC outer pad block */
+	uint32_t outer_state[5];
+} *CironPreparedPassword;
+
+/** A reader slot of a password store. See pwd_store.c */
+struct CironStoreReader;
+
+/** A password table that can be replaced while other threads unseal.
+ *
+ * Threads that unseal register as readers of the store once. Around
+ * every use of the table they call ciron_password_store_enter() and
+ * ciron_password_store_leave(), which take no lock and write only to the
+ * reader's own slot. ciron_password_store_publish() replaces the table
+ * and returns the previous one as soon as no reader can use it anymore,
+ * so that it can be freed or reused.
+ *
+ * Like CironContext, the struct is exposed so that API users can declare
+ * a variable of type 'struct CironPasswordStore'. Treat the fields as
+ * opaque and set them up using ciron_password_store_init().
+ */
+typedef struct CironPasswordStore {
+	/** The table published last */
+	struct CironIndexedPwdTable *current;
+	/** Number of publications plus 1 */
+	unsigned long epoch;
+	/** Number of reader slots */
+	unsigned int nreaders;
+	/** Reader slots, in the buffer supplied to ciron_password_store_init() */
+	struct CironStoreReader *readers;
+} *CironPasswordStore;
+
+/** Cipher and MAC state kept by the crypto implementation. See crypto.h */
+struct CironCipher;
+struct CironMac;
+
+/** A long-lived object for sealing and unsealing many tokens.
+ *
+ * A sealer resolves the algorithms of the options once and keeps the
+ * cipher and HMAC contexts of the underlying crypto library for reuse
+ * across calls. Sealing or unsealing through a sealer therefore saves
+ * the algorithm lookup and context setup of every call to ciron_seal()
+ * and ciron_unseal().
+ *
+ * Like CironContext, the struct is exposed so that API users can declare
+ * a variable of type 'struct CironSealer'. Initialize it with
+ * ciron_sealer_init() and release it with ciron_sealer_cleanup().
+ *
+ * A sealer must not be used by more than one thread at a time.
+ */
+typedef struct CironSealer {
+	/** Options to use for encryption */
+	CironOptions encryption_options;
+	/** Options to use for integrity */
+	CironOptions integrity_options;
+	/** Reusable cipher state of the crypto library */
+	struct CironCipher *cipher;
+	/** Reusable HMAC state of the crypto library */
+	struct CironMac *mac;
+} *CironSealer;
+
 /**
  * Initalize a CironContext with the given options
  */
@@ -107,6 +292,8 @@ void CIRONAPI ciron_context_init(CironContext ctx, CironOptions encryption_optio
 /** Get a human readable message about the last error
  * condition that ocurred for the given context.
  *
+ * The message is formatted by this call into the context and is valid
+ * until the context reports another error.
  */
 const char * CIRONAPI ciron_get_error(CironContext ctx);
 
@@ -185,6 +372,98 @@ CironError CIRONAPI ciron_calculate_seal_buffer_length(CironContext context,
  */
 CironError CIRONAPI ciron_calculate_unseal_buffer_length(CironContext context, size_t data_len, size_t *result_len);
 
+/** Calculates the length of the buffer ciron_pwd_table_index() needs for
+ * a table of nentries entries.
+ *
+ * Returns CIRON_OVERFLOW_ERROR if the table is too large.
+ */
+CironError CIRONAPI ciron_calculate_pwd_index_buffer_length(CironContext context,
+		unsigned int nentries, size_t *result_len);
+
+/** Build a hash index of a password table.
+ *
+ * Copies the table to indexed and builds its index in the supplied
+ * buffer, whose length must be at least that calculated by
+ * ciron_calculate_pwd_index_buffer_length(). Unsealing with indexed
+ * looks up password IDs through the index. If IDs occur more than once,
+ * the first entry is found, as without index.
+ *
+ * The entries of the table must not be changed while they are indexed.
+ * To change them, build the index again afterwards.
+ */
+CironError CIRONAPI ciron_pwd_table_index(CironContext context,
+		CironIndexedPwdTable indexed, CironPwdTable table,
+		unsigned char *buffer, size_t buffer_len);
+
+/** Prepare the passwords of a password table.
+ *
+ * Prepares the password of every entry of a table indexed by
+ * ciron_pwd_table_index() into the supplied array, which must have as
+ * many elements as the table has entries, and sets the prepared
+ * passwords of indexed to it. Unsealing with indexed then uses them
+ * instead of preparing the password of every token again. Indexing the
+ * table again drops them.
+ */
+CironError CIRONAPI ciron_pwd_table_prepare(CironContext context,
+		CironIndexedPwdTable indexed, struct CironPreparedPassword *prepared);
+
+/** Calculates the length of the buffer ciron_password_store_init() needs
+ * for nreaders reader slots.
+ *
+ * Returns CIRON_OVERFLOW_ERROR if nreaders is too large.
+ */
+CironError CIRONAPI ciron_calculate_password_store_buffer_length(CironContext context,
+		unsigned int nreaders, size_t *result_len);
+
+/** Initialize a password store.
+ *
+ * Sets up nreaders reader slots in the supplied buffer, whose length must
+ * be at least that calculated by ciron_calculate_password_store_buffer_length(),
+ * and publishes the table, which may be NULL.
+ */
+CironError CIRONAPI ciron_password_store_init(CironContext context,
+		CironPasswordStore store, CironIndexedPwdTable table, unsigned int nreaders,
+		unsigned char *buffer, size_t buffer_len);
+
+/** Register the calling thread as a reader of the store.
+ *
+ * Stores the number of a free reader slot in reader. Returns
+ * CIRON_OVERFLOW_ERROR if all slots are in use.
+ */
+CironError CIRONAPI ciron_password_store_register(CironContext context,
+		CironPasswordStore store, unsigned int *reader);
+
+/** Free the reader slot of a thread that no longer reads the store.
+ */
+void CIRONAPI ciron_password_store_unregister(CironPasswordStore store,
+		unsigned int reader);
+
+/** Get the current table of the store for unsealing.
+ *
+ * The table, including its index and prepared passwords, stays valid
+ * until the reader calls ciron_password_store_leave(). Pass it to
+ * ciron_unseal_indexed(), ciron_verify_indexed() or
+ * ciron_unseal_view_indexed(). Calls must not be nested.
+ */
+CironIndexedPwdTable CIRONAPI ciron_password_store_enter(CironPasswordStore store,
+		unsigned int reader);
+
+/** End the use of the table returned by ciron_password_store_enter().
+ */
+void CIRONAPI ciron_password_store_leave(CironPasswordStore store,
+		unsigned int reader);
+
+/** Replace the table of the store.
+ *
+ * Readers entering from now on get the new table. Waits until all readers
+ * that may still use the previous table have left and returns it; the
+ * caller may then free or change it. Several threads may publish at a
+ * time, but not from between ciron_password_store_enter() and
+ * ciron_password_store_leave().
+ */
+CironIndexedPwdTable CIRONAPI ciron_password_store_publish(CironPasswordStore store,
+		CironIndexedPwdTable table);
+
 
 /** Seal the supplied data.
  *
@@ -215,6 +494,38 @@ CironError CIRONAPI ciron_seal(CironContext ctx,const unsigned char *data, size_
 		size_t password_id_len,const unsigned char* password,
 		size_t password_len, unsigned char *buffer_encrypted_bytes, unsigned char *buf, size_t *plen);
 
+/** Prepare a password for use with ciron_seal_prepared() and
+ * ciron_unseal_prepared().
+ *
+ * The prepared password can be used for any number of seal and
+ * unseal operations and from several threads at a time. No copy of
+ * the password is kept.
+ */
+CironError CIRONAPI ciron_password_prepare(CironContext ctx, const unsigned char *password,
+		size_t password_len, CironPreparedPassword prepared);
+
+/** Seal the supplied data using a prepared password.
+ *
+ * Works exactly like ciron_seal() but saves re-hashing the password
+ * for each key derivation. Use this if you seal many tokens with the
+ * same password.
+ */
+CironError CIRONAPI ciron_seal_prepared(CironContext ctx,const unsigned char *data, size_t data_len,
+		const unsigned char* password_id, size_t password_id_len, CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes, unsigned char *buf, size_t *plen);
+
+/** Seal the supplied data in a single buffer.
+ *
+ * Works like ciron_seal() but needs no buffer for the encrypted data.
+ * buf must have the size that calculate_seal_buffer_length() returns.
+ * data may lie anywhere in buf, for example at its end, or outside of
+ * it. The data is moved to its place in the token, encrypted there and
+ * base64url encoded in place, so it is overwritten if it lies in buf.
+ */
+CironError CIRONAPI ciron_seal_inplace(CironContext ctx, const unsigned char *data, size_t data_len,
+		const unsigned char* password_id, size_t password_id_len,
+		const unsigned char* password, size_t password_len, unsigned char *buf, size_t *plen);
+
 /** Unseal the supplied data.
  *
  * This function unseals the supplied data. The parameters are:
@@ -249,7 +560,511 @@ CironError CIRONAPI ciron_unseal(CironContext ctx,const unsigned char *data, siz
 		const unsigned char* password, size_t password_len,
 		unsigned char *buffer_encrypted_bytes,unsigned char *result, size_t *plen);
 
+/** A field of a token, offset and length in bytes within the token.
+ */
+struct CironTokenField {
+	size_t offset;
+	size_t len;
+};
+
+/** The fields of a token, found by ciron_token_view().
+ *
+ * The fields are not copied, they are ranges of the token they were
+ * found in. AEAD tokens have no integrity salt, its length is 0, and
+ * hmac is their authentication tag.
+ */
+typedef struct CironTokenView {
+	struct CironTokenField prefix;
+	struct CironTokenField password_id;
+	struct CironTokenField encryption_salt;
+	struct CironTokenField iv;
+	struct CironTokenField encrypted;
+	struct CironTokenField integrity_salt;
+	struct CironTokenField hmac;
+} *CironTokenView;
+
+/** Split a token into its fields.
+ *
+ * Scans the token once for its delimiters and stores the offsets and
+ * lengths of its fields to view. Returns CIRON_TOKEN_PARSE_ERROR if the
+ * prefix is unknown or fields are missing. The lengths of the fields are
+ * checked when the token is unsealed.
+ */
+CironError CIRONAPI ciron_token_view(CironContext ctx, const unsigned char *data,
+		size_t data_len, CironTokenView view);
+
+/** Unseal a token split by ciron_token_view().
+ *
+ * Works exactly like ciron_unseal() but takes the fields of the token
+ * from view instead of parsing it again. The token ends with the hmac
+ * field of the view.
+ */
+CironError CIRONAPI ciron_unseal_view(CironContext ctx, const unsigned char *data,
+		CironTokenView view, CironPwdTable pwd_table,
+		const unsigned char* password, size_t password_len,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen);
+
+/** Unseal the supplied data in its own memory.
+ *
+ * Works like ciron_unseal() but needs no buffers. After the HMAC has
+ * been verified, the encrypted data is decoded and decrypted where it
+ * is in the token, which is destroyed. *presult is set to the result
+ * within data and *plen to its length.
+ */
+CironError CIRONAPI ciron_unseal_inplace(CironContext ctx, unsigned char *data, size_t data_len,
+		CironPwdTable pwd_table, const unsigned char* password, size_t password_len,
+		unsigned char **presult, size_t *plen);
+
+/** Check the structure of the supplied token without any crypto.
+ *
+ * Checks the prefix, the number of fields, that the password ID has
+ * letters, digits and underscores only, that the salts are hex digits
+ * and the other fields base64url, and the lengths of the fields against
+ * the options of the context. Returns CIRON_TOKEN_PARSE_ERROR if any of
+ * this fails. Unsealing and verifying do these checks first, too, so
+ * that malformed tokens cost no key derivation.
+ */
+CironError CIRONAPI ciron_token_check(CironContext ctx, const unsigned char *data, size_t data_len);
 
+/** Verify the integrity of the supplied token without unsealing it.
+ *
+ * Parses the token, looks up the password like ciron_unseal() and checks
+ * the HMAC, but derives no encryption key and decrypts nothing, so no
+ * buffers are needed. Returns CIRON_OK for an authentic token and
+ * CIRON_TOKEN_VALIDATION_ERROR for a modified one, like ciron_unseal().
+ * AEAD tokens can only be verified by unsealing them.
+ */
+CironError CIRONAPI ciron_verify(CironContext ctx, const unsigned char *data, size_t data_len,
+		CironPwdTable pwd_table, const unsigned char* password, size_t password_len);
+
+/** Unseal the supplied data with an indexed password table.
+ *
+ * Works exactly like ciron_unseal() but looks up the password ID of the
+ * token through the index built by ciron_pwd_table_index().
+ */
+CironError CIRONAPI ciron_unseal_indexed(CironContext ctx, const unsigned char *data,
+		size_t data_len, CironIndexedPwdTable pwd_table,
+		const unsigned char* password, size_t password_len,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen);
+
+/** Unseal a token split by ciron_token_view() with an indexed password
+ * table, like ciron_unseal_view().
+ */
+CironError CIRONAPI ciron_unseal_view_indexed(CironContext ctx, const unsigned char *data,
+		CironTokenView view, CironIndexedPwdTable pwd_table,
+		const unsigned char* password, size_t password_len,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen);
+
+/** Verify the integrity of the supplied token with an indexed password
+ * table, like ciron_verify().
+ */
+CironError CIRONAPI ciron_verify_indexed(CironContext ctx, const unsigned char *data,
+		size_t data_len, CironIndexedPwdTable pwd_table,
+		const unsigned char* password, size_t password_len);
+
+/** Unseal the supplied data using a prepared password.
+ *
+ * Works exactly like ciron_unseal() but uses the supplied prepared
+ * password for any token. The password ID contained in the token, if
+ * any, is not used for password lookup.
+ */
+CironError CIRONAPI ciron_unseal_prepared(CironContext ctx,const unsigned char *data, size_t data_len,
+		CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes,unsigned char *result, size_t *plen);
+
+
+
+
+/** Initialize a sealer for the options of the given context.
+ *
+ * This is the only ciron function that allocates memory (through the
+ * crypto library). Call ciron_sealer_cleanup() to release it.
+ */
+CironError CIRONAPI ciron_sealer_init(CironContext ctx, CironSealer sealer);
+
+/** Release the resources held by a sealer.
+ */
+void CIRONAPI ciron_sealer_cleanup(CironSealer sealer);
+
+/** Seal the supplied data using a sealer and a prepared password.
+ *
+ * Works like ciron_seal_prepared() but uses the options and the
+ * reusable crypto state of the sealer.
+ *
+ * With a sealer for a CBC algorithm buffer_encrypted_bytes may be NULL.
+ * The data is then encrypted and base64url encoded to buf in chunks of
+ * 768 bytes, so only buf needs to be allocated. The batch functions
+ * accept items without encryption buffer the same way.
+ */
+CironError CIRONAPI ciron_sealer_seal(CironContext ctx, CironSealer sealer,
+		const unsigned char *data, size_t data_len,
+		const unsigned char* password_id, size_t password_id_len, CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes, unsigned char *buf, size_t *plen);
+
+/** Unseal the supplied data using a sealer and a prepared password.
+ *
+ * Works like ciron_unseal_prepared() but uses the options and the
+ * reusable crypto state of the sealer.
+ *
+ * Fe26.1 tokens can be unsealed with a sealer for a CBC algorithm and
+ * NULL as buffer_encrypted_bytes. The encrypted data is then decoded and
+ * decrypted in chunks of 768 bytes, with the plaintext going to result
+ * directly. The batch functions accept items without encryption buffer
+ * the same way.
+ */
+CironError CIRONAPI ciron_sealer_unseal(CironContext ctx, CironSealer sealer,
+		const unsigned char *data, size_t data_len, CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes,unsigned char *result, size_t *plen);
+
+/** Verify a token like ciron_verify() using a sealer and a prepared password.
+ */
+CironError CIRONAPI ciron_sealer_verify(CironContext ctx, CironSealer sealer,
+		const unsigned char *data, size_t data_len, CironPreparedPassword password);
+
+/** Unseal only a range of the data of an Fe26.1 token using a sealer for
+ * a CBC algorithm.
+ *
+ * The HMAC of the whole token is verified as by ciron_sealer_unseal().
+ * Then only the cipher blocks holding the length bytes of the original
+ * data from offset on, and the base64url characters encoding them, are
+ * decoded and decrypted. result receives these bytes, *plen is less than
+ * length if the data ends before offset + length and 0 if it ends before
+ * offset.
+ */
+CironError CIRONAPI ciron_sealer_unseal_range(CironContext ctx, CironSealer sealer,
+		const unsigned char *data, size_t data_len, CironPreparedPassword password,
+		size_t offset, size_t length, unsigned char *result, size_t *plen);
+
+/** A token for ciron_sealer_seal_batch() or ciron_sealer_unseal_batch().
+ *
+ * The fields correspond to the parameters of ciron_sealer_seal() and
+ * ciron_sealer_unseal(). For unsealing, data is the token and the
+ * password ID fields are not used.
+ */
+typedef struct CironBatchItem {
+	const unsigned char *data;
+	size_t data_len;
+	const unsigned char *password_id;
+	size_t password_id_len;
+	CironPreparedPassword password;
+	unsigned char *buffer_encrypted_bytes;
+	unsigned char *result;
+	/** Set to the length of the result */
+	size_t result_len;
+	/** Set to the outcome for this item */
+	CironError error;
+} *CironBatchItem;
+
+/** Seal several tokens using a sealer.
+ *
+ * Produces the same tokens as calling ciron_sealer_seal() for every item,
+ * but derives the keys and calculates the HMACs of the items side by side,
+ * which is considerably faster with the multi-buffer SHA implementations
+ * of the native crypto implementation (see "sha_mb" below).
+ *
+ * Every item receives its own error. Returns CIRON_OK if all items have
+ * been sealed and otherwise the error of the first failed item. The
+ * context holds the message of the last failure.
+ */
+CironError CIRONAPI ciron_sealer_seal_batch(CironContext ctx, CironSealer sealer,
+		CironBatchItem items, size_t nitems);
+
+/** Unseal several tokens using a sealer, like ciron_sealer_seal_batch().
+ */
+CironError CIRONAPI ciron_sealer_unseal_batch(CironContext ctx, CironSealer sealer,
+		CironBatchItem items, size_t nitems);
+
+/** Data to seal with ciron_seal_batch().
+ */
+typedef struct CironPayload {
+	const unsigned char *data;
+	size_t data_len;
+} *CironPayload;
+
+/** Calculate the length of the arena ciron_seal_batch() needs.
+ *
+ * The arena holds the tokens of all payloads and, while they are sealed,
+ * their encrypted data. Returns CIRON_OVERFLOW_ERROR if the length does
+ * not fit a size_t.
+ */
+CironError CIRONAPI ciron_calculate_seal_batch_buffer_length(CironContext ctx,
+		const struct CironPayload *payloads, size_t npayloads,
+		size_t password_id_len, size_t *result_len);
+
+/** Seal several payloads with the same password into one arena.
+ *
+ * Produces the same tokens as calling ciron_seal() for every payload, but
+ * prepares the password, sets up the crypto library objects and draws
+ * random bytes once per call or per chunk of 16 payloads instead of per
+ * token, and seals the payloads like ciron_sealer_seal_batch().
+ *
+ * The tokens are written one after the other to arena, whose length must
+ * be at least that calculated by ciron_calculate_seal_batch_buffer_length().
+ * offsets must have npayloads + 1 elements. The token of payload i is
+ * stored from arena + offsets[i] to arena + offsets[i + 1]; this range is
+ * empty if errors[i] is not CIRON_OK. Returns CIRON_OK if all payloads
+ * have been sealed and otherwise the error of the first failed one.
+ *
+ * To seal batches with the same options repeatedly, ciron_sealer_seal_batch()
+ * keeps the crypto library objects from one call to the next.
+ */
+CironError CIRONAPI ciron_seal_batch(CironContext ctx,
+		const struct CironPayload *payloads, size_t npayloads,
+		const unsigned char *password_id, size_t password_id_len,
+		const unsigned char *password, size_t password_len,
+		unsigned char *arena, size_t arena_len, size_t *offsets,
+		CironError *errors);
+
+/** Calculate the length of the buffer with which ciron_unseal_batch()
+ * finds identical items in a batch of nitems items.
+ *
+ * Returns CIRON_OVERFLOW_ERROR if nitems is too large.
+ */
+CironError CIRONAPI ciron_calculate_unseal_batch_buffer_length(CironContext ctx,
+		size_t nitems, size_t *result_len);
+
+/** Unseal many tokens on several threads.
+ *
+ * Unseals the items like ciron_sealer_unseal_batch() with a sealer for
+ * the options of the context, on nthreads threads including the calling
+ * one, or one per online CPU if nthreads is 0. The threads take chunks of
+ * 16 items from the batch until all are taken, so that threads that get
+ * ahead take more of them. Every thread has its own sealer for all its
+ * chunks. Pass NULL as buffer_encrypted_bytes of the items to have CBC
+ * tokens decrypted without a buffer per item.
+ *
+ * If buffer is not NULL, items with the same token and the same prepared
+ * password are unsealed once, and the result and error are copied to the
+ * others. The buffer must have the length calculated by
+ * ciron_calculate_unseal_batch_buffer_length().
+ *
+ * Every item receives its own error. Returns CIRON_OK if all items have
+ * been unsealed and otherwise the error of the first failed item. The
+ * context then holds the message of a failure.
+ */
+CironError CIRONAPI ciron_unseal_batch(CironContext ctx, CironBatchItem items,
+		size_t nitems, unsigned int nthreads, unsigned char *buffer,
+		size_t buffer_len);
+
+/** Operations of asynchronous requests */
+#define CIRON_ASYNC_SEAL 1
+#define CIRON_ASYNC_UNSEAL 2
+
+/** A request for ciron_async_submit_seal() or ciron_async_submit_unseal().
+ *
+ * The item describes the token like the items of ciron_sealer_seal_batch()
+ * and ciron_sealer_unseal_batch(), its result_len and error are set when
+ * the request completes. The request and all buffers it points to must
+ * stay valid until ciron_async_reap() has returned it.
+ */
+typedef struct CironAsyncRequest {
+	struct CironBatchItem item;
+	/** For the caller to find its state on completion, not used by ciron */
+	void *user_data;
+	/** CIRON_ASYNC_SEAL or CIRON_ASYNC_UNSEAL, set by the submit functions */
+	int operation;
+} *CironAsyncRequest;
+
+/** Queues and worker threads of an asynchronous interface. See async.c */
+struct CironAsyncState;
+
+/** Worker threads sealing and unsealing on behalf of an event loop.
+ *
+ * Requests are submitted to a queue without blocking. Worker threads take
+ * them from there, up to 16 at a time, and seal or unseal them like the
+ * batch functions, each with its own sealer. Completed requests are put
+ * on a second queue and signalled on a file descriptor, which the event
+ * loop polls for reading and then calls ciron_async_reap().
+ *
+ * Like CironContext, the struct is exposed so that API users can declare
+ * a variable of type 'struct CironAsync'. Treat the fields as opaque, set
+ * it up with ciron_async_init() and release it with ciron_async_cleanup().
+ */
+typedef struct CironAsync {
+	/** Queues and workers, in the buffer supplied to ciron_async_init() */
+	struct CironAsyncState *state;
+} *CironAsync;
+
+/** Calculates the length of the buffer ciron_async_init() needs for
+ * nworkers worker threads and up to depth requests in flight.
+ *
+ * Returns CIRON_OVERFLOW_ERROR if nworkers or depth is 0 or too large.
+ */
+CironError CIRONAPI ciron_calculate_async_buffer_length(CironContext ctx,
+		unsigned int nworkers, size_t depth, size_t *result_len);
+
+/** Start the worker threads of an asynchronous interface.
+ *
+ * The workers seal and unseal with the options of the context. The
+ * buffer must have the length calculated by
+ * ciron_calculate_async_buffer_length() and stay valid until
+ * ciron_async_cleanup(). Returns CIRON_CRYPTO_ERROR if the descriptor or
+ * the threads cannot be created.
+ */
+CironError CIRONAPI ciron_async_init(CironContext ctx, CironAsync async,
+		unsigned int nworkers, size_t depth, unsigned char *buffer,
+		size_t buffer_len);
+
+/** Stop the worker threads after they have completed all submitted
+ * requests, and close the descriptor.
+ */
+void CIRONAPI ciron_async_cleanup(CironAsync async);
+
+/** Get the descriptor that becomes readable when requests have completed.
+ *
+ * This is an eventfd where available, otherwise the read end of a pipe.
+ * Do not read from it, ciron_async_reap() does.
+ */
+int CIRONAPI ciron_async_fd(CironAsync async);
+
+/** Submit a request to seal its item.
+ *
+ * Returns CIRON_OVERFLOW_ERROR without submitting the request if depth
+ * requests are in flight, that is submitted and not yet reaped.
+ */
+CironError CIRONAPI ciron_async_submit_seal(CironContext ctx, CironAsync async,
+		CironAsyncRequest request);
+
+/** Submit a request to unseal its item, like ciron_async_submit_seal().
+ */
+CironError CIRONAPI ciron_async_submit_unseal(CironContext ctx, CironAsync async,
+		CironAsyncRequest request);
+
+/** Take completed requests.
+ *
+ * Stores up to max completed requests in requests and returns their
+ * number, 0 if none has completed. Call it when the descriptor of
+ * ciron_async_fd() is readable, until it returns less than max.
+ */
+size_t CIRONAPI ciron_async_reap(CironAsync async, CironAsyncRequest *requests,
+		size_t max);
+
+/** State of a token sealed or unsealed in parts.
+ *
+ * Like CironContext, the struct is exposed so that API users can declare
+ * a variable of type 'struct CironStream'. Treat the fields as opaque.
+ * The stream uses the cipher and MAC objects of its sealer, which must
+ * not be used otherwise until the stream is finished.
+ */
+typedef struct CironStream {
+	CironSealer sealer;
+	CironPreparedPassword password;
+	/** Part of the token being processed */
+	int state;
+	/** Data not yet encrypted or decrypted, less than a cipher block */
+	unsigned char pending[16];
+	size_t pending_len;
+	/** Encrypted bytes not yet encoded or characters not yet decoded */
+	unsigned char carry[4];
+	size_t carry_len;
+	unsigned char integrity_salt_hex[64];
+	size_t integrity_salt_len;
+	/** Expected HMAC when unsealing */
+	unsigned char hmac[32];
+	size_t hmac_len;
+	/** Token up to the encrypted data, collected when unsealing */
+	unsigned char header[256];
+	size_t header_len;
+} *CironStream;
+
+/** Calculate the buffer size for a call of the stream functions below.
+ *
+ * A call passing data_len bytes (0 for ciron_seal_init(),
+ * ciron_seal_final() and ciron_unseal_final()) writes at most this many
+ * bytes to its buffer. password_id_len only matters for ciron_seal_init().
+ */
+CironError CIRONAPI ciron_calculate_stream_buffer_length(CironContext ctx, size_t data_len,
+		size_t password_id_len, size_t *result_len);
+
+/** Seal data in parts with a sealer for a CBC algorithm.
+ *
+ * ciron_seal_init() writes the token up to the encrypted data to buf.
+ * Every ciron_seal_update() encrypts the data passed to it as far as it
+ * fills cipher blocks and writes the base64url encoding to buf, and
+ * ciron_seal_final() writes the rest of the token. The HMAC is calculated
+ * over the token as it is written, so memory does not grow with the data.
+ * Each call sets *plen to the number of bytes it wrote; the parts joined
+ * are a token like the one ciron_sealer_seal() creates of all the data.
+ * The prepared password must stay valid until the stream is finished.
+ */
+CironError CIRONAPI ciron_seal_init(CironContext ctx, CironStream stream, CironSealer sealer,
+		const unsigned char* password_id, size_t password_id_len, CironPreparedPassword password,
+		unsigned char *buf, size_t *plen);
+CironError CIRONAPI ciron_seal_update(CironContext ctx, CironStream stream,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *plen);
+CironError CIRONAPI ciron_seal_final(CironContext ctx, CironStream stream,
+		unsigned char *buf, size_t *plen);
+
+/** Unseal an Fe26.1 token in parts with a sealer for a CBC algorithm.
+ *
+ * The integrity salt follows the encrypted data in the token, but is
+ * needed to calculate the HMAC from its start. ciron_unseal_init()
+ * therefore takes the end of the token, at least the integrity salt and
+ * the HMAC with the delimiter before each. The whole token is then passed
+ * from its start to any number of calls of ciron_unseal_update(), which
+ * write the plaintext decrypted so far to buf, and ciron_unseal_final()
+ * checks the HMAC and writes the rest. Until ciron_unseal_final() has
+ * returned CIRON_OK the plaintext is not authenticated and must not be
+ * used.
+ */
+CironError CIRONAPI ciron_unseal_init(CironContext ctx, CironStream stream, CironSealer sealer,
+		CironPreparedPassword password, const unsigned char *tail, size_t tail_len);
+CironError CIRONAPI ciron_unseal_update(CironContext ctx, CironStream stream,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *plen);
+CironError CIRONAPI ciron_unseal_final(CironContext ctx, CironStream stream,
+		unsigned char *buf, size_t *plen);
+
+/** Force the implementation used for a primitive.
+ *
+ * ciron selects the fastest implementation of its primitives that the
+ * CPU supports when it is first used. The primitives and their
+ * implementations, fastest first, are:
+ *
+ * - "crypto": "native" (on CPUs with AES-NI and SHA extensions), "openssl"
+ *   (if ciron has been built with libcrypto), "native"
+ * - "aes": "aesni", "generic"
+ * - "ghash": "pclmul", "generic"
+ * - "sha": "shani", "generic"
+ * - "sha_mb": "avx512", "serial" (on CPUs with SHA extensions), "avx2",
+ *   "sse41", "serial"
+ * - "blake3": "avx512", "avx2", "sse41", "generic"
+ * - "base64url": "avx2", "ssse3", "scalar"
+ * - "hex": "avx2", "ssse3", "scalar"
+ *
+ * The environment variable CIRON_IMPLEMENTATION can force implementations
+ * at startup, e.g. CIRON_IMPLEMENTATION=crypto=openssl,hex=scalar
+ *
+ * Returns CIRON_ERROR_UNKNOWN_ALGORITHM if the primitive or implementation
+ * is unknown or the CPU does not support the implementation. This function
+ * must not be called while other threads use ciron. CironSealer objects
+ * stay valid when the crypto implementation changes.
+ */
+CironError CIRONAPI ciron_set_implementation(CironContext ctx, const char *primitive,
+		const char *implementation);
+
+/** Get the name of the implementation used for a primitive, or NULL if
+ * the primitive is unknown.
+ */
+const char * CIRONAPI ciron_get_implementation(const char *primitive);
+
+/** A source of random bytes for ciron_set_random_source().
+ *
+ * Fills buf with nbytes bytes and returns 0, or returns -1 on failure,
+ * which makes sealing fail with CIRON_CRYPTO_ERROR. arg is the argument
+ * given to ciron_set_random_source().
+ */
+typedef int (*CironRandomSource)(void *arg, unsigned char *buf, size_t nbytes);
+
+/** Replace the source of the salts and IVs of all threads.
+ *
+ * By default every thread draws salts and IVs from its own pool, which
+ * ChaCha20 refills in large blocks from a key seeded by the kernel
+ * (getrandom) and seeded again in the child after fork(). A source set
+ * here is used instead, for example a deterministic one for benchmarks or
+ * tests. NULL restores the pools. This function must not be called while
+ * other threads use ciron.
+ */
+void CIRONAPI ciron_set_random_source(CironRandomSource source, void *arg);
 
 
 #ifdef __cplusplus
@@ -4,6 +4,11 @@
 #include <stdarg.h>
 #include "ciron.h"
 #include "common.h"
+#include "registry.h"
+
+#ifdef CIRON_X86_INTRINSICS
+#include <immintrin.h>
+#endif
 
 
 /**
@@ -15,13 +20,19 @@
  * Also, you must add to the selection if-cascades in crypto_openssl.c for them
  * to be recognized.
  */
-struct CironAlgorithm _AES_128_CBC = { "aes-128-cbc", 128, 128 };
-struct CironAlgorithm _AES_256_CBC = { "aes-256-cbc", 256, 128 };
-struct CironAlgorithm _SHA_256 = { "sha256", 256, 0 };
+struct CironAlgorithm _AES_128_CBC = { "aes-128-cbc", 128, 128, 0, NULL };
+struct CironAlgorithm _AES_256_CBC = { "aes-256-cbc", 256, 128, 0, NULL };
+struct CironAlgorithm _AES_256_GCM = { "aes-256-gcm", 256, 96, 128, "Ci26.G" };
+struct CironAlgorithm _CHACHA20_POLY1305 = { "chacha20-poly1305", 256, 96, 128, "Ci26.C" };
+struct CironAlgorithm _SHA_256 = { "sha256", 256, 0, 256, NULL };
+struct CironAlgorithm _BLAKE3 = { "blake3", 256, 0, 256, NULL };
 
 CironAlgorithm CIRON_AES_128_CBC = &_AES_128_CBC;
 CironAlgorithm CIRON_AES_256_CBC = &_AES_256_CBC;
+CironAlgorithm CIRON_AES_256_GCM = &_AES_256_GCM;
+CironAlgorithm CIRON_CHACHA20_POLY1305 = &_CHACHA20_POLY1305;
 CironAlgorithm CIRON_SHA_256 = &_SHA_256;
+CironAlgorithm CIRON_BLAKE3 = &_BLAKE3;
 
 /** Default options provided by ciron.
  *
@@ -36,9 +47,15 @@ CironAlgorithm CIRON_SHA_256 = &_SHA_256;
  */
 struct CironOptions _DEFAULT_ENCRYPTION_OPTIONS = { 256, &_AES_256_CBC, 1 };
 struct CironOptions _DEFAULT_INTEGRITY_OPTIONS = { 256, &_SHA_256, 1 };
+struct CironOptions _AES_256_GCM_OPTIONS = { 256, &_AES_256_GCM, 1 };
+struct CironOptions _CHACHA20_POLY1305_OPTIONS = { 256, &_CHACHA20_POLY1305, 1 };
+struct CironOptions _BLAKE3_INTEGRITY_OPTIONS = { 256, &_BLAKE3, 1 };
 
 CironOptions CIRON_DEFAULT_ENCRYPTION_OPTIONS = &_DEFAULT_ENCRYPTION_OPTIONS;
 CironOptions CIRON_DEFAULT_INTEGRITY_OPTIONS = &_DEFAULT_INTEGRITY_OPTIONS;
+CironOptions CIRON_AES_256_GCM_OPTIONS = &_AES_256_GCM_OPTIONS;
+CironOptions CIRON_CHACHA20_POLY1305_OPTIONS = &_CHACHA20_POLY1305_OPTIONS;
+CironOptions CIRON_BLAKE3_INTEGRITY_OPTIONS = &_BLAKE3_INTEGRITY_OPTIONS;
 
 /** Error strings used by ciron_strerror
  * The order here must correspond to the error codes in ciron.h
@@ -55,10 +72,18 @@ static const char *error_strings[] = {
 		NULL
 };
 
+/*
+ * Only the fields ciron_set_error() writes on every error are
+ * initialized, the others are written before they are read.
+ */
 void ciron_context_init(CironContext ctx, CironOptions encryption_options, CironOptions integrity_options) {
-    memset(ctx,0,sizeof(struct CironContext));
     ctx->encryption_options = encryption_options;
     ctx->integrity_options = integrity_options;
+    ctx->error = CIRON_OK;
+    ctx->error_line = 0;
+    ctx->error_file = NULL;
+    ctx->error_format = NULL;
+    ctx->crypto_error = NO_CRYPTO_ERROR;
 }
 
 const char* ciron_strerror(CironError e) {
@@ -66,27 +91,201 @@ const char* ciron_strerror(CironError e) {
 	return error_strings[e];
 }
 
+/* Types of the arguments of error messages */
+#define ARG_NONE 0
+#define ARG_INT 1
+#define ARG_UINT 2
+#define ARG_LONG 3
+#define ARG_ULONG 4
+#define ARG_SIZE 5
+#define ARG_STRING 6
+
+/*
+ * Finds the next conversion in fmt, see ciron_set_error(). Returns NULL
+ * if there is none, otherwise sets *start to its '%', *type to the type
+ * of its argument and *star to whether its precision is an argument,
+ * and returns the char following it. "%%" has no argument.
+ */
+static const char *next_conversion(const char *fmt, const char **start,
+		int *type, int *star) {
+	const char *p;
+	int size = 0;
+
+	if ((p = strchr(fmt, '%')) == NULL) {
+		return NULL;
+	}
+	*start = p++;
+	*type = ARG_NONE;
+	*star = 0;
+	while (*p != '\0' && strchr("-+ #0123456789", *p) != NULL) {
+		p++;
+	}
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			*star = 1;
+			p++;
+		}
+		while (*p >= '0' && *p <= '9') {
+			p++;
+		}
+	}
+	if (*p == 'l' || *p == 'z') {
+		size = *p++;
+	}
+	switch (*p) {
+	case 'd':
+	case 'i':
+		*type = size == 'l' ? ARG_LONG : size == 'z' ? ARG_SIZE : ARG_INT;
+		break;
+	case 'u':
+	case 'x':
+		*type = size == 'l' ? ARG_ULONG : size == 'z' ? ARG_SIZE : ARG_UINT;
+		break;
+	case 's':
+		*type = ARG_STRING;
+		break;
+	case '\0':
+		return p;
+	}
+	return p + 1;
+}
+
+/*
+ * Appends len chars to the message being formatted, as far as there is
+ * room.
+ */
+static void append_error(CironContext ctx, size_t *pos, const char *chars,
+		size_t len) {
+	if (len > sizeof(ctx->error_string) - 1 - *pos) {
+		len = sizeof(ctx->error_string) - 1 - *pos;
+	}
+	memcpy(ctx->error_string + *pos, chars, len);
+	*pos += len;
+}
+
+/*
+ * Records the error only. Formatting the message costs far more than
+ * failing on an invalid token, so ciron_get_error() does it if asked.
+ */
 CironError ciron_set_error(CironContext ctx, const char *file, int line,
 		unsigned long crypto_error, CironError e, const char *fmt, ...) {
 	va_list args;
-	char buf[256];
-	va_start(args, fmt);
-	vsnprintf(ctx->error_string, sizeof(ctx->error_string), fmt, args);
-	va_end(args);
-	if (crypto_error != NO_CRYPTO_ERROR) {
-		snprintf(buf, sizeof(buf), " in %s, line %d (internal error:%ld)", file,
-				line, crypto_error);
-	} else {
-		snprintf(buf, sizeof(buf), " in %s, line %d", file, line);
-	}
-	strncat(ctx->error_string, buf,
-			sizeof(ctx->error_string) - strlen(ctx->error_string) - 1);
+	const char *p, *start, *chars;
+	size_t chars_pos = 0, len;
+	int n, type, star, precision;
+
 	ctx->error = e;
+	ctx->error_line = line;
+	ctx->error_file = file;
+	ctx->error_format = fmt;
 	ctx->crypto_error = crypto_error;
+
+	va_start(args, fmt);
+	p = fmt;
+	for (n = 0; n < CIRON_ERROR_ARGS
+			&& (p = next_conversion(p, &start, &type, &star)) != NULL; ) {
+		precision = star ? va_arg(args, int) : -1;
+		switch (type) {
+		case ARG_INT:
+			ctx->error_args[n++].l = va_arg(args, int);
+			break;
+		case ARG_UINT:
+			ctx->error_args[n++].ul = va_arg(args, unsigned int);
+			break;
+		case ARG_LONG:
+			ctx->error_args[n++].l = va_arg(args, long);
+			break;
+		case ARG_ULONG:
+			ctx->error_args[n++].ul = va_arg(args, unsigned long);
+			break;
+		case ARG_SIZE:
+			ctx->error_args[n++].z = va_arg(args, size_t);
+			break;
+		case ARG_STRING:
+			/* The last char of error_chars is left for an empty string */
+			chars = va_arg(args, const char *);
+			for (len = 0; chars_pos + len < sizeof(ctx->error_chars) - 1
+					&& (precision < 0 || len < (size_t) precision)
+					&& chars[len] != '\0'; len++) {
+			}
+			memcpy(ctx->error_chars + chars_pos, chars, len);
+			ctx->error_chars[chars_pos + len] = '\0';
+			ctx->error_args[n++].z = chars_pos;
+			chars_pos += len;
+			if (chars_pos < sizeof(ctx->error_chars) - 1) {
+				chars_pos++;
+			}
+			break;
+		}
+	}
+	va_end(args);
 	return e;
 }
 
 const char *ciron_get_error(CironContext ctx) {
+	const char *p, *next, *start;
+	char spec[16];
+	char buf[256];
+	size_t pos = 0;
+	int n = 0, type, star;
+
+	if (ctx->error_format == NULL) {
+		ctx->error_string[0] = '\0';
+		return ctx->error_string;
+	}
+	for (p = ctx->error_format; (next = next_conversion(p, &start, &type, &star))
+			!= NULL; p = next) {
+		append_error(ctx, &pos, p, start - p);
+		if (type == ARG_NONE) {
+			append_error(ctx, &pos, start + 1, start[1] == '%');
+			continue;
+		}
+		if (n == CIRON_ERROR_ARGS || (size_t) (next - start) >= sizeof(spec)) {
+			continue;
+		}
+		if (star && type != ARG_STRING) {
+			/* Not supported, the precision has not been recorded */
+			n++;
+			continue;
+		}
+		memcpy(spec, start, next - start);
+		spec[next - start] = '\0';
+		switch (type) {
+		case ARG_INT:
+			snprintf(buf, sizeof(buf), spec, (int) ctx->error_args[n].l);
+			break;
+		case ARG_UINT:
+			snprintf(buf, sizeof(buf), spec, (unsigned int) ctx->error_args[n].ul);
+			break;
+		case ARG_LONG:
+			snprintf(buf, sizeof(buf), spec, ctx->error_args[n].l);
+			break;
+		case ARG_ULONG:
+			snprintf(buf, sizeof(buf), spec, ctx->error_args[n].ul);
+			break;
+		case ARG_SIZE:
+			snprintf(buf, sizeof(buf), spec, ctx->error_args[n].z);
+			break;
+		case ARG_STRING:
+			/* The copy has the precision applied already */
+			snprintf(buf, sizeof(buf), "%s", ctx->error_chars + ctx->error_args[n].z);
+			break;
+		}
+		n++;
+		append_error(ctx, &pos, buf, strlen(buf));
+	}
+	append_error(ctx, &pos, p, strlen(p));
+
+	if (ctx->crypto_error != NO_CRYPTO_ERROR) {
+		snprintf(buf, sizeof(buf), " in %s, line %d (internal error:%lu)",
+				ctx->error_file, ctx->error_line, ctx->crypto_error);
+	} else {
+		snprintf(buf, sizeof(buf), " in %s, line %d", ctx->error_file,
+				ctx->error_line);
+	}
+	append_error(ctx, &pos, buf, strlen(buf));
+	ctx->error_string[pos] = '\0';
 	return ctx->error_string;
 }
 
@@ -94,10 +293,15 @@ CironError ciron_get_error_code(CironContext ctx) {
 	return ctx->error;
 }
 
+unsigned long ciron_get_crypto_error(CironContext ctx) {
+	return ctx->crypto_error;
+}
+
 /* Lookup 'table' for hex encoding */
 static const char hex[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
 		'a', 'b', 'c', 'd', 'e', 'f' };
-void ciron_bytes_to_hex(const unsigned char *bytes, size_t len, unsigned char *buf) {
+
+static size_t hex_scalar(const unsigned char *bytes, size_t len, unsigned char *buf) {
 	size_t j;
 	for (j = 0; j < len; j++) {
 		size_t v;
@@ -105,6 +309,173 @@ void ciron_bytes_to_hex(const unsigned char *bytes, size_t len, unsigned char *b
 		buf[j * 2] = hex[v >> 4];
 		buf[j * 2 + 1] = hex[v & 0x0F];
 	}
+	return len;
+}
+
+/*
+ * Returns the number of characters at the start of chars that are hex
+ * digits, in upper or lower case.
+ */
+static size_t hex_check_scalar(const unsigned char *chars, size_t len) {
+	size_t j;
+	for (j = 0; j < len; j++) {
+		unsigned char c = chars[j];
+		if (!(c >= '0' && c <= '9') && !((c | 0x20) >= 'a' && (c | 0x20) <= 'f')) {
+			break;
+		}
+	}
+	return j;
+}
+
+#ifdef CIRON_X86_INTRINSICS
+
+/*
+ * The SIMD kernels split every byte into its nibbles, map them to
+ * characters with a byte shuffle over the hex table and interleave the
+ * high and low nibble characters.
+ */
+
+__attribute__((target("ssse3")))
+static size_t hex_ssse3(const unsigned char *bytes, size_t len, unsigned char *buf) {
+	const __m128i table = _mm_loadu_si128((const __m128i *) hex);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	__m128i in, high, low;
+	size_t done;
+
+	for (done = 0; len - done >= 16; done += 16) {
+		in = _mm_loadu_si128((const __m128i *) (bytes + done));
+		high = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+		low = _mm_shuffle_epi8(table, _mm_and_si128(in, mask));
+		_mm_storeu_si128((__m128i *) (buf + 2 * done), _mm_unpacklo_epi8(high, low));
+		_mm_storeu_si128((__m128i *) (buf + 2 * done + 16), _mm_unpackhi_epi8(high, low));
+	}
+	return done;
+}
+
+__attribute__((target("avx2")))
+static size_t hex_avx2(const unsigned char *bytes, size_t len, unsigned char *buf) {
+	const __m256i table = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i *) hex));
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	__m256i in, high, low, first, second;
+	size_t done;
+
+	for (done = 0; len - done >= 32; done += 32) {
+		in = _mm256_loadu_si256((const __m256i *) (bytes + done));
+		high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+		low = _mm256_shuffle_epi8(table, _mm256_and_si256(in, mask));
+		/* The unpacks work per 128 bit lane, so the lanes need to be reordered */
+		first = _mm256_unpacklo_epi8(high, low);
+		second = _mm256_unpackhi_epi8(high, low);
+		_mm256_storeu_si256((__m256i *) (buf + 2 * done),
+				_mm256_permute2x128_si256(first, second, 0x20));
+		_mm256_storeu_si256((__m256i *) (buf + 2 * done + 32),
+				_mm256_permute2x128_si256(first, second, 0x31));
+	}
+	return done + hex_ssse3(bytes + done, len - done, buf + 2 * done);
+}
+
+/*
+ * The check kernels compare the characters with the digit range and,
+ * with the case bit set, with the letter range. Setting the bit maps
+ * no other character to a letter.
+ */
+
+__attribute__((target("ssse3")))
+static size_t hex_check_ssse3(const unsigned char *chars, size_t len) {
+	__m128i c, digit, letter;
+	size_t done;
+
+	for (done = 0; len - done >= 16; done += 16) {
+		c = _mm_loadu_si128((const __m128i *) (chars + done));
+		digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+				_mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+		c = _mm_or_si128(c, _mm_set1_epi8(0x20));
+		letter = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+				_mm_cmplt_epi8(c, _mm_set1_epi8('f' + 1)));
+		if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xffff) {
+			break;
+		}
+	}
+	return done;
+}
+
+__attribute__((target("avx2")))
+static size_t hex_check_avx2(const unsigned char *chars, size_t len) {
+	__m256i c, digit, letter;
+	size_t done;
+
+	for (done = 0; len - done >= 32; done += 32) {
+		c = _mm256_loadu_si256((const __m256i *) (chars + done));
+		digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+		c = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+		letter = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), c));
+		if (_mm256_movemask_epi8(_mm256_or_si256(digit, letter)) != -1) {
+			break;
+		}
+	}
+	return done + hex_check_ssse3(chars + done, len - done);
+}
+
+#endif /* CIRON_X86_INTRINSICS */
+
+/*
+ * A hex implementation encodes or checks a prefix of the data, the rest
+ * is done by the scalar code.
+ */
+struct hex_functions {
+	size_t (*encode)(const unsigned char *bytes, size_t len, unsigned char *buf);
+	size_t (*check)(const unsigned char *chars, size_t len);
+};
+
+static const struct hex_functions scalar = { hex_scalar, hex_check_scalar };
+#ifdef CIRON_X86_INTRINSICS
+static const struct hex_functions ssse3 = { hex_ssse3, hex_check_ssse3 };
+static const struct hex_functions avx2 = { hex_avx2, hex_check_avx2 };
+#endif
+
+static const struct CironImplementation hex_implementations[] = {
+#ifdef CIRON_X86_INTRINSICS
+	{ "avx2", CIRON_CPU_AVX2 | CIRON_CPU_SSSE3, &avx2 },
+	{ "ssse3", CIRON_CPU_SSSE3, &ssse3 },
+#endif
+	{ "scalar", 0, &scalar },
+	{ NULL, 0, NULL }
+};
+
+struct CironPrimitive ciron_hex_primitive = { "hex", hex_implementations, NULL };
+
+void ciron_bytes_to_hex(const unsigned char *bytes, size_t len, unsigned char *buf) {
+	const struct hex_functions *f = ciron_primitive_functions(&ciron_hex_primitive);
+	size_t done;
+
+	done = f->encode(bytes, len, buf);
+	hex_scalar(bytes + done, len - done, buf + 2 * done);
+}
+
+int ciron_hex_valid(const unsigned char *chars, size_t len) {
+	const struct hex_functions *f = ciron_primitive_functions(&ciron_hex_primitive);
+	size_t done;
+
+	done = f->check(chars, len);
+	done += hex_check_scalar(chars + done, len - done);
+	return done == len;
+}
+
+int ciron_password_id_valid(const unsigned char *id, size_t len) {
+	size_t i;
+	unsigned char c;
+
+	for (i = 0; i < len; i++) {
+		c = id[i];
+		if (!(c >= '0' && c <= '9') && !(c >= 'A' && c <= 'Z')
+				&& !(c >= 'a' && c <= 'z') && c != '_') {
+			return 0;
+		}
+	}
+	return 1;
 }
 
 
@@ -122,6 +493,19 @@ int ciron_fixed_time_equal(unsigned char *lhs, unsigned char * rhs, size_t len)
 	return equal;
 }
 
+/*
+ * 32 bit FNV-1a.
+ */
+uint32_t ciron_hash(const unsigned char *bytes, size_t len) {
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h = (h ^ bytes[i]) * 16777619u;
+	}
+	return h;
+}
+
 
 
 /** Tracing and assertion utilities below
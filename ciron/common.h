@@ -63,7 +63,7 @@ extern "C" {
 #define MAX_KEY_BYTES 32
 
 /*
- * Must match the specifications of the supplied HMAC algorithms.
+ * Must match the largest tag_bits / 8 of the supplied integrity algorithms.
  *
  */
 #define MAX_HMAC_BYTES 32
@@ -75,6 +75,11 @@ extern "C" {
  */
 #define CIPHER_BLOCK_SIZE 16
 
+/*
+ * Maximum size of the tags of AEAD algorithms.
+ */
+#define MAX_TAG_BYTES 16
+
 /** A macro to calculate byte size from number of bits.
  *
  */
@@ -99,8 +104,20 @@ struct CironAlgorithm {
 	const char* name;
 	unsigned int key_bits;
 	unsigned int iv_bits;
+	/** Size of the authentication tag of AEAD algorithms and of the MAC
+	 * of integrity algorithms, 0 for CBC algorithms.
+	 */
+	unsigned int tag_bits;
+	/** Token prefix of AEAD algorithms, which replaces the Fe26.1 one.
+	 * All prefixes have the length of MAC_PREFIX in seal.c.
+	 */
+	const char *prefix;
 };
 
+/** Evaluates to true if the algorithm encrypts and authenticates in one pass.
+ */
+#define IS_AEAD(algorithm) ((algorithm)->prefix != NULL)
+
 /** Structure for the Options typedef in ciron.h
  */
 struct CironOptions {
@@ -121,10 +138,43 @@ struct CironOptions {
 
 /**
  * Set the context error for error retrieval by the caller.
+ *
+ * Only records the format and its arguments, ciron_get_error() formats
+ * the message. The format may have up to CIRON_ERROR_ARGS conversions
+ * d, i, u, x or s, with the length modifiers l and z and, for s, the
+ * precision *. Strings are copied, up to the size of error_chars of the
+ * context in total.
  */
 CironError CIRONAPI ciron_set_error(CironContext ctx, const char *file, int line, unsigned long crypto_error,CironError e, const char *fmt, ...);
 
 
+/** Find the entry of a password table with the given password ID.
+ *
+ * Uses the index of the table if it has one, otherwise compares the ID
+ * with every entry. Returns NULL if there is no entry with the ID.
+ */
+CironPwdTableEntry ciron_pwd_table_find(CironIndexedPwdTable indexed,
+		const unsigned char *id, size_t len);
+
+/** Set up indexed to look up the entries of a plain password table
+ * without index, by comparing the ID with every entry.
+ */
+void ciron_pwd_table_unindexed(CironIndexedPwdTable indexed, CironPwdTable table);
+
+/** Number of items the batch functions of seal.c work on at a time, so
+ * that their state fits on the stack. The multi-buffer SHA implementations
+ * have at most 16 lanes and every item needs two key derivations.
+ */
+#define CIRON_BATCH_ITEMS 16
+
+/** Unseal a chunk of at most CIRON_BATCH_ITEMS items with the sealer.
+ *
+ * Sets the error and result length of every item. The key derivations
+ * and HMACs of the items are done in one call each.
+ */
+void ciron_unseal_chunk(CironContext context, CironSealer sealer,
+		CironBatchItem items, size_t n);
+
 /** Turn an unsigned char array into an array of hex-encoded bytes.
  *
  * The result will encode each bye as a two-chars hex value (00 to ff)
@@ -137,6 +187,19 @@ CironError CIRONAPI ciron_set_error(CironContext ctx, const char *file, int line
  */
 void CIRONAPI ciron_bytes_to_hex(const unsigned char *bytes, size_t len, unsigned char *buf);
 
+/** Check that the given chars are hex digits.
+ *
+ * Return 1 if all len chars are 0 to 9, a to f or A to F, 0 otherwise.
+ */
+int CIRONAPI ciron_hex_valid(const unsigned char *chars, size_t len);
+
+/** Check that the given chars are a valid password ID.
+ *
+ * Return 1 if all len chars are word characters (0 to 9, A to Z, a to z
+ * or _), as iron requires, 0 otherwise. The empty ID is valid.
+ */
+int CIRONAPI ciron_password_id_valid(const unsigned char *id, size_t len);
+
 /** Fixed time byte-wise comparison.
  *
  * Return 1 if the supplied byte sequences are byte-wise equal, 0 otherwise.
@@ -144,6 +207,10 @@ void CIRONAPI ciron_bytes_to_hex(const unsigned char *bytes, size_t len, unsigne
 int ciron_fixed_time_equal(unsigned char *lhs, unsigned char * rhs, size_t len);
 
 
+/** Hash of a byte sequence for hash tables, not for cryptographic use.
+ */
+uint32_t ciron_hash(const unsigned char *bytes, size_t len);
+
 /** The remainder of this header file defines utilities for
  * tracing and assertions thathave been used throughout development and
  * debugging.
@@ -0,0 +1,62 @@
+#include <pthread.h>
+#include "cpu.h"
+
+#ifdef CIRON_X86_INTRINSICS
+#include <cpuid.h>
+#endif
+
+static unsigned int features;
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+
+static void detect(void) {
+#ifdef CIRON_X86_INTRINSICS
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int xcr0_lo, xcr0_hi;
+	int os_avx = 0;
+	int os_avx512 = 0;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return;
+	}
+	if (ecx & bit_SSSE3) {
+		features |= CIRON_CPU_SSSE3;
+	}
+	if (ecx & bit_SSE4_1) {
+		features |= CIRON_CPU_SSE41;
+	}
+	if (ecx & bit_AES) {
+		features |= CIRON_CPU_AESNI;
+	}
+	if (ecx & bit_PCLMUL) {
+		features |= CIRON_CPU_PCLMUL;
+	}
+	/*
+	 * AVX registers may only be used if the OS saves them on context
+	 * switches, which it signals through XCR0.
+	 */
+	if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+		__asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+		os_avx = (xcr0_lo & 0x6) == 0x6;
+		/* AVX-512 also needs the opmask and upper ZMM registers saved */
+		os_avx512 = (xcr0_lo & 0xe6) == 0xe6;
+	}
+	if (__get_cpuid_max(0, NULL) < 7) {
+		return;
+	}
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if (ebx & bit_SHA) {
+		features |= CIRON_CPU_SHA;
+	}
+	if (os_avx && (ebx & bit_AVX2)) {
+		features |= CIRON_CPU_AVX2;
+	}
+	if (os_avx512 && (ebx & bit_AVX512F)) {
+		features |= CIRON_CPU_AVX512;
+	}
+#endif
+}
+
+unsigned int ciron_cpu_features(void) {
+	pthread_once(&detect_once, detect);
+	return features;
+}
@@ -0,0 +1,41 @@
+#ifndef CIRON_CPU_H
+#define CIRON_CPU_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Defined if the compiler can generate code for x86 instruction set
+ * extensions on a per-function basis.
+ *
+ * Such functions are compiled with __attribute__((target(...))) and must
+ * only be called after ciron_cpu_features() reported the extension to be
+ * available on the running CPU.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CIRON_X86_INTRINSICS 1
+#endif
+
+/** CPU feature flags returned by ciron_cpu_features().
+ */
+#define CIRON_CPU_SSSE3  0x01
+#define CIRON_CPU_SSE41  0x02
+#define CIRON_CPU_AESNI  0x04
+#define CIRON_CPU_SHA    0x08
+#define CIRON_CPU_AVX2   0x10
+#define CIRON_CPU_AVX512 0x20
+#define CIRON_CPU_PCLMUL 0x40
+
+/** Returns the instruction set extensions of the running CPU as a
+ * combination of the CIRON_CPU_* flags.
+ *
+ * Returns 0 on CPUs other than x86 or when the library has been compiled
+ * without CIRON_X86_INTRINSICS.
+ */
+unsigned int ciron_cpu_features(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_CPU_H */
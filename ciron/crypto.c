@@ -0,0 +1,281 @@
+/*
+ * This file implements the functions declared in crypto.h by calling
+ * the crypto implementation selected through the registry.
+ */
+#include <errno.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "crypto.h"
+#include "random.h"
+#include "registry.h"
+
+/*
+ * The native implementation is only preferred over libcrypto if the CPU
+ * can run it with AES-NI and the SHA extensions.
+ */
+static const struct CironImplementation implementations[] = {
+	{ "native", CIRON_CPU_AESNI | CIRON_CPU_SHA | CIRON_CPU_SSE41 | CIRON_CPU_SSSE3,
+			&ciron_crypto_native },
+#ifdef HAVE_LIBCRYPTO
+	{ "openssl", 0, &ciron_crypto_openssl },
+#endif
+	{ "native", 0, &ciron_crypto_native },
+	{ NULL, 0, NULL }
+};
+
+struct CironPrimitive ciron_crypto_primitive = { "crypto", implementations, NULL };
+
+static const struct CironCryptoFunctions *selected(void) {
+	return ciron_primitive_functions(&ciron_crypto_primitive);
+}
+
+/*
+ * Salts and IVs do not depend on the crypto implementation, they come
+ * from the random pool (random.h).
+ */
+CironError ciron_generate_salt(CironContext context, size_t nbytes,
+		unsigned char *buf) {
+	unsigned char salt_bytes[MAX_SALT_BYTES];
+	assert(nbytes <= MAX_SALT_BYTES);
+
+	if (ciron_random_bytes(salt_bytes, nbytes) != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, errno,
+				CIRON_CRYPTO_ERROR, "Unable to get %zu random bytes", nbytes);
+	}
+	ciron_bytes_to_hex(salt_bytes, nbytes, buf);
+
+	return CIRON_OK;
+}
+
+CironError ciron_generate_iv(CironContext context, size_t nbytes,
+		unsigned char *buf) {
+	if (ciron_random_bytes(buf, nbytes) != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, errno,
+				CIRON_CRYPTO_ERROR, "Unable to get %zu random bytes", nbytes);
+	}
+
+	return CIRON_OK;
+}
+
+CironError ciron_password_prepare(CironContext context,
+		const unsigned char *password, size_t password_len,
+		CironPreparedPassword prepared) {
+	return selected()->password_prepare(context, password, password_len, prepared);
+}
+
+CironError ciron_generate_key(CironContext context,
+		const unsigned char* password, size_t password_len,
+		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+		unsigned int iterations, unsigned char *buf) {
+	return selected()->generate_key(context, password, password_len, salt,
+			salt_len, algorithm, iterations, buf);
+}
+
+CironError ciron_generate_key_prepared(CironContext context,
+		CironPreparedPassword password,
+		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+		unsigned int iterations, unsigned char *buf) {
+	return selected()->generate_key_prepared(context, password, salt, salt_len,
+			algorithm, iterations, buf);
+}
+
+CironError ciron_encrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	return selected()->encrypt(context, algorithm, key, iv, data, data_len, buf,
+			sizep);
+}
+
+CironError ciron_decrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	return selected()->decrypt(context, algorithm, key, iv, data, data_len, buf,
+			sizep);
+}
+
+CironError ciron_aead_encrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag) {
+	return selected()->aead_encrypt(context, algorithm, key, iv, aad, aad_len,
+			data, data_len, buf, tag);
+}
+
+CironError ciron_aead_decrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf) {
+	return selected()->aead_decrypt(context, algorithm, key, iv, aad, aad_len,
+			data, data_len, tag, buf);
+}
+
+CironError ciron_hmac(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *password, size_t password_len,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	return selected()->hmac(context, algorithm, password, password_len,
+			salt_bytes, salt_len, iterations, data, data_len, result, result_len);
+}
+
+CironError ciron_hmac_prepared(CironContext context, CironAlgorithm algorithm,
+		CironPreparedPassword password,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	return selected()->hmac_prepared(context, algorithm, password, salt_bytes,
+			salt_len, iterations, data, data_len, result, result_len);
+}
+
+CironError ciron_cipher_new(CironContext context, CironAlgorithm algorithm,
+		struct CironCipher **cipherp) {
+	return selected()->cipher_new(context, algorithm, cipherp);
+}
+
+void ciron_cipher_free(struct CironCipher *cipher) {
+	if (cipher != NULL) {
+		cipher->functions->cipher_free(cipher);
+	}
+}
+
+CironError ciron_cipher_encrypt(CironContext context, struct CironCipher *cipher,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	return cipher->functions->cipher_encrypt(context, cipher, key, iv, data,
+			data_len, buf, sizep);
+}
+
+CironError ciron_cipher_decrypt(CironContext context, struct CironCipher *cipher,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	return cipher->functions->cipher_decrypt(context, cipher, key, iv, data,
+			data_len, buf, sizep);
+}
+
+CironError ciron_cipher_encrypt_init(CironContext context,
+		struct CironCipher *cipher, const unsigned char *key, const unsigned char *iv) {
+	return cipher->functions->cipher_encrypt_init(context, cipher, key, iv);
+}
+
+CironError ciron_cipher_encrypt_update(CironContext context,
+		struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+		unsigned char *buf) {
+	return cipher->functions->cipher_encrypt_update(context, cipher, data,
+			data_len, buf);
+}
+
+CironError ciron_cipher_encrypt_final(CironContext context,
+		struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep) {
+	return cipher->functions->cipher_encrypt_final(context, cipher, data,
+			data_len, buf, sizep);
+}
+
+CironError ciron_cipher_decrypt_init(CironContext context,
+		struct CironCipher *cipher, const unsigned char *key, const unsigned char *iv) {
+	return cipher->functions->cipher_decrypt_init(context, cipher, key, iv);
+}
+
+CironError ciron_cipher_decrypt_update(CironContext context,
+		struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep) {
+	return cipher->functions->cipher_decrypt_update(context, cipher, data,
+			data_len, buf, sizep);
+}
+
+CironError ciron_cipher_decrypt_final(CironContext context,
+		struct CironCipher *cipher, unsigned char *buf, size_t *sizep) {
+	return cipher->functions->cipher_decrypt_final(context, cipher, buf, sizep);
+}
+
+CironError ciron_mac_new(CironContext context, CironAlgorithm algorithm,
+		struct CironMac **macp) {
+	return selected()->mac_new(context, algorithm, macp);
+}
+
+void ciron_mac_free(struct CironMac *mac) {
+	if (mac != NULL) {
+		mac->functions->mac_free(mac);
+	}
+}
+
+CironError ciron_mac(CironContext context, struct CironMac *mac,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	return mac->functions->mac(context, mac, key, key_len, data, data_len, result,
+			result_len);
+}
+
+CironError ciron_mac_init(CironContext context, struct CironMac *mac,
+		const unsigned char *key, size_t key_len) {
+	return mac->functions->mac_init(context, mac, key, key_len);
+}
+
+CironError ciron_mac_update(CironContext context, struct CironMac *mac,
+		const unsigned char *data, size_t data_len) {
+	return mac->functions->mac_update(context, mac, data, data_len);
+}
+
+CironError ciron_mac_final(CironContext context, struct CironMac *mac,
+		unsigned char *result, size_t *result_len) {
+	return mac->functions->mac_final(context, mac, result, result_len);
+}
+
+CironError ciron_generate_keys_prepared(CironContext context,
+		struct CironKeyJob *jobs, size_t njobs) {
+	const struct CironCryptoFunctions *f = selected();
+	CironError e;
+	size_t i;
+
+	if (f->generate_keys_prepared != NULL) {
+		return f->generate_keys_prepared(context, jobs, njobs);
+	}
+	for (i = 0; i < njobs; i++) {
+		if ((e = f->generate_key_prepared(context, jobs[i].password, jobs[i].salt,
+				jobs[i].salt_len, jobs[i].algorithm, jobs[i].iterations,
+				jobs[i].key)) != CIRON_OK) {
+			return e;
+		}
+	}
+	return CIRON_OK;
+}
+
+CironError ciron_mac_batch(CironContext context, struct CironMac *mac,
+		struct CironMacJob *jobs, size_t njobs) {
+	CironError e;
+	size_t i;
+
+	if (mac->functions->mac_batch != NULL) {
+		return mac->functions->mac_batch(context, mac, jobs, njobs);
+	}
+	for (i = 0; i < njobs; i++) {
+		if ((e = mac->functions->mac(context, mac, jobs[i].key, jobs[i].key_len,
+				jobs[i].data, jobs[i].data_len, jobs[i].result,
+				&jobs[i].result_len)) != CIRON_OK) {
+			return e;
+		}
+	}
+	return CIRON_OK;
+}
+
+CironError ciron_cipher_encrypt_batch(CironContext context,
+		struct CironCipher *cipher, struct CironCipherJob *jobs, size_t njobs) {
+	CironError e;
+	size_t i;
+
+	if (cipher->functions->cipher_encrypt_batch != NULL) {
+		return cipher->functions->cipher_encrypt_batch(context, cipher, jobs, njobs);
+	}
+	for (i = 0; i < njobs; i++) {
+		if ((e = cipher->functions->cipher_encrypt(context, cipher, jobs[i].key,
+				jobs[i].iv, jobs[i].data, jobs[i].data_len, jobs[i].buf,
+				&jobs[i].len)) != CIRON_OK) {
+			return e;
+		}
+	}
+	return CIRON_OK;
+}
@@ -54,6 +54,19 @@ CironError CIRONAPI ciron_generate_key(CironContext context,
 		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
 		unsigned int iterations, unsigned char *buf);
 
+/** Generate a key using the provided prepared password, salt, and
+ * iterations.
+ *
+ * Produces the same key as ciron_generate_key() would for the password
+ * that has been passed to ciron_password_prepare(), but resumes the
+ * PBKDF2 HMAC-SHA1 computations from the prepared states instead of
+ * hashing the password again.
+ */
+CironError CIRONAPI ciron_generate_key_prepared(CironContext context,
+		CironPreparedPassword password,
+		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+		unsigned int iterations, unsigned char *buf);
+
 /** Encrypt the provided data using the specified algorithm.
  *
  * This function encrypts the provided data and stores the
@@ -112,6 +125,34 @@ CironError CIRONAPI ciron_decrypt(CironContext context, CironAlgorithm algorithm
 		const unsigned char *key, const unsigned char *iv,
 		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep);
 
+/** Encrypt data with an AEAD algorithm (see IS_AEAD() in common.h) and
+ * authenticate it together with aad.
+ *
+ * The key has NBYTES(algorithm->key_bits) bytes and the IV
+ * NBYTES(algorithm->iv_bits). buf receives data_len bytes of encrypted
+ * data and tag NBYTES(algorithm->tag_bits) bytes of authentication tag.
+ *
+ * Returns CIRON_ERROR_UNKNOWN_ALGORITHM if the algorithm is not an AEAD
+ * algorithm or not supported by the crypto implementation.
+ */
+CironError CIRONAPI ciron_aead_encrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag);
+
+/** Check the tag of data and aad and decrypt data with an AEAD algorithm.
+ *
+ * buf receives data_len bytes of decrypted data. Returns
+ * CIRON_TOKEN_VALIDATION_ERROR if the tag does not match, buf holds no
+ * decrypted data in that case.
+ */
+CironError CIRONAPI ciron_aead_decrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf);
+
 
 /** Calculates an HMAC from the provided data using password, salt,
  * algorithm, and iterations.
@@ -137,6 +178,287 @@ CironError CIRONAPI ciron_hmac(CironContext context, CironAlgorithm algorithm,
 		const unsigned char *data, size_t data_len, unsigned char *result,
 		size_t *result_len);
 
+/** Calculates an HMAC like ciron_hmac() but derives the HMAC key from
+ * a prepared password.
+ */
+CironError CIRONAPI ciron_hmac_prepared(CironContext context, CironAlgorithm algorithm,
+		CironPreparedPassword password,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len);
+
+/*
+ * The functions below support CironSealer. They operate on cipher and
+ * MAC state objects whose layout is private to the crypto implementation.
+ * The algorithm of such an object is resolved once when it is created,
+ * the underlying contexts are reused for every operation.
+ */
+
+/** Common beginning of the cipher and MAC objects of all crypto
+ * implementations, which extend them with their own state.
+ *
+ * An object remembers the implementation that created it, so it keeps
+ * working if another implementation is selected afterwards.
+ */
+struct CironCipher {
+	const struct CironCryptoFunctions *functions;
+};
+
+struct CironMac {
+	const struct CironCryptoFunctions *functions;
+};
+
+/** Create a cipher object for the given encryption algorithm.
+ *
+ * Returns CIRON_ERROR_UNKNOWN_ALGORITHM if the algorithm is not
+ * supported.
+ */
+CironError CIRONAPI ciron_cipher_new(CironContext context, CironAlgorithm algorithm,
+		struct CironCipher **cipherp);
+
+/** Release a cipher object. Accepts NULL.
+ */
+void CIRONAPI ciron_cipher_free(struct CironCipher *cipher);
+
+/** Encrypt like ciron_encrypt() using the algorithm and context of the cipher object.
+ */
+CironError CIRONAPI ciron_cipher_encrypt(CironContext context, struct CironCipher *cipher,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep);
+
+/** Decrypt like ciron_decrypt() using the algorithm and context of the cipher object.
+ */
+CironError CIRONAPI ciron_cipher_decrypt(CironContext context, struct CironCipher *cipher,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep);
+
+/** Encrypt like ciron_cipher_encrypt(), but in parts.
+ *
+ * ciron_cipher_encrypt_init() sets key and IV. Every following
+ * ciron_cipher_encrypt_update() encrypts data_len bytes, a multiple of
+ * CIPHER_BLOCK_SIZE, to as many bytes in buf. ciron_cipher_encrypt_final()
+ * encrypts the rest of the data with the padding, which makes *sizep the
+ * next multiple of CIPHER_BLOCK_SIZE above data_len. Together the parts
+ * are the same as ciron_cipher_encrypt() of the whole data.
+ */
+CironError CIRONAPI ciron_cipher_encrypt_init(CironContext context,
+		struct CironCipher *cipher, const unsigned char *key, const unsigned char *iv);
+CironError CIRONAPI ciron_cipher_encrypt_update(CironContext context,
+		struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+		unsigned char *buf);
+CironError CIRONAPI ciron_cipher_encrypt_final(CironContext context,
+		struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep);
+
+/** Decrypt like ciron_cipher_decrypt(), but in parts.
+ *
+ * ciron_cipher_decrypt_init() sets key and IV. Every following
+ * ciron_cipher_decrypt_update() decrypts data_len bytes, a multiple of
+ * CIPHER_BLOCK_SIZE, and stores the plaintext known so far to buf,
+ * *sizep bytes. The last block, which holds the padding, is kept back
+ * until ciron_cipher_decrypt_final() checks and removes the padding and
+ * stores the rest of the plaintext to buf.
+ */
+CironError CIRONAPI ciron_cipher_decrypt_init(CironContext context,
+		struct CironCipher *cipher, const unsigned char *key, const unsigned char *iv);
+CironError CIRONAPI ciron_cipher_decrypt_update(CironContext context,
+		struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep);
+CironError CIRONAPI ciron_cipher_decrypt_final(CironContext context,
+		struct CironCipher *cipher, unsigned char *buf, size_t *sizep);
+
+/** Create a MAC object for the given integrity algorithm.
+ *
+ * Returns CIRON_ERROR_UNKNOWN_ALGORITHM if the algorithm is not
+ * supported.
+ */
+CironError CIRONAPI ciron_mac_new(CironContext context, CironAlgorithm algorithm,
+		struct CironMac **macp);
+
+/** Release a MAC object. Accepts NULL.
+ */
+void CIRONAPI ciron_mac_free(struct CironMac *mac);
+
+/** Calculate the MAC of data with an already derived key.
+ *
+ * Unlike ciron_hmac() this does not derive the key from a password.
+ */
+CironError CIRONAPI ciron_mac(CironContext context, struct CironMac *mac,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len);
+
+/** Calculate a MAC like ciron_mac(), but of data passed in parts to any
+ * number of calls of ciron_mac_update().
+ */
+CironError CIRONAPI ciron_mac_init(CironContext context, struct CironMac *mac,
+		const unsigned char *key, size_t key_len);
+CironError CIRONAPI ciron_mac_update(CironContext context, struct CironMac *mac,
+		const unsigned char *data, size_t data_len);
+CironError CIRONAPI ciron_mac_final(CironContext context, struct CironMac *mac,
+		unsigned char *result, size_t *result_len);
+
+/*
+ * The functions below support ciron_sealer_seal_batch() and
+ * ciron_sealer_unseal_batch(). An implementation can process the jobs of
+ * a batch together; the native one hashes them side by side with the
+ * multi-buffer SHA functions (see sha_mb.h) and interleaves the AES-CBC
+ * encryptions (see aes.h). For implementations without batch support the
+ * jobs are processed one by one.
+ */
+
+/** A key derivation for ciron_generate_keys_prepared().
+ */
+struct CironKeyJob {
+	CironPreparedPassword password;
+	const unsigned char *salt;
+	size_t salt_len;
+	CironAlgorithm algorithm;
+	unsigned int iterations;
+	/** Receives NBYTES(algorithm->key_bits) bytes of key */
+	unsigned char *key;
+};
+
+/** Derive the keys of all jobs like ciron_generate_key_prepared().
+ */
+CironError CIRONAPI ciron_generate_keys_prepared(CironContext context,
+		struct CironKeyJob *jobs, size_t njobs);
+
+/** A MAC calculation for ciron_mac_batch().
+ */
+struct CironMacJob {
+	const unsigned char *key;
+	size_t key_len;
+	const unsigned char *data;
+	size_t data_len;
+	/** Receives the MAC, which has at most MAX_HMAC_BYTES */
+	unsigned char *result;
+	size_t result_len;
+};
+
+/** Calculate the MACs of all jobs like ciron_mac().
+ */
+CironError CIRONAPI ciron_mac_batch(CironContext context, struct CironMac *mac,
+		struct CironMacJob *jobs, size_t njobs);
+
+/** An encryption for ciron_cipher_encrypt_batch().
+ */
+struct CironCipherJob {
+	const unsigned char *key;
+	const unsigned char *iv;
+	const unsigned char *data;
+	size_t data_len;
+	/** Receives the encrypted data, see ciron_calculate_encryption_buffer_length() */
+	unsigned char *buf;
+	size_t len;
+};
+
+/** Encrypt the data of all jobs like ciron_cipher_encrypt().
+ */
+CironError CIRONAPI ciron_cipher_encrypt_batch(CironContext context,
+		struct CironCipher *cipher, struct CironCipherJob *jobs, size_t njobs);
+
+/** The functions of a crypto implementation.
+ *
+ * The functions declared above, and ciron_password_prepare() declared in
+ * ciron.h, call the ones of the implementation selected for the "crypto"
+ * primitive (see registry.h). To add an implementation, provide such a
+ * table and add it to the list in crypto.c. The batch functions are
+ * optional and may be NULL.
+ */
+struct CironCryptoFunctions {
+	CironError (*password_prepare)(CironContext context,
+			const unsigned char *password, size_t password_len,
+			CironPreparedPassword prepared);
+	CironError (*generate_key)(CironContext context,
+			const unsigned char* password, size_t password_len,
+			const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+			unsigned int iterations, unsigned char *buf);
+	CironError (*generate_key_prepared)(CironContext context,
+			CironPreparedPassword password,
+			const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+			unsigned int iterations, unsigned char *buf);
+	CironError (*encrypt)(CironContext context, CironAlgorithm algorithm,
+			const unsigned char *key, const unsigned char *iv,
+			const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep);
+	CironError (*decrypt)(CironContext context, CironAlgorithm algorithm,
+			const unsigned char *key, const unsigned char *iv,
+			const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep);
+	CironError (*aead_encrypt)(CironContext context, CironAlgorithm algorithm,
+			const unsigned char *key, const unsigned char *iv,
+			const unsigned char *aad, size_t aad_len,
+			const unsigned char *data, size_t data_len, unsigned char *buf,
+			unsigned char *tag);
+	CironError (*aead_decrypt)(CironContext context, CironAlgorithm algorithm,
+			const unsigned char *key, const unsigned char *iv,
+			const unsigned char *aad, size_t aad_len,
+			const unsigned char *data, size_t data_len, const unsigned char *tag,
+			unsigned char *buf);
+	CironError (*hmac)(CironContext context, CironAlgorithm algorithm,
+			const unsigned char *password, size_t password_len,
+			const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+			const unsigned char *data, size_t data_len, unsigned char *result,
+			size_t *result_len);
+	CironError (*hmac_prepared)(CironContext context, CironAlgorithm algorithm,
+			CironPreparedPassword password,
+			const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+			const unsigned char *data, size_t data_len, unsigned char *result,
+			size_t *result_len);
+	CironError (*cipher_new)(CironContext context, CironAlgorithm algorithm,
+			struct CironCipher **cipherp);
+	void (*cipher_free)(struct CironCipher *cipher);
+	CironError (*cipher_encrypt)(CironContext context, struct CironCipher *cipher,
+			const unsigned char *key, const unsigned char *iv,
+			const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep);
+	CironError (*cipher_decrypt)(CironContext context, struct CironCipher *cipher,
+			const unsigned char *key, const unsigned char *iv,
+			const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep);
+	CironError (*cipher_encrypt_init)(CironContext context,
+			struct CironCipher *cipher, const unsigned char *key,
+			const unsigned char *iv);
+	CironError (*cipher_encrypt_update)(CironContext context,
+			struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+			unsigned char *buf);
+	CironError (*cipher_encrypt_final)(CironContext context,
+			struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+			unsigned char *buf, size_t *sizep);
+	CironError (*cipher_decrypt_init)(CironContext context,
+			struct CironCipher *cipher, const unsigned char *key,
+			const unsigned char *iv);
+	CironError (*cipher_decrypt_update)(CironContext context,
+			struct CironCipher *cipher, const unsigned char *data, size_t data_len,
+			unsigned char *buf, size_t *sizep);
+	CironError (*cipher_decrypt_final)(CironContext context,
+			struct CironCipher *cipher, unsigned char *buf, size_t *sizep);
+	CironError (*mac_new)(CironContext context, CironAlgorithm algorithm,
+			struct CironMac **macp);
+	void (*mac_free)(struct CironMac *mac);
+	CironError (*mac)(CironContext context, struct CironMac *mac,
+			const unsigned char *key, size_t key_len,
+			const unsigned char *data, size_t data_len, unsigned char *result,
+			size_t *result_len);
+	CironError (*mac_init)(CironContext context, struct CironMac *mac,
+			const unsigned char *key, size_t key_len);
+	CironError (*mac_update)(CironContext context, struct CironMac *mac,
+			const unsigned char *data, size_t data_len);
+	CironError (*mac_final)(CironContext context, struct CironMac *mac,
+			unsigned char *result, size_t *result_len);
+	CironError (*generate_keys_prepared)(CironContext context,
+			struct CironKeyJob *jobs, size_t njobs);
+	CironError (*mac_batch)(CironContext context, struct CironMac *mac,
+			struct CironMacJob *jobs, size_t njobs);
+	CironError (*cipher_encrypt_batch)(CironContext context,
+			struct CironCipher *cipher, struct CironCipherJob *jobs, size_t njobs);
+};
+
+/** Implementation in crypto_native.c, always available. */
+extern const struct CironCryptoFunctions ciron_crypto_native;
+
+#ifdef HAVE_LIBCRYPTO
+/** Implementation in crypto_openssl.c or crypto_openssl3.c. */
+extern const struct CironCryptoFunctions ciron_crypto_openssl;
+#endif
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
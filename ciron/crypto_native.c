@@ -0,0 +1,1093 @@
+/*
+ * This file provides the crypto implementation "native" (see crypto.c),
+ * which needs no external crypto library.
+ *
+ * iron only needs AES-CBC, PBKDF2 with HMAC-SHA1 and HMAC-SHA256, all on
+ * small inputs of known shape. These are implemented directly on top of
+ * the AES and SHA compression functions in aes.c and sha.c, which use
+ * AES-NI and the SHA extensions where the CPU has them. The AEAD
+ * algorithms come from aead.c, keyed BLAKE3 from blake3.c.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "crypto.h"
+#include "aead.h"
+#include "aes.h"
+#include "blake3.h"
+#include "sha.h"
+#include "sha_mb.h"
+
+/*
+ * Overwrites secrets. The volatile pointer keeps the compiler from
+ * removing the stores to memory that is not read afterwards.
+ */
+static void cleanse(void *p, size_t len) {
+	volatile unsigned char *v = p;
+
+	while (len-- > 0) {
+		*v++ = 0;
+	}
+}
+
+static void store_be32(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char) (v >> 24);
+	p[1] = (unsigned char) (v >> 16);
+	p[2] = (unsigned char) (v >> 8);
+	p[3] = (unsigned char) v;
+}
+
+
+/*
+ * Maps an encryption algorithm to its AES key size.
+ */
+static CironError lookup_cipher(CironContext context, CironAlgorithm algorithm,
+		const char *purpose, unsigned int *key_bitsp) {
+	if (strcmp(algorithm->name, CIRON_AES_128_CBC->name) == 0) {
+		*key_bitsp = 128;
+	} else if (strcmp(algorithm->name, CIRON_AES_256_CBC->name) == 0) {
+		*key_bitsp = 256;
+	} else {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for %s", algorithm->name, purpose);
+	}
+	return CIRON_OK;
+}
+
+/*
+ * AES-CBC encryption with PKCS#7 padding. The result is always at least
+ * one byte and at most one block longer than the data.
+ */
+static CironError encrypt_padded(CironContext context, unsigned int key_bits,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		size_t *sizep) {
+	struct CironAesKey k;
+	unsigned char chain[CIRON_AES_BLOCK_BYTES];
+	unsigned char last[CIRON_AES_BLOCK_BYTES];
+	size_t full;
+	size_t rest;
+
+	ciron_aes_set_key(&k, key, key_bits);
+	memcpy(chain, iv, CIRON_AES_BLOCK_BYTES);
+
+	full = data_len / CIRON_AES_BLOCK_BYTES;
+	rest = data_len % CIRON_AES_BLOCK_BYTES;
+	ciron_aes_cbc_encrypt(&k, chain, data, buf, full);
+
+	memcpy(last, data + full * CIRON_AES_BLOCK_BYTES, rest);
+	memset(last + rest, (int) (CIRON_AES_BLOCK_BYTES - rest),
+			CIRON_AES_BLOCK_BYTES - rest);
+	ciron_aes_cbc_encrypt(&k, chain, last, buf + full * CIRON_AES_BLOCK_BYTES, 1);
+
+	*sizep = (full + 1) * CIRON_AES_BLOCK_BYTES;
+	cleanse(&k, sizeof(k));
+	cleanse(last, sizeof(last));
+	return CIRON_OK;
+}
+
+/*
+ * AES-CBC decryption removing the PKCS#7 padding.
+ */
+static CironError decrypt_padded(CironContext context, unsigned int key_bits,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		size_t *sizep) {
+	struct CironAesKey k;
+	unsigned char chain[CIRON_AES_BLOCK_BYTES];
+	unsigned int pad;
+	unsigned int bad;
+	unsigned int i;
+
+	if (data_len == 0 || data_len % CIRON_AES_BLOCK_BYTES != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Unable to decrypt, data len %zu is not a multiple of the block size",
+				data_len);
+	}
+	ciron_aes_set_key(&k, key, key_bits);
+	memcpy(chain, iv, CIRON_AES_BLOCK_BYTES);
+	ciron_aes_cbc_decrypt(&k, chain, data, buf, data_len / CIRON_AES_BLOCK_BYTES);
+	cleanse(&k, sizeof(k));
+
+	pad = buf[data_len - 1];
+	bad = (pad == 0 || pad > CIRON_AES_BLOCK_BYTES);
+	for (i = 1; !bad && i <= pad; i++) {
+		bad |= (buf[data_len - i] != pad);
+	}
+	if (bad) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unable to decrypt, bad padding");
+	}
+	*sizep = data_len - pad;
+	return CIRON_OK;
+}
+
+static CironError native_encrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	CironError e;
+	unsigned int key_bits = 0;
+
+	if ((e = lookup_cipher(context, algorithm, "encryption", &key_bits)) != CIRON_OK) {
+		return e;
+	}
+	return encrypt_padded(context, key_bits, key, iv, data, data_len, buf, sizep);
+}
+
+static CironError native_decrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	CironError e;
+	unsigned int key_bits = 0;
+
+	if ((e = lookup_cipher(context, algorithm, "decryption", &key_bits)) != CIRON_OK) {
+		return e;
+	}
+	return decrypt_padded(context, key_bits, key, iv, data, data_len, buf, sizep);
+}
+
+static CironError native_aead_encrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag) {
+	if (strcmp(algorithm->name, CIRON_AES_256_GCM->name) == 0) {
+		ciron_aes_gcm_encrypt(key, 256, iv, aad, aad_len, data, data_len, buf, tag);
+	} else if (strcmp(algorithm->name, CIRON_CHACHA20_POLY1305->name) == 0) {
+		ciron_chacha20_poly1305_encrypt(key, iv, aad, aad_len, data, data_len, buf, tag);
+	} else {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for AEAD encryption", algorithm->name);
+	}
+	return CIRON_OK;
+}
+
+static CironError native_aead_decrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf) {
+	int r;
+
+	if (strcmp(algorithm->name, CIRON_AES_256_GCM->name) == 0) {
+		r = ciron_aes_gcm_decrypt(key, 256, iv, aad, aad_len, data, data_len, tag, buf);
+	} else if (strcmp(algorithm->name, CIRON_CHACHA20_POLY1305->name) == 0) {
+		r = ciron_chacha20_poly1305_decrypt(key, iv, aad, aad_len, data, data_len,
+				tag, buf);
+	} else {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for AEAD decryption", algorithm->name);
+	}
+	if (r != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_VALIDATION_ERROR, "Authentication tag does not match");
+	}
+	return CIRON_OK;
+}
+
+static CironError native_password_prepare(CironContext context,
+		const unsigned char *password, size_t password_len,
+		CironPreparedPassword prepared) {
+	struct CironSha1 c;
+	unsigned char key[CIRON_SHA_BLOCK_BYTES];
+	unsigned char pad[CIRON_SHA_BLOCK_BYTES];
+	size_t i;
+
+	/*
+	 * HMAC keys longer than the block size are hashed first, shorter
+	 * ones are padded with zeros (RFC 2104).
+	 */
+	memset(key, 0, sizeof(key));
+	if (password_len > CIRON_SHA_BLOCK_BYTES) {
+		ciron_sha1_init(&c);
+		ciron_sha1_update(&c, password, password_len);
+		ciron_sha1_final(&c, key);
+	} else if (password_len > 0) {
+		memcpy(key, password, password_len);
+	}
+
+	ciron_sha1_init(&c);
+	for (i = 0; i < CIRON_SHA_BLOCK_BYTES; i++) {
+		pad[i] = key[i] ^ 0x36;
+	}
+	memcpy(prepared->inner_state, c.state, sizeof(c.state));
+	ciron_sha1_blocks(prepared->inner_state, pad, 1);
+
+	for (i = 0; i < CIRON_SHA_BLOCK_BYTES; i++) {
+		pad[i] = key[i] ^ 0x5c;
+	}
+	memcpy(prepared->outer_state, c.state, sizeof(c.state));
+	ciron_sha1_blocks(prepared->outer_state, pad, 1);
+
+	cleanse(key, sizeof(key));
+	cleanse(pad, sizeof(pad));
+	cleanse(&c, sizeof(c));
+
+	return CIRON_OK;
+}
+
+/*
+ * Finishes an HMAC-SHA1 from the inner hash state: hashes the inner
+ * digest with the outer state into result.
+ */
+static void hmac_sha1_outer(CironPreparedPassword password,
+		struct CironSha1 *c, unsigned char *result) {
+	unsigned char inner[CIRON_SHA1_DIGEST_BYTES];
+
+	ciron_sha1_final(c, inner);
+	ciron_sha1_resume(c, password->outer_state, CIRON_SHA_BLOCK_BYTES);
+	ciron_sha1_update(c, inner, CIRON_SHA1_DIGEST_BYTES);
+	ciron_sha1_final(c, result);
+	cleanse(inner, sizeof(inner));
+}
+
+/*
+ * PBKDF2 (RFC 2898, section 5.2) with HMAC-SHA1 as the PRF, resuming each
+ * HMAC from the prepared states.
+ *
+ * From the second iteration on, every HMAC hashes a 20 byte digest, so
+ * inner and outer hash are exactly one compression of a block whose
+ * padding and length never change. These blocks are set up once and only
+ * the digest is replaced per iteration.
+ */
+static CironError native_generate_key_prepared(CironContext context,
+		CironPreparedPassword password,
+		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+		unsigned int iterations, unsigned char *buf) {
+	struct CironSha1 c;
+	unsigned char block[CIRON_SHA_BLOCK_BYTES];
+	unsigned char u[CIRON_SHA1_DIGEST_BYTES];
+	unsigned char t[CIRON_SHA1_DIGEST_BYTES];
+	unsigned char block_index[4];
+	uint32_t state[5];
+	unsigned long n_block;
+	size_t keylen;
+	size_t done;
+	size_t n;
+	size_t j;
+	unsigned int i;
+
+	keylen = NBYTES(algorithm->key_bits);
+	assert(keylen <= MAX_KEY_BYTES);
+
+	memset(block, 0, sizeof(block));
+	block[CIRON_SHA1_DIGEST_BYTES] = 0x80;
+	store_be32(block + CIRON_SHA_BLOCK_BYTES - 4,
+			(CIRON_SHA_BLOCK_BYTES + CIRON_SHA1_DIGEST_BYTES) * 8);
+
+	for (n_block = 1, done = 0; done < keylen; n_block++, done += n) {
+		store_be32(block_index, (uint32_t) n_block);
+
+		ciron_sha1_resume(&c, password->inner_state, CIRON_SHA_BLOCK_BYTES);
+		ciron_sha1_update(&c, salt, salt_len);
+		ciron_sha1_update(&c, block_index, 4);
+		hmac_sha1_outer(password, &c, u);
+		memcpy(t, u, CIRON_SHA1_DIGEST_BYTES);
+
+		for (i = 1; i < iterations; i++) {
+			memcpy(block, u, CIRON_SHA1_DIGEST_BYTES);
+			memcpy(state, password->inner_state, sizeof(state));
+			ciron_sha1_blocks(state, block, 1);
+			for (j = 0; j < 5; j++) {
+				store_be32(block + 4 * j, state[j]);
+			}
+			memcpy(state, password->outer_state, sizeof(state));
+			ciron_sha1_blocks(state, block, 1);
+			for (j = 0; j < 5; j++) {
+				store_be32(u + 4 * j, state[j]);
+			}
+			for (j = 0; j < CIRON_SHA1_DIGEST_BYTES; j++) {
+				t[j] ^= u[j];
+			}
+		}
+
+		n = keylen - done;
+		if (n > CIRON_SHA1_DIGEST_BYTES) {
+			n = CIRON_SHA1_DIGEST_BYTES;
+		}
+		memcpy(buf + done, t, n);
+	}
+
+	cleanse(&c, sizeof(c));
+	cleanse(block, sizeof(block));
+	cleanse(u, sizeof(u));
+	cleanse(t, sizeof(t));
+	cleanse(state, sizeof(state));
+
+	return CIRON_OK;
+}
+
+static CironError native_generate_key(CironContext context,
+		const unsigned char* password, size_t password_len,
+		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+		unsigned int iterations, unsigned char *buf) {
+	struct CironPreparedPassword prepared;
+	CironError e;
+
+	if ((e = native_password_prepare(context, password, password_len, &prepared))
+			!= CIRON_OK) {
+		return e;
+	}
+	e = native_generate_key_prepared(context, &prepared, salt, salt_len,
+			algorithm, iterations, buf);
+	cleanse(&prepared, sizeof(prepared));
+	return e;
+}
+
+/*
+ * HMAC-SHA256 (RFC 2104) of data with an already derived key.
+ */
+static void hmac_sha256(const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result) {
+	struct CironSha256 c;
+	unsigned char k[CIRON_SHA_BLOCK_BYTES];
+	unsigned char pad[CIRON_SHA_BLOCK_BYTES];
+	unsigned char inner[CIRON_SHA256_DIGEST_BYTES];
+	size_t i;
+
+	memset(k, 0, sizeof(k));
+	if (key_len > CIRON_SHA_BLOCK_BYTES) {
+		ciron_sha256_init(&c);
+		ciron_sha256_update(&c, key, key_len);
+		ciron_sha256_final(&c, k);
+	} else {
+		memcpy(k, key, key_len);
+	}
+
+	for (i = 0; i < CIRON_SHA_BLOCK_BYTES; i++) {
+		pad[i] = k[i] ^ 0x36;
+	}
+	ciron_sha256_init(&c);
+	ciron_sha256_update(&c, pad, CIRON_SHA_BLOCK_BYTES);
+	ciron_sha256_update(&c, data, data_len);
+	ciron_sha256_final(&c, inner);
+
+	for (i = 0; i < CIRON_SHA_BLOCK_BYTES; i++) {
+		pad[i] = k[i] ^ 0x5c;
+	}
+	ciron_sha256_init(&c);
+	ciron_sha256_update(&c, pad, CIRON_SHA_BLOCK_BYTES);
+	ciron_sha256_update(&c, inner, CIRON_SHA256_DIGEST_BYTES);
+	ciron_sha256_final(&c, result);
+
+	cleanse(&c, sizeof(c));
+	cleanse(k, sizeof(k));
+	cleanse(pad, sizeof(pad));
+	cleanse(inner, sizeof(inner));
+}
+
+static CironError check_hmac_algorithm(CironContext context,
+		CironAlgorithm algorithm) {
+	if (strcmp(algorithm->name, CIRON_SHA_256->name) != 0
+			&& strcmp(algorithm->name, CIRON_BLAKE3->name) != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for HMAC calculation",
+				algorithm->name);
+	}
+	return CIRON_OK;
+}
+
+/*
+ * Calculates the MAC of data with an already derived key: HMAC-SHA256 or,
+ * for CIRON_BLAKE3, the keyed BLAKE3 hash.
+ */
+static CironError mac_with_key(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	if (strcmp(algorithm->name, CIRON_BLAKE3->name) == 0) {
+		if (key_len != CIRON_BLAKE3_KEY_BYTES) {
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_CRYPTO_ERROR, "Key length %zu invalid for BLAKE3",
+					key_len);
+		}
+		ciron_blake3_keyed(key, data, data_len, result);
+		*result_len = CIRON_BLAKE3_OUT_BYTES;
+		return CIRON_OK;
+	}
+	hmac_sha256(key, key_len, data, data_len, result);
+	*result_len = CIRON_SHA256_DIGEST_BYTES;
+	return CIRON_OK;
+}
+
+static CironError native_hmac_prepared(CironContext context, CironAlgorithm algorithm,
+		CironPreparedPassword password,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	CironError e;
+	unsigned char buffer_key_bytes[MAX_KEY_BYTES];
+	size_t key_len;
+
+	if ((e = check_hmac_algorithm(context, algorithm)) != CIRON_OK) {
+		return e;
+	}
+	key_len = NBYTES(algorithm->key_bits);
+	assert(key_len <= MAX_KEY_BYTES);
+
+	if ((e = native_generate_key_prepared(context, password, salt_bytes,
+			salt_len, algorithm, iterations, buffer_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+	e = mac_with_key(context, algorithm, buffer_key_bytes, key_len, data,
+			data_len, result, result_len);
+	cleanse(buffer_key_bytes, sizeof(buffer_key_bytes));
+
+	return e;
+}
+
+static CironError native_hmac(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *password, size_t password_len,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	struct CironPreparedPassword prepared;
+	CironError e;
+
+	if ((e = native_password_prepare(context, password, password_len, &prepared))
+			!= CIRON_OK) {
+		return e;
+	}
+	e = native_hmac_prepared(context, algorithm, &prepared, salt_bytes, salt_len,
+			iterations, data, data_len, result, result_len);
+	cleanse(&prepared, sizeof(prepared));
+	return e;
+}
+
+/*
+ * Cipher and MAC objects for CironSealer. There are no library contexts
+ * to keep, the objects only remember the key size and the algorithm. The
+ * cipher also holds the expanded key and the CBC chaining value between
+ * the parts of a streaming encryption or decryption. Decryption keeps the
+ * last ciphertext block back, it may be the one with the padding.
+ */
+struct native_cipher {
+	struct CironCipher base;
+	unsigned int key_bits;
+	struct CironAesKey aes;
+	unsigned char chain[CIRON_AES_BLOCK_BYTES];
+	unsigned char held[CIRON_AES_BLOCK_BYTES];
+	size_t held_len;
+};
+
+/*
+ * A MAC calculated in parts is kept in the state of its algorithm. For
+ * HMAC-SHA256 that is the inner hash and the outer pad block.
+ */
+struct native_mac {
+	struct CironMac base;
+	CironAlgorithm algorithm;
+	union {
+		struct {
+			struct CironSha256 inner;
+			unsigned char outer_pad[CIRON_SHA_BLOCK_BYTES];
+		} sha256;
+		struct CironBlake3 blake3;
+	} state;
+};
+
+static CironError native_cipher_new(CironContext context, CironAlgorithm algorithm,
+		struct CironCipher **cipherp) {
+	CironError e;
+	struct native_cipher *cipher;
+	unsigned int key_bits = 0;
+
+	if ((e = lookup_cipher(context, algorithm, "encryption", &key_bits)) != CIRON_OK) {
+		return e;
+	}
+	if ((cipher = malloc(sizeof(struct native_cipher))) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unable to allocate cipher");
+	}
+	cipher->key_bits = key_bits;
+	cipher->base.functions = &ciron_crypto_native;
+	*cipherp = &cipher->base;
+	return CIRON_OK;
+}
+
+static void native_cipher_free(struct CironCipher *cipher) {
+	cleanse(cipher, sizeof(struct native_cipher));
+	free(cipher);
+}
+
+static CironError native_cipher_encrypt(CironContext context, struct CironCipher *base,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+
+	return encrypt_padded(context, cipher->key_bits, key, iv, data, data_len, buf, sizep);
+}
+
+static CironError native_cipher_decrypt(CironContext context, struct CironCipher *base,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+
+	return decrypt_padded(context, cipher->key_bits, key, iv, data, data_len, buf, sizep);
+}
+
+static CironError native_cipher_encrypt_init(CironContext context,
+		struct CironCipher *base, const unsigned char *key, const unsigned char *iv) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+
+	ciron_aes_set_key(&cipher->aes, key, cipher->key_bits);
+	memcpy(cipher->chain, iv, CIRON_AES_BLOCK_BYTES);
+	return CIRON_OK;
+}
+
+static CironError native_cipher_encrypt_update(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+
+	if (data_len % CIRON_AES_BLOCK_BYTES != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Unable to encrypt, data len %zu is not a multiple of the block size",
+				data_len);
+	}
+	ciron_aes_cbc_encrypt(&cipher->aes, cipher->chain, data, buf,
+			data_len / CIRON_AES_BLOCK_BYTES);
+	return CIRON_OK;
+}
+
+static CironError native_cipher_encrypt_final(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+	unsigned char last[CIRON_AES_BLOCK_BYTES];
+	size_t full;
+	size_t rest;
+
+	full = data_len / CIRON_AES_BLOCK_BYTES;
+	rest = data_len % CIRON_AES_BLOCK_BYTES;
+	ciron_aes_cbc_encrypt(&cipher->aes, cipher->chain, data, buf, full);
+
+	memcpy(last, data + full * CIRON_AES_BLOCK_BYTES, rest);
+	memset(last + rest, (int) (CIRON_AES_BLOCK_BYTES - rest),
+			CIRON_AES_BLOCK_BYTES - rest);
+	ciron_aes_cbc_encrypt(&cipher->aes, cipher->chain, last,
+			buf + full * CIRON_AES_BLOCK_BYTES, 1);
+
+	*sizep = (full + 1) * CIRON_AES_BLOCK_BYTES;
+	cleanse(&cipher->aes, sizeof(cipher->aes));
+	cleanse(last, sizeof(last));
+	return CIRON_OK;
+}
+
+static CironError native_cipher_decrypt_init(CironContext context,
+		struct CironCipher *base, const unsigned char *key, const unsigned char *iv) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+
+	ciron_aes_set_key(&cipher->aes, key, cipher->key_bits);
+	memcpy(cipher->chain, iv, CIRON_AES_BLOCK_BYTES);
+	cipher->held_len = 0;
+	return CIRON_OK;
+}
+
+static CironError native_cipher_decrypt_update(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+	size_t n = 0;
+
+	if (data_len % CIRON_AES_BLOCK_BYTES != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Unable to decrypt, data len %zu is not a multiple of the block size",
+				data_len);
+	}
+	if (data_len == 0) {
+		*sizep = 0;
+		return CIRON_OK;
+	}
+	if (cipher->held_len > 0) {
+		ciron_aes_cbc_decrypt(&cipher->aes, cipher->chain, cipher->held, buf, 1);
+		n = CIRON_AES_BLOCK_BYTES;
+	}
+	data_len -= CIRON_AES_BLOCK_BYTES;
+	ciron_aes_cbc_decrypt(&cipher->aes, cipher->chain, data, buf + n,
+			data_len / CIRON_AES_BLOCK_BYTES);
+	memcpy(cipher->held, data + data_len, CIRON_AES_BLOCK_BYTES);
+	cipher->held_len = CIRON_AES_BLOCK_BYTES;
+	*sizep = n + data_len;
+	return CIRON_OK;
+}
+
+static CironError native_cipher_decrypt_final(CironContext context,
+		struct CironCipher *base, unsigned char *buf, size_t *sizep) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+	unsigned char last[CIRON_AES_BLOCK_BYTES];
+	unsigned int pad;
+	unsigned int bad;
+	unsigned int i;
+
+	if (cipher->held_len == 0) {
+		cleanse(&cipher->aes, sizeof(cipher->aes));
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unable to decrypt, no data");
+	}
+	ciron_aes_cbc_decrypt(&cipher->aes, cipher->chain, cipher->held, last, 1);
+	cipher->held_len = 0;
+	cleanse(&cipher->aes, sizeof(cipher->aes));
+
+	pad = last[CIRON_AES_BLOCK_BYTES - 1];
+	bad = (pad == 0 || pad > CIRON_AES_BLOCK_BYTES);
+	for (i = 1; !bad && i <= pad; i++) {
+		bad |= (last[CIRON_AES_BLOCK_BYTES - i] != pad);
+	}
+	if (bad) {
+		cleanse(last, sizeof(last));
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unable to decrypt, bad padding");
+	}
+	memcpy(buf, last, CIRON_AES_BLOCK_BYTES - pad);
+	*sizep = CIRON_AES_BLOCK_BYTES - pad;
+	cleanse(last, sizeof(last));
+	return CIRON_OK;
+}
+
+static CironError native_mac_new(CironContext context, CironAlgorithm algorithm,
+		struct CironMac **macp) {
+	CironError e;
+	struct native_mac *m;
+
+	if ((e = check_hmac_algorithm(context, algorithm)) != CIRON_OK) {
+		return e;
+	}
+	if ((m = malloc(sizeof(struct native_mac))) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unable to allocate HMAC");
+	}
+	m->algorithm = algorithm;
+	m->base.functions = &ciron_crypto_native;
+	*macp = &m->base;
+	return CIRON_OK;
+}
+
+static void native_mac_free(struct CironMac *m) {
+	if (m != NULL) {
+		cleanse(m, sizeof(struct native_mac));
+	}
+	free(m);
+}
+
+static CironError native_mac(CironContext context, struct CironMac *m,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	struct native_mac *mac = (struct native_mac *) m;
+
+	return mac_with_key(context, mac->algorithm, key, key_len, data, data_len,
+			result, result_len);
+}
+
+static CironError native_mac_init(CironContext context, struct CironMac *m,
+		const unsigned char *key, size_t key_len) {
+	struct native_mac *mac = (struct native_mac *) m;
+	unsigned char k[CIRON_SHA_BLOCK_BYTES];
+	unsigned char pad[CIRON_SHA_BLOCK_BYTES];
+	size_t i;
+
+	if (strcmp(mac->algorithm->name, CIRON_BLAKE3->name) == 0) {
+		if (key_len != CIRON_BLAKE3_KEY_BYTES) {
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_CRYPTO_ERROR, "Key length %zu invalid for BLAKE3",
+					key_len);
+		}
+		ciron_blake3_init_keyed(&mac->state.blake3, key);
+		return CIRON_OK;
+	}
+
+	memset(k, 0, sizeof(k));
+	if (key_len > CIRON_SHA_BLOCK_BYTES) {
+		ciron_sha256_init(&mac->state.sha256.inner);
+		ciron_sha256_update(&mac->state.sha256.inner, key, key_len);
+		ciron_sha256_final(&mac->state.sha256.inner, k);
+	} else {
+		memcpy(k, key, key_len);
+	}
+	for (i = 0; i < CIRON_SHA_BLOCK_BYTES; i++) {
+		pad[i] = k[i] ^ 0x36;
+		mac->state.sha256.outer_pad[i] = k[i] ^ 0x5c;
+	}
+	ciron_sha256_init(&mac->state.sha256.inner);
+	ciron_sha256_update(&mac->state.sha256.inner, pad, CIRON_SHA_BLOCK_BYTES);
+	cleanse(k, sizeof(k));
+	cleanse(pad, sizeof(pad));
+	return CIRON_OK;
+}
+
+static CironError native_mac_update(CironContext context, struct CironMac *m,
+		const unsigned char *data, size_t data_len) {
+	struct native_mac *mac = (struct native_mac *) m;
+
+	if (strcmp(mac->algorithm->name, CIRON_BLAKE3->name) == 0) {
+		ciron_blake3_update(&mac->state.blake3, data, data_len);
+	} else {
+		ciron_sha256_update(&mac->state.sha256.inner, data, data_len);
+	}
+	return CIRON_OK;
+}
+
+static CironError native_mac_final(CironContext context, struct CironMac *m,
+		unsigned char *result, size_t *result_len) {
+	struct native_mac *mac = (struct native_mac *) m;
+	struct CironSha256 c;
+	unsigned char inner[CIRON_SHA256_DIGEST_BYTES];
+
+	if (strcmp(mac->algorithm->name, CIRON_BLAKE3->name) == 0) {
+		ciron_blake3_final(&mac->state.blake3, result);
+		*result_len = CIRON_BLAKE3_OUT_BYTES;
+		return CIRON_OK;
+	}
+	ciron_sha256_final(&mac->state.sha256.inner, inner);
+	ciron_sha256_init(&c);
+	ciron_sha256_update(&c, mac->state.sha256.outer_pad, CIRON_SHA_BLOCK_BYTES);
+	ciron_sha256_update(&c, inner, CIRON_SHA256_DIGEST_BYTES);
+	ciron_sha256_final(&c, result);
+	*result_len = CIRON_SHA256_DIGEST_BYTES;
+
+	cleanse(&c, sizeof(c));
+	cleanse(inner, sizeof(inner));
+	cleanse(&mac->state, sizeof(mac->state));
+	return CIRON_OK;
+}
+
+/*
+ * The batch functions hash the jobs of a batch side by side with the
+ * multi-buffer SHA functions. They process BATCH_JOBS jobs at a time so
+ * that their buffers fit on the stack.
+ */
+#define BATCH_JOBS 16
+
+/* Number of PBKDF2 blocks (of one SHA-1 digest each) of the longest key */
+#define PBKDF2_BLOCKS ((MAX_KEY_BYTES + CIRON_SHA1_DIGEST_BYTES - 1) / CIRON_SHA1_DIGEST_BYTES)
+
+/*
+ * One PBKDF2 block being derived. block first holds the end of the salt
+ * and the block index and later the digest of the last HMAC, padded as a
+ * message following a pad block. This padding is the same for the inner
+ * and outer hashes of all iterations.
+ */
+struct pbkdf2_lane {
+	CironPreparedPassword password;
+	unsigned int iterations;
+	uint32_t state[5];
+	unsigned char block[2 * CIRON_SHA_BLOCK_BYTES];
+	unsigned char t[CIRON_SHA1_DIGEST_BYTES];
+	unsigned char *out;
+	size_t out_len;
+};
+
+/*
+ * Stores the digest of every lane in its block and sets up the jobs to
+ * hash the block from the inner or outer states.
+ */
+static void pbkdf2_next_hash(struct pbkdf2_lane **lanes, size_t n, int outer,
+		struct CironShaMbJob *mb) {
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < 5; j++) {
+			store_be32(lanes[i]->block + 4 * j, lanes[i]->state[j]);
+		}
+		memcpy(lanes[i]->state, outer ? lanes[i]->password->outer_state
+				: lanes[i]->password->inner_state, sizeof(lanes[i]->state));
+		mb[i].state = lanes[i]->state;
+		mb[i].nblocks = 0;
+		mb[i].tail = lanes[i]->block;
+		mb[i].tail_blocks = 1;
+	}
+}
+
+static void pbkdf2_xor_digest(struct pbkdf2_lane **lanes, size_t n) {
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < 5; j++) {
+			store_be32(lanes[i]->block + 4 * j, lanes[i]->state[j]);
+		}
+		for (j = 0; j < CIRON_SHA1_DIGEST_BYTES; j++) {
+			lanes[i]->t[j] ^= lanes[i]->block[j];
+		}
+	}
+}
+
+/*
+ * PBKDF2 HMAC-SHA1 like native_generate_key_prepared() for up to
+ * BATCH_JOBS jobs, with every PBKDF2 block of every job in its own lane.
+ * Lanes with fewer iterations drop out of the later rounds.
+ */
+static void pbkdf2_batch(struct CironKeyJob *jobs, size_t njobs) {
+	struct pbkdf2_lane lanes[BATCH_JOBS * PBKDF2_BLOCKS];
+	struct pbkdf2_lane *active[BATCH_JOBS * PBKDF2_BLOCKS];
+	struct CironShaMbJob mb[BATCH_JOBS * PBKDF2_BLOCKS];
+	struct pbkdf2_lane *lane;
+	unsigned int max_iterations = 1;
+	unsigned int i;
+	size_t keylen, done, rest, n = 0, k, j;
+
+	for (k = 0; k < njobs; k++) {
+		keylen = NBYTES(jobs[k].algorithm->key_bits);
+		assert(keylen <= MAX_KEY_BYTES);
+		rest = jobs[k].salt_len % CIRON_SHA_BLOCK_BYTES;
+		for (j = 1, done = 0; done < keylen; j++, done += CIRON_SHA1_DIGEST_BYTES) {
+			lane = &lanes[n];
+			lane->password = jobs[k].password;
+			lane->iterations = jobs[k].iterations;
+			lane->out = jobs[k].key + done;
+			lane->out_len = keylen - done;
+			if (lane->out_len > CIRON_SHA1_DIGEST_BYTES) {
+				lane->out_len = CIRON_SHA1_DIGEST_BYTES;
+			}
+			memcpy(lane->state, lane->password->inner_state, sizeof(lane->state));
+			memcpy(lane->block, jobs[k].salt + jobs[k].salt_len - rest, rest);
+			store_be32(lane->block + rest, (uint32_t) j);
+
+			mb[n].state = lane->state;
+			mb[n].data = jobs[k].salt;
+			mb[n].nblocks = jobs[k].salt_len / CIRON_SHA_BLOCK_BYTES;
+			mb[n].tail = lane->block;
+			mb[n].tail_blocks = ciron_sha_pad(lane->block, rest + 4,
+					CIRON_SHA_BLOCK_BYTES + jobs[k].salt_len + 4);
+			active[n] = lane;
+			n++;
+		}
+		if (jobs[k].iterations > max_iterations) {
+			max_iterations = jobs[k].iterations;
+		}
+	}
+
+	/* U_1 = HMAC(salt || INT(j)) */
+	ciron_sha1_mb(mb, n);
+	for (j = 0; j < n; j++) {
+		ciron_sha_pad(lanes[j].block, CIRON_SHA1_DIGEST_BYTES,
+				CIRON_SHA_BLOCK_BYTES + CIRON_SHA1_DIGEST_BYTES);
+	}
+	pbkdf2_next_hash(active, n, 1, mb);
+	ciron_sha1_mb(mb, n);
+	for (j = 0; j < n; j++) {
+		memset(lanes[j].t, 0, sizeof(lanes[j].t));
+	}
+	pbkdf2_xor_digest(active, n);
+
+	/* U_i = HMAC(U_i-1) */
+	for (i = 1; i < max_iterations; i++) {
+		for (j = 0, k = 0; j < n; j++) {
+			if (lanes[j].iterations > i) {
+				active[k++] = &lanes[j];
+			}
+		}
+		pbkdf2_next_hash(active, k, 0, mb);
+		ciron_sha1_mb(mb, k);
+		pbkdf2_next_hash(active, k, 1, mb);
+		ciron_sha1_mb(mb, k);
+		pbkdf2_xor_digest(active, k);
+	}
+
+	for (j = 0; j < n; j++) {
+		memcpy(lanes[j].out, lanes[j].t, lanes[j].out_len);
+	}
+	cleanse(lanes, sizeof(lanes));
+}
+
+static CironError native_generate_keys_prepared(CironContext context,
+		struct CironKeyJob *jobs, size_t njobs) {
+	size_t n;
+
+	for (; njobs > 0; jobs += n, njobs -= n) {
+		n = (njobs < BATCH_JOBS) ? njobs : BATCH_JOBS;
+		pbkdf2_batch(jobs, n);
+	}
+	return CIRON_OK;
+}
+
+/*
+ * HMAC-SHA256 like hmac_sha256() for up to BATCH_JOBS jobs. The key pad
+ * blocks, the inner and the outer hashes of all jobs are each done
+ * together. The inner hash reads the complete blocks of the data in place
+ * and only copies the rest into tail for padding.
+ */
+struct hmac_lane {
+	uint32_t inner[8];
+	uint32_t outer[8];
+	unsigned char pads[2 * CIRON_SHA_BLOCK_BYTES];
+	unsigned char tail[2 * CIRON_SHA_BLOCK_BYTES];
+};
+
+static void hmac_sha256_batch(struct CironMacJob *jobs, size_t njobs) {
+	struct hmac_lane lanes[BATCH_JOBS];
+	struct CironShaMbJob mb[2 * BATCH_JOBS];
+	struct CironSha256 c;
+	unsigned char *k;
+	size_t i, j, rest;
+
+	ciron_sha256_init(&c);
+	for (i = 0; i < njobs; i++) {
+		k = lanes[i].tail;
+		memset(k, 0, CIRON_SHA_BLOCK_BYTES);
+		if (jobs[i].key_len > CIRON_SHA_BLOCK_BYTES) {
+			struct CironSha256 kc;
+
+			ciron_sha256_init(&kc);
+			ciron_sha256_update(&kc, jobs[i].key, jobs[i].key_len);
+			ciron_sha256_final(&kc, k);
+			cleanse(&kc, sizeof(kc));
+		} else {
+			memcpy(k, jobs[i].key, jobs[i].key_len);
+		}
+		for (j = 0; j < CIRON_SHA_BLOCK_BYTES; j++) {
+			lanes[i].pads[j] = k[j] ^ 0x36;
+			lanes[i].pads[CIRON_SHA_BLOCK_BYTES + j] = k[j] ^ 0x5c;
+		}
+		memcpy(lanes[i].inner, c.state, sizeof(lanes[i].inner));
+		memcpy(lanes[i].outer, c.state, sizeof(lanes[i].outer));
+		mb[2 * i].state = lanes[i].inner;
+		mb[2 * i].data = lanes[i].pads;
+		mb[2 * i].nblocks = 1;
+		mb[2 * i].tail_blocks = 0;
+		mb[2 * i + 1].state = lanes[i].outer;
+		mb[2 * i + 1].data = lanes[i].pads + CIRON_SHA_BLOCK_BYTES;
+		mb[2 * i + 1].nblocks = 1;
+		mb[2 * i + 1].tail_blocks = 0;
+	}
+	ciron_sha256_mb(mb, 2 * njobs);
+
+	for (i = 0; i < njobs; i++) {
+		rest = jobs[i].data_len % CIRON_SHA_BLOCK_BYTES;
+		memcpy(lanes[i].tail, jobs[i].data + jobs[i].data_len - rest, rest);
+		mb[i].state = lanes[i].inner;
+		mb[i].data = jobs[i].data;
+		mb[i].nblocks = jobs[i].data_len / CIRON_SHA_BLOCK_BYTES;
+		mb[i].tail = lanes[i].tail;
+		mb[i].tail_blocks = ciron_sha_pad(lanes[i].tail, rest,
+				CIRON_SHA_BLOCK_BYTES + jobs[i].data_len);
+	}
+	ciron_sha256_mb(mb, njobs);
+
+	for (i = 0; i < njobs; i++) {
+		for (j = 0; j < 8; j++) {
+			store_be32(lanes[i].tail + 4 * j, lanes[i].inner[j]);
+		}
+		mb[i].state = lanes[i].outer;
+		mb[i].nblocks = 0;
+		mb[i].tail_blocks = ciron_sha_pad(lanes[i].tail, CIRON_SHA256_DIGEST_BYTES,
+				CIRON_SHA_BLOCK_BYTES + CIRON_SHA256_DIGEST_BYTES);
+	}
+	ciron_sha256_mb(mb, njobs);
+
+	for (i = 0; i < njobs; i++) {
+		for (j = 0; j < 8; j++) {
+			store_be32(jobs[i].result + 4 * j, lanes[i].outer[j]);
+		}
+		jobs[i].result_len = CIRON_SHA256_DIGEST_BYTES;
+	}
+	cleanse(lanes, sizeof(lanes));
+}
+
+static CironError native_mac_batch(CironContext context, struct CironMac *m,
+		struct CironMacJob *jobs, size_t njobs) {
+	struct native_mac *mac = (struct native_mac *) m;
+	CironError e;
+	size_t n;
+
+	/* BLAKE3 only hashes large tokens side by side, chunk by chunk */
+	if (strcmp(mac->algorithm->name, CIRON_SHA_256->name) != 0) {
+		for (n = 0; n < njobs; n++) {
+			if ((e = mac_with_key(context, mac->algorithm, jobs[n].key,
+					jobs[n].key_len, jobs[n].data, jobs[n].data_len,
+					jobs[n].result, &jobs[n].result_len)) != CIRON_OK) {
+				return e;
+			}
+		}
+		return CIRON_OK;
+	}
+	for (; njobs > 0; jobs += n, njobs -= n) {
+		n = (njobs < BATCH_JOBS) ? njobs : BATCH_JOBS;
+		hmac_sha256_batch(jobs, n);
+	}
+	return CIRON_OK;
+}
+
+/*
+ * Pads the data of the jobs into their buffers and encrypts them in place
+ * with interleaved AES-CBC.
+ */
+static void encrypt_padded_batch(unsigned int key_bits,
+		struct CironCipherJob *jobs, size_t njobs) {
+	struct CironAesKey keys[BATCH_JOBS];
+	unsigned char chains[BATCH_JOBS][CIRON_AES_BLOCK_BYTES];
+	struct CironAesCbcJob cbc[BATCH_JOBS];
+	size_t i, rest;
+
+	for (i = 0; i < njobs; i++) {
+		rest = jobs[i].data_len % CIRON_AES_BLOCK_BYTES;
+		jobs[i].len = jobs[i].data_len - rest + CIRON_AES_BLOCK_BYTES;
+		memmove(jobs[i].buf, jobs[i].data, jobs[i].data_len);
+		memset(jobs[i].buf + jobs[i].data_len, (int) (CIRON_AES_BLOCK_BYTES - rest),
+				CIRON_AES_BLOCK_BYTES - rest);
+
+		ciron_aes_set_key(&keys[i], jobs[i].key, key_bits);
+		memcpy(chains[i], jobs[i].iv, CIRON_AES_BLOCK_BYTES);
+		cbc[i].key = &keys[i];
+		cbc[i].iv = chains[i];
+		cbc[i].in = jobs[i].buf;
+		cbc[i].out = jobs[i].buf;
+		cbc[i].nblocks = jobs[i].len / CIRON_AES_BLOCK_BYTES;
+	}
+	ciron_aes_cbc_encrypt_multi(cbc, njobs);
+	cleanse(keys, sizeof(keys));
+}
+
+static CironError native_cipher_encrypt_batch(CironContext context,
+		struct CironCipher *base, struct CironCipherJob *jobs, size_t njobs) {
+	struct native_cipher *cipher = (struct native_cipher *) base;
+	size_t n;
+
+	for (; njobs > 0; jobs += n, njobs -= n) {
+		n = (njobs < BATCH_JOBS) ? njobs : BATCH_JOBS;
+		encrypt_padded_batch(cipher->key_bits, jobs, n);
+	}
+	return CIRON_OK;
+}
+
+const struct CironCryptoFunctions ciron_crypto_native = {
+	native_password_prepare,
+	native_generate_key,
+	native_generate_key_prepared,
+	native_encrypt,
+	native_decrypt,
+	native_aead_encrypt,
+	native_aead_decrypt,
+	native_hmac,
+	native_hmac_prepared,
+	native_cipher_new,
+	native_cipher_free,
+	native_cipher_encrypt,
+	native_cipher_decrypt,
+	native_cipher_encrypt_init,
+	native_cipher_encrypt_update,
+	native_cipher_encrypt_final,
+	native_cipher_decrypt_init,
+	native_cipher_decrypt_update,
+	native_cipher_decrypt_final,
+	native_mac_new,
+	native_mac_free,
+	native_mac,
+	native_mac_init,
+	native_mac_update,
+	native_mac_final,
+	native_generate_keys_prepared,
+	native_mac_batch,
+	native_cipher_encrypt_batch
+};
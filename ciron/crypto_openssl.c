@@ -1,18 +1,20 @@
 /*
- * This file implements the functions declared in crypto.h using libcrypto
- * of the OpenSSL library.
+ * This file provides the crypto implementation "openssl" (see crypto.c)
+ * using libcrypto of the OpenSSL library.
  */
 #include <string.h>
 #include <limits.h>
-#include <openssl/rand.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
 #include <openssl/hmac.h>
 
 #include "ciron.h"
 #include "common.h"
+#include "crypto.h"
+#include "blake3.h"
+#include "openssl_prepared.h"
 
-CironError ciron_encrypt(CironContext context, CironAlgorithm algorithm,
+static CironError openssl_encrypt(CironContext context, CironAlgorithm algorithm,
 		const unsigned char *key, const unsigned char *iv,
 		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
 	int r;
@@ -60,7 +62,7 @@ CironError ciron_encrypt(CironContext context, CironAlgorithm algorithm,
 	return CIRON_OK;
 }
 
-CironError ciron_decrypt(CironContext context, CironAlgorithm algorithm,
+static CironError openssl_decrypt(CironContext context, CironAlgorithm algorithm,
 		const unsigned char *key, const unsigned char *iv,
 		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
 	int r;
@@ -109,10 +111,100 @@ CironError ciron_decrypt(CironContext context, CironAlgorithm algorithm,
 	return CIRON_OK;
 }
 
-CironError ciron_generate_key(CironContext context,
+/*
+ * Maps an AEAD algorithm to its cipher, returns NULL if OpenSSL lacks it.
+ * ChaCha20-Poly1305 is only available as of OpenSSL 1.1.0.
+ */
+static const EVP_CIPHER *aead_cipher(CironAlgorithm algorithm) {
+	if (strcmp(algorithm->name, CIRON_AES_256_GCM->name) == 0) {
+		return EVP_aes_256_gcm();
+	}
+#ifdef NID_chacha20_poly1305
+	if (strcmp(algorithm->name, CIRON_CHACHA20_POLY1305->name) == 0) {
+		return EVP_chacha20_poly1305();
+	}
+#endif
+	return NULL;
+}
+
+/*
+ * AEAD encryption (enc = 1) or tag check and decryption (enc = 0). OpenSSL
+ * only checks the tag after it has decrypted, so buf is cleared again if
+ * the tag does not match.
+ */
+static CironError openssl_aead(CironContext context, CironAlgorithm algorithm,
+		int enc, const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag) {
+	const EVP_CIPHER *cipher;
+	int tag_len = NBYTES(algorithm->tag_bits);
+	int n;
+	int n2;
+	int ok;
+	EVP_CIPHER_CTX ctx;
+
+	if ((cipher = aead_cipher(algorithm)) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for AEAD %s", algorithm->name,
+				enc ? "encryption" : "decryption");
+	}
+	if (aad_len > INT_MAX || data_len > INT_MAX) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Data len %zu exceeds INT_MAX", data_len);
+	}
+	EVP_CIPHER_CTX_init(&ctx);
+	ok = EVP_CipherInit_ex(&ctx, cipher, NULL, key, iv, enc) == 1
+			&& (enc || EVP_CIPHER_CTX_ctrl(&ctx, EVP_CTRL_GCM_SET_TAG, tag_len, tag) == 1)
+			&& (aad_len == 0 || EVP_CipherUpdate(&ctx, NULL, &n, aad, (int) aad_len) == 1)
+			&& EVP_CipherUpdate(&ctx, buf, &n, data, (int) data_len) == 1;
+	if (!ok) {
+		EVP_CIPHER_CTX_cleanup(&ctx);
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to %s", enc ? "encrypt" : "decrypt");
+	}
+	if (EVP_CipherFinal_ex(&ctx, buf + n, &n2) != 1) {
+		EVP_CIPHER_CTX_cleanup(&ctx);
+		if (!enc) {
+			memset(buf, 0, data_len);
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_TOKEN_VALIDATION_ERROR, "Authentication tag does not match");
+		}
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	if (enc && EVP_CIPHER_CTX_ctrl(&ctx, EVP_CTRL_GCM_GET_TAG, tag_len, tag) != 1) {
+		EVP_CIPHER_CTX_cleanup(&ctx);
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to get authentication tag");
+	}
+	EVP_CIPHER_CTX_cleanup(&ctx);
+	return CIRON_OK;
+}
+
+static CironError openssl_aead_encrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag) {
+	return openssl_aead(context, algorithm, 1, key, iv, aad, aad_len, data,
+			data_len, buf, tag);
+}
+
+static CironError openssl_aead_decrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf) {
+	return openssl_aead(context, algorithm, 0, key, iv, aad, aad_len, data,
+			data_len, buf, (unsigned char *) tag);
+}
+
+static CironError openssl_generate_key(CironContext context,
 		const unsigned char* password, size_t password_len,
 		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
-		size_t iterations, unsigned char *buf) {
+		unsigned int iterations, unsigned char *buf) {
 	int keylen;
 	int r;
 
@@ -134,65 +226,374 @@ CironError ciron_generate_key(CironContext context,
 	return CIRON_OK;
 }
 
-CironError ciron_generate_salt(CironContext context, size_t nbytes,
-		unsigned char *buf) {
-	int r;
-	unsigned char salt_bytes[MAX_SALT_BYTES];
-	assert(nbytes <= MAX_SALT_BYTES);
+/*
+ * Calculates the HMAC of data once the key has been derived.
+ */
+static CironError hmac(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	unsigned int rlen;
 
-	if ((r = RAND_bytes(salt_bytes, nbytes)) != 1) {
-		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
-				CIRON_CRYPTO_ERROR, "Unable to get %d random bytes", nbytes);
+	if (strcmp(algorithm->name, CIRON_BLAKE3->name) == 0) {
+		assert(key_len == CIRON_BLAKE3_KEY_BYTES);
+		ciron_blake3_keyed(key, data, data_len, result);
+		*result_len = CIRON_BLAKE3_OUT_BYTES;
+		return CIRON_OK;
 	}
-	ciron_bytes_to_hex(salt_bytes, nbytes, buf);
-
-	return CIRON_OK;
-}
-
-CironError ciron_generate_iv(CironContext context, size_t nbytes,
-		unsigned char *buf) {
-	int r;
-	if ((r = RAND_bytes(buf, nbytes)) != 1) {
-		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
-				CIRON_CRYPTO_ERROR, "Unable to get %d random bytes", nbytes);
+	if (strcmp(algorithm->name, CIRON_SHA_256->name) == 0) {
+		if ((HMAC(EVP_sha256(), key, key_len, data, data_len,
+				result, &rlen)) == NULL ) {
+			return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+					CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+		}
+	} else {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for HMAC calculation",
+				algorithm->name);
 	}
-
+	assert(rlen > 0 && rlen < UINT_MAX);
+	*result_len = (size_t)rlen;
 	return CIRON_OK;
 }
 
-CironError ciron_hmac(CironContext context, CironAlgorithm algorithm,
+static CironError openssl_hmac(CironContext context, CironAlgorithm algorithm,
 		const unsigned char *password, size_t password_len,
-		const unsigned char *salt_bytes, size_t salt_len, size_t iterations,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
 		const unsigned char *data, size_t data_len, unsigned char *result,
 		size_t *result_len) {
 	CironError e;
 	unsigned char buffer_key_bytes[MAX_KEY_BYTES];
 	size_t key_len;
-	unsigned int rlen;
 
 
 	key_len = NBYTES(algorithm->key_bits);
 	assert(key_len <= MAX_KEY_BYTES);
 
-	if ((e = ciron_generate_key(context, password, password_len, salt_bytes,
+	if ((e = openssl_generate_key(context, password, password_len, salt_bytes,
 			salt_len, algorithm, iterations, buffer_key_bytes)) != CIRON_OK) {
 		return e;
 	}
 
-	if (strcmp(algorithm->name, CIRON_SHA_256->name) == 0) {
-		if ((HMAC(EVP_sha256(), buffer_key_bytes, key_len, data, data_len,
-				result, &rlen)) == NULL ) {
-			return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
-					CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
-		}
+	return hmac(context, algorithm, buffer_key_bytes, key_len, data, data_len,
+			result, result_len);
+}
+
+static CironError openssl_hmac_prepared(CironContext context, CironAlgorithm algorithm,
+		CironPreparedPassword password,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	return ciron_openssl_hmac_prepared(context, algorithm, password, salt_bytes,
+			salt_len, iterations, data, data_len, result, result_len, hmac);
+}
+
+/*
+ * Cipher and MAC objects for CironSealer. The algorithms are resolved to
+ * EVP_CIPHER and EVP_MD once, the contexts are re-keyed for every use.
+ */
+struct openssl_cipher {
+	struct CironCipher base;
+	const EVP_CIPHER *evp_cipher;
+	EVP_CIPHER_CTX ctx;
+};
+
+struct openssl_mac {
+	struct CironMac base;
+	const EVP_MD *evp_md;
+	HMAC_CTX ctx;
+};
+
+static CironError openssl_cipher_new(CironContext context, CironAlgorithm algorithm,
+		struct CironCipher **cipherp) {
+	struct openssl_cipher *cipher;
+	const EVP_CIPHER *evp_cipher;
+
+	if (strcmp(algorithm->name, CIRON_AES_128_CBC->name) == 0) {
+		evp_cipher = EVP_aes_128_cbc();
+	} else if (strcmp(algorithm->name, CIRON_AES_256_CBC->name) == 0) {
+		evp_cipher = EVP_aes_256_cbc();
 	} else {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for encryption", algorithm->name);
+	}
+	if ((cipher = OPENSSL_malloc(sizeof(struct openssl_cipher))) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate cipher");
+	}
+	cipher->evp_cipher = evp_cipher;
+	EVP_CIPHER_CTX_init(&cipher->ctx);
+	cipher->base.functions = &ciron_crypto_openssl;
+	*cipherp = &cipher->base;
+	return CIRON_OK;
+}
+
+static void openssl_cipher_free(struct CironCipher *base) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+
+	if (cipher == NULL) {
+		return;
+	}
+	EVP_CIPHER_CTX_cleanup(&cipher->ctx);
+	OPENSSL_free(cipher);
+}
+
+static CironError openssl_cipher_encrypt(CironContext context, struct CironCipher *base,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+	int n2;
+
+	if (EVP_EncryptInit_ex(&cipher->ctx, cipher->evp_cipher, NULL, key, iv) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to initialize encrypt cipher");
+	}
+	if (EVP_EncryptUpdate(&cipher->ctx, buf, &n, data, data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	if (EVP_EncryptFinal_ex(&cipher->ctx, buf + n, &n2) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	*sizep = n + n2;
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_decrypt(CironContext context, struct CironCipher *base,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+	int n2;
+
+	if (EVP_DecryptInit_ex(&cipher->ctx, cipher->evp_cipher, NULL, key, iv) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to initialize decrypt cipher");
+	}
+	if (EVP_DecryptUpdate(&cipher->ctx, buf, &n, data, data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to decrypt");
+	}
+	if (EVP_DecryptFinal_ex(&cipher->ctx, buf + n, &n2) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to decrypt");
+	}
+	*sizep = n + n2;
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_encrypt_init(CironContext context,
+		struct CironCipher *base, const unsigned char *key, const unsigned char *iv) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+
+	if (EVP_EncryptInit_ex(&cipher->ctx, cipher->evp_cipher, NULL, key, iv) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to initialize encrypt cipher");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_encrypt_update(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+
+	if (data_len % CIPHER_BLOCK_SIZE != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Unable to encrypt, data len %zu is not a multiple of the block size",
+				data_len);
+	}
+	if (EVP_EncryptUpdate(&cipher->ctx, buf, &n, data, data_len) != 1
+			|| (size_t) n != data_len) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_encrypt_final(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+	int n2;
+
+	if (EVP_EncryptUpdate(&cipher->ctx, buf, &n, data, data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	if (EVP_EncryptFinal_ex(&cipher->ctx, buf + n, &n2) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	*sizep = n + n2;
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_decrypt_init(CironContext context,
+		struct CironCipher *base, const unsigned char *key, const unsigned char *iv) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+
+	if (EVP_DecryptInit_ex(&cipher->ctx, cipher->evp_cipher, NULL, key, iv) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to initialize decrypt cipher");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_decrypt_update(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+
+	if (data_len % CIPHER_BLOCK_SIZE != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Unable to decrypt, data len %zu is not a multiple of the block size",
+				data_len);
+	}
+	if (EVP_DecryptUpdate(&cipher->ctx, buf, &n, data, data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to decrypt");
+	}
+	*sizep = n;
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_decrypt_final(CironContext context,
+		struct CironCipher *base, unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+
+	if (EVP_DecryptFinal_ex(&cipher->ctx, buf, &n) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to decrypt");
+	}
+	*sizep = n;
+	return CIRON_OK;
+}
+
+static CironError openssl_mac_new(CironContext context, CironAlgorithm algorithm,
+		struct CironMac **macp) {
+	struct openssl_mac *mac;
+
+	/* libcrypto has no BLAKE3, the native MAC object calculates it */
+	if (strcmp(algorithm->name, CIRON_BLAKE3->name) == 0) {
+		return ciron_crypto_native.mac_new(context, algorithm, macp);
+	}
+	if (strcmp(algorithm->name, CIRON_SHA_256->name) != 0) {
 		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
 				CIRON_ERROR_UNKNOWN_ALGORITHM,
 				"Algorithm %s not recognized for HMAC calculation",
 				algorithm->name);
 	}
-	assert(rlen > 0 && rlen < UINT_MAX);
+	if ((mac = OPENSSL_malloc(sizeof(struct openssl_mac))) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate HMAC");
+	}
+	mac->evp_md = EVP_sha256();
+	HMAC_CTX_init(&mac->ctx);
+	mac->base.functions = &ciron_crypto_openssl;
+	*macp = &mac->base;
+	return CIRON_OK;
+}
+
+static void openssl_mac_free(struct CironMac *base) {
+	struct openssl_mac *mac = (struct openssl_mac *) base;
+
+	if (mac == NULL) {
+		return;
+	}
+	HMAC_CTX_cleanup(&mac->ctx);
+	OPENSSL_free(mac);
+}
+
+static CironError openssl_mac(CironContext context, struct CironMac *base,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	struct openssl_mac *mac = (struct openssl_mac *) base;
+	unsigned int rlen;
+
+	if (HMAC_Init_ex(&mac->ctx, key, key_len, mac->evp_md, NULL) != 1
+			|| HMAC_Update(&mac->ctx, data, data_len) != 1
+			|| HMAC_Final(&mac->ctx, result, &rlen) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+	}
+	*result_len = (size_t)rlen;
+	return CIRON_OK;
+}
+
+static CironError openssl_mac_init(CironContext context, struct CironMac *base,
+		const unsigned char *key, size_t key_len) {
+	struct openssl_mac *mac = (struct openssl_mac *) base;
+
+	if (HMAC_Init_ex(&mac->ctx, key, key_len, mac->evp_md, NULL) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_mac_update(CironContext context, struct CironMac *base,
+		const unsigned char *data, size_t data_len) {
+	struct openssl_mac *mac = (struct openssl_mac *) base;
+
+	if (HMAC_Update(&mac->ctx, data, data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_mac_final(CironContext context, struct CironMac *base,
+		unsigned char *result, size_t *result_len) {
+	struct openssl_mac *mac = (struct openssl_mac *) base;
+	unsigned int rlen;
+
+	if (HMAC_Final(&mac->ctx, result, &rlen) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+	}
 	*result_len = (size_t)rlen;
 	return CIRON_OK;
 }
 
+const struct CironCryptoFunctions ciron_crypto_openssl = {
+	ciron_openssl_password_prepare,
+	openssl_generate_key,
+	ciron_openssl_generate_key_prepared,
+	openssl_encrypt,
+	openssl_decrypt,
+	openssl_aead_encrypt,
+	openssl_aead_decrypt,
+	openssl_hmac,
+	openssl_hmac_prepared,
+	openssl_cipher_new,
+	openssl_cipher_free,
+	openssl_cipher_encrypt,
+	openssl_cipher_decrypt,
+	openssl_cipher_encrypt_init,
+	openssl_cipher_encrypt_update,
+	openssl_cipher_encrypt_final,
+	openssl_cipher_decrypt_init,
+	openssl_cipher_decrypt_update,
+	openssl_cipher_decrypt_final,
+	openssl_mac_new,
+	openssl_mac_free,
+	openssl_mac,
+	openssl_mac_init,
+	openssl_mac_update,
+	openssl_mac_final,
+	NULL,
+	NULL,
+	NULL
+};
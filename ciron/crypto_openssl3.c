@@ -0,0 +1,714 @@
+/*
+ * This file provides the crypto implementation "openssl" (see crypto.c)
+ * using libcrypto of OpenSSL 3.
+ *
+ * OpenSSL 3 looks up algorithm implementations in its providers. The
+ * convenience functions used by crypto_openssl.c (EVP_aes_256_cbc(),
+ * HMAC(), PKCS5_PBKDF2_HMAC_SHA1(), ...) do such a fetch on every call,
+ * which is expensive and takes locks. This implementation fetches the
+ * ciphers, the MAC and the KDF once and creates MAC and KDF template
+ * contexts with their digests already set. Every operation then only
+ * duplicates a template or uses a fetched cipher directly.
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <openssl/evp.h>
+#include <openssl/err.h>
+#include <openssl/kdf.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "crypto.h"
+#include "blake3.h"
+#include "openssl_prepared.h"
+
+/*
+ * The objects fetched once from the default provider.
+ */
+static EVP_CIPHER *aes_128_cbc;
+static EVP_CIPHER *aes_256_cbc;
+static EVP_CIPHER *aes_256_gcm;
+static EVP_CIPHER *chacha20_poly1305;
+static EVP_MAC_CTX *hmac_sha256_template;
+static EVP_KDF *pbkdf2;
+static EVP_KDF_CTX *pbkdf2_sha1_template;
+static unsigned long fetch_error;
+
+static pthread_once_t fetch_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Sets the first two params to select SHA-1 and PKCS#5 mode for PBKDF2
+ * and terminates the list. PKCS#5 mode disables the SP 800-132 lower
+ * bounds on salt length, key length and iterations that OpenSSL 3
+ * enforces by default. iron allows shorter values than these.
+ */
+static void pbkdf2_sha1_params(OSSL_PARAM *params) {
+	static int pkcs5 = 1;
+
+	params[0] = OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST,
+			"SHA1", 0);
+	params[1] = OSSL_PARAM_construct_int(OSSL_KDF_PARAM_PKCS5, &pkcs5);
+	params[2] = OSSL_PARAM_construct_end();
+}
+
+static void fetch(void) {
+	EVP_MAC *mac = NULL;
+	OSSL_PARAM mac_params[2];
+	OSSL_PARAM kdf_params[3];
+
+	aes_128_cbc = EVP_CIPHER_fetch(NULL, "AES-128-CBC", NULL);
+	aes_256_cbc = EVP_CIPHER_fetch(NULL, "AES-256-CBC", NULL);
+
+	if ((mac = EVP_MAC_fetch(NULL, "HMAC", NULL)) != NULL
+			&& (hmac_sha256_template = EVP_MAC_CTX_new(mac)) != NULL) {
+		mac_params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+				"SHA256", 0);
+		mac_params[1] = OSSL_PARAM_construct_end();
+		if (EVP_MAC_CTX_set_params(hmac_sha256_template, mac_params) != 1) {
+			EVP_MAC_CTX_free(hmac_sha256_template);
+			hmac_sha256_template = NULL;
+		}
+	}
+	EVP_MAC_free(mac);
+
+	if ((pbkdf2 = EVP_KDF_fetch(NULL, "PBKDF2", NULL)) != NULL
+			&& (pbkdf2_sha1_template = EVP_KDF_CTX_new(pbkdf2)) != NULL) {
+		pbkdf2_sha1_params(kdf_params);
+		if (EVP_KDF_CTX_set_params(pbkdf2_sha1_template, kdf_params) != 1) {
+			EVP_KDF_CTX_free(pbkdf2_sha1_template);
+			pbkdf2_sha1_template = NULL;
+		}
+	}
+
+	if (aes_128_cbc == NULL || aes_256_cbc == NULL
+			|| hmac_sha256_template == NULL || pbkdf2_sha1_template == NULL) {
+		fetch_error = ERR_get_error();
+	}
+
+	/* The AEAD ciphers are optional, lookup_aead() reports them missing */
+	aes_256_gcm = EVP_CIPHER_fetch(NULL, "AES-256-GCM", NULL);
+	chacha20_poly1305 = EVP_CIPHER_fetch(NULL, "ChaCha20-Poly1305", NULL);
+	if (aes_256_gcm == NULL || chacha20_poly1305 == NULL) {
+		ERR_clear_error();
+	}
+}
+
+/*
+ * Makes sure the objects have been fetched. Called by every function that
+ * uses them.
+ */
+static CironError ensure_fetched(CironContext context) {
+	pthread_once(&fetch_once, fetch);
+	if (aes_128_cbc == NULL || aes_256_cbc == NULL
+			|| hmac_sha256_template == NULL || pbkdf2_sha1_template == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, fetch_error,
+				CIRON_CRYPTO_ERROR, "Unable to fetch algorithms from OpenSSL provider");
+	}
+	return CIRON_OK;
+}
+
+/*
+ * Maps an encryption algorithm to its fetched cipher.
+ */
+static CironError lookup_cipher(CironContext context, CironAlgorithm algorithm,
+		const char *purpose, EVP_CIPHER **cipherp) {
+	CironError e;
+
+	if ((e = ensure_fetched(context)) != CIRON_OK) {
+		return e;
+	}
+	if (strcmp(algorithm->name, CIRON_AES_128_CBC->name) == 0) {
+		*cipherp = aes_128_cbc;
+	} else if (strcmp(algorithm->name, CIRON_AES_256_CBC->name) == 0) {
+		*cipherp = aes_256_cbc;
+	} else {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for %s", algorithm->name, purpose);
+	}
+	return CIRON_OK;
+}
+
+/*
+ * Runs a complete encryption or decryption on an already allocated context.
+ */
+static CironError run_cipher(CironContext context, EVP_CIPHER_CTX *ctx,
+		const EVP_CIPHER *cipher, int enc,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	int n;
+	int n2;
+
+	if (data_len > INT_MAX) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Data len %zu exceeds INT_MAX", data_len);
+	}
+	if (EVP_CipherInit_ex2(ctx, cipher, key, iv, enc, NULL) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to initialize %s cipher",
+				enc ? "encrypt" : "decrypt");
+	}
+	if (EVP_CipherUpdate(ctx, buf, &n, data, (int)data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to %s", enc ? "encrypt" : "decrypt");
+	}
+	if (EVP_CipherFinal_ex(ctx, buf + n, &n2) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to %s", enc ? "encrypt" : "decrypt");
+	}
+	*sizep = n + n2;
+	return CIRON_OK;
+}
+
+/*
+ * One-shot encryption or decryption with a context of its own.
+ */
+static CironError crypt_once(CironContext context, CironAlgorithm algorithm,
+		int enc, const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	CironError e;
+	EVP_CIPHER *cipher;
+	EVP_CIPHER_CTX *ctx;
+
+	if ((e = lookup_cipher(context, algorithm,
+			enc ? "encryption" : "decryption", &cipher)) != CIRON_OK) {
+		return e;
+	}
+	if ((ctx = EVP_CIPHER_CTX_new()) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate cipher context");
+	}
+	e = run_cipher(context, ctx, cipher, enc, key, iv, data, data_len, buf, sizep);
+	EVP_CIPHER_CTX_free(ctx);
+	return e;
+}
+
+static CironError openssl_encrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	return crypt_once(context, algorithm, 1, key, iv, data, data_len, buf, sizep);
+}
+
+static CironError openssl_decrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	return crypt_once(context, algorithm, 0, key, iv, data, data_len, buf, sizep);
+}
+
+/*
+ * Maps an AEAD algorithm to its fetched cipher.
+ */
+static CironError lookup_aead(CironContext context, CironAlgorithm algorithm,
+		const char *purpose, EVP_CIPHER **cipherp) {
+	CironError e;
+
+	if ((e = ensure_fetched(context)) != CIRON_OK) {
+		return e;
+	}
+	*cipherp = NULL;
+	if (strcmp(algorithm->name, CIRON_AES_256_GCM->name) == 0) {
+		*cipherp = aes_256_gcm;
+	} else if (strcmp(algorithm->name, CIRON_CHACHA20_POLY1305->name) == 0) {
+		*cipherp = chacha20_poly1305;
+	}
+	if (*cipherp == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for %s", algorithm->name, purpose);
+	}
+	return CIRON_OK;
+}
+
+/*
+ * AEAD encryption (enc = 1) or tag check and decryption (enc = 0). OpenSSL
+ * only checks the tag after it has decrypted, so buf is cleared again if
+ * the tag does not match.
+ */
+static CironError crypt_aead(CironContext context, CironAlgorithm algorithm,
+		int enc, const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag) {
+	CironError e;
+	EVP_CIPHER *cipher;
+	EVP_CIPHER_CTX *ctx;
+	int tag_len = NBYTES(algorithm->tag_bits);
+	int n;
+	int n2;
+	int ok;
+
+	if ((e = lookup_aead(context, algorithm,
+			enc ? "AEAD encryption" : "AEAD decryption", &cipher)) != CIRON_OK) {
+		return e;
+	}
+	if (aad_len > INT_MAX || data_len > INT_MAX) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Data len %zu exceeds INT_MAX", data_len);
+	}
+	if ((ctx = EVP_CIPHER_CTX_new()) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate cipher context");
+	}
+	ok = EVP_CipherInit_ex2(ctx, cipher, key, iv, enc, NULL) == 1
+			&& (enc || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, tag_len, tag) == 1)
+			&& (aad_len == 0 || EVP_CipherUpdate(ctx, NULL, &n, aad, (int) aad_len) == 1)
+			&& EVP_CipherUpdate(ctx, buf, &n, data, (int) data_len) == 1;
+	if (!ok) {
+		e = ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to %s", enc ? "encrypt" : "decrypt");
+	} else if (EVP_CipherFinal_ex(ctx, buf + n, &n2) != 1) {
+		if (enc) {
+			e = ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+					CIRON_CRYPTO_ERROR, "Unable to encrypt");
+		} else {
+			memset(buf, 0, data_len);
+			e = ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_TOKEN_VALIDATION_ERROR, "Authentication tag does not match");
+		}
+	} else if (enc && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, tag_len, tag) != 1) {
+		e = ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to get authentication tag");
+	}
+	EVP_CIPHER_CTX_free(ctx);
+	return e;
+}
+
+static CironError openssl_aead_encrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		unsigned char *tag) {
+	return crypt_aead(context, algorithm, 1, key, iv, aad, aad_len, data,
+			data_len, buf, tag);
+}
+
+static CironError openssl_aead_decrypt(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *aad, size_t aad_len,
+		const unsigned char *data, size_t data_len, const unsigned char *tag,
+		unsigned char *buf) {
+	return crypt_aead(context, algorithm, 0, key, iv, aad, aad_len, data,
+			data_len, buf, (unsigned char *) tag);
+}
+
+static CironError openssl_generate_key(CironContext context,
+		const unsigned char* password, size_t password_len,
+		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+		unsigned int iterations, unsigned char *buf) {
+	CironError e;
+	EVP_KDF_CTX *ctx;
+	OSSL_PARAM params[6];
+	OSSL_PARAM *p;
+	size_t keylen;
+	int r;
+
+	keylen = NBYTES(algorithm->key_bits);
+	assert(keylen <= MAX_KEY_BYTES);
+
+	if ((e = ensure_fetched(context)) != CIRON_OK) {
+		return e;
+	}
+	/*
+	 * PBKDF2 contexts can only be duplicated as of OpenSSL 3.1. Before
+	 * that we need a new context and must set the digest again.
+	 */
+	p = params;
+	if ((ctx = EVP_KDF_CTX_dup(pbkdf2_sha1_template)) == NULL) {
+		if ((ctx = EVP_KDF_CTX_new(pbkdf2)) == NULL) {
+			return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+					CIRON_CRYPTO_ERROR, "Unable to allocate KDF context");
+		}
+		pbkdf2_sha1_params(p);
+		p += 2;
+	}
+	p[0] = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_PASSWORD,
+			(void *) password, password_len);
+	p[1] = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT,
+			(void *) salt, salt_len);
+	p[2] = OSSL_PARAM_construct_uint(OSSL_KDF_PARAM_ITER, &iterations);
+	p[3] = OSSL_PARAM_construct_end();
+
+	r = EVP_KDF_derive(ctx, buf, keylen, params);
+	EVP_KDF_CTX_free(ctx);
+	if (r != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to generate key for algorithm %s",
+				algorithm->name);
+	}
+
+	return CIRON_OK;
+}
+
+/*
+ * Keys the MAC context and calculates the HMAC of data.
+ */
+static CironError mac(CironContext context, EVP_MAC_CTX *ctx,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	if (EVP_MAC_init(ctx, key, key_len, NULL) != 1
+			|| EVP_MAC_update(ctx, data, data_len) != 1
+			|| EVP_MAC_final(ctx, result, result_len, MAX_HMAC_BYTES) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+	}
+	return CIRON_OK;
+}
+
+/*
+ * Calculates the HMAC of data once the key has been derived.
+ */
+static CironError hmac(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	CironError e;
+	EVP_MAC_CTX *ctx;
+
+	if (strcmp(algorithm->name, CIRON_BLAKE3->name) == 0) {
+		assert(key_len == CIRON_BLAKE3_KEY_BYTES);
+		ciron_blake3_keyed(key, data, data_len, result);
+		*result_len = CIRON_BLAKE3_OUT_BYTES;
+		return CIRON_OK;
+	}
+	if ((e = ensure_fetched(context)) != CIRON_OK) {
+		return e;
+	}
+	if (strcmp(algorithm->name, CIRON_SHA_256->name) != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for HMAC calculation",
+				algorithm->name);
+	}
+	if ((ctx = EVP_MAC_CTX_dup(hmac_sha256_template)) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate HMAC context");
+	}
+	e = mac(context, ctx, key, key_len, data, data_len, result, result_len);
+	EVP_MAC_CTX_free(ctx);
+	return e;
+}
+
+static CironError openssl_hmac(CironContext context, CironAlgorithm algorithm,
+		const unsigned char *password, size_t password_len,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	CironError e;
+	unsigned char buffer_key_bytes[MAX_KEY_BYTES];
+	size_t key_len;
+
+	key_len = NBYTES(algorithm->key_bits);
+	assert(key_len <= MAX_KEY_BYTES);
+
+	if ((e = openssl_generate_key(context, password, password_len, salt_bytes,
+			salt_len, algorithm, iterations, buffer_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+
+	return hmac(context, algorithm, buffer_key_bytes, key_len, data, data_len,
+			result, result_len);
+}
+
+static CironError openssl_hmac_prepared(CironContext context, CironAlgorithm algorithm,
+		CironPreparedPassword password,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	return ciron_openssl_hmac_prepared(context, algorithm, password, salt_bytes,
+			salt_len, iterations, data, data_len, result, result_len, hmac);
+}
+
+/*
+ * Cipher and MAC objects for CironSealer. They hold on to the fetched
+ * cipher and a MAC context duplicated from the template, which are
+ * re-keyed for every use.
+ */
+struct openssl_cipher {
+	struct CironCipher base;
+	EVP_CIPHER *evp_cipher;
+	EVP_CIPHER_CTX *ctx;
+};
+
+struct openssl_mac {
+	struct CironMac base;
+	EVP_MAC_CTX *ctx;
+};
+
+static CironError openssl_cipher_new(CironContext context, CironAlgorithm algorithm,
+		struct CironCipher **cipherp) {
+	CironError e;
+	struct openssl_cipher *cipher;
+	EVP_CIPHER *evp_cipher;
+
+	if ((e = lookup_cipher(context, algorithm, "encryption", &evp_cipher))
+			!= CIRON_OK) {
+		return e;
+	}
+	if ((cipher = OPENSSL_malloc(sizeof(struct openssl_cipher))) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate cipher");
+	}
+	cipher->evp_cipher = evp_cipher;
+	if ((cipher->ctx = EVP_CIPHER_CTX_new()) == NULL) {
+		OPENSSL_free(cipher);
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate cipher context");
+	}
+	cipher->base.functions = &ciron_crypto_openssl;
+	*cipherp = &cipher->base;
+	return CIRON_OK;
+}
+
+static void openssl_cipher_free(struct CironCipher *base) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+
+	if (cipher == NULL) {
+		return;
+	}
+	EVP_CIPHER_CTX_free(cipher->ctx);
+	OPENSSL_free(cipher);
+}
+
+static CironError openssl_cipher_encrypt(CironContext context, struct CironCipher *base,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+
+	return run_cipher(context, cipher->ctx, cipher->evp_cipher, 1, key, iv, data,
+			data_len, buf, sizep);
+}
+
+static CironError openssl_cipher_decrypt(CironContext context, struct CironCipher *base,
+		const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+
+	return run_cipher(context, cipher->ctx, cipher->evp_cipher, 0, key, iv, data,
+			data_len, buf, sizep);
+}
+
+static CironError openssl_cipher_encrypt_init(CironContext context,
+		struct CironCipher *base, const unsigned char *key, const unsigned char *iv) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+
+	if (EVP_CipherInit_ex2(cipher->ctx, cipher->evp_cipher, key, iv, 1, NULL) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to initialize encrypt cipher");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_encrypt_update(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+
+	if (data_len > INT_MAX) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Data len %zu exceeds INT_MAX", data_len);
+	}
+	if (data_len % CIPHER_BLOCK_SIZE != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Unable to encrypt, data len %zu is not a multiple of the block size",
+				data_len);
+	}
+	if (EVP_CipherUpdate(cipher->ctx, buf, &n, data, (int)data_len) != 1
+			|| (size_t) n != data_len) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_encrypt_final(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+	int n2;
+
+	if (data_len > INT_MAX) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Data len %zu exceeds INT_MAX", data_len);
+	}
+	if (EVP_CipherUpdate(cipher->ctx, buf, &n, data, (int)data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	if (EVP_CipherFinal_ex(cipher->ctx, buf + n, &n2) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to encrypt");
+	}
+	*sizep = n + n2;
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_decrypt_init(CironContext context,
+		struct CironCipher *base, const unsigned char *key, const unsigned char *iv) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+
+	if (EVP_CipherInit_ex2(cipher->ctx, cipher->evp_cipher, key, iv, 0, NULL) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to initialize decrypt cipher");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_decrypt_update(CironContext context,
+		struct CironCipher *base, const unsigned char *data, size_t data_len,
+		unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+
+	if (data_len > INT_MAX) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Data len %zu exceeds INT_MAX", data_len);
+	}
+	if (data_len % CIPHER_BLOCK_SIZE != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Unable to decrypt, data len %zu is not a multiple of the block size",
+				data_len);
+	}
+	if (EVP_CipherUpdate(cipher->ctx, buf, &n, data, (int)data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to decrypt");
+	}
+	*sizep = n;
+	return CIRON_OK;
+}
+
+static CironError openssl_cipher_decrypt_final(CironContext context,
+		struct CironCipher *base, unsigned char *buf, size_t *sizep) {
+	struct openssl_cipher *cipher = (struct openssl_cipher *) base;
+	int n;
+
+	if (EVP_CipherFinal_ex(cipher->ctx, buf, &n) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to decrypt");
+	}
+	*sizep = n;
+	return CIRON_OK;
+}
+
+static CironError openssl_mac_new(CironContext context, CironAlgorithm algorithm,
+		struct CironMac **macp) {
+	CironError e;
+	struct openssl_mac *m;
+
+	/* libcrypto has no BLAKE3, the native MAC object calculates it */
+	if (strcmp(algorithm->name, CIRON_BLAKE3->name) == 0) {
+		return ciron_crypto_native.mac_new(context, algorithm, macp);
+	}
+	if ((e = ensure_fetched(context)) != CIRON_OK) {
+		return e;
+	}
+	if (strcmp(algorithm->name, CIRON_SHA_256->name) != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Algorithm %s not recognized for HMAC calculation",
+				algorithm->name);
+	}
+	if ((m = OPENSSL_malloc(sizeof(struct openssl_mac))) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate HMAC");
+	}
+	if ((m->ctx = EVP_MAC_CTX_dup(hmac_sha256_template)) == NULL) {
+		OPENSSL_free(m);
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to allocate HMAC context");
+	}
+	m->base.functions = &ciron_crypto_openssl;
+	*macp = &m->base;
+	return CIRON_OK;
+}
+
+static void openssl_mac_free(struct CironMac *base) {
+	struct openssl_mac *m = (struct openssl_mac *) base;
+
+	if (m == NULL) {
+		return;
+	}
+	EVP_MAC_CTX_free(m->ctx);
+	OPENSSL_free(m);
+}
+
+static CironError openssl_mac(CironContext context, struct CironMac *base,
+		const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	struct openssl_mac *m = (struct openssl_mac *) base;
+
+	return mac(context, m->ctx, key, key_len, data, data_len, result, result_len);
+}
+
+static CironError openssl_mac_init(CironContext context, struct CironMac *base,
+		const unsigned char *key, size_t key_len) {
+	struct openssl_mac *m = (struct openssl_mac *) base;
+
+	if (EVP_MAC_init(m->ctx, key, key_len, NULL) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_mac_update(CironContext context, struct CironMac *base,
+		const unsigned char *data, size_t data_len) {
+	struct openssl_mac *m = (struct openssl_mac *) base;
+
+	if (EVP_MAC_update(m->ctx, data, data_len) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+	}
+	return CIRON_OK;
+}
+
+static CironError openssl_mac_final(CironContext context, struct CironMac *base,
+		unsigned char *result, size_t *result_len) {
+	struct openssl_mac *m = (struct openssl_mac *) base;
+
+	if (EVP_MAC_final(m->ctx, result, result_len, MAX_HMAC_BYTES) != 1) {
+		return ciron_set_error(context, __FILE__, __LINE__, ERR_get_error(),
+				CIRON_CRYPTO_ERROR, "Unable to calculate HMAC");
+	}
+	return CIRON_OK;
+}
+
+const struct CironCryptoFunctions ciron_crypto_openssl = {
+	ciron_openssl_password_prepare,
+	openssl_generate_key,
+	ciron_openssl_generate_key_prepared,
+	openssl_encrypt,
+	openssl_decrypt,
+	openssl_aead_encrypt,
+	openssl_aead_decrypt,
+	openssl_hmac,
+	openssl_hmac_prepared,
+	openssl_cipher_new,
+	openssl_cipher_free,
+	openssl_cipher_encrypt,
+	openssl_cipher_decrypt,
+	openssl_cipher_encrypt_init,
+	openssl_cipher_encrypt_update,
+	openssl_cipher_encrypt_final,
+	openssl_cipher_decrypt_init,
+	openssl_cipher_decrypt_update,
+	openssl_cipher_decrypt_final,
+	openssl_mac_new,
+	openssl_mac_free,
+	openssl_mac,
+	openssl_mac_init,
+	openssl_mac_update,
+	openssl_mac_final,
+	NULL,
+	NULL,
+	NULL
+};
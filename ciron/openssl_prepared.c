@@ -0,0 +1,183 @@
+/*
+ * This file provides the prepared password functions shared by the
+ * crypto implementations using libcrypto of OpenSSL, crypto_openssl.c
+ * and crypto_openssl3.c.
+ */
+
+/*
+ * The prepared password functions must resume SHA-1 from a captured
+ * state, which the EVP interface does not allow. The low-level SHA-1
+ * functions needed for that are deprecated in OpenSSL 3, but still
+ * available.
+ */
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/sha.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "crypto.h"
+#include "openssl_prepared.h"
+
+/*
+ * Captures the state of a SHA-1 context after it has hashed exactly one
+ * block, which is all the prepared password needs to store.
+ */
+static void sha1_capture(const SHA_CTX *c, uint32_t *state) {
+	state[0] = c->h0;
+	state[1] = c->h1;
+	state[2] = c->h2;
+	state[3] = c->h3;
+	state[4] = c->h4;
+}
+
+/*
+ * Restores a SHA-1 context from a state captured by sha1_capture.
+ */
+static void sha1_resume(SHA_CTX *c, const uint32_t *state) {
+	memset(c, 0, sizeof(SHA_CTX));
+	c->h0 = state[0];
+	c->h1 = state[1];
+	c->h2 = state[2];
+	c->h3 = state[3];
+	c->h4 = state[4];
+	c->Nl = SHA_CBLOCK * 8;
+}
+
+/*
+ * HMAC-SHA1 of the concatenation of data1 and data2, starting from the
+ * prepared pad states. data2 may be NULL.
+ */
+static void hmac_sha1_prepared(CironPreparedPassword password,
+		const unsigned char *data1, size_t data1_len,
+		const unsigned char *data2, size_t data2_len, unsigned char *result) {
+	SHA_CTX c;
+	unsigned char inner[SHA_DIGEST_LENGTH];
+
+	sha1_resume(&c, password->inner_state);
+	SHA1_Update(&c, data1, data1_len);
+	if (data2 != NULL) {
+		SHA1_Update(&c, data2, data2_len);
+	}
+	SHA1_Final(inner, &c);
+
+	sha1_resume(&c, password->outer_state);
+	SHA1_Update(&c, inner, SHA_DIGEST_LENGTH);
+	SHA1_Final(result, &c);
+
+	OPENSSL_cleanse(inner, sizeof(inner));
+	OPENSSL_cleanse(&c, sizeof(c));
+}
+
+CironError ciron_openssl_password_prepare(CironContext context,
+		const unsigned char *password, size_t password_len,
+		CironPreparedPassword prepared) {
+	SHA_CTX c;
+	unsigned char key[SHA_CBLOCK];
+	unsigned char pad[SHA_CBLOCK];
+	size_t i;
+
+	/*
+	 * HMAC keys longer than the block size are hashed first, shorter
+	 * ones are padded with zeros (RFC 2104).
+	 */
+	memset(key, 0, sizeof(key));
+	if (password_len > SHA_CBLOCK) {
+		SHA1(password, password_len, key);
+	} else if (password_len > 0) {
+		memcpy(key, password, password_len);
+	}
+
+	for (i = 0; i < SHA_CBLOCK; i++) {
+		pad[i] = key[i] ^ 0x36;
+	}
+	SHA1_Init(&c);
+	SHA1_Update(&c, pad, SHA_CBLOCK);
+	sha1_capture(&c, prepared->inner_state);
+
+	for (i = 0; i < SHA_CBLOCK; i++) {
+		pad[i] = key[i] ^ 0x5c;
+	}
+	SHA1_Init(&c);
+	SHA1_Update(&c, pad, SHA_CBLOCK);
+	sha1_capture(&c, prepared->outer_state);
+
+	OPENSSL_cleanse(key, sizeof(key));
+	OPENSSL_cleanse(pad, sizeof(pad));
+	OPENSSL_cleanse(&c, sizeof(c));
+
+	return CIRON_OK;
+}
+
+/*
+ * PBKDF2 (RFC 2898, section 5.2) with HMAC-SHA1 as the PRF. Unlike
+ * PKCS5_PBKDF2_HMAC_SHA1 this never hashes the password but resumes
+ * each HMAC from the prepared states.
+ */
+CironError ciron_openssl_generate_key_prepared(CironContext context,
+		CironPreparedPassword password,
+		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+		unsigned int iterations, unsigned char *buf) {
+	unsigned char u[SHA_DIGEST_LENGTH];
+	unsigned char t[SHA_DIGEST_LENGTH];
+	unsigned char block_index[4];
+	unsigned long block;
+	size_t keylen;
+	size_t done;
+	size_t n;
+	size_t j;
+	unsigned int i;
+
+	keylen = NBYTES(algorithm->key_bits);
+	assert(keylen <= MAX_KEY_BYTES);
+
+	for (block = 1, done = 0; done < keylen; block++, done += n) {
+		block_index[0] = (unsigned char) (block >> 24);
+		block_index[1] = (unsigned char) (block >> 16);
+		block_index[2] = (unsigned char) (block >> 8);
+		block_index[3] = (unsigned char) block;
+
+		hmac_sha1_prepared(password, salt, salt_len, block_index, 4, u);
+		memcpy(t, u, SHA_DIGEST_LENGTH);
+		for (i = 1; i < iterations; i++) {
+			hmac_sha1_prepared(password, u, SHA_DIGEST_LENGTH, NULL, 0, u);
+			for (j = 0; j < SHA_DIGEST_LENGTH; j++) {
+				t[j] ^= u[j];
+			}
+		}
+
+		n = keylen - done;
+		if (n > SHA_DIGEST_LENGTH) {
+			n = SHA_DIGEST_LENGTH;
+		}
+		memcpy(buf + done, t, n);
+	}
+
+	OPENSSL_cleanse(u, sizeof(u));
+	OPENSSL_cleanse(t, sizeof(t));
+
+	return CIRON_OK;
+}
+
+CironError ciron_openssl_hmac_prepared(CironContext context, CironAlgorithm algorithm,
+		CironPreparedPassword password,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len, CironOpensslHmac hmac) {
+	CironError e;
+	unsigned char buffer_key_bytes[MAX_KEY_BYTES];
+	size_t key_len;
+
+	key_len = NBYTES(algorithm->key_bits);
+	assert(key_len <= MAX_KEY_BYTES);
+
+	if ((e = ciron_openssl_generate_key_prepared(context, password, salt_bytes,
+			salt_len, algorithm, iterations, buffer_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+
+	return hmac(context, algorithm, buffer_key_bytes, key_len, data, data_len,
+			result, result_len);
+}
@@ -0,0 +1,53 @@
+#ifndef CIRON_OPENSSL_PREPARED_H
+#define CIRON_OPENSSL_PREPARED_H 1
+
+#include "ciron.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Prepared passwords for the crypto implementations using libcrypto of
+ * OpenSSL (crypto_openssl.c and crypto_openssl3.c).
+ *
+ * libcrypto has no PBKDF2 that starts from HMAC pad states, so these
+ * functions implement PBKDF2-HMAC-SHA1 on the low-level SHA-1 functions
+ * of libcrypto, which both OpenSSL 1.0 and 3 provide.
+ */
+
+/** Calculates the HMAC of data with a key that has been derived already.
+ * Every implementation provides its own.
+ */
+typedef CironError (*CironOpensslHmac)(CironContext context,
+		CironAlgorithm algorithm, const unsigned char *key, size_t key_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len);
+
+/** The password_prepare function of the implementations.
+ */
+CironError ciron_openssl_password_prepare(CironContext context,
+		const unsigned char *password, size_t password_len,
+		CironPreparedPassword prepared);
+
+/** The generate_key_prepared function of the implementations.
+ */
+CironError ciron_openssl_generate_key_prepared(CironContext context,
+		CironPreparedPassword password,
+		const unsigned char *salt, size_t salt_len, CironAlgorithm algorithm,
+		unsigned int iterations, unsigned char *buf);
+
+/** The hmac_prepared function of the implementations, calculating the
+ * HMAC with the supplied function of the implementation.
+ */
+CironError ciron_openssl_hmac_prepared(CironContext context, CironAlgorithm algorithm,
+		CironPreparedPassword password,
+		const unsigned char *salt_bytes, size_t salt_len, unsigned int iterations,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len, CironOpensslHmac hmac);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_OPENSSL_PREPARED_H */
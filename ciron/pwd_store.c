@@ -0,0 +1,136 @@
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include "ciron.h"
+#include "common.h"
+#include "atomics.h"
+
+/*
+ * Password store, see struct CironPasswordStore in ciron.h.
+ *
+ * The store reclaims tables by epochs. Every publication increments the
+ * epoch of the store. A reader entering the store records the current
+ * epoch in its slot before it loads the table, and clears it when it
+ * leaves. A publisher swaps the table first and increments the epoch
+ * then, so a reader that recorded the new epoch gets the new table. The
+ * previous table may only be in use by readers that recorded an older
+ * epoch, and the publisher waits until none of them is left.
+ *
+ * All accesses are sequentially consistent. The reader would otherwise
+ * need a full fence between storing its epoch and loading the table
+ * anyway, and readers enter the store once per token, next to a key
+ * derivation.
+ */
+
+/*
+ * Readers only write to their own slot, which fills a cache line so that
+ * readers on different cores do not contend for it.
+ */
+struct CironStoreReader {
+	/* The epoch of the store when the reader entered it, 0 outside */
+	unsigned long epoch;
+	/* 1 if a thread has registered with the slot */
+	unsigned int registered;
+	unsigned char pad[CACHE_LINE_BYTES - sizeof(unsigned long) - sizeof(unsigned int)];
+};
+
+CironError ciron_calculate_password_store_buffer_length(CironContext context,
+		unsigned int nreaders, size_t *result_len) {
+	if (nreaders == 0 || nreaders > (SIZE_MAX - CACHE_LINE_BYTES)
+			/ sizeof(struct CironStoreReader)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Password store of %u readers not supported",
+				nreaders);
+	}
+	*result_len = CACHE_LINE_BYTES - 1 + nreaders * sizeof(struct CironStoreReader);
+	return CIRON_OK;
+}
+
+CironError ciron_password_store_init(CironContext context,
+		CironPasswordStore store, CironIndexedPwdTable table, unsigned int nreaders,
+		unsigned char *buffer, size_t buffer_len) {
+	CironError e;
+	size_t needed = 0;
+	uintptr_t misalignment;
+
+	if ((e = ciron_calculate_password_store_buffer_length(context, nreaders,
+			&needed)) != CIRON_OK) {
+		return e;
+	}
+	if (buffer_len < needed) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR,
+				"Password store buffer of %zu bytes too small, %zu needed",
+				buffer_len, needed);
+	}
+	misalignment = (uintptr_t) buffer % CACHE_LINE_BYTES;
+	if (misalignment != 0) {
+		buffer += CACHE_LINE_BYTES - misalignment;
+	}
+	memset(buffer, 0, nreaders * sizeof(struct CironStoreReader));
+	store->readers = (struct CironStoreReader *) buffer;
+	store->nreaders = nreaders;
+	store->epoch = 1;
+	STORE(&store->current, table);
+	return CIRON_OK;
+}
+
+CironError ciron_password_store_register(CironContext context,
+		CironPasswordStore store, unsigned int *reader) {
+	unsigned int n, expected;
+
+	for (n = 0; n < store->nreaders; n++) {
+		expected = 0;
+		if (__atomic_compare_exchange_n(&store->readers[n].registered,
+				&expected, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			*reader = n;
+			return CIRON_OK;
+		}
+	}
+	return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+			CIRON_OVERFLOW_ERROR, "All %u readers of the password store registered",
+			store->nreaders);
+}
+
+void ciron_password_store_unregister(CironPasswordStore store,
+		unsigned int reader) {
+	STORE(&store->readers[reader].epoch, 0);
+	STORE(&store->readers[reader].registered, 0);
+}
+
+CironIndexedPwdTable ciron_password_store_enter(CironPasswordStore store,
+		unsigned int reader) {
+	STORE(&store->readers[reader].epoch, LOAD(&store->epoch));
+	return LOAD(&store->current);
+}
+
+void ciron_password_store_leave(CironPasswordStore store,
+		unsigned int reader) {
+	STORE(&store->readers[reader].epoch, 0);
+}
+
+CironIndexedPwdTable ciron_password_store_publish(CironPasswordStore store,
+		CironIndexedPwdTable table) {
+	CironIndexedPwdTable previous;
+	unsigned long epoch, reader_epoch;
+	unsigned int n;
+
+	previous = __atomic_exchange_n(&store->current, table, __ATOMIC_SEQ_CST);
+	epoch = __atomic_add_fetch(&store->epoch, 1, __ATOMIC_SEQ_CST);
+
+	/*
+	 * Readers that entered before the epoch was incremented may have the
+	 * previous table. Those entering later get the new one, so the wait
+	 * ends even while readers keep entering.
+	 */
+	for (n = 0; n < store->nreaders; n++) {
+		for (;;) {
+			reader_epoch = LOAD(&store->readers[n].epoch);
+			if (reader_epoch == 0 || reader_epoch >= epoch) {
+				break;
+			}
+			sched_yield();
+		}
+	}
+	return previous;
+}
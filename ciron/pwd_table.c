@@ -0,0 +1,188 @@
+#include <string.h>
+#include <stdint.h>
+#include "ciron.h"
+#include "common.h"
+
+/*
+ * Hash index of password tables, see struct CironPwdIndex in ciron.h.
+ *
+ * The index has at least twice as many slots as the table has entries,
+ * so that a lookup, including one of an ID that is not in the table,
+ * probes few slots. A slot is two uint32_t, the hash of the ID and the
+ * entry number plus 1, so the hash is compared without any other memory
+ * access.
+ */
+
+#define SLOT_HASH(index, i) ((index)->slots[2 * (i)])
+#define SLOT_ENTRY(index, i) ((index)->slots[2 * (i) + 1])
+
+/*
+ * The arrays are stored in this order after aligning the buffer for
+ * size_t. The slots follow the lengths and are so aligned, too.
+ */
+#define ALIGNMENT sizeof(size_t)
+
+/*
+ * Bytes of the buffer needed per entry at most, with twice to four times
+ * as many slots as entries.
+ */
+#define MAX_BYTES_PER_ENTRY (4 * 2 * sizeof(uint32_t) + sizeof(size_t) + CIRON_PWD_INDEX_ID_BYTES)
+
+static size_t index_slots(unsigned int nentries) {
+	size_t nslots = 2;
+
+	while (nslots < 2 * (size_t) nentries) {
+		nslots *= 2;
+	}
+	return nslots;
+}
+
+CironError ciron_calculate_pwd_index_buffer_length(CironContext context,
+		unsigned int nentries, size_t *result_len) {
+	size_t nslots;
+
+	/* Entry numbers plus 1 must fit the slots */
+	if (nentries >= UINT32_MAX
+			|| nentries > (SIZE_MAX - ALIGNMENT - 4 * sizeof(uint32_t)) / MAX_BYTES_PER_ENTRY) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Password table of %u entries too large",
+				nentries);
+	}
+	nslots = index_slots(nentries);
+	*result_len = ALIGNMENT - 1 + nentries * sizeof(size_t)
+			+ nslots * 2 * sizeof(uint32_t) + nentries * CIRON_PWD_INDEX_ID_BYTES;
+	return CIRON_OK;
+}
+
+/*
+ * Compares an ID with the one of an entry, of which the first
+ * CIRON_PWD_INDEX_ID_BYTES bytes are in the index.
+ */
+static int id_equal(CironIndexedPwdTable indexed, uint32_t e,
+		const unsigned char *id, size_t len) {
+	CironPwdIndex index = &indexed->index;
+
+	if (index->id_lens[e] != len) {
+		return 0;
+	}
+	if (len <= CIRON_PWD_INDEX_ID_BYTES) {
+		return memcmp(index->ids + e * CIRON_PWD_INDEX_ID_BYTES, id, len) == 0;
+	}
+	return memcmp(index->ids + e * CIRON_PWD_INDEX_ID_BYTES, id,
+			CIRON_PWD_INDEX_ID_BYTES) == 0
+			&& memcmp(indexed->table.entries[e].password_id + CIRON_PWD_INDEX_ID_BYTES,
+					id + CIRON_PWD_INDEX_ID_BYTES,
+					len - CIRON_PWD_INDEX_ID_BYTES) == 0;
+}
+
+CironError ciron_pwd_table_index(CironContext context,
+		CironIndexedPwdTable indexed, CironPwdTable table,
+		unsigned char *buffer, size_t buffer_len) {
+	CironError e;
+	CironPwdIndex index = &indexed->index;
+	CironPwdTableEntry entry;
+	size_t needed, mask, i;
+	uintptr_t misalignment;
+	uint32_t hash, n;
+
+	if ((e = ciron_calculate_pwd_index_buffer_length(context, table->nentries,
+			&needed)) != CIRON_OK) {
+		return e;
+	}
+	if (buffer_len < needed) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR,
+				"Password index buffer of %zu bytes too small, %zu needed",
+				buffer_len, needed);
+	}
+
+	misalignment = (uintptr_t) buffer % ALIGNMENT;
+	if (misalignment != 0) {
+		buffer += ALIGNMENT - misalignment;
+	}
+	indexed->table = *table;
+	indexed->prepared = NULL;
+	index->nslots = index_slots(table->nentries);
+	index->id_lens = (size_t *) buffer;
+	index->slots = (uint32_t *) (index->id_lens + table->nentries);
+	index->ids = (unsigned char *) (index->slots + 2 * index->nslots);
+	memset(index->slots, 0, index->nslots * 2 * sizeof(uint32_t));
+	mask = index->nslots - 1;
+
+	for (n = 0; n < table->nentries; n++) {
+		entry = &table->entries[n];
+		index->id_lens[n] = entry->password_id_len;
+		memcpy(index->ids + n * CIRON_PWD_INDEX_ID_BYTES, entry->password_id,
+				entry->password_id_len < CIRON_PWD_INDEX_ID_BYTES
+						? entry->password_id_len : CIRON_PWD_INDEX_ID_BYTES);
+
+		/* An ID seen before keeps its first entry */
+		hash = ciron_hash(entry->password_id, entry->password_id_len);
+		for (i = hash & mask; SLOT_ENTRY(index, i) != 0; i = (i + 1) & mask) {
+			if (SLOT_HASH(index, i) == hash && id_equal(indexed,
+					SLOT_ENTRY(index, i) - 1, entry->password_id,
+					entry->password_id_len)) {
+				break;
+			}
+		}
+		if (SLOT_ENTRY(index, i) == 0) {
+			SLOT_HASH(index, i) = hash;
+			SLOT_ENTRY(index, i) = n + 1;
+		}
+	}
+	return CIRON_OK;
+}
+
+CironPwdTableEntry ciron_pwd_table_find(CironIndexedPwdTable indexed,
+		const unsigned char *id, size_t len) {
+	CironPwdTable table = &indexed->table;
+	CironPwdIndex index = &indexed->index;
+	CironPwdTableEntry entry;
+	size_t mask, i;
+	uint32_t hash;
+
+	if (index->nslots == 0) {
+		for (i = 0; i < table->nentries; i++) {
+			entry = &table->entries[i];
+			if (entry->password_id_len == len
+					&& memcmp(entry->password_id, id, len) == 0) {
+				return entry;
+			}
+		}
+		return NULL;
+	}
+
+	hash = ciron_hash(id, len);
+	mask = index->nslots - 1;
+	for (i = hash & mask; SLOT_ENTRY(index, i) != 0; i = (i + 1) & mask) {
+		if (SLOT_HASH(index, i) == hash
+				&& id_equal(indexed, SLOT_ENTRY(index, i) - 1, id, len)) {
+			return &table->entries[SLOT_ENTRY(index, i) - 1];
+		}
+	}
+	return NULL;
+}
+
+void ciron_pwd_table_unindexed(CironIndexedPwdTable indexed, CironPwdTable table) {
+	indexed->table = *table;
+	memset(&indexed->index, 0, sizeof(indexed->index));
+	indexed->prepared = NULL;
+}
+
+CironError ciron_pwd_table_prepare(CironContext context,
+		CironIndexedPwdTable indexed, struct CironPreparedPassword *prepared) {
+	CironPwdTable table = &indexed->table;
+	CironError e;
+	CironPwdTableEntry entry;
+	unsigned int n;
+
+	for (n = 0; n < table->nentries; n++) {
+		entry = &table->entries[n];
+		if ((e = ciron_password_prepare(context, entry->password,
+				entry->password_len, &prepared[n])) != CIRON_OK) {
+			return e;
+		}
+	}
+	indexed->prepared = prepared;
+	return CIRON_OK;
+}
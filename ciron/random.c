@@ -0,0 +1,214 @@
+/*
+ * This file implements the random pool described in random.h.
+ */
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "random.h"
+
+#ifdef HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
+
+#if defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define THREAD_LOCAL _Thread_local
+#else
+#error "ciron needs thread-local storage for its random pool"
+#endif
+
+#define POOL_BLOCKS 16
+#define POOL_BYTES (POOL_BLOCKS * CIRON_CHACHA20_BLOCK_BYTES)
+
+struct pool {
+	unsigned char key[CIRON_CHACHA20_KEY_BYTES];
+	unsigned char bytes[POOL_BYTES];
+	/* Index of the first byte of bytes not handed out yet */
+	size_t next;
+	/* The fork_generation the key has been seeded in, 0 if never */
+	unsigned long generation;
+};
+
+static THREAD_LOCAL struct pool pool;
+
+/*
+ * Incremented in the child of every fork(), so the pools copied from the
+ * parent are seeded again instead of repeating the parent's output.
+ */
+static unsigned long fork_generation = 1;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static CironRandomSource source;
+static void *source_arg;
+
+static const unsigned char zero_nonce[CIRON_CHACHA20_NONCE_BYTES];
+
+static uint32_t load_le32(const unsigned char *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+			| ((uint32_t) p[3] << 24);
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char) v;
+	p[1] = (unsigned char) (v >> 8);
+	p[2] = (unsigned char) (v >> 16);
+	p[3] = (unsigned char) (v >> 24);
+}
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d) do { \
+	a += b; d ^= a; d = ROTL32(d, 16); \
+	c += d; b ^= c; b = ROTL32(b, 12); \
+	a += b; d ^= a; d = ROTL32(d, 8); \
+	c += d; b ^= c; b = ROTL32(b, 7); \
+} while (0)
+
+void ciron_chacha20(const unsigned char *key, const unsigned char *nonce,
+		uint32_t counter, unsigned char *out, size_t nblocks) {
+	uint32_t input[16];
+	uint32_t x[16];
+	int i;
+
+	/* "expand 32-byte k" */
+	input[0] = 0x61707865;
+	input[1] = 0x3320646e;
+	input[2] = 0x79622d32;
+	input[3] = 0x6b206574;
+	for (i = 0; i < 8; i++) {
+		input[4 + i] = load_le32(key + 4 * i);
+	}
+	input[12] = counter;
+	for (i = 0; i < 3; i++) {
+		input[13 + i] = load_le32(nonce + 4 * i);
+	}
+
+	while (nblocks-- > 0) {
+		memcpy(x, input, sizeof(x));
+		for (i = 0; i < 10; i++) {
+			QUARTERROUND(x[0], x[4], x[8], x[12]);
+			QUARTERROUND(x[1], x[5], x[9], x[13]);
+			QUARTERROUND(x[2], x[6], x[10], x[14]);
+			QUARTERROUND(x[3], x[7], x[11], x[15]);
+			QUARTERROUND(x[0], x[5], x[10], x[15]);
+			QUARTERROUND(x[1], x[6], x[11], x[12]);
+			QUARTERROUND(x[2], x[7], x[8], x[13]);
+			QUARTERROUND(x[3], x[4], x[9], x[14]);
+		}
+		for (i = 0; i < 16; i++) {
+			store_le32(out + 4 * i, x[i] + input[i]);
+		}
+		out += CIRON_CHACHA20_BLOCK_BYTES;
+		input[12]++;
+	}
+	memset(x, 0, sizeof(x));
+	memset(input, 0, sizeof(input));
+}
+
+/*
+ * Fills buf with nbytes from the kernel's CSPRNG.
+ */
+static int system_random(unsigned char *buf, size_t nbytes) {
+#ifdef HAVE_GETRANDOM
+	ssize_t n;
+
+	while (nbytes > 0) {
+		if ((n = getrandom(buf, nbytes, 0)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf += n;
+		nbytes -= n;
+	}
+	return 0;
+#else
+	ssize_t n;
+	int fd;
+
+	if ((fd = open("/dev/urandom", O_RDONLY)) < 0) {
+		return -1;
+	}
+	while (nbytes > 0) {
+		if ((n = read(fd, buf, nbytes)) <= 0) {
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			close(fd);
+			return -1;
+		}
+		buf += n;
+		nbytes -= n;
+	}
+	close(fd);
+	return 0;
+#endif
+}
+
+static void forked_child(void) {
+	fork_generation++;
+}
+
+static void register_atfork(void) {
+	pthread_atfork(NULL, NULL, forked_child);
+}
+
+/*
+ * Refills the pool from a key stream block of the current key, the first
+ * bytes of which replace the key.
+ */
+static int refill(struct pool *p) {
+	if (p->generation != fork_generation) {
+		pthread_once(&atfork_once, register_atfork);
+		if (system_random(p->key, sizeof(p->key)) != 0) {
+			return -1;
+		}
+		p->generation = fork_generation;
+	}
+	ciron_chacha20(p->key, zero_nonce, 0, p->bytes, POOL_BLOCKS);
+	memcpy(p->key, p->bytes, sizeof(p->key));
+	memset(p->bytes, 0, sizeof(p->key));
+	p->next = sizeof(p->key);
+	return 0;
+}
+
+int ciron_random_bytes(unsigned char *buf, size_t nbytes) {
+	struct pool *p = &pool;
+	size_t n;
+
+	if (source != NULL) {
+		return source(source_arg, buf, nbytes);
+	}
+
+	/* Bytes drawn before a fork() must not be handed out in the child */
+	if (p->generation != fork_generation) {
+		p->next = POOL_BYTES;
+	}
+	while (nbytes > 0) {
+		if (p->next == POOL_BYTES && refill(p) != 0) {
+			return -1;
+		}
+		n = POOL_BYTES - p->next;
+		if (n > nbytes) {
+			n = nbytes;
+		}
+		memcpy(buf, p->bytes + p->next, n);
+		memset(p->bytes + p->next, 0, n);
+		p->next += n;
+		buf += n;
+		nbytes -= n;
+	}
+	return 0;
+}
+
+void ciron_set_random_source(CironRandomSource s, void *arg) {
+	source = s;
+	source_arg = arg;
+}
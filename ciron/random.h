@@ -0,0 +1,49 @@
+#ifndef CIRON_RANDOM_H
+#define CIRON_RANDOM_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Random bytes for salts and IVs.
+ *
+ * Every token needs two salts and an IV, a few dozen bytes in three
+ * requests. Asking the kernel or a locked library generator for each of
+ * them costs more than the bytes are worth, so every thread keeps a pool
+ * of random bytes instead. The pool is filled 1 KiB at a time by ChaCha20
+ * in fast key erasure mode: the first 32 bytes of every block of output
+ * become the key of the next one and bytes are wiped from the pool when
+ * they are handed out, so the pool never holds anything from which past
+ * output can be computed. The key is seeded from the kernel (getrandom or
+ * /dev/urandom) and seeded again in the child after fork().
+ *
+ * ciron_set_random_source() in ciron.h replaces the pool.
+ */
+
+#define CIRON_CHACHA20_KEY_BYTES 32
+#define CIRON_CHACHA20_NONCE_BYTES 12
+#define CIRON_CHACHA20_BLOCK_BYTES 64
+
+/** Fill buf with nbytes random bytes from the pool of the calling thread,
+ * or the source set with ciron_set_random_source().
+ *
+ * Returns 0 on success and -1 if the kernel or the source failed, errno
+ * is set in the first case.
+ */
+int ciron_random_bytes(unsigned char *buf, size_t nbytes);
+
+/** Write nblocks blocks of the ChaCha20 key stream (RFC 8439) to out,
+ * starting with block counter.
+ */
+void ciron_chacha20(const unsigned char *key, const unsigned char *nonce,
+		uint32_t counter, unsigned char *out, size_t nblocks);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_RANDOM_H */
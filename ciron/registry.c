@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ciron.h"
+#include "common.h"
+#include "registry.h"
+
+#define ENVIRONMENT_VARIABLE "CIRON_IMPLEMENTATION"
+
+static struct CironPrimitive *primitives[] = {
+	&ciron_crypto_primitive,
+	&ciron_aes_primitive,
+	&ciron_ghash_primitive,
+	&ciron_sha_primitive,
+	&ciron_sha_mb_primitive,
+	&ciron_blake3_primitive,
+	&ciron_base64url_primitive,
+	&ciron_hex_primitive,
+	NULL
+};
+
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Finds the first implementation with the given name (all if name is
+ * NULL) that the CPU supports.
+ */
+static const struct CironImplementation *find_implementation(
+		const struct CironPrimitive *primitive, const char *name, size_t name_len) {
+	const struct CironImplementation *i;
+	unsigned int features = ciron_cpu_features();
+
+	for (i = primitive->implementations; i->name != NULL; i++) {
+		if ((i->cpu_features & features) != i->cpu_features) {
+			continue;
+		}
+		if (name == NULL || (strlen(i->name) == name_len
+				&& strncmp(i->name, name, name_len) == 0)) {
+			return i;
+		}
+	}
+	return NULL;
+}
+
+static struct CironPrimitive *find_primitive(const char *name, size_t name_len) {
+	struct CironPrimitive **p;
+
+	for (p = primitives; *p != NULL; p++) {
+		if (strlen((*p)->name) == name_len && strncmp((*p)->name, name, name_len) == 0) {
+			return *p;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Applies the primitive=implementation pairs from the environment.
+ * Entries that do not name an available implementation are ignored.
+ */
+static void apply_environment(void) {
+	const char *s;
+	const char *end;
+	const char *eq;
+	struct CironPrimitive *p;
+	const struct CironImplementation *i;
+
+	if ((s = getenv(ENVIRONMENT_VARIABLE)) == NULL) {
+		return;
+	}
+	while (*s != '\0') {
+		if ((end = strchr(s, ',')) == NULL) {
+			end = s + strlen(s);
+		}
+		eq = memchr(s, '=', end - s);
+		if (eq != NULL && (p = find_primitive(s, eq - s)) != NULL
+				&& (i = find_implementation(p, eq + 1, end - eq - 1)) != NULL) {
+			p->selected = i;
+		}
+		s = (*end == ',') ? end + 1 : end;
+	}
+}
+
+static void select_implementations(void) {
+	struct CironPrimitive **p;
+
+	for (p = primitives; *p != NULL; p++) {
+		/* The last implementation of every primitive requires no CPU features */
+		(*p)->selected = find_implementation(*p, NULL, 0);
+		assert((*p)->selected != NULL);
+	}
+	apply_environment();
+}
+
+const void *ciron_primitive_functions(struct CironPrimitive *primitive) {
+	pthread_once(&select_once, select_implementations);
+	return primitive->selected->functions;
+}
+
+struct CironPrimitive *ciron_find_primitive(const char *name) {
+	return find_primitive(name, strlen(name));
+}
+
+CironError ciron_set_implementation(CironContext context, const char *primitive,
+		const char *implementation) {
+	struct CironPrimitive *p;
+	const struct CironImplementation *i;
+
+	pthread_once(&select_once, select_implementations);
+	if ((p = ciron_find_primitive(primitive)) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM, "Unknown primitive %s", primitive);
+	}
+	if ((i = find_implementation(p, implementation, strlen(implementation))) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_ERROR_UNKNOWN_ALGORITHM,
+				"Implementation %s of %s is unknown or not supported by the CPU",
+				implementation, primitive);
+	}
+	p->selected = i;
+	return CIRON_OK;
+}
+
+const char *ciron_get_implementation(const char *primitive) {
+	struct CironPrimitive *p;
+
+	pthread_once(&select_once, select_implementations);
+	if ((p = ciron_find_primitive(primitive)) == NULL) {
+		return NULL;
+	}
+	return p->selected->name;
+}
@@ -0,0 +1,70 @@
+#ifndef CIRON_REGISTRY_H
+#define CIRON_REGISTRY_H 1
+
+#include "ciron.h"
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Registry of the implementations of ciron's primitives.
+ *
+ * A primitive (the crypto functions of crypto.h, AES, GHASH, SHA,
+ * multi-buffer SHA, BLAKE3, base64url and hex encoding) has a list of
+ * implementations ordered from fastest to slowest. When ciron is first
+ * used, the fastest implementation the CPU supports is selected for every
+ * primitive, unless the environment variable CIRON_IMPLEMENTATION forces
+ * another, for example:
+ *
+ *     CIRON_IMPLEMENTATION=crypto=openssl,base64url=scalar
+ *
+ * ciron_set_implementation() in ciron.h does the same at runtime.
+ */
+
+/** One implementation of a primitive.
+ *
+ * An implementation can be listed more than once with different CPU
+ * features to express that it is only preferred over the following ones
+ * on CPUs having these features.
+ */
+struct CironImplementation {
+	/** Name used to select the implementation */
+	const char *name;
+	/** CIRON_CPU_* flags of the CPU features the implementation requires */
+	unsigned int cpu_features;
+	/** Table of functions, its type is defined by the primitive */
+	const void *functions;
+};
+
+struct CironPrimitive {
+	const char *name;
+	/** Implementations, preferred first, terminated by one with NULL name */
+	const struct CironImplementation *implementations;
+	const struct CironImplementation *selected;
+};
+
+/* The primitives, defined by the files implementing them */
+extern struct CironPrimitive ciron_crypto_primitive;
+extern struct CironPrimitive ciron_aes_primitive;
+extern struct CironPrimitive ciron_ghash_primitive;
+extern struct CironPrimitive ciron_sha_primitive;
+extern struct CironPrimitive ciron_sha_mb_primitive;
+extern struct CironPrimitive ciron_blake3_primitive;
+extern struct CironPrimitive ciron_base64url_primitive;
+extern struct CironPrimitive ciron_hex_primitive;
+
+/** Returns the function table of the selected implementation of a primitive.
+ */
+const void *ciron_primitive_functions(struct CironPrimitive *primitive);
+
+/** Looks up a primitive by name, returns NULL if there is none.
+ */
+struct CironPrimitive *ciron_find_primitive(const char *name);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_REGISTRY_H */
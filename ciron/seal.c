@@ -1,15 +1,28 @@
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
 #include "ciron.h"
 #include "common.h"
 #include "crypto.h"
 #include "base64url.h"
+#include "random.h"
 
 #define DELIM '*'
 #define MAC_FORMAT_VERSION "1"
 #define MAC_PREFIX "Fe26." MAC_FORMAT_VERSION
+#define PREFIX_LEN (sizeof(MAC_PREFIX) - 1)
+
+/*
+ * Bytes encrypted at a time when sealing without an encryption buffer,
+ * and decrypted at a time when unsealing without one. A
+ * multiple of the cipher block size and of 3, so that every chunk but the
+ * last encodes to base64url without padding and the chunks join up.
+ */
+#define SEAL_CHUNK_BYTES (48 * CIPHER_BLOCK_SIZE)
+#define SEAL_CHUNK_CHARS (SEAL_CHUNK_BYTES / 3 * 4)
 
 /*
  * These are local helper structs to bind the various char pointers
@@ -26,26 +39,13 @@ struct chars_and_len {
 };
 
 /*
- * Parses an unsigned char array until the next delimiter is found. Sets the
- * supplied bytes_and_len structure to point to the start of the parsed sequence
- * and its len field to contain the length of the parsed sequence.
- *
- * This function can not be used to parse a chunk of unisgned chars that do not
- * contain a delimiter. The rationale for this design is that the last sequence
- * in a parsed token needs not be parsed because the end is known already.
- *
- * Returns an error if the end of the supplied data is reached bevore a delimiter is
- * found.
+ * Splits the len bytes of data at the first n - 1 delimiters into n
+ * fields, the last of which is the rest of the data. Returns the number
+ * of fields found, which is less than n if there are not enough
+ * delimiters.
  */
-static CironError parse(CironContext context, const unsigned char *data,
-		size_t len, struct const_chars_and_len *balp);
-
-/* Variants of parse. Not sure whether that is truely needed, but I want to limit possible attack vectors */
-static CironError parse_fixed_len(CironContext context,
-		const unsigned char *data, size_t len, size_t expected_len,
-		struct const_chars_and_len *balp);
-static CironError parse_max_len(CironContext context, const unsigned char *data,
-		size_t len, size_t max_len, struct const_chars_and_len *balp);
+static size_t split_fields(const unsigned char *data, size_t len,
+		struct CironTokenField *fields, size_t n);
 
 
 
@@ -53,6 +53,12 @@ CironError ciron_calculate_encryption_buffer_length(CironContext context, size_t
 	/* for all CBC. But see https://github.com/algermissen/ciron/issues/5 */
 	size_t cipher_block_size = CIPHER_BLOCK_SIZE;
 
+	/* AEAD algorithms encrypt without padding */
+	if (IS_AEAD(context->encryption_options->algorithm)) {
+		*result_len = data_len;
+		return CIRON_OK;
+	}
+
 	/* Below we calculate the encryption buffer length as
  	 * data_len + cipher_block_size - (data_len % cipher_block_size)
 	 * To avoid integer overflow the following needs consideration:
@@ -64,7 +70,7 @@ CironError ciron_calculate_encryption_buffer_length(CironContext context, size_t
 	 */
 	if(UINT_MAX - data_len < 2 * cipher_block_size) {
 		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-				CIRON_OVERFLOW_ERROR, "Cannot unseal a buffer of size %ud due to integer overflow");
+				CIRON_OVERFLOW_ERROR, "Cannot unseal a buffer of size %zu due to integer overflow", data_len);
 	}
 
 	/* Taken from http://www.obviex.com/articles/ciphertextsize.aspx */
@@ -86,6 +92,22 @@ CironError ciron_calculate_seal_buffer_length(CironContext context,  size_t data
 	   return e;
 	}
 
+	if (IS_AEAD(context->encryption_options->algorithm)) {
+		size_t len = PREFIX_LEN;
+		len++; /* delimiter */
+		len += password_id_len;
+		len++; /* delimiter */
+		len += NBYTES(context->encryption_options->salt_bits) * 2; /* Salt (hex encoded) */
+		len++; /* delimiter */
+		len += BASE64URL_ENCODE_SIZE(NBYTES(context->encryption_options->algorithm->iv_bits)); /* Base64url encoded IV */
+		len++; /* delimiter */
+		len += BASE64URL_ENCODE_SIZE(encryption_buffer_length); /* Base64url encoded encrypted data */
+		len++; /* delimiter */
+		len += BASE64URL_ENCODE_SIZE(NBYTES(context->encryption_options->algorithm->tag_bits)); /* Base64url encoded tag */
+		*result_len = len;
+		return CIRON_OK;
+	}
+
 	size_t len = 6; /* MAC_PREFIIX */
 	len++; /* delimiter */
 	len += password_id_len;
@@ -98,7 +120,7 @@ CironError ciron_calculate_seal_buffer_length(CironContext context,  size_t data
 	len++; /* delimiter */
 	len += NBYTES(context->integrity_options->salt_bits) * 2; /* Integrity salt (NBYTES * 2 due to hex encoding) */
 	len++; /* delimiter */
-	len += BASE64URL_ENCODE_SIZE(32); /* Base64url encoded HMAC (for HMAC SHA256 HMAC size is 32 bytes)  */
+	len += BASE64URL_ENCODE_SIZE(NBYTES(context->integrity_options->algorithm->tag_bits)); /* Base64url encoded HMAC */
 	/* see https://github.com/algermissen/ciron/issues/13 */
 	*result_len = len;
 	return CIRON_OK;
@@ -117,6 +139,29 @@ CironError ciron_calculate_unseal_buffer_length(CironContext context, size_t dat
 
 	len = data_len;
 
+	/*
+	 * AEAD tokens have less overhead than Fe26.1 tokens, so this size is
+	 * also large enough for the Fe26.1 tokens that AEAD contexts unseal.
+	 */
+	if (IS_AEAD(context->encryption_options->algorithm)) {
+		len -= PREFIX_LEN;
+		len--; /* delimiter */
+		len--; /* delimiter */
+		len -= (NBYTES(context->encryption_options->salt_bits) * 2); /* Salt (hex encoded) */
+		len--; /* delimiter */
+		len -= BASE64URL_ENCODE_SIZE(NBYTES(context->encryption_options->algorithm->iv_bits)); /* Base64url encoded IV */
+		len--; /* delimiter */
+		len--; /* delimiter */
+		len -= BASE64URL_ENCODE_SIZE(NBYTES(context->encryption_options->algorithm->tag_bits)); /* Base64url encoded tag */
+		len = BASE64URL_DECODE_SIZE(len);
+		if (len < 0) {
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_OVERFLOW_ERROR, "Data len %zu too small", data_len);
+		}
+		*result_len = len;
+		return CIRON_OK;
+	}
+
 	len -= 6; /* MAC_PREFIIX */
 	len--; /* delimiter */
 	/* We do not know password length when unsealing hence ignore it. If password is present, the calculated */
@@ -131,7 +176,7 @@ CironError ciron_calculate_unseal_buffer_length(CironContext context, size_t dat
 	len--; /* delimiter */
 	len -= (NBYTES(context->integrity_options->salt_bits) * 2); /* Integrity salt (NBYTES * 2 due to hex encoding) */
 	len--; /* delimiter */
-	len -= BASE64URL_ENCODE_SIZE(32); /* Base64url encoded HMAC (for HMAC SHA256 HMAC size is 32 bytes) */
+	len -= BASE64URL_ENCODE_SIZE(NBYTES(context->integrity_options->algorithm->tag_bits)); /* Base64url encoded HMAC */
 	/* see https://github.com/algermissen/ciron/issues/13 */
 
 	/*
@@ -148,51 +193,335 @@ CironError ciron_calculate_unseal_buffer_length(CironContext context, size_t dat
 	return CIRON_OK;
 }
 
+/*
+ * Seals the data with the prepared password. If sealer is not NULL, its
+ * options and crypto state are used instead of those of the context. Shared
+ * implementation of ciron_seal_prepared() and ciron_sealer_seal().
+ */
+static CironError seal(CironContext context, CironSealer sealer,
+		const unsigned char *data, size_t data_len,
+		const unsigned char* password_id, size_t password_id_len,
+		CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen);
+
+/*
+ * Unseals the token, either with a password from the table or the supplied
+ * one or, if prepared is not NULL, with the prepared password. If sealer is
+ * not NULL, its options and crypto state are used. If view is not NULL, it
+ * holds the fields of the token already. If inplace_result is
+ * not NULL, the token is unsealed in its own memory and the result
+ * pointer is stored there, buffer_encrypted_bytes and result are not
+ * used. Shared implementation of ciron_unseal(), ciron_unseal_prepared(),
+ * ciron_unseal_inplace(), ciron_unseal_view() and ciron_sealer_unseal().
+ */
+static CironError unseal(CironContext context, CironSealer sealer, const unsigned char *data,
+		size_t data_len, CironTokenView view, CironIndexedPwdTable pwd_table, const unsigned char* password, size_t password_len,
+		CironPreparedPassword prepared,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen,
+		unsigned char **inplace_result);
+
+/*
+ * Fe26.1 tokens are unsealed with the encryption options of the context or
+ * sealer, unless these are for an AEAD algorithm. Then the defaults are
+ * used.
+ */
+static CironOptions fe26_encryption_options(CironOptions encryption_options) {
+	if (IS_AEAD(encryption_options->algorithm)) {
+		return CIRON_DEFAULT_ENCRYPTION_OPTIONS;
+	}
+	return encryption_options;
+}
+
+/*
+ * Returns the AEAD algorithm a token prefix stands for, or NULL.
+ */
+static CironAlgorithm aead_algorithm(const unsigned char *prefix) {
+	if (memcmp(prefix, CIRON_AES_256_GCM->prefix, PREFIX_LEN) == 0) {
+		return CIRON_AES_256_GCM;
+	}
+	if (memcmp(prefix, CIRON_CHACHA20_POLY1305->prefix, PREFIX_LEN) == 0) {
+		return CIRON_CHACHA20_POLY1305;
+	}
+	return NULL;
+}
+
+CironError ciron_token_view(CironContext context, const unsigned char *data,
+		size_t data_len, CironTokenView view) {
+	struct CironTokenField fields[7];
+	size_t n;
+
+	/*
+	 * The prefix tells the number of fields, AEAD tokens have no
+	 * integrity salt.
+	 */
+	if (data_len <= PREFIX_LEN || data[PREFIX_LEN] != DELIM) {
+		n = 0;
+	} else if (memcmp(data, MAC_PREFIX, PREFIX_LEN) == 0) {
+		n = 7;
+	} else if (aead_algorithm(data) != NULL) {
+		n = 6;
+	} else {
+		n = 0;
+	}
+	if (n == 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Invalid prefix");
+	}
+	if (split_fields(data, data_len, fields, n) != n) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR,
+				"End of char sequence reached before finding delimiter");
+	}
+
+	view->prefix = fields[0];
+	view->password_id = fields[1];
+	view->encryption_salt = fields[2];
+	view->iv = fields[3];
+	view->encrypted = fields[4];
+	if (n == 7) {
+		view->integrity_salt = fields[5];
+		view->hmac = fields[6];
+	} else {
+		view->integrity_salt.offset = fields[5].offset;
+		view->integrity_salt.len = 0;
+		view->hmac = fields[5];
+	}
+	return CIRON_OK;
+}
+
+/*
+ * The following helpers perform a crypto operation either through the
+ * reusable objects of a sealer or, if sealer is NULL or has no cipher
+ * (AEAD sealers unsealing Fe26.1 tokens), through the one-shot functions
+ * of crypto.h.
+ */
+static CironError seal_encrypt(CironContext context, CironSealer sealer,
+		CironAlgorithm algorithm, const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	if (sealer != NULL && sealer->cipher != NULL) {
+		return ciron_cipher_encrypt(context, sealer->cipher, key, iv, data,
+				data_len, buf, sizep);
+	}
+	return ciron_encrypt(context, algorithm, key, iv, data, data_len, buf, sizep);
+}
+
+static CironError unseal_decrypt(CironContext context, CironSealer sealer,
+		CironAlgorithm algorithm, const unsigned char *key, const unsigned char *iv,
+		const unsigned char *data, size_t data_len, unsigned char *buf, size_t *sizep) {
+	if (sealer != NULL && sealer->cipher != NULL) {
+		return ciron_cipher_decrypt(context, sealer->cipher, key, iv, data,
+				data_len, buf, sizep);
+	}
+	return ciron_decrypt(context, algorithm, key, iv, data, data_len, buf, sizep);
+}
+
+static CironError integrity_hmac(CironContext context, CironSealer sealer,
+		CironOptions integrity_options, CironPreparedPassword password,
+		const unsigned char *salt, size_t salt_len,
+		const unsigned char *data, size_t data_len, unsigned char *result,
+		size_t *result_len) {
+	CironError e;
+	unsigned char buffer_key_bytes[MAX_KEY_BYTES];
+	size_t key_len;
+
+	if (sealer == NULL) {
+		return ciron_hmac_prepared(context, integrity_options->algorithm,
+				password, salt, salt_len, integrity_options->iterations, data,
+				data_len, result, result_len);
+	}
+	key_len = NBYTES(integrity_options->algorithm->key_bits);
+	if ((e = ciron_generate_key_prepared(context, password, salt, salt_len,
+			integrity_options->algorithm, integrity_options->iterations,
+			buffer_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+	return ciron_mac(context, sealer->mac, buffer_key_bytes, key_len, data,
+			data_len, result, result_len);
+}
+
+CironError ciron_sealer_init(CironContext context, CironSealer sealer) {
+	CironError e;
+
+	memset(sealer, 0, sizeof(struct CironSealer));
+	sealer->encryption_options = context->encryption_options;
+	sealer->integrity_options = context->integrity_options;
+
+	/* AEAD algorithms have no cipher object, see ciron_aead_encrypt() */
+	if (!IS_AEAD(sealer->encryption_options->algorithm) && (e = ciron_cipher_new(context,
+			sealer->encryption_options->algorithm, &sealer->cipher)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = ciron_mac_new(context, sealer->integrity_options->algorithm,
+			&sealer->mac)) != CIRON_OK) {
+		ciron_cipher_free(sealer->cipher);
+		sealer->cipher = NULL;
+		return e;
+	}
+	return CIRON_OK;
+}
+
+void ciron_sealer_cleanup(CironSealer sealer) {
+	ciron_cipher_free(sealer->cipher);
+	ciron_mac_free(sealer->mac);
+	sealer->cipher = NULL;
+	sealer->mac = NULL;
+}
+
+CironError ciron_sealer_seal(CironContext context, CironSealer sealer,
+		const unsigned char *data, size_t data_len,
+		const unsigned char* password_id, size_t password_id_len,
+		CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	return seal(context, sealer, data, data_len, password_id, password_id_len,
+			password, buffer_encrypted_bytes, result, plen);
+}
+
+CironError ciron_sealer_unseal(CironContext context, CironSealer sealer,
+		const unsigned char *data, size_t data_len, CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	return unseal(context, sealer, data, data_len, NULL, NULL, NULL, 0, password,
+			buffer_encrypted_bytes, result, plen, NULL);
+}
+
 CironError ciron_seal(CironContext context, const unsigned char *data,
 		size_t data_len, const unsigned char* password_id, size_t password_id_len,
 		const unsigned char* password, size_t password_len,
 		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	CironError e;
+	struct CironPreparedPassword prepared;
+
+	/*
+	 * Preparing the password once saves hashing it again for the second
+	 * key derivation.
+	 */
+	if ((e = ciron_password_prepare(context, password, password_len, &prepared))
+			!= CIRON_OK) {
+		return e;
+	}
+	return ciron_seal_prepared(context, data, data_len, password_id,
+			password_id_len, &prepared, buffer_encrypted_bytes, result, plen);
+}
 
-    CironOptions encryption_options;
-    CironOptions integrity_options;
+CironError ciron_seal_prepared(CironContext context, const unsigned char *data,
+		size_t data_len, const unsigned char* password_id, size_t password_id_len,
+		CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	return seal(context, NULL, data, data_len, password_id, password_id_len,
+			password, buffer_encrypted_bytes, result, plen);
+}
 
+/*
+ * Length of the token before the encrypted data, as written by
+ * seal_begin().
+ */
+static size_t seal_header_length(CironOptions encryption_options,
+		size_t password_id_len) {
+	size_t len = PREFIX_LEN;
+	len++; /* delimiter */
+	len += password_id_len;
+	len++; /* delimiter */
+	len += NBYTES(encryption_options->salt_bits) * 2; /* Salt (hex encoded) */
+	len++; /* delimiter */
+	len += BASE64URL_ENCODE_SIZE(NBYTES(encryption_options->algorithm->iv_bits)); /* Base64url encoded IV */
+	len++; /* delimiter */
+	return len;
+}
 
+CironError ciron_seal_inplace(CironContext context, const unsigned char *data,
+		size_t data_len, const unsigned char* password_id, size_t password_id_len,
+		const unsigned char* password, size_t password_len,
+		unsigned char *buf, size_t *plen) {
 	CironError e;
-	size_t prefix_len;
-	/*
-	 *  These are local buffers to hold data that is pointed to by the xxx_and_len structs
-	 */
-	unsigned char buffer_key_bytes[MAX_KEY_BYTES];
-	unsigned char buffer_iv_bytes[MAX_IV_BYTES];
-	unsigned char buffer_hmac_bytes[MAX_HMAC_BYTES];
+	struct CironPreparedPassword prepared;
+	unsigned char *encrypted;
+
+	if ((e = ciron_password_prepare(context, password, password_len, &prepared))
+			!= CIRON_OK) {
+		return e;
+	}
 
 	/*
-	 * Variables to keep together pointer and length information
-	 * of encryption data.
+	 * Move the data to where its encryption begins in the token, the
+	 * data is encrypted and encoded there. The token header written
+	 * before it then cannot overwrite it.
 	 */
+	encrypted = buf + seal_header_length(context->encryption_options, password_id_len);
+	memmove(encrypted, data, data_len);
+	return seal(context, NULL, encrypted, data_len, password_id, password_id_len,
+			&prepared, encrypted, buf, plen);
+}
+
+/*
+ * State of a token while it is sealed. Sealing is split into steps, so
+ * that the batch functions can do each step for several tokens at once.
+ */
+struct seal_state {
+	unsigned char *result;
+	unsigned char *result_ptr;
 	struct chars_and_len encryption_salt_hex;
-	struct chars_and_len key_bytes;
 	struct chars_and_len iv_bytes;
-	struct chars_and_len iv_base64url;
-	struct chars_and_len encrypted_bytes;
-	struct chars_and_len encrypted_base64url;
-
-	/*
-	 * Variables to keep together pointer and length information
-	 * of integrity data.
-	 */
 	struct chars_and_len integrity_salt_hex;
-	struct chars_and_len hmac_bytes;
-	struct chars_and_len hmac_base64url;
 	struct chars_and_len hmac_base_chars;
+	struct chars_and_len hmac_bytes;
+	unsigned char buffer_iv_bytes[MAX_IV_BYTES];
+	unsigned char buffer_integrity_salt_hex[2 * MAX_SALT_BYTES];
+	unsigned char buffer_key_bytes[MAX_KEY_BYTES];
+	unsigned char buffer_integrity_key_bytes[MAX_KEY_BYTES];
+	unsigned char buffer_hmac_bytes[MAX_HMAC_BYTES];
+};
 
-	/*
-	 * This maintains position while filling the result buffer.
-	 */
-	unsigned char *result_ptr;
+/*
+ * Random bytes a token needs at most: two salts and an IV.
+ */
+#define MAX_SEAL_RANDOM_BYTES (2 * MAX_SALT_BYTES + MAX_IV_BYTES)
+
+/*
+ * Returns the number of random bytes seal_begin() takes for a token:
+ * the encryption salt, the IV and, unless AEAD tokens are sealed, the
+ * integrity salt.
+ */
+static size_t seal_random_length(CironOptions encryption_options,
+		CironOptions integrity_options) {
+	size_t len;
+
+	len = NBYTES(encryption_options->salt_bits)
+			+ NBYTES(encryption_options->algorithm->iv_bits);
+	if (!IS_AEAD(encryption_options->algorithm)) {
+		len += NBYTES(integrity_options->salt_bits);
+	}
+	return len;
+}
+
+/*
+ * Draws the random bytes of ntokens tokens at once.
+ */
+static CironError seal_random(CironContext context,
+		CironOptions encryption_options, CironOptions integrity_options,
+		size_t ntokens, unsigned char *buf) {
+	size_t len = ntokens * seal_random_length(encryption_options, integrity_options);
+
+	if (ciron_random_bytes(buf, len) != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, errno,
+				CIRON_CRYPTO_ERROR, "Unable to get %zu random bytes", len);
+	}
+	return CIRON_OK;
+}
 
-	encryption_options = context->encryption_options;
-	integrity_options = context->integrity_options;
+/*
+ * Writes the token up to the encrypted data: prefix, password ID,
+ * encryption salt and IV. Also sets up the integrity salt, which is
+ * kept in the state until the encrypted data has been added. AEAD tokens
+ * have their own prefix and no integrity salt. The salts and the IV are
+ * taken from the bytes drawn by seal_random(), in this order.
+ */
+static void seal_begin(CironOptions encryption_options,
+		CironOptions integrity_options,
+		const unsigned char* password_id, size_t password_id_len,
+		const unsigned char *random, unsigned char *result,
+		struct seal_state *s) {
+	const char *prefix;
+	size_t salt_len;
+	struct chars_and_len iv_base64url;
 
 	/*
 	 * Calculate number of salt bytes from provided options and
@@ -202,8 +531,10 @@ CironError ciron_seal(CironContext context, const unsigned char *data,
 	assert(NBYTES(integrity_options->salt_bits) <= MAX_SALT_BYTES);
 	assert(NBYTES(encryption_options->algorithm->iv_bits) <= MAX_IV_BYTES);
 	assert(NBYTES(encryption_options->algorithm->key_bits) <= MAX_KEY_BYTES);
+	assert(NBYTES(integrity_options->algorithm->key_bits) <= MAX_KEY_BYTES);
 
-	result_ptr = result;
+	s->result = result;
+	s->result_ptr = result;
 
 	/*
 	 * prefix*pwd*encSalt*iv64*data64* integritySalt*integrityHmac
@@ -213,23 +544,26 @@ CironError ciron_seal(CironContext context, const unsigned char *data,
 	 * Write the prefix and delimiter.
 	 * Advance the result pointer.
 	 */
-	prefix_len = strlen(MAC_PREFIX);
-	memcpy(result_ptr, (unsigned char*) MAC_PREFIX "*", prefix_len+1);
-	result_ptr += prefix_len + 1;
+	prefix = IS_AEAD(encryption_options->algorithm)
+			? encryption_options->algorithm->prefix : MAC_PREFIX;
+	memcpy(s->result_ptr, prefix, PREFIX_LEN);
+	s->result_ptr += PREFIX_LEN;
+	*s->result_ptr = DELIM;
+	s->result_ptr++;
 
 	/*
 	 * If provided (len>0) write the password_id to the result_buffer
 	 */
 	if(password_id_len > 0) {
-		memcpy(result_ptr, password_id, password_id_len);
-		result_ptr += password_id_len;
+		memcpy(s->result_ptr, password_id, password_id_len);
+		s->result_ptr += password_id_len;
 	}
 
 	/*
 	 * Add a '*' delimiter.
 	 */
-	*result_ptr = DELIM;
-	result_ptr++;
+	*s->result_ptr = DELIM;
+	s->result_ptr++;
 
 
 
@@ -240,37 +574,18 @@ CironError ciron_seal(CironContext context, const unsigned char *data,
 	 * Note that the result is twice as long as the requested number of
 	 * bytes.
 	 */
-	encryption_salt_hex.chars = result_ptr;
-	encryption_salt_hex.len = NBYTES(encryption_options->salt_bits) * 2; /* Due to byte-to-hex conversion */
-	if ((e = ciron_generate_salt(context, NBYTES(encryption_options->salt_bits),
-			encryption_salt_hex.chars)) != CIRON_OK) {
-		return e;
-	}
-	result_ptr += encryption_salt_hex.len;
+	salt_len = NBYTES(encryption_options->salt_bits);
+	s->encryption_salt_hex.chars = s->result_ptr;
+	s->encryption_salt_hex.len = salt_len * 2; /* Due to byte-to-hex conversion */
+	ciron_bytes_to_hex(random, salt_len, s->encryption_salt_hex.chars);
+	random += salt_len;
+	s->result_ptr += s->encryption_salt_hex.len;
 
 	/*
 	 * Add a '*' delimiter.
 	 */
-	*result_ptr = DELIM;
-	result_ptr++;
-#if 0
-	*result_ptr = '\0';
-	TRACE("STRING added salt |%s|\n" _ result);
-#endif
-
-	/*
-	 * Encryption key handling. Because the key is not part of the
-	 * result, we need to store the generated key in a buffer.
-	 */
-
-	key_bytes.len = NBYTES(encryption_options->algorithm->key_bits);
-	key_bytes.chars = buffer_key_bytes;
-	if ((e = ciron_generate_key(context, password, password_len,
-			encryption_salt_hex.chars, encryption_salt_hex.len,
-			encryption_options->algorithm, encryption_options->iterations,
-			key_bytes.chars)) != CIRON_OK) {
-		return e;
-	}
+	*s->result_ptr = DELIM;
+	s->result_ptr++;
 
 	/*
 	 * IV Handling. Because the IV bytes are not stored in the
@@ -278,162 +593,439 @@ CironError ciron_seal(CironContext context, const unsigned char *data,
 	 * bytes in a buffer.
 	 */
 
-	iv_bytes.len = NBYTES(encryption_options->algorithm->iv_bits);
-	iv_bytes.chars = buffer_iv_bytes;
-	if ((e = ciron_generate_iv(context, iv_bytes.len, iv_bytes.chars))
-			!= CIRON_OK) {
-		return e;
-	}
+	s->iv_bytes.len = NBYTES(encryption_options->algorithm->iv_bits);
+	s->iv_bytes.chars = s->buffer_iv_bytes;
+	memcpy(s->iv_bytes.chars, random, s->iv_bytes.len);
+	random += s->iv_bytes.len;
 
 	/*
 	 * Turn iv bytes into base64url encoded value. Because this value is part
 	 * of the result, we can directly store it in the result and need no
 	 * extra buffer here.
 	 */
-	iv_base64url.chars = result_ptr;
-	ciron_base64url_encode(iv_bytes.chars, iv_bytes.len, iv_base64url.chars,
+	iv_base64url.chars = s->result_ptr;
+	ciron_base64url_encode(s->iv_bytes.chars, s->iv_bytes.len, iv_base64url.chars,
 			&(iv_base64url.len));
-	result_ptr += iv_base64url.len;
+	s->result_ptr += iv_base64url.len;
 
 	/*
 	 * Add a delimiter.
 	 */
-	*result_ptr = DELIM;
-	result_ptr++;
-#if 0
-	*result_ptr = '\0';
-	TRACE("STRING: added iv |%s|\n" _ result);
-#endif
+	*s->result_ptr = DELIM;
+	s->result_ptr++;
 
-	/*
-	 * Encrypt the data. Because the encrypted data is not part of the
-	 * result (the base64url version is), we need a buffer to hold the encrypted
-	 * binary data.
-	 */
-	encrypted_bytes.chars = buffer_encrypted_bytes;
-	if ((e = ciron_encrypt(context, encryption_options->algorithm,
-			key_bytes.chars, iv_bytes.chars, data, data_len,
-			encrypted_bytes.chars, &(encrypted_bytes.len))) != CIRON_OK) {
-		return e;
+	if (IS_AEAD(encryption_options->algorithm)) {
+		return;
 	}
-#if 0
-	TRACE("encrypted to %d bytes\n" _ encrypted_bytes.len);
-	ciron_trace_bytes("encbytes", encrypted_bytes.chars, encrypted_bytes.len);
-#endif
 
 	/*
-	 * Create base64url encoding of encypted binary data. Because the
-	 * base64 version is part of the result string, we do not need a
-	 * separate buffer but encode the data to the result directly.
+	 * Integrity salt. The salt is needed for the key derivation before
+	 * its position in the result is known, so it is kept in a buffer
+	 * until seal_add_encrypted() copies it there.
+	 *
+	 * Note that the result is twice as long as the requested number of
+	 * bytes.
 	 */
-	encrypted_base64url.chars = result_ptr;
-	ciron_base64url_encode(encrypted_bytes.chars, encrypted_bytes.len,
-			encrypted_base64url.chars, &(encrypted_base64url.len));
-	result_ptr += encrypted_base64url.len;
+	salt_len = NBYTES(integrity_options->salt_bits);
+	s->integrity_salt_hex.chars = s->buffer_integrity_salt_hex;
+	s->integrity_salt_hex.len = salt_len * 2; /* Due to byte-to-hex conversion */
+	ciron_bytes_to_hex(random, salt_len, s->integrity_salt_hex.chars);
+}
+
+/*
+ * Base64url encodes the len bytes at p in place, for
+ * ciron_seal_inplace(). The chunks are encoded from the last one to the
+ * first, each from a copy, so that the encoding of a chunk only
+ * overwrites its own bytes and those of the chunks already done. The
+ * encoding is longer than the data, it extends past p + len.
+ */
+static void encode_inplace(unsigned char *p, size_t len, size_t *encoded_len) {
+	unsigned char chunk[SEAL_CHUNK_BYTES];
+	size_t start, end, n;
+
+	*encoded_len = 0;
+	for (end = len; end > 0; end = start) {
+		start = (end - 1) / SEAL_CHUNK_BYTES * SEAL_CHUNK_BYTES;
+		memcpy(chunk, p + start, end - start);
+		ciron_base64url_encode(chunk, end - start, p + start / 3 * 4, &n);
+		*encoded_len += n;
+	}
+}
+
+/*
+ * Base64url encodes the encrypted data to the token. The data is either
+ * in a buffer of its own or, with ciron_seal_inplace(), at its place in
+ * the token already.
+ */
+static void seal_encode(struct seal_state *s, const unsigned char *encrypted_bytes,
+		size_t encrypted_len) {
+	size_t len;
+
+	if (encrypted_bytes == s->result_ptr) {
+		encode_inplace(s->result_ptr, encrypted_len, &len);
+	} else {
+		ciron_base64url_encode(encrypted_bytes, encrypted_len, s->result_ptr, &len);
+	}
+	s->result_ptr += len;
+}
 
+/*
+ * Adds the integrity salt to the token after the base64url encoded
+ * encrypted data. After this the HMAC base string is known.
+ */
+static void seal_add_integrity_salt(struct seal_state *s) {
 	/*
 	 * With the base64 encoding of the encrypted data the HMAC base string
 	 * ends and we note its length now.
 	 */
-	hmac_base_chars.chars = result;
-	hmac_base_chars.len = result_ptr - result;
+	s->hmac_base_chars.chars = s->result;
+	s->hmac_base_chars.len = s->result_ptr - s->result;
 
 #if 0
-	*result_ptr = '\0';
-	TRACE("HMAC base string |%s|\n" _ result);
+	*s->result_ptr = '\0';
+	TRACE("HMAC base string |%s|\n" _ s->result);
 #endif
 	/*
 	 * Now that the HMAC base string end has been noted, we can add a delimiter.
 	 */
-	*result_ptr = DELIM;
-	result_ptr++;
-#if 0
-	*result_ptr = '\0';
-	TRACE("STRING: added encrypted |%s|\n" _ result);
-#endif
+	*s->result_ptr = DELIM;
+	s->result_ptr++;
 
 	/* ----- Encryption portion done, now handle integrity ----- */
 
 	/*
-	 * Integrity salt generation. Because the salt is part of the result,
-	 * we can generate the hex directly into the result without the need for
-	 * a buffer.
-	 *
-	 * Note that the result is twice as long as the requested number of
-	 * bytes.
+	 * Add the integrity salt generated by seal_begin() and another
+	 * delimiter.
+	 */
+	memcpy(s->result_ptr, s->integrity_salt_hex.chars, s->integrity_salt_hex.len);
+	s->result_ptr += s->integrity_salt_hex.len;
+	*s->result_ptr = DELIM;
+	s->result_ptr++;
+}
+
+/*
+ * Adds the encrypted data and the integrity salt to the token. After this
+ * the HMAC base string is known.
+ */
+static void seal_add_encrypted(struct seal_state *s,
+		const unsigned char *encrypted_bytes, size_t encrypted_len) {
+	/*
+	 * Create base64url encoding of encypted binary data. Because the
+	 * base64 version is part of the result string, we do not need a
+	 * separate buffer but encode the data to the result directly.
 	 */
+	seal_encode(s, encrypted_bytes, encrypted_len);
+
+	seal_add_integrity_salt(s);
+}
 
-	integrity_salt_hex.chars = result_ptr;
-	integrity_salt_hex.len = NBYTES(integrity_options->salt_bits) * 2; /* Due to byte-to-hex conversion */
-	if ((e = ciron_generate_salt(context, NBYTES(integrity_options->salt_bits),
-			integrity_salt_hex.chars)) != CIRON_OK) {
+/*
+ * Encrypts the data with the cipher of the sealer and encodes it to the
+ * token chunk by chunk, so that no buffer for all of the encrypted data
+ * is needed. The chunks stay in the cache between encryption and
+ * encoding.
+ */
+static CironError seal_encrypt_encode(CironContext context, CironSealer sealer,
+		struct seal_state *s, const unsigned char *data, size_t data_len) {
+	CironError e;
+	unsigned char chunk[SEAL_CHUNK_BYTES + CIPHER_BLOCK_SIZE];
+	size_t len;
+
+	if ((e = ciron_cipher_encrypt_init(context, sealer->cipher,
+			s->buffer_key_bytes, s->iv_bytes.chars)) != CIRON_OK) {
+		return e;
+	}
+	while (data_len > SEAL_CHUNK_BYTES) {
+		if ((e = ciron_cipher_encrypt_update(context, sealer->cipher, data,
+				SEAL_CHUNK_BYTES, chunk)) != CIRON_OK) {
+			return e;
+		}
+		ciron_base64url_encode(chunk, SEAL_CHUNK_BYTES, s->result_ptr, &len);
+		s->result_ptr += len;
+		data += SEAL_CHUNK_BYTES;
+		data_len -= SEAL_CHUNK_BYTES;
+	}
+	if ((e = ciron_cipher_encrypt_final(context, sealer->cipher, data,
+			data_len, chunk, &len)) != CIRON_OK) {
 		return e;
 	}
-	result_ptr += integrity_salt_hex.len;
+	ciron_base64url_encode(chunk, len, s->result_ptr, &len);
+	s->result_ptr += len;
 
-	/*
-	 * Add another delimiter.
-	 */
-	*result_ptr = DELIM;
-	result_ptr++;
-#if 0
-	*result_ptr = '\0';
-	TRACE("STRING: added integrity salt |%s|\n" _ result);
-	TRACE("AAA-2.a hmac base_chars len: %d\n" _ hmac_base_chars.len);
-#endif
+	seal_add_integrity_salt(s);
+	return CIRON_OK;
+}
+
+/*
+ * Encrypts the data with the encryption key of the state and adds it to
+ * the token.
+ */
+static CironError seal_encrypt_data(CironContext context, CironSealer sealer,
+		CironOptions encryption_options, struct seal_state *s,
+		const unsigned char *data, size_t data_len,
+		unsigned char *buffer_encrypted_bytes) {
+	CironError e;
+	struct chars_and_len encrypted_bytes;
+
+	if (buffer_encrypted_bytes == NULL) {
+		return seal_encrypt_encode(context, sealer, s, data, data_len);
+	}
 
 	/*
-	 * Now calculate the HMAC. Because the HMAC is not part of the result
-	 * (the base64url version is), we need an intermediate buffer to hold the binary.
-	 * from which we generate the base64url encoded directly into the result.
+	 * Encrypt the data. Because the encrypted data is not part of the
+	 * result (the base64url version is), we need a buffer to hold the encrypted
+	 * binary data.
 	 */
-	hmac_bytes.chars = buffer_hmac_bytes;
-	if ((e = ciron_hmac(context, integrity_options->algorithm, password,
-			password_len, integrity_salt_hex.chars, integrity_salt_hex.len,
-			integrity_options->iterations, hmac_base_chars.chars,
-			hmac_base_chars.len, hmac_bytes.chars, &(hmac_bytes.len)))
-			!= CIRON_OK) {
+	encrypted_bytes.chars = buffer_encrypted_bytes;
+	if ((e = seal_encrypt(context, sealer, encryption_options->algorithm,
+			s->buffer_key_bytes, s->iv_bytes.chars, data, data_len,
+			encrypted_bytes.chars, &(encrypted_bytes.len))) != CIRON_OK) {
 		return e;
 	}
 #if 0
-	TRACE("AAA-2.b Hmac bytes len:%d\n" _ hmac_bytes.len);
+	TRACE("encrypted to %d bytes\n" _ encrypted_bytes.len);
+	ciron_trace_bytes("encbytes", encrypted_bytes.chars, encrypted_bytes.len);
 #endif
 
-	/*
-	 * Generate the base64url encoded version of the HMAC. Because this is stored in
-	 * the result directly, we need no buffer here, but encode directly to
-	 * the result.
-	 */
-	hmac_base64url.chars = result_ptr;
-	ciron_base64url_encode(hmac_bytes.chars, hmac_bytes.len,
-			hmac_base64url.chars, &(hmac_base64url.len));
-	result_ptr += hmac_base64url.len;
+	seal_add_encrypted(s, encrypted_bytes.chars, encrypted_bytes.len);
 
-	/*
+	return CIRON_OK;
+}
+
+/*
+ * Adds the HMAC of the state to the token and sets its length.
+ */
+static void seal_end(struct seal_state *s, size_t *plen) {
+	struct chars_and_len hmac_base64url;
+
+	/*
+	 * Generate the base64url encoded version of the HMAC. Because this is stored in
+	 * the result directly, we need no buffer here, but encode directly to
+	 * the result.
+	 */
+	hmac_base64url.chars = s->result_ptr;
+	ciron_base64url_encode(s->hmac_bytes.chars, s->hmac_bytes.len,
+			hmac_base64url.chars, &(hmac_base64url.len));
+	s->result_ptr += hmac_base64url.len;
+
+	/*
 	 * Calculate the length of the result.
 	 *
 	 * Note that we do not \0 terminate it.
 	 */
-	*plen = result_ptr - result;
+	*plen = s->result_ptr - s->result;
+}
 
+/*
+ * Completes an AEAD token after seal_begin():
+ *
+ *     prefix*pwd*encSalt*iv64*data64*tag64
+ *
+ * Everything before the encrypted data, including the delimiter, is
+ * authenticated together with it.
+ */
+static CironError seal_aead_end(CironContext context,
+		CironOptions encryption_options, struct seal_state *s,
+		const unsigned char *data, size_t data_len,
+		unsigned char *buffer_encrypted_bytes, size_t *plen) {
+	CironError e;
+	unsigned char tag[MAX_TAG_BYTES];
+	size_t tag_len = NBYTES(encryption_options->algorithm->tag_bits);
+	size_t len;
+
+	assert(tag_len <= MAX_TAG_BYTES);
+	if ((e = ciron_aead_encrypt(context, encryption_options->algorithm,
+			s->buffer_key_bytes, s->iv_bytes.chars, s->result,
+			s->result_ptr - s->result, data, data_len, buffer_encrypted_bytes,
+			tag)) != CIRON_OK) {
+		return e;
+	}
+	seal_encode(s, buffer_encrypted_bytes, data_len);
+	*s->result_ptr = DELIM;
+	s->result_ptr++;
+	ciron_base64url_encode(tag, tag_len, s->result_ptr, &len);
+	s->result_ptr += len;
+
+	*plen = s->result_ptr - s->result;
 	return CIRON_OK;
 }
 
-CironError ciron_unseal(CironContext context, const unsigned char *data,
-		size_t data_len, CironPwdTable pwd_table, const unsigned char* password, size_t password_len,
+/*
+ * Tokens are only sealed with password IDs that unsealing accepts, word
+ * characters as in iron. The ID is checked before any random bytes are
+ * drawn or keys derived.
+ */
+static CironError seal_check_password_id(CironContext context,
+		const unsigned char *password_id, size_t password_id_len) {
+	if (!ciron_password_id_valid(password_id, password_id_len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_PASSWORD_ROTATION_ERROR,
+				"Invalid character in password ID %.*s",
+				(int) password_id_len, password_id);
+	}
+	return CIRON_OK;
+}
+
+static CironError seal(CironContext context, CironSealer sealer,
+		const unsigned char *data, size_t data_len,
+		const unsigned char* password_id, size_t password_id_len,
+		CironPreparedPassword password,
 		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+
 	CironOptions encryption_options;
 	CironOptions integrity_options;
-
 	CironError e;
-	size_t i;
-	int found_password;
+	struct seal_state s;
+	unsigned char random[MAX_SEAL_RANDOM_BYTES];
+
+	if (sealer != NULL) {
+		encryption_options = sealer->encryption_options;
+		integrity_options = sealer->integrity_options;
+	} else {
+		encryption_options = context->encryption_options;
+		integrity_options = context->integrity_options;
+	}
+
+	/*
+	 * Without an encryption buffer the data is encrypted in parts, which
+	 * needs the cipher object of a sealer.
+	 */
+	if (buffer_encrypted_bytes == NULL && (sealer == NULL || sealer->cipher == NULL)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Sealing without encryption buffer needs a CBC sealer");
+	}
+
+	if ((e = seal_check_password_id(context, password_id,
+			password_id_len)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = seal_random(context, encryption_options, integrity_options, 1,
+			random)) != CIRON_OK) {
+		return e;
+	}
+	seal_begin(encryption_options, integrity_options, password_id,
+			password_id_len, random, result, &s);
+
+	/*
+	 * Encryption key handling. Because the key is not part of the
+	 * result, we need to store the generated key in a buffer.
+	 */
+	if ((e = ciron_generate_key_prepared(context, password,
+			s.encryption_salt_hex.chars, s.encryption_salt_hex.len,
+			encryption_options->algorithm, encryption_options->iterations,
+			s.buffer_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+
+	if (IS_AEAD(encryption_options->algorithm)) {
+		return seal_aead_end(context, encryption_options, &s, data, data_len,
+				buffer_encrypted_bytes, plen);
+	}
+
+	if ((e = seal_encrypt_data(context, sealer, encryption_options, &s, data,
+			data_len, buffer_encrypted_bytes)) != CIRON_OK) {
+		return e;
+	}
+
+	/*
+	 * Now calculate the HMAC. Because the HMAC is not part of the result
+	 * (the base64url version is), we need an intermediate buffer to hold the binary.
+	 * from which we generate the base64url encoded directly into the result.
+	 */
+	s.hmac_bytes.chars = s.buffer_hmac_bytes;
+	if ((e = integrity_hmac(context, sealer, integrity_options, password,
+			s.integrity_salt_hex.chars, s.integrity_salt_hex.len,
+			s.hmac_base_chars.chars,
+			s.hmac_base_chars.len, s.hmac_bytes.chars, &(s.hmac_bytes.len)))
+			!= CIRON_OK) {
+		return e;
+	}
+
+	seal_end(&s, plen);
+
+	return CIRON_OK;
+}
+
+/*
+ * Plain password tables are looked up like indexed ones without index.
+ * Returns NULL for no table.
+ */
+static CironIndexedPwdTable unindexed(CironPwdTable pwd_table,
+		CironIndexedPwdTable buffer) {
+	if (pwd_table == NULL) {
+		return NULL;
+	}
+	ciron_pwd_table_unindexed(buffer, pwd_table);
+	return buffer;
+}
+
+CironError ciron_unseal(CironContext context, const unsigned char *data,
+		size_t data_len, CironPwdTable pwd_table, const unsigned char* password, size_t password_len,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	struct CironIndexedPwdTable buffer;
+
+	return unseal(context, NULL, data, data_len, NULL, unindexed(pwd_table, &buffer),
+			password, password_len, NULL, buffer_encrypted_bytes, result, plen, NULL);
+}
+
+CironError ciron_unseal_indexed(CironContext context, const unsigned char *data,
+		size_t data_len, CironIndexedPwdTable pwd_table,
+		const unsigned char* password, size_t password_len,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	return unseal(context, NULL, data, data_len, NULL, pwd_table, password, password_len,
+			NULL, buffer_encrypted_bytes, result, plen, NULL);
+}
+
+CironError ciron_unseal_inplace(CironContext context, unsigned char *data,
+		size_t data_len, CironPwdTable pwd_table, const unsigned char* password, size_t password_len,
+		unsigned char **presult, size_t *plen) {
+	struct CironIndexedPwdTable buffer;
+
+	return unseal(context, NULL, data, data_len, NULL, unindexed(pwd_table, &buffer),
+			password, password_len, NULL, NULL, NULL, plen, presult);
+}
+
+CironError ciron_unseal_view(CironContext context, const unsigned char *data,
+		CironTokenView view, CironPwdTable pwd_table,
+		const unsigned char* password, size_t password_len,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	struct CironIndexedPwdTable buffer;
+
+	return unseal(context, NULL, data, view->hmac.offset + view->hmac.len, view,
+			unindexed(pwd_table, &buffer), password, password_len, NULL,
+			buffer_encrypted_bytes, result, plen, NULL);
+}
+
+CironError ciron_unseal_view_indexed(CironContext context, const unsigned char *data,
+		CironTokenView view, CironIndexedPwdTable pwd_table,
+		const unsigned char* password, size_t password_len,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	return unseal(context, NULL, data, view->hmac.offset + view->hmac.len, view,
+			pwd_table, password, password_len, NULL, buffer_encrypted_bytes,
+			result, plen, NULL);
+}
+
+CironError ciron_unseal_prepared(CironContext context, const unsigned char *data,
+		size_t data_len, CironPreparedPassword password,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	return unseal(context, NULL, data, data_len, NULL, NULL, NULL, 0,
+			password, buffer_encrypted_bytes, result, plen, NULL);
+}
+
+/*
+ * State of a token while it is unsealed, like struct seal_state.
+ */
+struct unseal_state {
+	/* The fields of the token, see ciron_token_view() */
+	struct CironTokenView view;
 
 	/*
 	 * These are parse from the incoming data and point into that data block.
 	 * No copy is made.
 	 */
-	struct const_chars_and_len prefix;
+	/* The algorithm of AEAD tokens, NULL for Fe26.1 tokens */
+	CironAlgorithm aead_algorithm;
 	struct const_chars_and_len password_id;
 	struct const_chars_and_len encryption_salt_hexchars;
 	struct const_chars_and_len encryption_iv_b64urlchars;
@@ -443,39 +1035,77 @@ CironError ciron_unseal(CironContext context, const unsigned char *data,
 	struct const_chars_and_len hmac_base_chars;
 
 	/*
-	 *  These are local buffers to hold data that is pointed to by the xxx_and_len structs
+	 * Set for ciron_unseal_inplace(). The token is then decoded and
+	 * decrypted where its encrypted data is.
 	 */
+	int inplace;
+
+	struct chars_and_len integrity_hmac_bytes;
 	unsigned char buffer_encryption_key_bytes[MAX_KEY_BYTES];
-	unsigned char buffer_encryption_iv_bytes[MAX_IV_BYTES];
+	unsigned char buffer_integrity_key_bytes[MAX_KEY_BYTES];
 	unsigned char buffer_integrity_hmac_bytes[MAX_HMAC_BYTES];
-	unsigned char buffer_incoming_integrity_hmac_bytes[MAX_HMAC_BYTES];
+};
 
-	/*
-	 * Variables to keep together pointer and length information
-	 * of encryption data.
-	 */
+/*
+ * Splits a token into its fields, unless the caller has done that with
+ * ciron_token_view() already and passes the view, and checks the prefix.
+ * AEAD tokens are only accepted if the encryption options are for an AEAD
+ * algorithm, others would not have sized the buffers for them.
+ */
+static CironError unseal_parse_header(CironContext context,
+		CironOptions encryption_options, const unsigned char *data,
+		size_t data_len, CironTokenView view, struct unseal_state *s) {
+	CironError e;
 
-	struct chars_and_len encryption_key_bytes;
-	struct chars_and_len encryption_iv_bytes;
-	struct chars_and_len encrypted_bytes;
-	struct chars_and_len decrypted_bytes;
+	s->inplace = 0;
+	if (view != NULL) {
+		s->view = *view;
+	} else if ((e = ciron_token_view(context, data, data_len, &s->view)) != CIRON_OK) {
+		return e;
+	}
 
-	/*
-	 * Variables to keep together pointer and length information
-	 * of integrity data.
-	 */
-	struct chars_and_len integrity_hmac_bytes;
-	struct chars_and_len incodming_integrity_hmac_bytes;
+	s->aead_algorithm = NULL;
+	if (memcmp(data, MAC_PREFIX, PREFIX_LEN) != 0
+			&& (!IS_AEAD(encryption_options->algorithm)
+					|| (s->aead_algorithm = aead_algorithm(data)) == NULL)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Invalid prefix");
+	}
+
+	s->password_id.chars = data + s->view.password_id.offset;
+	s->password_id.len = s->view.password_id.len;
+	s->encryption_salt_hexchars.chars = data + s->view.encryption_salt.offset;
+	s->encryption_salt_hexchars.len = s->view.encryption_salt.len;
+	s->encryption_iv_b64urlchars.chars = data + s->view.iv.offset;
+	s->encryption_iv_b64urlchars.len = s->view.iv.len;
+	s->encrypted_data_b64urlchars.chars = data + s->view.encrypted.offset;
+	s->encrypted_data_b64urlchars.len = s->view.encrypted.len;
+	s->integrity_salt_hexchars.chars = data + s->view.integrity_salt.offset;
+	s->integrity_salt_hexchars.len = s->view.integrity_salt.len;
+	s->integrity_hmac_b64urlchars.chars = data + s->view.hmac.offset;
+	s->integrity_hmac_b64urlchars.len = s->view.hmac.len;
 
 	/*
-	 * These maintain parsing position when extracting fields from incoming data
+	 * The HMAC base string is the token up to the end of the encrypted
+	 * data, without the delimiter.
 	 */
-	const unsigned char *data_ptr;
-	size_t data_remain_len;
-
-	encryption_options = context->encryption_options;
-    integrity_options = context->integrity_options;
+	s->hmac_base_chars.chars = data;
+	s->hmac_base_chars.len = s->view.encrypted.offset + s->view.encrypted.len;
+	return CIRON_OK;
+}
 
+/*
+ * Checks the fields of a token before any crypto is done, so that junk
+ * costs no key derivation: the password ID has word characters only, as
+ * in iron, the salts are hex digits and the other fields base64url. All
+ * fields but the encrypted data have the lengths the options give, the
+ * encrypted data of Fe26.1 tokens is whole CBC blocks.
+ */
+static CironError unseal_parse_fields(CironContext context,
+		CironOptions encryption_options, CironOptions integrity_options,
+		const unsigned char *data, struct unseal_state *s) {
+	CironAlgorithm algorithm = encryption_options->algorithm;
+	size_t hmac_chars_len, encrypted_len;
 
 	/*
 	 * Calculate number of salt bytes from provided options and
@@ -485,217 +1115,113 @@ CironError ciron_unseal(CironContext context, const unsigned char *data,
 	assert(NBYTES(integrity_options->salt_bits) <= MAX_SALT_BYTES);
 	assert(NBYTES(encryption_options->algorithm->iv_bits) <= MAX_IV_BYTES);
 	assert(NBYTES(encryption_options->algorithm->key_bits) <= MAX_KEY_BYTES);
+	assert(NBYTES(integrity_options->algorithm->key_bits) <= MAX_KEY_BYTES);
 
-	/*
-         * Prevent compiler warning about possible uninitialzed use.
-         */
-        memset(&encryption_iv_b64urlchars,0,sizeof(struct const_chars_and_len));
-        memset(&encrypted_data_b64urlchars,0,sizeof(struct const_chars_and_len));
-
-	/*
-	 * Remember the start of the base string for later HMAC generation for
-	 * HMAC validation. We will set length later, once we are at that
-	 * parsing position.
-	 */
-	hmac_base_chars.chars = data;
-
-	/*
-	 * Initialize vars that maintain parsing state.
-	 */
-	data_ptr = data;
-	data_remain_len = data_len;
-#if 0
-	TRACE("data_remain_len=%d now prefix\n" _ data_remain_len);
-#endif
+	if (s->aead_algorithm != NULL) {
+		algorithm = s->aead_algorithm;
+		hmac_chars_len = BASE64URL_ENCODE_SIZE(NBYTES(algorithm->tag_bits));
+	} else {
+		hmac_chars_len = BASE64URL_ENCODE_SIZE(NBYTES(integrity_options->algorithm->tag_bits));
+	}
 
-	/*
-	 * Parse the prefix and validate.
-	 */
-	if ((e = parse_fixed_len(context, data_ptr, data_remain_len, 6, &prefix)
-			!= CIRON_OK)) {
-		return e;
+	if (!ciron_password_id_valid(s->password_id.chars, s->password_id.len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Invalid character in password ID");
 	}
-	if (memcmp(prefix.chars, MAC_PREFIX, 6) != 0) {
+	if (s->encryption_salt_hexchars.len != NBYTES(encryption_options->salt_bits) * 2) {
 		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-				CIRON_TOKEN_PARSE_ERROR, "Invalid prefix");
+				CIRON_TOKEN_PARSE_ERROR,
+				"Expected encryption salt length of %d, but got %d",
+				(int) (NBYTES(encryption_options->salt_bits) * 2),
+				(int) s->encryption_salt_hexchars.len);
 	}
-
-	/* Skip prefix and delimiter */
-	data_ptr += prefix.len + 1;
-	data_remain_len -= prefix.len;
-	data_remain_len--;
-#if 0
-	TRACE("data_remain_len=%d now password_id\n" _ data_remain_len);
-#endif
-	/*
-	 * Parse password_id sequence. There
-	 * is no size checking here. it is the responsibility
-	 * of the caller to supply the correct data_len value
-	 * so that we do not read past the end of the sealed
-	 * data.
-	 */
-	if ((e = parse(context, data_ptr, data_remain_len,
-			&password_id) != CIRON_OK)) {
-		return e;
+	if (!ciron_hex_valid(s->encryption_salt_hexchars.chars,
+			s->encryption_salt_hexchars.len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Encryption salt is not hex encoded");
 	}
-
-	/* Skip password and delimiter */
-	data_ptr += password_id.len + 1;
-	data_remain_len -= password_id.len;
-	data_remain_len--;
-#if 0
-	TRACE("data_remain_len=%d now encryption salt\n" _ data_remain_len);
-#endif
-
-	if(password_id.len == 0 && password_len == 0) {
+	if (s->encryption_iv_b64urlchars.len != BASE64URL_ENCODE_SIZE(NBYTES(algorithm->iv_bits))
+			|| !ciron_base64url_valid(s->encryption_iv_b64urlchars.chars,
+					s->encryption_iv_b64urlchars.len)) {
 		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-						CIRON_PASSWORD_ROTATION_ERROR, "Sealed token does not contain password ID and provided password is empty");
+				CIRON_TOKEN_PARSE_ERROR, "Invalid base64url encoded IV of length %d",
+				(int) s->encryption_iv_b64urlchars.len);
 	}
-	found_password = 0;
-	if(pwd_table != NULL) {
-		/*
-		 * Now try to find the password in the password table and use that one if found.
-		 * if we found one, we re-point the function parameters password and password len to
-	 	 * the table entry.
-	 	 */
 
-		 for(i = 0; i < pwd_table->nentries; i++) {
-			 CironPwdTableEntry entry = &(pwd_table->entries[i]);
-			 if(entry->password_id_len != password_id.len) {
-				 continue;
-			 }
-			 if(memcmp(entry->password_id,password_id.chars, password_id.len) != 0) {
-				 continue;
-			 }
-			 password = entry->password;
-			 password_len = entry->password_len;
-			 found_password = 1;
-			 break;
-		 }
+	/* Without padding, n characters encode n / 4 * 3 + (n % 4) - 1 bytes */
+	encrypted_len = s->encrypted_data_b64urlchars.len / 4 * 3;
+	if (s->encrypted_data_b64urlchars.len % 4 > 1) {
+		encrypted_len += s->encrypted_data_b64urlchars.len % 4 - 1;
 	}
-	/*
-	 * Right now, we accept if a password is not found in the table and fall back to the
-	 * provided password if it has been provided. If none was provided, we report an error.
-	 */
-	if(( !found_password ) && (password_len == 0)) {
+	if (!ciron_base64url_valid(s->encrypted_data_b64urlchars.chars,
+			s->encrypted_data_b64urlchars.len)
+			|| (s->aead_algorithm == NULL && (encrypted_len == 0
+					|| encrypted_len % CIPHER_BLOCK_SIZE != 0))) {
 		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-				CIRON_PASSWORD_ROTATION_ERROR, "Password with ID %.*s not found" , password_id.len, password_id.chars);
+				CIRON_TOKEN_PARSE_ERROR,
+				"Invalid base64url encoded encrypted data of length %d",
+				(int) s->encrypted_data_b64urlchars.len);
 	}
 
-
-	/*
-	 * Parse encryption salt.
-	 */
-	if ((e = parse_fixed_len(context, data_ptr, data_remain_len,
-			NBYTES(encryption_options->salt_bits) * 2,
-			&encryption_salt_hexchars) != CIRON_OK)) {
-		return e;
+	if (s->aead_algorithm == NULL) {
+		if (s->integrity_salt_hexchars.len != NBYTES(integrity_options->salt_bits) * 2) {
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_TOKEN_PARSE_ERROR,
+					"Expected integrity salt length of %d, but got %d",
+					(int) (NBYTES(integrity_options->salt_bits) * 2),
+					(int) s->integrity_salt_hexchars.len);
+		}
+		if (!ciron_hex_valid(s->integrity_salt_hexchars.chars,
+				s->integrity_salt_hexchars.len)) {
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_TOKEN_PARSE_ERROR, "Integrity salt is not hex encoded");
+		}
 	}
-
-	/* Skip salt and delimiter */
-	data_ptr += encryption_salt_hexchars.len + 1;
-	data_remain_len -= encryption_salt_hexchars.len;
-	data_remain_len--;
-#if 0
-	TRACE("data_remain_len=%d now enc IV\n" _ data_remain_len);
-#endif
-	/*
-	 * Parse encryption IV base64url sequence.
-	 */
-	if ((e = parse_max_len(context, data_ptr, data_remain_len, MAX_IV_B64URL_CHARS,
-			&encryption_iv_b64urlchars) != CIRON_OK)) {
-		return e;
+	if (s->integrity_hmac_b64urlchars.len != hmac_chars_len
+			|| !ciron_base64url_valid(s->integrity_hmac_b64urlchars.chars,
+					s->integrity_hmac_b64urlchars.len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR,
+				"Invalid base64url encoded %s of length %d",
+				s->aead_algorithm != NULL ? "tag" : "HMAC",
+				(int) s->integrity_hmac_b64urlchars.len);
 	}
-#if 0
-	TRACE("len=%d\n" _ encryption_iv_b64urlchars.len);
-	TRACE("s=%s\n" _ encryption_iv_b64urlchars.chars);
-#endif
-
-	/* Skip IV base64url and delimiter */
-	data_ptr += encryption_iv_b64urlchars.len + 1;
-	data_remain_len -= encryption_iv_b64urlchars.len;
-	data_remain_len--;
-#if 0
-	TRACE("data_remain_len=%d now 64ofenced data\n" _ data_remain_len);
-#endif
 
-	/*
-	 * Parse encrypted base64url encoded sequence. There
-	 * is no size checking here. it is the responsibility
-	 * of the caller to supply the correct data_len value
-	 * so that we do not read past the end of the sealed
-	 * data.
-	 */
-	if ((e = parse(context, data_ptr, data_remain_len,
-			&encrypted_data_b64urlchars) != CIRON_OK)) {
-		return e;
-	}
-	/* skip encrypted and delimiter */
-	data_ptr += encrypted_data_b64urlchars.len + 1;
-	data_remain_len -= encrypted_data_b64urlchars.len;
-	data_remain_len--;
-#if 0
-	TRACE("data_remain_len=%d now hmac remains with this len\n" _ data_remain_len);
-#endif
+	return CIRON_OK;
+}
 
-	/*
-	 * Now we can set the HMAC base string length. We must
-	 * substract one because we already advanced to the delimiter
-	 * above. And the elimiter is not part of the base string.
-	 */
-	hmac_base_chars.len = data_ptr - data;
-	hmac_base_chars.len--;
+CironError ciron_token_check(CironContext context, const unsigned char *data,
+		size_t data_len) {
+	CironOptions encryption_options = context->encryption_options;
+	CironError e;
+	struct unseal_state s;
 
-	/*
-	 * Now we parse the integrity salt.
-	 */
-	if ((e = parse_fixed_len(context, data_ptr, data_remain_len,
-			NBYTES(integrity_options->salt_bits) * 2, &integrity_salt_hexchars)
-			!= CIRON_OK)) {
+	if ((e = unseal_parse_header(context, encryption_options, data, data_len,
+			NULL, &s)) != CIRON_OK) {
 		return e;
 	}
-	/* skip salt and delimiter */
-	data_ptr += integrity_salt_hexchars.len + 1;
-	data_remain_len -= integrity_salt_hexchars.len;
-	data_remain_len--;
-#if 0
-	TRACE("data_remain_len=%d\n" _ data_remain_len);
-#endif
-
-	/*
-	 * Now we parse the base64url encoded HMAC value.
-	 * We do not need to parse for delimiter here, because it
-	 * is the last portion of the input anyhow.
-	 */
-	integrity_hmac_b64urlchars.chars = data_ptr;
-	integrity_hmac_b64urlchars.len = data_remain_len;
-	if (integrity_hmac_b64urlchars.len > MAX_IV_B64URL_CHARS) {
-		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-				CIRON_TOKEN_PARSE_ERROR,
-				"Base64url encoded string of HMAC is too long. Parsed %d bytes, but max is %d",
-				integrity_hmac_b64urlchars.len, MAX_IV_B64URL_CHARS);
+	if (s.aead_algorithm == NULL) {
+		encryption_options = fe26_encryption_options(encryption_options);
 	}
+	return unseal_parse_fields(context, encryption_options,
+			context->integrity_options, data, &s);
+}
 
-	/*
-	 * Calculate integrity HMAC using the base string. This value is the
-	 * used to validate the incoming HMAC in the input.
-	 */
-	integrity_hmac_bytes.chars = buffer_integrity_hmac_bytes;
-	if ((e = ciron_hmac(context, integrity_options->algorithm, password,
-			password_len, integrity_salt_hexchars.chars,
-			integrity_salt_hexchars.len, integrity_options->iterations,
-			hmac_base_chars.chars, hmac_base_chars.len,
-			integrity_hmac_bytes.chars, &(integrity_hmac_bytes.len)))
-			!= CIRON_OK) {
-		return e;
-	}
+/*
+ * Compares the HMAC of the token with the one calculated from its base
+ * string, which the state holds.
+ */
+static CironError unseal_check_hmac(CironContext context, struct unseal_state *s) {
+	CironError e;
+	unsigned char buffer_incoming_integrity_hmac_bytes[MAX_HMAC_BYTES];
+	struct chars_and_len incodming_integrity_hmac_bytes;
 
 	/*
 	 * Turn incoming base64url encoded HMAC value into binary for comparison.
 	 */
 	incodming_integrity_hmac_bytes.chars = buffer_incoming_integrity_hmac_bytes;
-	if( (e = ciron_base64url_decode(context,integrity_hmac_b64urlchars.chars,
-			integrity_hmac_b64urlchars.len,
+	if( (e = ciron_base64url_decode(context,s->integrity_hmac_b64urlchars.chars,
+			s->integrity_hmac_b64urlchars.len,
 			incodming_integrity_hmac_bytes.chars,
 			&(incodming_integrity_hmac_bytes.len))) != CIRON_OK) {
 		return e;
@@ -704,7 +1230,7 @@ CironError ciron_unseal(CironContext context, const unsigned char *data,
 	/*
 	 * Lengths of the HMACs must match, of course.
 	 */
-	if (integrity_hmac_bytes.len != incodming_integrity_hmac_bytes.len) {
+	if (s->integrity_hmac_bytes.len != incodming_integrity_hmac_bytes.len) {
 		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
 				CIRON_TOKEN_VALIDATION_ERROR,
 				"HMAC signature invalid (lengths differ)");
@@ -714,43 +1240,157 @@ CironError ciron_unseal(CironContext context, const unsigned char *data,
 	 * And check for HMAC equality. If this succeeds, we know that no one has tampered
 	 * with the input.
 	 */
-	if (! ciron_fixed_time_equal(incodming_integrity_hmac_bytes.chars, integrity_hmac_bytes.chars,
-			integrity_hmac_bytes.len) ) {
+	if (! ciron_fixed_time_equal(incodming_integrity_hmac_bytes.chars, s->integrity_hmac_bytes.chars,
+			s->integrity_hmac_bytes.len) ) {
 		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
 				CIRON_TOKEN_VALIDATION_ERROR, "HMAC signature invalid");
 	}
 
-	/*
-	 * Generate an encryption key using the given salt and algorithm.
-	 */
-	encryption_key_bytes.len = NBYTES(encryption_options->algorithm->key_bits);
-	encryption_key_bytes.chars = buffer_encryption_key_bytes;
-	if ((e = ciron_generate_key(context, password, password_len,
-			encryption_salt_hexchars.chars, encryption_salt_hexchars.len,
-			encryption_options->algorithm, encryption_options->iterations,
-			encryption_key_bytes.chars)) != CIRON_OK) {
-		return e;
-	}
+	return CIRON_OK;
+}
 
-	/*
-	 * Base64url decode the encryption IV. The size has been
-	 * verified during parsing, but we could do it
-	 * again here using the other macro. Try it -> FIXME. What did I actually mean here?
-	 */
-	encryption_iv_bytes.chars = buffer_encryption_iv_bytes;
-	if( (e = ciron_base64url_decode(context,encryption_iv_b64urlchars.chars,
-			encryption_iv_b64urlchars.len, encryption_iv_bytes.chars,
-			&(encryption_iv_bytes.len))) != CIRON_OK) {
-		return e;
+/*
+ * Base64url decodes the encrypted data of the token to buf. With
+ * ciron_unseal_inplace() buf is the encrypted data itself. The decoding
+ * then goes chunk by chunk, each from a copy, and only overwrites the
+ * characters of its own chunk and those of the chunks already done.
+ */
+static CironError unseal_decode(CironContext context, struct unseal_state *s,
+		unsigned char *buf, size_t *sizep) {
+	CironError e;
+	unsigned char chunk[SEAL_CHUNK_CHARS];
+	const unsigned char *chars = s->encrypted_data_b64urlchars.chars;
+	size_t chars_len = s->encrypted_data_b64urlchars.len;
+	size_t n, len;
+
+	if (buf != chars) {
+		return ciron_base64url_decode(context, chars, chars_len, buf, sizep);
+	}
+	*sizep = 0;
+	while (chars_len > 0) {
+		n = chars_len < SEAL_CHUNK_CHARS ? chars_len : SEAL_CHUNK_CHARS;
+		memcpy(chunk, chars, n);
+		if ((e = ciron_base64url_decode(context, chunk, n, buf + *sizep, &len))
+				!= CIRON_OK) {
+			return e;
+		}
+		*sizep += len;
+		chars += n;
+		chars_len -= n;
 	}
+	return CIRON_OK;
+}
 
-	/*
-	 * Turn base64 of encrypted into bytes for decrypting. It is
+/*
+ * For ciron_unseal_inplace(), the buffers of the decoding and decryption
+ * are the encrypted data of the token.
+ */
+static void unseal_buffers_inplace(struct unseal_state *s,
+		unsigned char **buffer_encrypted_bytes, unsigned char **result) {
+	if (s->inplace) {
+		*buffer_encrypted_bytes = (unsigned char *) s->encrypted_data_b64urlchars.chars;
+		*result = *buffer_encrypted_bytes;
+	}
+}
+
+/*
+ * Passes the outcome of unseal() on and, for ciron_unseal_inplace(),
+ * stores where the result is.
+ */
+static CironError unseal_end_inplace(struct unseal_state *s, CironError e,
+		unsigned char **inplace_result) {
+	if (e == CIRON_OK && inplace_result != NULL) {
+		*inplace_result = (unsigned char *) s->encrypted_data_b64urlchars.chars;
+	}
+	return e;
+}
+
+/*
+ * Decodes the encrypted data of the token chunk by chunk and decrypts it
+ * with the cipher of the sealer, so that no buffer for all of the
+ * encrypted data is needed. The plaintext goes to result directly.
+ */
+static CironError unseal_decode_decrypt(CironContext context, CironSealer sealer,
+		struct unseal_state *s, const unsigned char *iv, unsigned char *result,
+		size_t *plen) {
+	CironError e;
+	unsigned char chunk[SEAL_CHUNK_BYTES];
+	const unsigned char *chars = s->encrypted_data_b64urlchars.chars;
+	size_t chars_len = s->encrypted_data_b64urlchars.len;
+	unsigned char *result_ptr = result;
+	size_t n, len;
+
+	if ((e = ciron_cipher_decrypt_init(context, sealer->cipher,
+			s->buffer_encryption_key_bytes, iv)) != CIRON_OK) {
+		return e;
+	}
+	while (chars_len > 0) {
+		n = chars_len < SEAL_CHUNK_CHARS ? chars_len : SEAL_CHUNK_CHARS;
+		if ((e = ciron_base64url_decode(context, chars, n, chunk, &len)) != CIRON_OK) {
+			return e;
+		}
+		if ((e = ciron_cipher_decrypt_update(context, sealer->cipher, chunk, len,
+				result_ptr, &len)) != CIRON_OK) {
+			return e;
+		}
+		result_ptr += len;
+		chars += n;
+		chars_len -= n;
+	}
+	if ((e = ciron_cipher_decrypt_final(context, sealer->cipher, result_ptr, &len))
+			!= CIRON_OK) {
+		return e;
+	}
+	*plen = result_ptr + len - result;
+	return CIRON_OK;
+}
+
+/*
+ * Decrypts the data of the token with the encryption key of the state.
+ */
+static CironError unseal_decrypt_data(CironContext context, CironSealer sealer,
+		CironOptions encryption_options, struct unseal_state *s,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	CironError e;
+	unsigned char buffer_encryption_iv_bytes[MAX_IV_BYTES];
+	struct chars_and_len encryption_iv_bytes;
+	struct chars_and_len encrypted_bytes;
+	struct chars_and_len decrypted_bytes;
+
+	/*
+	 * Base64url decode the encryption IV. The size has been
+	 * verified during parsing, but we could do it
+	 * again here using the other macro. Try it -> FIXME. What did I actually mean here?
+	 */
+	encryption_iv_bytes.chars = buffer_encryption_iv_bytes;
+	if( (e = ciron_base64url_decode(context,s->encryption_iv_b64urlchars.chars,
+			s->encryption_iv_b64urlchars.len, encryption_iv_bytes.chars,
+			&(encryption_iv_bytes.len))) != CIRON_OK) {
+		return e;
+	}
+
+	unseal_buffers_inplace(s, &buffer_encrypted_bytes, &result);
+
+	/*
+	 * Without an encryption buffer the data is decrypted in parts, which
+	 * needs the cipher object of a sealer.
+	 */
+	if (buffer_encrypted_bytes == NULL) {
+		if (sealer == NULL || sealer->cipher == NULL) {
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_CRYPTO_ERROR,
+					"Unsealing without encryption buffer needs a CBC sealer");
+		}
+		return unseal_decode_decrypt(context, sealer, s, encryption_iv_bytes.chars,
+				result, plen);
+	}
+
+	/*
+	 * Turn base64 of encrypted into bytes for decrypting. It is
 	 * caller's responsibility that the buffer is large enough.
 	 */
 	encrypted_bytes.chars = buffer_encrypted_bytes;
-	if( (e = ciron_base64url_decode(context,encrypted_data_b64urlchars.chars,
-			encrypted_data_b64urlchars.len, encrypted_bytes.chars,
+	if( (e = unseal_decode(context, s, encrypted_bytes.chars,
 			&(encrypted_bytes.len))) != CIRON_OK) {
 		return e;
 	}
@@ -759,8 +1399,8 @@ CironError ciron_unseal(CironContext context, const unsigned char *data,
 	 * Decrypt the data.
 	 */
 	decrypted_bytes.chars = result;
-	if ((e = ciron_decrypt(context, encryption_options->algorithm,
-			encryption_key_bytes.chars, encryption_iv_bytes.chars,
+	if ((e = unseal_decrypt(context, sealer, encryption_options->algorithm,
+			s->buffer_encryption_key_bytes, encryption_iv_bytes.chars,
 			encrypted_bytes.chars, encrypted_bytes.len, decrypted_bytes.chars,
 			&(decrypted_bytes.len))) != CIRON_OK) {
 		return e;
@@ -771,74 +1411,1427 @@ CironError ciron_unseal(CironContext context, const unsigned char *data,
 	return CIRON_OK;
 }
 
-static CironError parse(CironContext context, const unsigned char *data,
-		size_t len, struct const_chars_and_len *balp) {
-	size_t pos = 0;
-	balp->chars = data;
+/*
+ * Unseals the rest of an AEAD token after unseal_parse_header(). The salt
+ * and the iterations are those of the encryption options, the algorithm
+ * that of the prefix.
+ */
+static CironError unseal_aead(CironContext context,
+		CironOptions encryption_options, CironPreparedPassword password,
+		const unsigned char *data, struct unseal_state *s,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen) {
+	CironError e;
+	CironAlgorithm algorithm = s->aead_algorithm;
+	unsigned char iv[MAX_IV_BYTES];
+	unsigned char tag[MAX_TAG_BYTES];
+	size_t aad_len;
+	size_t iv_len;
+	size_t tag_len;
+	size_t encrypted_len;
+
+	assert(NBYTES(encryption_options->salt_bits) <= MAX_SALT_BYTES);
+
+	/* There is no incremental AEAD decryption, see ciron_aead_decrypt() */
+	if (buffer_encrypted_bytes == NULL && !s->inplace) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR,
+				"Unsealing without encryption buffer needs a CBC sealer");
+	}
+
+	/* The associated data ends with the delimiter before the encrypted data */
+	aad_len = s->view.encrypted.offset;
+
+	/* unseal_parse_fields() has checked the lengths of the IV and the tag */
+	if ((e = ciron_base64url_decode(context, s->encryption_iv_b64urlchars.chars,
+			s->encryption_iv_b64urlchars.len, iv, &iv_len)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = ciron_base64url_decode(context, s->integrity_hmac_b64urlchars.chars,
+			s->integrity_hmac_b64urlchars.len, tag, &tag_len)) != CIRON_OK) {
+		return e;
+	}
+	if (iv_len != NBYTES(algorithm->iv_bits) || tag_len != NBYTES(algorithm->tag_bits)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Invalid IV or tag length");
+	}
+	unseal_buffers_inplace(s, &buffer_encrypted_bytes, &result);
+	if ((e = unseal_decode(context, s, buffer_encrypted_bytes, &encrypted_len))
+			!= CIRON_OK) {
+		return e;
+	}
+
+	if ((e = ciron_generate_key_prepared(context, password,
+			s->encryption_salt_hexchars.chars, s->encryption_salt_hexchars.len,
+			algorithm, encryption_options->iterations,
+			s->buffer_encryption_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = ciron_aead_decrypt(context, algorithm, s->buffer_encryption_key_bytes,
+			iv, data, aad_len, buffer_encrypted_bytes, encrypted_len, tag,
+			result)) != CIRON_OK) {
+		return e;
+	}
+	*plen = encrypted_len;
+	return CIRON_OK;
+}
+
+/*
+ * Looks up the password for the password ID of the token in the table,
+ * falling back to the supplied password, and prepares it.
+ */
+static CironError unseal_prepare_password(CironContext context,
+		struct unseal_state *s, CironIndexedPwdTable pwd_table,
+		const unsigned char* password, size_t password_len,
+		CironPreparedPassword prepared) {
+	CironPwdTableEntry entry;
+	int found_password;
 
-	while (pos < len) {
-		if (data[pos] == DELIM) {
-			balp->len = pos;
+	if(s->password_id.len == 0 && password_len == 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+						CIRON_PASSWORD_ROTATION_ERROR, "Sealed token does not contain password ID and provided password is empty");
+	}
+	found_password = 0;
+	if(pwd_table != NULL) {
+		/*
+		 * Now try to find the password in the password table and use that one if found.
+		 * if we found one, we re-point the function parameters password and password len to
+	 	 * the table entry. With an index, see ciron_pwd_table_index(), this takes constant
+	 	 * time.
+	 	 */
+		entry = ciron_pwd_table_find(pwd_table, s->password_id.chars, s->password_id.len);
+		/* Passwords prepared by ciron_pwd_table_prepare() need no further work */
+		if(entry != NULL && pwd_table->prepared != NULL) {
+			*prepared = pwd_table->prepared[entry - pwd_table->table.entries];
 			return CIRON_OK;
 		}
-		pos++;
+		if(entry != NULL) {
+			password = entry->password;
+			password_len = entry->password_len;
+			found_password = 1;
+		}
+	}
+	/*
+	 * Right now, we accept if a password is not found in the table and fall back to the
+	 * provided password if it has been provided. If none was provided, we report an error.
+	 */
+	if(( !found_password ) && (password_len == 0)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_PASSWORD_ROTATION_ERROR, "Password with ID %.*s not found" , (int) s->password_id.len, s->password_id.chars);
 	}
 
-	return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-			CIRON_TOKEN_PARSE_ERROR,
-			"End of char sequence reached before finding delimiter");
+	return ciron_password_prepare(context, password, password_len, prepared);
 }
-static CironError parse_fixed_len(CironContext context,
-		const unsigned char *data, size_t len, size_t expected_len,
-		struct const_chars_and_len *balp) {
-	size_t pos = 0;
-	balp->chars = data;
-	if (expected_len > len) {
-		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-				CIRON_TOKEN_PARSE_ERROR,
-				"Remaining length %d smaller than expected length %d", len,
-				expected_len);
+
+static CironError unseal(CironContext context, CironSealer sealer, const unsigned char *data,
+		size_t data_len, CironTokenView view, CironIndexedPwdTable pwd_table, const unsigned char* password, size_t password_len,
+		CironPreparedPassword prepared,
+		unsigned char *buffer_encrypted_bytes, unsigned char *result, size_t *plen,
+		unsigned char **inplace_result) {
+	CironOptions encryption_options;
+	CironOptions integrity_options;
+
+	CironError e;
+	struct CironPreparedPassword buffer_prepared;
+	struct unseal_state s;
+
+	if (sealer != NULL) {
+		encryption_options = sealer->encryption_options;
+		integrity_options = sealer->integrity_options;
+	} else {
+		encryption_options = context->encryption_options;
+		integrity_options = context->integrity_options;
 	}
 
-	while (pos < len && pos <= expected_len) {
-		if (data[pos] == DELIM) {
-			if (pos != expected_len) {
-				return ciron_set_error(context, __FILE__, __LINE__,
-						NO_CRYPTO_ERROR, CIRON_TOKEN_PARSE_ERROR,
-						"Expected parse length of %d, but only got %d",
-						expected_len, pos);
-			}
-			balp->len = pos;
-			return CIRON_OK;
+	if ((e = unseal_parse_header(context, encryption_options, data, data_len,
+			view, &s)) != CIRON_OK) {
+		return e;
+	}
+	s.inplace = inplace_result != NULL;
+	if (s.aead_algorithm == NULL) {
+		encryption_options = fe26_encryption_options(encryption_options);
+	}
+
+	/* Malformed tokens are rejected before a password is even looked up */
+	if ((e = unseal_parse_fields(context, encryption_options, integrity_options,
+			data, &s)) != CIRON_OK) {
+		return e;
+	}
+
+	/*
+	 * Without a prepared password we look up the password to use and
+	 * prepare it here.
+	 */
+	if (prepared == NULL) {
+		if ((e = unseal_prepare_password(context, &s, pwd_table, password,
+				password_len, &buffer_prepared)) != CIRON_OK) {
+			return e;
+		}
+		prepared = &buffer_prepared;
+	}
+
+	if (s.aead_algorithm != NULL) {
+		e = unseal_aead(context, encryption_options, prepared, data, &s,
+				buffer_encrypted_bytes, result, plen);
+		return unseal_end_inplace(&s, e, inplace_result);
+	}
+
+	/*
+	 * Calculate integrity HMAC using the base string. This value is the
+	 * used to validate the incoming HMAC in the input.
+	 */
+	s.integrity_hmac_bytes.chars = s.buffer_integrity_hmac_bytes;
+	if ((e = integrity_hmac(context, sealer, integrity_options, prepared,
+			s.integrity_salt_hexchars.chars,
+			s.integrity_salt_hexchars.len,
+			s.hmac_base_chars.chars, s.hmac_base_chars.len,
+			s.integrity_hmac_bytes.chars, &(s.integrity_hmac_bytes.len)))
+			!= CIRON_OK) {
+		return e;
+	}
+
+	if ((e = unseal_check_hmac(context, &s)) != CIRON_OK) {
+		return e;
+	}
+
+	/*
+	 * Generate an encryption key using the given salt and algorithm.
+	 */
+	if ((e = ciron_generate_key_prepared(context, prepared,
+			s.encryption_salt_hexchars.chars, s.encryption_salt_hexchars.len,
+			encryption_options->algorithm, encryption_options->iterations,
+			s.buffer_encryption_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+
+	e = unseal_decrypt_data(context, sealer, encryption_options, &s,
+			buffer_encrypted_bytes, result, plen);
+	return unseal_end_inplace(&s, e, inplace_result);
+}
+
+/*
+ * Checks the HMAC of an Fe26.1 token like unseal(), but derives no
+ * encryption key and decrypts nothing. Shared implementation of
+ * ciron_verify() and ciron_sealer_verify().
+ */
+static CironError verify(CironContext context, CironSealer sealer,
+		const unsigned char *data, size_t data_len, CironIndexedPwdTable pwd_table,
+		const unsigned char* password, size_t password_len,
+		CironPreparedPassword prepared) {
+	CironOptions encryption_options;
+	CironOptions integrity_options;
+	CironError e;
+	struct CironPreparedPassword buffer_prepared;
+	struct unseal_state s;
+
+	if (sealer != NULL) {
+		encryption_options = sealer->encryption_options;
+		integrity_options = sealer->integrity_options;
+	} else {
+		encryption_options = context->encryption_options;
+		integrity_options = context->integrity_options;
+	}
+
+	if ((e = unseal_parse_header(context, encryption_options, data, data_len,
+			NULL, &s)) != CIRON_OK) {
+		return e;
+	}
+
+	/*
+	 * The tag of AEAD tokens is only checked together with the
+	 * decryption.
+	 */
+	if (s.aead_algorithm != NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "AEAD tokens can only be verified by unsealing");
+	}
+	if ((e = unseal_parse_fields(context, fe26_encryption_options(encryption_options),
+			integrity_options, data, &s)) != CIRON_OK) {
+		return e;
+	}
+	if (prepared == NULL) {
+		if ((e = unseal_prepare_password(context, &s, pwd_table, password,
+				password_len, &buffer_prepared)) != CIRON_OK) {
+			return e;
 		}
-		pos++;
+		prepared = &buffer_prepared;
 	}
+	s.integrity_hmac_bytes.chars = s.buffer_integrity_hmac_bytes;
+	if ((e = integrity_hmac(context, sealer, integrity_options, prepared,
+			s.integrity_salt_hexchars.chars, s.integrity_salt_hexchars.len,
+			s.hmac_base_chars.chars, s.hmac_base_chars.len,
+			s.integrity_hmac_bytes.chars, &(s.integrity_hmac_bytes.len)))
+			!= CIRON_OK) {
+		return e;
+	}
+	return unseal_check_hmac(context, &s);
+}
+
+CironError ciron_verify(CironContext context, const unsigned char *data,
+		size_t data_len, CironPwdTable pwd_table, const unsigned char* password,
+		size_t password_len) {
+	struct CironIndexedPwdTable buffer;
+
+	return verify(context, NULL, data, data_len, unindexed(pwd_table, &buffer),
+			password, password_len, NULL);
+}
+
+CironError ciron_verify_indexed(CironContext context, const unsigned char *data,
+		size_t data_len, CironIndexedPwdTable pwd_table,
+		const unsigned char* password, size_t password_len) {
+	return verify(context, NULL, data, data_len, pwd_table, password,
+			password_len, NULL);
+}
 
-	return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-			CIRON_TOKEN_PARSE_ERROR,
-			"End of char sequence or expected length reached before finding delimiter");
+CironError ciron_sealer_verify(CironContext context, CironSealer sealer,
+		const unsigned char *data, size_t data_len, CironPreparedPassword password) {
+	return verify(context, sealer, data, data_len, NULL, NULL, 0, password);
 }
 
-static CironError parse_max_len(CironContext context, const unsigned char *data,
-		size_t len, size_t max_len, struct const_chars_and_len *balp) {
-	size_t pos = 0;
-	balp->chars = data;
-	if (max_len > len) {
+/*
+ * Decodes the len bytes of the encrypted data of the token that start at
+ * byte pos to buf, at most SEAL_CHUNK_BYTES. Only the base64url quads
+ * covering them are decoded.
+ */
+static CironError range_decode(CironContext context, struct unseal_state *s,
+		size_t pos, size_t len, unsigned char *buf) {
+	CironError e;
+	unsigned char chunk[SEAL_CHUNK_BYTES + 6];
+	size_t first = pos / 3 * 4;
+	size_t end = (pos + len + 2) / 3 * 4;
+	size_t n;
+
+	if (end > s->encrypted_data_b64urlchars.len) {
+		end = s->encrypted_data_b64urlchars.len;
+	}
+	if ((e = ciron_base64url_decode(context,
+			s->encrypted_data_b64urlchars.chars + first, end - first, chunk, &n))
+			!= CIRON_OK) {
+		return e;
+	}
+	if (n < pos % 3 + len) {
 		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-				CIRON_TOKEN_PARSE_ERROR,
-				"Remaining length %d smaller than expected max length %d", len,
-				max_len);
+				CIRON_TOKEN_PARSE_ERROR, "Encrypted data too short");
 	}
+	memcpy(buf, chunk + pos % 3, len);
+	return CIRON_OK;
+}
 
-	while (pos < len && pos <= max_len) {
-		if (data[pos] == DELIM) {
-			balp->len = pos;
-			return CIRON_OK;
+/*
+ * Copies the part of the plaintext bytes in chunk, which start at
+ * plaintext position pos, that lies in [offset, end) to result.
+ */
+static void range_copy(const unsigned char *chunk, size_t pos, size_t len,
+		size_t offset, size_t end, unsigned char *result, size_t *plen) {
+	size_t from = pos > offset ? pos : offset;
+	size_t to = pos + len < end ? pos + len : end;
+
+	if (from < to) {
+		memcpy(result + (from - offset), chunk + (from - pos), to - from);
+		*plen = to - offset;
+	}
+}
+
+/*
+ * Decrypts the CBC blocks of the verified token that hold the plaintext
+ * bytes from offset to end. Block i only needs block i - 1 as its IV, so
+ * decryption starts there. The block after the last one needed is also
+ * decrypted, because the cipher holds back the last block it is passed;
+ * if that is the last block of the token, its padding is removed.
+ */
+static CironError range_decrypt(CironContext context, CironSealer sealer,
+		struct unseal_state *s, const unsigned char *token_iv, size_t offset,
+		size_t end, unsigned char *result, size_t *plen) {
+	CironError e;
+	unsigned char iv[CIPHER_BLOCK_SIZE];
+	unsigned char chunk[SEAL_CHUNK_BYTES];
+	unsigned char plain[SEAL_CHUNK_BYTES];
+	size_t chars_len = s->encrypted_data_b64urlchars.len;
+	size_t encrypted_len = chars_len / 4 * 3 + (chars_len % 4 ? chars_len % 4 - 1 : 0);
+	size_t nblocks = encrypted_len / CIPHER_BLOCK_SIZE;
+	size_t first, stop, pos, plain_pos, n, len;
+
+	*plen = 0;
+	if (chars_len % 4 == 1 || encrypted_len % CIPHER_BLOCK_SIZE != 0 || nblocks == 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Encrypted data length invalid");
+	}
+	first = offset / CIPHER_BLOCK_SIZE;
+	if (offset >= end || first >= nblocks) {
+		return CIRON_OK;
+	}
+	stop = (end - 1) / CIPHER_BLOCK_SIZE + 2;
+	if (stop > nblocks) {
+		stop = nblocks;
+	}
+
+	if (first == 0) {
+		memcpy(iv, token_iv, CIPHER_BLOCK_SIZE);
+	} else if ((e = range_decode(context, s, (first - 1) * CIPHER_BLOCK_SIZE,
+			CIPHER_BLOCK_SIZE, iv)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = ciron_cipher_decrypt_init(context, sealer->cipher,
+			s->buffer_encryption_key_bytes, iv)) != CIRON_OK) {
+		return e;
+	}
+	plain_pos = first * CIPHER_BLOCK_SIZE;
+	for (pos = plain_pos; pos < stop * CIPHER_BLOCK_SIZE; pos += n) {
+		n = stop * CIPHER_BLOCK_SIZE - pos;
+		n = n < SEAL_CHUNK_BYTES ? n : SEAL_CHUNK_BYTES;
+		if ((e = range_decode(context, s, pos, n, chunk)) != CIRON_OK) {
+			return e;
+		}
+		if ((e = ciron_cipher_decrypt_update(context, sealer->cipher, chunk, n,
+				plain, &len)) != CIRON_OK) {
+			return e;
+		}
+		range_copy(plain, plain_pos, len, offset, end, result, plen);
+		plain_pos += len;
+	}
+	if (stop == nblocks) {
+		if ((e = ciron_cipher_decrypt_final(context, sealer->cipher, plain, &len))
+				!= CIRON_OK) {
+			return e;
+		}
+		range_copy(plain, plain_pos, len, offset, end, result, plen);
+	}
+	return CIRON_OK;
+}
+
+CironError ciron_sealer_unseal_range(CironContext context, CironSealer sealer,
+		const unsigned char *data, size_t data_len, CironPreparedPassword password,
+		size_t offset, size_t length, unsigned char *result, size_t *plen) {
+	CironOptions encryption_options = sealer->encryption_options;
+	CironOptions integrity_options = sealer->integrity_options;
+	CironError e;
+	struct unseal_state s;
+	unsigned char iv[MAX_IV_BYTES];
+	size_t iv_len;
+
+	if (sealer->cipher == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Unsealing a range needs a CBC sealer");
+	}
+	if ((e = unseal_parse_header(context, encryption_options, data, data_len,
+			NULL, &s)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = unseal_parse_fields(context, encryption_options, integrity_options,
+			data, &s)) != CIRON_OK) {
+		return e;
+	}
+
+	/*
+	 * The whole token is verified, only the decoding and decryption are
+	 * limited to the range.
+	 */
+	s.integrity_hmac_bytes.chars = s.buffer_integrity_hmac_bytes;
+	if ((e = integrity_hmac(context, sealer, integrity_options, password,
+			s.integrity_salt_hexchars.chars, s.integrity_salt_hexchars.len,
+			s.hmac_base_chars.chars, s.hmac_base_chars.len,
+			s.integrity_hmac_bytes.chars, &(s.integrity_hmac_bytes.len)))
+			!= CIRON_OK) {
+		return e;
+	}
+	if ((e = unseal_check_hmac(context, &s)) != CIRON_OK) {
+		return e;
+	}
+
+	if ((e = ciron_generate_key_prepared(context, password,
+			s.encryption_salt_hexchars.chars, s.encryption_salt_hexchars.len,
+			encryption_options->algorithm, encryption_options->iterations,
+			s.buffer_encryption_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = ciron_base64url_decode(context, s.encryption_iv_b64urlchars.chars,
+			s.encryption_iv_b64urlchars.len, iv, &iv_len)) != CIRON_OK) {
+		return e;
+	}
+	if (iv_len != CIPHER_BLOCK_SIZE) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "IV length %d invalid", (int) iv_len);
+	}
+	return range_decrypt(context, sealer, &s, iv, offset,
+			length > SIZE_MAX - offset ? SIZE_MAX : offset + length, result, plen);
+}
+
+/*
+ * Sets the error of all items of a chunk that have not failed yet.
+ */
+static void batch_fail(CironBatchItem items, size_t n, CironError e) {
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (items[i].error == CIRON_OK) {
+			items[i].error = e;
+		}
+	}
+}
+
+/*
+ * Returns the error of the first failed item of a chunk, or CIRON_OK.
+ */
+static CironError batch_first_error(CironBatchItem items, size_t n) {
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (items[i].error != CIRON_OK) {
+			return items[i].error;
+		}
+	}
+	return CIRON_OK;
+}
+
+/*
+ * Seals a chunk of at most CIRON_BATCH_ITEMS items with the steps of seal().
+ * The key derivations, encryptions and HMACs of the items are done in one
+ * call each.
+ */
+static void seal_chunk(CironContext context, CironSealer sealer,
+		CironBatchItem items, size_t n) {
+	CironOptions encryption_options = sealer->encryption_options;
+	CironOptions integrity_options = sealer->integrity_options;
+	struct seal_state states[CIRON_BATCH_ITEMS];
+	struct CironKeyJob key_jobs[2 * CIRON_BATCH_ITEMS];
+	struct CironCipherJob cipher_jobs[CIRON_BATCH_ITEMS];
+	struct CironMacJob mac_jobs[CIRON_BATCH_ITEMS];
+	unsigned char random[CIRON_BATCH_ITEMS * MAX_SEAL_RANDOM_BYTES];
+	size_t map[CIRON_BATCH_ITEMS];
+	size_t i, njobs, random_len;
+	CironError e;
+
+	/*
+	 * AEAD tokens need a single key derivation and no HMAC, there is
+	 * little to gain from batching.
+	 */
+	if (IS_AEAD(encryption_options->algorithm)) {
+		for (i = 0; i < n; i++) {
+			items[i].error = seal(context, sealer, items[i].data,
+					items[i].data_len, items[i].password_id,
+					items[i].password_id_len, items[i].password,
+					items[i].buffer_encrypted_bytes, items[i].result,
+					&items[i].result_len);
 		}
-		pos++;
+		return;
 	}
 
-	return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
-			CIRON_TOKEN_PARSE_ERROR,
-			"End of char sequence or expected length reached before finding delimiter");
+	/*
+	 * The salts and IVs of all items come from one draw.
+	 */
+	for (i = 0; i < n; i++) {
+		items[i].error = seal_check_password_id(context, items[i].password_id,
+				items[i].password_id_len);
+	}
+	if ((e = seal_random(context, encryption_options, integrity_options, n,
+			random)) != CIRON_OK) {
+		batch_fail(items, n, e);
+		return;
+	}
+	random_len = seal_random_length(encryption_options, integrity_options);
+	for (i = 0; i < n; i++) {
+		if (items[i].error != CIRON_OK) {
+			continue;
+		}
+		seal_begin(encryption_options, integrity_options,
+				items[i].password_id, items[i].password_id_len,
+				random + i * random_len, items[i].result, &states[i]);
+	}
+
+	/*
+	 * Derive the encryption and integrity keys of all items.
+	 */
+	njobs = 0;
+	for (i = 0; i < n; i++) {
+		if (items[i].error != CIRON_OK) {
+			continue;
+		}
+		key_jobs[njobs].password = items[i].password;
+		key_jobs[njobs].salt = states[i].encryption_salt_hex.chars;
+		key_jobs[njobs].salt_len = states[i].encryption_salt_hex.len;
+		key_jobs[njobs].algorithm = encryption_options->algorithm;
+		key_jobs[njobs].iterations = encryption_options->iterations;
+		key_jobs[njobs].key = states[i].buffer_key_bytes;
+		njobs++;
+		key_jobs[njobs].password = items[i].password;
+		key_jobs[njobs].salt = states[i].integrity_salt_hex.chars;
+		key_jobs[njobs].salt_len = states[i].integrity_salt_hex.len;
+		key_jobs[njobs].algorithm = integrity_options->algorithm;
+		key_jobs[njobs].iterations = integrity_options->iterations;
+		key_jobs[njobs].key = states[i].buffer_integrity_key_bytes;
+		njobs++;
+	}
+	if (njobs > 0 && (e = ciron_generate_keys_prepared(context, key_jobs, njobs))
+			!= CIRON_OK) {
+		batch_fail(items, n, e);
+		return;
+	}
+
+	/*
+	 * Encrypt the data of all items. Items without an encryption buffer
+	 * are encrypted and encoded in chunks on their own.
+	 */
+	njobs = 0;
+	for (i = 0; i < n; i++) {
+		if (items[i].error != CIRON_OK) {
+			continue;
+		}
+		if (items[i].buffer_encrypted_bytes == NULL) {
+			items[i].error = seal_encrypt_data(context, sealer,
+					encryption_options, &states[i], items[i].data,
+					items[i].data_len, NULL);
+			continue;
+		}
+		cipher_jobs[njobs].key = states[i].buffer_key_bytes;
+		cipher_jobs[njobs].iv = states[i].iv_bytes.chars;
+		cipher_jobs[njobs].data = items[i].data;
+		cipher_jobs[njobs].data_len = items[i].data_len;
+		cipher_jobs[njobs].buf = items[i].buffer_encrypted_bytes;
+		map[njobs] = i;
+		njobs++;
+	}
+	if (njobs > 0 && (e = ciron_cipher_encrypt_batch(context, sealer->cipher,
+			cipher_jobs, njobs)) != CIRON_OK) {
+		batch_fail(items, n, e);
+		return;
+	}
+	for (i = 0; i < njobs; i++) {
+		seal_add_encrypted(&states[map[i]], cipher_jobs[i].buf, cipher_jobs[i].len);
+	}
+
+	/*
+	 * Calculate the HMACs of all items.
+	 */
+	njobs = 0;
+	for (i = 0; i < n; i++) {
+		if (items[i].error != CIRON_OK) {
+			continue;
+		}
+		mac_jobs[njobs].key = states[i].buffer_integrity_key_bytes;
+		mac_jobs[njobs].key_len = NBYTES(integrity_options->algorithm->key_bits);
+		mac_jobs[njobs].data = states[i].hmac_base_chars.chars;
+		mac_jobs[njobs].data_len = states[i].hmac_base_chars.len;
+		mac_jobs[njobs].result = states[i].buffer_hmac_bytes;
+		map[njobs] = i;
+		njobs++;
+	}
+	if (njobs > 0 && (e = ciron_mac_batch(context, sealer->mac, mac_jobs, njobs))
+			!= CIRON_OK) {
+		batch_fail(items, n, e);
+		return;
+	}
+
+	for (i = 0; i < njobs; i++) {
+		states[map[i]].hmac_bytes.chars = mac_jobs[i].result;
+		states[map[i]].hmac_bytes.len = mac_jobs[i].result_len;
+		seal_end(&states[map[i]], &items[map[i]].result_len);
+	}
+}
+
+/*
+ * Unseals a chunk of at most CIRON_BATCH_ITEMS items with the steps of
+ * unseal(), like seal_chunk().
+ */
+void ciron_unseal_chunk(CironContext context, CironSealer sealer,
+		CironBatchItem items, size_t n) {
+	CironOptions encryption_options = fe26_encryption_options(sealer->encryption_options);
+	CironOptions integrity_options = sealer->integrity_options;
+	struct unseal_state states[CIRON_BATCH_ITEMS];
+	struct CironKeyJob key_jobs[2 * CIRON_BATCH_ITEMS];
+	struct CironMacJob mac_jobs[CIRON_BATCH_ITEMS];
+	size_t map[CIRON_BATCH_ITEMS];
+	int batched[CIRON_BATCH_ITEMS];
+	size_t i, njobs;
+	CironError e;
+
+	for (i = 0; i < n; i++) {
+		batched[i] = 0;
+		if (items[i].password == NULL || items[i].data_len < PREFIX_LEN
+				|| memcmp(items[i].data, MAC_PREFIX, PREFIX_LEN) != 0) {
+			/*
+			 * Without a password the item fails, unseal() reports why.
+			 * AEAD tokens (and invalid ones) are unsealed one by one.
+			 */
+			items[i].error = unseal(context, sealer, items[i].data,
+					items[i].data_len, NULL, NULL, NULL, 0, items[i].password,
+					items[i].buffer_encrypted_bytes, items[i].result,
+					&items[i].result_len, NULL);
+			continue;
+		}
+		if ((items[i].error = unseal_parse_header(context, encryption_options,
+				items[i].data, items[i].data_len, NULL, &states[i])) != CIRON_OK) {
+			continue;
+		}
+		items[i].error = unseal_parse_fields(context, encryption_options,
+				integrity_options, items[i].data, &states[i]);
+		batched[i] = items[i].error == CIRON_OK;
+	}
+
+	/*
+	 * Derive the integrity and encryption keys of all items. Unlike
+	 * unseal(), this derives the encryption key before the HMAC has been
+	 * checked, which only costs extra work for invalid tokens.
+	 */
+	njobs = 0;
+	for (i = 0; i < n; i++) {
+		if (!batched[i]) {
+			continue;
+		}
+		key_jobs[njobs].password = items[i].password;
+		key_jobs[njobs].salt = states[i].integrity_salt_hexchars.chars;
+		key_jobs[njobs].salt_len = states[i].integrity_salt_hexchars.len;
+		key_jobs[njobs].algorithm = integrity_options->algorithm;
+		key_jobs[njobs].iterations = integrity_options->iterations;
+		key_jobs[njobs].key = states[i].buffer_integrity_key_bytes;
+		njobs++;
+		key_jobs[njobs].password = items[i].password;
+		key_jobs[njobs].salt = states[i].encryption_salt_hexchars.chars;
+		key_jobs[njobs].salt_len = states[i].encryption_salt_hexchars.len;
+		key_jobs[njobs].algorithm = encryption_options->algorithm;
+		key_jobs[njobs].iterations = encryption_options->iterations;
+		key_jobs[njobs].key = states[i].buffer_encryption_key_bytes;
+		njobs++;
+	}
+	if (njobs > 0 && (e = ciron_generate_keys_prepared(context, key_jobs, njobs))
+			!= CIRON_OK) {
+		batch_fail(items, n, e);
+		return;
+	}
+
+	/*
+	 * Calculate the HMACs of the base strings of all items.
+	 */
+	njobs = 0;
+	for (i = 0; i < n; i++) {
+		if (!batched[i]) {
+			continue;
+		}
+		mac_jobs[njobs].key = states[i].buffer_integrity_key_bytes;
+		mac_jobs[njobs].key_len = NBYTES(integrity_options->algorithm->key_bits);
+		mac_jobs[njobs].data = states[i].hmac_base_chars.chars;
+		mac_jobs[njobs].data_len = states[i].hmac_base_chars.len;
+		mac_jobs[njobs].result = states[i].buffer_integrity_hmac_bytes;
+		map[njobs] = i;
+		njobs++;
+	}
+	if (njobs > 0 && (e = ciron_mac_batch(context, sealer->mac, mac_jobs, njobs))
+			!= CIRON_OK) {
+		batch_fail(items, n, e);
+		return;
+	}
+
+	for (i = 0; i < njobs; i++) {
+		struct unseal_state *s = &states[map[i]];
+		CironBatchItem item = &items[map[i]];
+
+		s->integrity_hmac_bytes.chars = mac_jobs[i].result;
+		s->integrity_hmac_bytes.len = mac_jobs[i].result_len;
+		if ((item->error = unseal_check_hmac(context, s)) != CIRON_OK) {
+			continue;
+		}
+		item->error = unseal_decrypt_data(context, sealer, encryption_options,
+				s, item->buffer_encrypted_bytes, item->result, &item->result_len);
+	}
+}
+
+CironError ciron_sealer_seal_batch(CironContext context, CironSealer sealer,
+		CironBatchItem items, size_t nitems) {
+	CironError first = CIRON_OK;
+	size_t start, n;
+
+	for (start = 0; start < nitems; start += n) {
+		n = nitems - start < CIRON_BATCH_ITEMS ? nitems - start : CIRON_BATCH_ITEMS;
+		seal_chunk(context, sealer, items + start, n);
+		if (first == CIRON_OK) {
+			first = batch_first_error(items + start, n);
+		}
+	}
+	return first;
+}
+
+CironError ciron_sealer_unseal_batch(CironContext context, CironSealer sealer,
+		CironBatchItem items, size_t nitems) {
+	CironError first = CIRON_OK;
+	size_t start, n;
+
+	for (start = 0; start < nitems; start += n) {
+		n = nitems - start < CIRON_BATCH_ITEMS ? nitems - start : CIRON_BATCH_ITEMS;
+		ciron_unseal_chunk(context, sealer, items + start, n);
+		if (first == CIRON_OK) {
+			first = batch_first_error(items + start, n);
+		}
+	}
+	return first;
+}
+
+/*
+ * Calculates the total length of the tokens of the payloads and that of
+ * their encrypted data, for ciron_seal_batch().
+ */
+static CironError seal_batch_lengths(CironContext context,
+		const struct CironPayload *payloads, size_t npayloads,
+		size_t password_id_len, size_t *tokens_len, size_t *encrypted_len) {
+	CironError e;
+	size_t i, token_len, encryption_len;
+
+	*tokens_len = 0;
+	*encrypted_len = 0;
+	for (i = 0; i < npayloads; i++) {
+		if ((e = ciron_calculate_seal_buffer_length(context, payloads[i].data_len,
+				password_id_len, &token_len)) != CIRON_OK
+				|| (e = ciron_calculate_encryption_buffer_length(context,
+						payloads[i].data_len, &encryption_len)) != CIRON_OK) {
+			return e;
+		}
+		if (token_len > SIZE_MAX - *tokens_len
+				|| encryption_len > SIZE_MAX - *encrypted_len
+				|| *tokens_len + token_len > SIZE_MAX - *encrypted_len - encryption_len) {
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_OVERFLOW_ERROR, "Arena for %zu payloads too large",
+					npayloads);
+		}
+		*tokens_len += token_len;
+		*encrypted_len += encryption_len;
+	}
+	return CIRON_OK;
+}
+
+CironError ciron_calculate_seal_batch_buffer_length(CironContext context,
+		const struct CironPayload *payloads, size_t npayloads,
+		size_t password_id_len, size_t *result_len) {
+	CironError e;
+	size_t tokens_len, encrypted_len;
+
+	if ((e = seal_batch_lengths(context, payloads, npayloads, password_id_len,
+			&tokens_len, &encrypted_len)) != CIRON_OK) {
+		return e;
+	}
+	*result_len = tokens_len + encrypted_len;
+	return CIRON_OK;
+}
+
+CironError ciron_seal_batch(CironContext context,
+		const struct CironPayload *payloads, size_t npayloads,
+		const unsigned char *password_id, size_t password_id_len,
+		const unsigned char *password, size_t password_len,
+		unsigned char *arena, size_t arena_len, size_t *offsets,
+		CironError *errors) {
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	struct CironBatchItem items[CIRON_BATCH_ITEMS];
+	CironError e, first = CIRON_OK;
+	size_t tokens_len, encrypted_len, token_len, encryption_len;
+	size_t start, n, i, slot, scratch;
+
+	offsets[0] = 0;
+	for (i = 0; i < npayloads; i++) {
+		offsets[i + 1] = 0;
+		errors[i] = CIRON_OK;
+	}
+	if ((e = seal_check_password_id(context, password_id,
+			password_id_len)) == CIRON_OK
+			&& (e = seal_batch_lengths(context, payloads, npayloads, password_id_len,
+			&tokens_len, &encrypted_len)) == CIRON_OK
+			&& tokens_len + encrypted_len > arena_len) {
+		e = ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Arena of %zu bytes too small, %zu needed",
+				arena_len, tokens_len + encrypted_len);
+	}
+	if (e == CIRON_OK) {
+		e = ciron_password_prepare(context, password, password_len, &prepared);
+	}
+	if (e == CIRON_OK) {
+		e = ciron_sealer_init(context, &sealer);
+	}
+	if (e != CIRON_OK) {
+		for (i = 0; i < npayloads; i++) {
+			errors[i] = e;
+		}
+		return e;
+	}
+
+	/*
+	 * The tokens of a chunk are sealed into slots of their calculated
+	 * length, which start where the tokens sealed so far end, and then
+	 * moved together. The encrypted data goes behind the space for all
+	 * tokens.
+	 */
+	for (start = 0; start < npayloads; start += n) {
+		n = npayloads - start < CIRON_BATCH_ITEMS ? npayloads - start : CIRON_BATCH_ITEMS;
+		slot = offsets[start];
+		scratch = tokens_len;
+		for (i = 0; i < n; i++) {
+			ciron_calculate_seal_buffer_length(context, payloads[start + i].data_len,
+					password_id_len, &token_len);
+			ciron_calculate_encryption_buffer_length(context,
+					payloads[start + i].data_len, &encryption_len);
+			items[i].data = payloads[start + i].data;
+			items[i].data_len = payloads[start + i].data_len;
+			items[i].password_id = password_id;
+			items[i].password_id_len = password_id_len;
+			items[i].password = &prepared;
+			items[i].buffer_encrypted_bytes = arena + scratch;
+			items[i].result = arena + slot;
+			slot += token_len;
+			scratch += encryption_len;
+		}
+		seal_chunk(context, &sealer, items, n);
+
+		slot = offsets[start];
+		for (i = 0; i < n; i++) {
+			errors[start + i] = items[i].error;
+			if (items[i].error == CIRON_OK) {
+				memmove(arena + slot, items[i].result, items[i].result_len);
+				slot += items[i].result_len;
+			} else if (first == CIRON_OK) {
+				first = items[i].error;
+			}
+			offsets[start + i + 1] = slot;
+		}
+	}
+	ciron_sealer_cleanup(&sealer);
+	return first;
+}
+
+/*
+ * Parts of the token a stream is at. Sealing streams stay at
+ * STREAM_ENCRYPTED from init to final, unsealing streams collect the
+ * header first and ignore everything after the encrypted data.
+ */
+#define STREAM_HEADER 0
+#define STREAM_ENCRYPTED 1
+#define STREAM_TRAILER 2
+
+/*
+ * Number of delimiters in the token up to the encrypted data.
+ */
+#define HEADER_DELIMS 4
+
+CironError ciron_calculate_stream_buffer_length(CironContext context,
+		size_t data_len, size_t password_id_len, size_t *result_len) {
+	/*
+	 * A call encrypts at most data_len plus the pending bytes and the
+	 * padding, and encodes up to two carried bytes with them. As in
+	 * ciron_calculate_encryption_buffer_length() we must not overflow.
+	 */
+	if (UINT_MAX - data_len < CIPHER_BLOCK_SIZE + 2) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Data len %zu too large", data_len);
+	}
+	return ciron_calculate_seal_buffer_length(context,
+			data_len + CIPHER_BLOCK_SIZE + 2, password_id_len, result_len);
+}
+
+/*
+ * Streams encrypt with the cipher object of the sealer, there is no
+ * incremental AEAD.
+ */
+static CironError stream_check_sealer(CironContext context, CironSealer sealer) {
+	if (sealer->cipher == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_CRYPTO_ERROR, "Streams need a CBC sealer");
+	}
+	return CIRON_OK;
+}
+
+/*
+ * Base64url encodes the len bytes to buf + *plen as far as they fill
+ * groups of three, or all of them if final is set, and carries the rest
+ * over to the next call. The characters are added to the HMAC.
+ */
+static CironError stream_encode(CironContext context, CironStream stream,
+		const unsigned char *bytes, size_t len, int final, unsigned char *buf,
+		size_t *plen) {
+	CironError e;
+	size_t n = final ? len : len / 3 * 3;
+	size_t chars_len;
+
+	ciron_base64url_encode(bytes, n, buf + *plen, &chars_len);
+	if ((e = ciron_mac_update(context, stream->sealer->mac, buf + *plen,
+			chars_len)) != CIRON_OK) {
+		return e;
+	}
+	*plen += chars_len;
+	memcpy(stream->carry, bytes + n, len - n);
+	stream->carry_len = len - n;
+	return CIRON_OK;
+}
+
+/*
+ * Encrypts len bytes, a multiple of the block size and at most
+ * SEAL_CHUNK_BYTES, after the carried bytes and encodes them.
+ */
+static CironError stream_encrypt_encode(CironContext context, CironStream stream,
+		const unsigned char *data, size_t len, unsigned char *buf, size_t *plen) {
+	CironError e;
+	unsigned char chunk[2 + SEAL_CHUNK_BYTES];
+
+	memcpy(chunk, stream->carry, stream->carry_len);
+	if ((e = ciron_cipher_encrypt_update(context, stream->sealer->cipher, data,
+			len, chunk + stream->carry_len)) != CIRON_OK) {
+		return e;
+	}
+	return stream_encode(context, stream, chunk, stream->carry_len + len, 0,
+			buf, plen);
+}
+
+CironError ciron_seal_init(CironContext context, CironStream stream,
+		CironSealer sealer, const unsigned char* password_id,
+		size_t password_id_len, CironPreparedPassword password,
+		unsigned char *buf, size_t *plen) {
+	CironOptions encryption_options = sealer->encryption_options;
+	CironOptions integrity_options = sealer->integrity_options;
+	CironError e;
+	struct seal_state s;
+	unsigned char random[MAX_SEAL_RANDOM_BYTES];
+
+	if ((e = stream_check_sealer(context, sealer)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = seal_check_password_id(context, password_id,
+			password_id_len)) != CIRON_OK) {
+		return e;
+	}
+	memset(stream, 0, sizeof(struct CironStream));
+	stream->sealer = sealer;
+	stream->password = password;
+
+	if ((e = seal_random(context, encryption_options, integrity_options, 1,
+			random)) != CIRON_OK) {
+		return e;
+	}
+	seal_begin(encryption_options, integrity_options, password_id,
+			password_id_len, random, buf, &s);
+	if ((e = ciron_generate_key_prepared(context, password,
+			s.encryption_salt_hex.chars, s.encryption_salt_hex.len,
+			encryption_options->algorithm, encryption_options->iterations,
+			s.buffer_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = ciron_cipher_encrypt_init(context, sealer->cipher,
+			s.buffer_key_bytes, s.iv_bytes.chars)) != CIRON_OK) {
+		return e;
+	}
+
+	/*
+	 * The integrity salt is known from the start, so the HMAC can be
+	 * calculated over the token as it is written, beginning with the
+	 * header.
+	 */
+	if ((e = ciron_generate_key_prepared(context, password,
+			s.integrity_salt_hex.chars, s.integrity_salt_hex.len,
+			integrity_options->algorithm, integrity_options->iterations,
+			s.buffer_integrity_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = ciron_mac_init(context, sealer->mac, s.buffer_integrity_key_bytes,
+			NBYTES(integrity_options->algorithm->key_bits))) != CIRON_OK) {
+		return e;
+	}
+	*plen = s.result_ptr - buf;
+	if ((e = ciron_mac_update(context, sealer->mac, buf, *plen)) != CIRON_OK) {
+		return e;
+	}
+	memcpy(stream->integrity_salt_hex, s.integrity_salt_hex.chars,
+			s.integrity_salt_hex.len);
+	stream->integrity_salt_len = s.integrity_salt_hex.len;
+	stream->state = STREAM_ENCRYPTED;
+	return CIRON_OK;
+}
+
+CironError ciron_seal_update(CironContext context, CironStream stream,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		size_t *plen) {
+	CironError e;
+	size_t n;
+
+	*plen = 0;
+
+	/*
+	 * Complete the block left over from the last call first.
+	 */
+	if (stream->pending_len > 0) {
+		n = CIPHER_BLOCK_SIZE - stream->pending_len;
+		n = data_len < n ? data_len : n;
+		memcpy(stream->pending + stream->pending_len, data, n);
+		stream->pending_len += n;
+		data += n;
+		data_len -= n;
+		if (stream->pending_len < CIPHER_BLOCK_SIZE) {
+			return CIRON_OK;
+		}
+		if ((e = stream_encrypt_encode(context, stream, stream->pending,
+				CIPHER_BLOCK_SIZE, buf, plen)) != CIRON_OK) {
+			return e;
+		}
+		stream->pending_len = 0;
+	}
+	while (data_len >= CIPHER_BLOCK_SIZE) {
+		n = data_len < SEAL_CHUNK_BYTES ? data_len : SEAL_CHUNK_BYTES;
+		n -= n % CIPHER_BLOCK_SIZE;
+		if ((e = stream_encrypt_encode(context, stream, data, n, buf, plen))
+				!= CIRON_OK) {
+			return e;
+		}
+		data += n;
+		data_len -= n;
+	}
+	memcpy(stream->pending, data, data_len);
+	stream->pending_len = data_len;
+	return CIRON_OK;
+}
+
+CironError ciron_seal_final(CironContext context, CironStream stream,
+		unsigned char *buf, size_t *plen) {
+	CironError e;
+	unsigned char chunk[2 + 2 * CIPHER_BLOCK_SIZE];
+	unsigned char hmac[MAX_HMAC_BYTES];
+	size_t len, hmac_len;
+
+	*plen = 0;
+	memcpy(chunk, stream->carry, stream->carry_len);
+	if ((e = ciron_cipher_encrypt_final(context, stream->sealer->cipher,
+			stream->pending, stream->pending_len, chunk + stream->carry_len, &len))
+			!= CIRON_OK) {
+		return e;
+	}
+	if ((e = stream_encode(context, stream, chunk, stream->carry_len + len, 1,
+			buf, plen)) != CIRON_OK) {
+		return e;
+	}
+
+	/*
+	 * The HMAC base string ends with the encrypted data, the integrity
+	 * salt and the HMAC follow.
+	 */
+	buf[(*plen)++] = DELIM;
+	memcpy(buf + *plen, stream->integrity_salt_hex, stream->integrity_salt_len);
+	*plen += stream->integrity_salt_len;
+	buf[(*plen)++] = DELIM;
+	if ((e = ciron_mac_final(context, stream->sealer->mac, hmac, &hmac_len))
+			!= CIRON_OK) {
+		return e;
+	}
+	ciron_base64url_encode(hmac, hmac_len, buf + *plen, &len);
+	*plen += len;
+
+	memset(stream, 0, sizeof(struct CironStream));
+	return CIRON_OK;
+}
+
+/*
+ * Returns the last delimiter in the len bytes of data, or NULL.
+ */
+static const unsigned char *last_delim(const unsigned char *data, size_t len) {
+	while (len > 0) {
+		len--;
+		if (data[len] == DELIM) {
+			return data + len;
+		}
+	}
+	return NULL;
+}
+
+CironError ciron_unseal_init(CironContext context, CironStream stream,
+		CironSealer sealer, CironPreparedPassword password,
+		const unsigned char *tail, size_t tail_len) {
+	CironOptions integrity_options = sealer->integrity_options;
+	CironError e;
+	const unsigned char *hmac_delim, *salt_delim;
+	size_t salt_len, hmac_chars_len;
+	unsigned char buffer_integrity_key_bytes[MAX_KEY_BYTES];
+
+	if ((e = stream_check_sealer(context, sealer)) != CIRON_OK) {
+		return e;
+	}
+	memset(stream, 0, sizeof(struct CironStream));
+	stream->sealer = sealer;
+	stream->password = password;
+
+	/*
+	 * The HMAC follows the last delimiter of the tail, the integrity salt
+	 * the one before.
+	 */
+	if ((hmac_delim = last_delim(tail, tail_len)) == NULL
+			|| (salt_delim = last_delim(tail, hmac_delim - tail)) == NULL) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR,
+				"Token tail does not contain integrity salt and HMAC");
+	}
+	salt_len = hmac_delim - salt_delim - 1;
+	hmac_chars_len = tail + tail_len - hmac_delim - 1;
+	if (salt_len != NBYTES(integrity_options->salt_bits) * 2) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR,
+				"Expected integrity salt length of %d, but got %d",
+				(int) (NBYTES(integrity_options->salt_bits) * 2), (int) salt_len);
+	}
+	if (!ciron_hex_valid(salt_delim + 1, salt_len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Integrity salt is not hex encoded");
+	}
+	if (hmac_chars_len != BASE64URL_ENCODE_SIZE(NBYTES(integrity_options->algorithm->tag_bits))
+			|| !ciron_base64url_valid(hmac_delim + 1, hmac_chars_len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Invalid base64url encoded HMAC of length %d",
+				(int) hmac_chars_len);
+	}
+	if ((e = ciron_base64url_decode(context, hmac_delim + 1, hmac_chars_len,
+			stream->hmac, &stream->hmac_len)) != CIRON_OK) {
+		return e;
+	}
+
+	if ((e = ciron_generate_key_prepared(context, password, salt_delim + 1,
+			salt_len, integrity_options->algorithm, integrity_options->iterations,
+			buffer_integrity_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+	if ((e = ciron_mac_init(context, sealer->mac, buffer_integrity_key_bytes,
+			NBYTES(integrity_options->algorithm->key_bits))) != CIRON_OK) {
+		return e;
+	}
+	stream->state = STREAM_HEADER;
+	return CIRON_OK;
+}
+
+/*
+ * Parses the collected header of the token, derives the encryption key
+ * and starts the decryption.
+ */
+static CironError stream_parse_header(CironContext context, CironStream stream) {
+	CironOptions encryption_options = stream->sealer->encryption_options;
+	CironError e;
+	struct unseal_state s;
+	struct CironTokenField fields[HEADER_DELIMS + 1];
+	unsigned char iv[MAX_IV_BYTES];
+	size_t iv_len;
+
+	/*
+	 * The header ends with a delimiter, so its last field is empty.
+	 */
+	split_fields(stream->header, stream->header_len, fields, HEADER_DELIMS + 1);
+	if (fields[0].len != PREFIX_LEN
+			|| memcmp(stream->header, MAC_PREFIX, PREFIX_LEN) != 0) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Invalid prefix");
+	}
+	if (!ciron_password_id_valid(stream->header + fields[1].offset, fields[1].len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Invalid character in password ID");
+	}
+	s.encryption_salt_hexchars.chars = stream->header + fields[2].offset;
+	s.encryption_salt_hexchars.len = fields[2].len;
+	s.encryption_iv_b64urlchars.chars = stream->header + fields[3].offset;
+	s.encryption_iv_b64urlchars.len = fields[3].len;
+	if (s.encryption_salt_hexchars.len != NBYTES(encryption_options->salt_bits) * 2) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Encryption salt length %d invalid",
+				(int) s.encryption_salt_hexchars.len);
+	}
+	if (!ciron_hex_valid(s.encryption_salt_hexchars.chars, s.encryption_salt_hexchars.len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Encryption salt is not hex encoded");
+	}
+	if (s.encryption_iv_b64urlchars.len
+			!= BASE64URL_ENCODE_SIZE(NBYTES(encryption_options->algorithm->iv_bits))
+			|| !ciron_base64url_valid(s.encryption_iv_b64urlchars.chars,
+					s.encryption_iv_b64urlchars.len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "Invalid base64url encoded IV of length %d",
+				(int) s.encryption_iv_b64urlchars.len);
+	}
+	if ((e = ciron_base64url_decode(context, s.encryption_iv_b64urlchars.chars,
+			s.encryption_iv_b64urlchars.len, iv, &iv_len)) != CIRON_OK) {
+		return e;
+	}
+	if (iv_len != NBYTES(encryption_options->algorithm->iv_bits)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR, "IV length %d invalid", (int) iv_len);
+	}
+
+	if ((e = ciron_generate_key_prepared(context, stream->password,
+			s.encryption_salt_hexchars.chars, s.encryption_salt_hexchars.len,
+			encryption_options->algorithm, encryption_options->iterations,
+			s.buffer_encryption_key_bytes)) != CIRON_OK) {
+		return e;
+	}
+	return ciron_cipher_decrypt_init(context, stream->sealer->cipher,
+			s.buffer_encryption_key_bytes, iv);
+}
+
+/*
+ * Collects the header of the token from data until its last delimiter
+ * and returns the number of bytes taken.
+ */
+static CironError stream_collect_header(CironContext context, CironStream stream,
+		const unsigned char *data, size_t data_len, size_t *taken) {
+	CironError e;
+	size_t i, delims = 0;
+
+	for (i = 0; i < stream->header_len; i++) {
+		delims += stream->header[i] == DELIM;
+	}
+	*taken = 0;
+	while (*taken < data_len) {
+		if (stream->header_len == sizeof(stream->header)) {
+			return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+					CIRON_TOKEN_PARSE_ERROR, "Token header is too long");
+		}
+		stream->header[stream->header_len++] = data[*taken];
+		delims += data[(*taken)++] == DELIM;
+		if (delims == HEADER_DELIMS) {
+			if ((e = ciron_mac_update(context, stream->sealer->mac,
+					stream->header, stream->header_len)) != CIRON_OK) {
+				return e;
+			}
+			stream->state = STREAM_ENCRYPTED;
+			return stream_parse_header(context, stream);
+		}
+	}
+	return CIRON_OK;
+}
+
+/*
+ * Decodes the len characters after the carried ones as far as they fill
+ * groups of four and decrypts the bytes after the pending ones as far as
+ * they fill blocks. The rest of both is kept for the next call.
+ */
+static CironError stream_decode_decrypt(CironContext context, CironStream stream,
+		const unsigned char *chars, size_t len, unsigned char *buf, size_t *plen) {
+	CironError e;
+	unsigned char chunk[SEAL_CHUNK_CHARS];
+	unsigned char bytes[CIPHER_BLOCK_SIZE + SEAL_CHUNK_BYTES];
+	size_t n, bytes_len, blocks_len;
+
+	while (stream->carry_len + len >= 4) {
+		n = stream->carry_len + len;
+		n = n < SEAL_CHUNK_CHARS ? n / 4 * 4 : SEAL_CHUNK_CHARS;
+		memcpy(chunk, stream->carry, stream->carry_len);
+		memcpy(chunk + stream->carry_len, chars, n - stream->carry_len);
+		chars += n - stream->carry_len;
+		len -= n - stream->carry_len;
+		stream->carry_len = 0;
+
+		memcpy(bytes, stream->pending, stream->pending_len);
+		if ((e = ciron_base64url_decode(context, chunk, n,
+				bytes + stream->pending_len, &bytes_len)) != CIRON_OK) {
+			return e;
+		}
+		bytes_len += stream->pending_len;
+		blocks_len = bytes_len - bytes_len % CIPHER_BLOCK_SIZE;
+		if ((e = ciron_cipher_decrypt_update(context, stream->sealer->cipher,
+				bytes, blocks_len, buf + *plen, &n)) != CIRON_OK) {
+			return e;
+		}
+		*plen += n;
+		memcpy(stream->pending, bytes + blocks_len, bytes_len - blocks_len);
+		stream->pending_len = bytes_len - blocks_len;
+	}
+	memcpy(stream->carry + stream->carry_len, chars, len);
+	stream->carry_len += len;
+	return CIRON_OK;
+}
+
+CironError ciron_unseal_update(CironContext context, CironStream stream,
+		const unsigned char *data, size_t data_len, unsigned char *buf,
+		size_t *plen) {
+	CironError e;
+	const unsigned char *end;
+	size_t n;
+
+	*plen = 0;
+	if (stream->state == STREAM_HEADER) {
+		if ((e = stream_collect_header(context, stream, data, data_len, &n))
+				!= CIRON_OK) {
+			return e;
+		}
+		data += n;
+		data_len -= n;
+	}
+	if (stream->state != STREAM_ENCRYPTED || data_len == 0) {
+		return CIRON_OK;
+	}
+
+	/*
+	 * The HMAC base string and the encrypted data end at the next
+	 * delimiter. The rest of the token was passed to ciron_unseal_init().
+	 */
+	if ((end = memchr(data, DELIM, data_len)) != NULL) {
+		data_len = end - data;
+		stream->state = STREAM_TRAILER;
+	}
+	if ((e = ciron_mac_update(context, stream->sealer->mac, data, data_len))
+			!= CIRON_OK) {
+		return e;
+	}
+	return stream_decode_decrypt(context, stream, data, data_len, buf, plen);
+}
+
+CironError ciron_unseal_final(CironContext context, CironStream stream,
+		unsigned char *buf, size_t *plen) {
+	CironError e;
+	unsigned char bytes[CIPHER_BLOCK_SIZE + 3];
+	unsigned char hmac[MAX_HMAC_BYTES];
+	size_t bytes_len, hmac_len, len;
+
+	*plen = 0;
+	if (stream->state != STREAM_TRAILER) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_PARSE_ERROR,
+				"End of token reached before end of encrypted data");
+	}
+	if ((e = ciron_mac_final(context, stream->sealer->mac, hmac, &hmac_len))
+			!= CIRON_OK) {
+		return e;
+	}
+	if (hmac_len != stream->hmac_len
+			|| !ciron_fixed_time_equal(hmac, stream->hmac, hmac_len)) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_TOKEN_VALIDATION_ERROR, "HMAC signature invalid");
+	}
+
+	memcpy(bytes, stream->pending, stream->pending_len);
+	bytes_len = 0;
+	if (stream->carry_len > 0 && (e = ciron_base64url_decode(context,
+			stream->carry, stream->carry_len, bytes + stream->pending_len,
+			&bytes_len)) != CIRON_OK) {
+		return e;
+	}
+	bytes_len += stream->pending_len;
+	if ((e = ciron_cipher_decrypt_update(context, stream->sealer->cipher, bytes,
+			bytes_len, buf, &len)) != CIRON_OK) {
+		return e;
+	}
+	*plen = len;
+	if ((e = ciron_cipher_decrypt_final(context, stream->sealer->cipher,
+			buf + *plen, &len)) != CIRON_OK) {
+		return e;
+	}
+	*plen += len;
+
+	memset(stream, 0, sizeof(struct CironStream));
+	return CIRON_OK;
+}
+
+static size_t split_fields(const unsigned char *data, size_t len,
+		struct CironTokenField *fields, size_t n) {
+	const unsigned char *p = data;
+	const unsigned char *end = data + len;
+	const unsigned char *delim;
+	size_t i;
+
+	/*
+	 * memchr() of the C library compares a word or vector of bytes at a
+	 * time, so each field is scanned once and quickly.
+	 */
+	for (i = 0; i + 1 < n; i++) {
+		if ((delim = memchr(p, DELIM, end - p)) == NULL) {
+			return i;
+		}
+		fields[i].offset = p - data;
+		fields[i].len = delim - p;
+		p = delim + 1;
+	}
+	fields[i].offset = p - data;
+	fields[i].len = end - p;
+	return n;
 }
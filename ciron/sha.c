@@ -0,0 +1,456 @@
+#include <string.h>
+#include "sha.h"
+#include "registry.h"
+
+#ifdef CIRON_X86_INTRINSICS
+#include <immintrin.h>
+#endif
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+typedef void (*blocks_function)(uint32_t *state, const unsigned char *data,
+		size_t nblocks);
+
+const uint32_t ciron_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t load_be32(const unsigned char *p) {
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+			| ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static void store_be32(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char) (v >> 24);
+	p[1] = (unsigned char) (v >> 16);
+	p[2] = (unsigned char) (v >> 8);
+	p[3] = (unsigned char) v;
+}
+
+void ciron_sha1_blocks_generic(uint32_t *state, const unsigned char *data,
+		size_t nblocks) {
+	uint32_t w[80];
+	uint32_t a, b, c, d, e, f, k, t;
+	int i;
+
+	while (nblocks-- > 0) {
+		for (i = 0; i < 16; i++) {
+			w[i] = load_be32(data + 4 * i);
+		}
+		for (i = 16; i < 80; i++) {
+			w[i] = ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+		for (i = 0; i < 80; i++) {
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+			t = ROL32(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = ROL32(b, 30);
+			b = a;
+			a = t;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		data += CIRON_SHA_BLOCK_BYTES;
+	}
+}
+
+void ciron_sha256_blocks_generic(uint32_t *state, const unsigned char *data,
+		size_t nblocks) {
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	while (nblocks-- > 0) {
+		for (i = 0; i < 16; i++) {
+			w[i] = load_be32(data + 4 * i);
+		}
+		for (i = 16; i < 64; i++) {
+			w[i] = w[i - 16] + w[i - 7]
+					+ (ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3))
+					+ (ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+		}
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+		f = state[5];
+		g = state[6];
+		h = state[7];
+		for (i = 0; i < 64; i++) {
+			t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25))
+					+ ((e & f) ^ (~e & g)) + ciron_sha256_k[i] + w[i];
+			t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22))
+					+ ((a & b) ^ (a & c) ^ (b & c));
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+		data += CIRON_SHA_BLOCK_BYTES;
+	}
+}
+
+#ifdef CIRON_X86_INTRINSICS
+
+/*
+ * Four SHA-1 rounds. Besides the rounds, each step advances the message
+ * schedule for the following steps: it completes the next four words
+ * with sha1msg2 and starts on the ones after with sha1msg1 and xor.
+ */
+#define SHA1_ROUNDS4(e_in, e_out, cur, next, mid, prev, f) \
+	do { \
+		e_in = _mm_sha1nexte_epu32(e_in, cur); \
+		e_out = abcd; \
+		next = _mm_sha1msg2_epu32(next, cur); \
+		abcd = _mm_sha1rnds4_epu32(abcd, e_in, f); \
+		prev = _mm_sha1msg1_epu32(prev, cur); \
+		mid = _mm_xor_si128(mid, cur); \
+	} while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+void ciron_sha1_blocks_shani(uint32_t *state, const unsigned char *data,
+		size_t nblocks) {
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607LL,
+			0x08090a0b0c0d0e0fLL);
+	__m128i abcd, abcd_save, e0, e0_save, e1;
+	__m128i m0, m1, m2, m3;
+
+	abcd = _mm_loadu_si128((const __m128i *) state);
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	e0 = _mm_set_epi32((int) state[4], 0, 0, 0);
+
+	while (nblocks-- > 0) {
+		abcd_save = abcd;
+		e0_save = e0;
+
+		/* Rounds 0-15 load the message words */
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), mask);
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		m0 = _mm_sha1msg1_epu32(m0, m1);
+
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), mask);
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		m1 = _mm_sha1msg1_epu32(m1, m2);
+		m0 = _mm_xor_si128(m0, m2);
+
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, m3);
+		e0 = abcd;
+		m0 = _mm_sha1msg2_epu32(m0, m3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		m2 = _mm_sha1msg1_epu32(m2, m3);
+		m1 = _mm_xor_si128(m1, m3);
+
+		/* Rounds 16-79 */
+		SHA1_ROUNDS4(e0, e1, m0, m1, m2, m3, 0);
+		SHA1_ROUNDS4(e1, e0, m1, m2, m3, m0, 1);
+		SHA1_ROUNDS4(e0, e1, m2, m3, m0, m1, 1);
+		SHA1_ROUNDS4(e1, e0, m3, m0, m1, m2, 1);
+		SHA1_ROUNDS4(e0, e1, m0, m1, m2, m3, 1);
+		SHA1_ROUNDS4(e1, e0, m1, m2, m3, m0, 1);
+		SHA1_ROUNDS4(e0, e1, m2, m3, m0, m1, 2);
+		SHA1_ROUNDS4(e1, e0, m3, m0, m1, m2, 2);
+		SHA1_ROUNDS4(e0, e1, m0, m1, m2, m3, 2);
+		SHA1_ROUNDS4(e1, e0, m1, m2, m3, m0, 2);
+		SHA1_ROUNDS4(e0, e1, m2, m3, m0, m1, 2);
+		SHA1_ROUNDS4(e1, e0, m3, m0, m1, m2, 3);
+		SHA1_ROUNDS4(e0, e1, m0, m1, m2, m3, 3);
+		SHA1_ROUNDS4(e1, e0, m1, m2, m3, m0, 3);
+		SHA1_ROUNDS4(e0, e1, m2, m3, m0, m1, 3);
+		SHA1_ROUNDS4(e1, e0, m3, m0, m1, m2, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		data += CIRON_SHA_BLOCK_BYTES;
+	}
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	_mm_storeu_si128((__m128i *) state, abcd);
+	state[4] = (uint32_t) _mm_extract_epi32(e0, 3);
+}
+
+/*
+ * Four SHA-256 rounds with message words cur, finishing the next four
+ * words and starting on the ones after, like SHA1_ROUNDS4.
+ */
+#define SHA256_ROUNDS4(cur, next, prev, i) \
+	do { \
+		msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *) (ciron_sha256_k + (i)))); \
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+		next = _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)); \
+		next = _mm_sha256msg2_epu32(next, cur); \
+		msg = _mm_shuffle_epi32(msg, 0x0e); \
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+		prev = _mm_sha256msg1_epu32(prev, cur); \
+	} while (0)
+
+/*
+ * Four SHA-256 rounds on the first message words, which only start on
+ * the schedule.
+ */
+#define SHA256_LOAD_ROUNDS4(cur, i) \
+	do { \
+		cur = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 4 * (i))), mask); \
+		msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *) (ciron_sha256_k + (i)))); \
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+		msg = _mm_shuffle_epi32(msg, 0x0e); \
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+	} while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+void ciron_sha256_blocks_shani(uint32_t *state, const unsigned char *data,
+		size_t nblocks) {
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bLL,
+			0x0405060700010203LL);
+	__m128i state0, state1, abef_save, cdgh_save, msg, tmp;
+	__m128i m0, m1, m2, m3;
+
+	/* The rounds instructions expect the state as ABEF and CDGH */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0xb1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) (state + 4)), 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	while (nblocks-- > 0) {
+		abef_save = state0;
+		cdgh_save = state1;
+
+		SHA256_LOAD_ROUNDS4(m0, 0);
+		SHA256_LOAD_ROUNDS4(m1, 4);
+		m0 = _mm_sha256msg1_epu32(m0, m1);
+		SHA256_LOAD_ROUNDS4(m2, 8);
+		m1 = _mm_sha256msg1_epu32(m1, m2);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+		SHA256_ROUNDS4(m3, m0, m2, 12);
+		SHA256_ROUNDS4(m0, m1, m3, 16);
+		SHA256_ROUNDS4(m1, m2, m0, 20);
+		SHA256_ROUNDS4(m2, m3, m1, 24);
+		SHA256_ROUNDS4(m3, m0, m2, 28);
+		SHA256_ROUNDS4(m0, m1, m3, 32);
+		SHA256_ROUNDS4(m1, m2, m0, 36);
+		SHA256_ROUNDS4(m2, m3, m1, 40);
+		SHA256_ROUNDS4(m3, m0, m2, 44);
+		SHA256_ROUNDS4(m0, m1, m3, 48);
+		SHA256_ROUNDS4(m1, m2, m0, 52);
+		SHA256_ROUNDS4(m2, m3, m1, 56);
+		SHA256_ROUNDS4(m3, m0, m2, 60);
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+		data += CIRON_SHA_BLOCK_BYTES;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *) state, state0);
+	_mm_storeu_si128((__m128i *) (state + 4), state1);
+}
+
+#endif /* CIRON_X86_INTRINSICS */
+
+/*
+ * The compression functions of an implementation.
+ */
+struct sha_functions {
+	blocks_function sha1_blocks;
+	blocks_function sha256_blocks;
+};
+
+static const struct sha_functions generic = {
+	ciron_sha1_blocks_generic,
+	ciron_sha256_blocks_generic
+};
+
+#ifdef CIRON_X86_INTRINSICS
+static const struct sha_functions shani = {
+	ciron_sha1_blocks_shani,
+	ciron_sha256_blocks_shani
+};
+#endif
+
+static const struct CironImplementation implementations[] = {
+#ifdef CIRON_X86_INTRINSICS
+	{ "shani", CIRON_CPU_SHA | CIRON_CPU_SSE41 | CIRON_CPU_SSSE3, &shani },
+#endif
+	{ "generic", 0, &generic },
+	{ NULL, 0, NULL }
+};
+
+struct CironPrimitive ciron_sha_primitive = { "sha", implementations, NULL };
+
+void ciron_sha1_blocks(uint32_t *state, const unsigned char *data,
+		size_t nblocks) {
+	const struct sha_functions *f = ciron_primitive_functions(&ciron_sha_primitive);
+
+	f->sha1_blocks(state, data, nblocks);
+}
+
+void ciron_sha256_blocks(uint32_t *state, const unsigned char *data,
+		size_t nblocks) {
+	const struct sha_functions *f = ciron_primitive_functions(&ciron_sha_primitive);
+
+	f->sha256_blocks(state, data, nblocks);
+}
+
+/*
+ * Buffers data into complete blocks for the compression function. Shared
+ * by SHA-1 and SHA-256 which only differ in state size.
+ */
+static void update(blocks_function blocks, uint32_t *state, uint64_t *length,
+		unsigned char *block, size_t *fill, const unsigned char *data,
+		size_t len) {
+	size_t n;
+
+	*length += len;
+	if (*fill > 0) {
+		n = CIRON_SHA_BLOCK_BYTES - *fill;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(block + *fill, data, n);
+		*fill += n;
+		data += n;
+		len -= n;
+		if (*fill < CIRON_SHA_BLOCK_BYTES) {
+			return;
+		}
+		blocks(state, block, 1);
+		*fill = 0;
+	}
+	if (len >= CIRON_SHA_BLOCK_BYTES) {
+		blocks(state, data, len / CIRON_SHA_BLOCK_BYTES);
+		data += len - len % CIRON_SHA_BLOCK_BYTES;
+		len %= CIRON_SHA_BLOCK_BYTES;
+	}
+	memcpy(block, data, len);
+	*fill = len;
+}
+
+/*
+ * Appends the padding and the message length in bits.
+ */
+static void finish(blocks_function blocks, uint32_t *state, uint64_t length,
+		unsigned char *block, size_t fill) {
+	block[fill++] = 0x80;
+	if (fill > CIRON_SHA_BLOCK_BYTES - 8) {
+		memset(block + fill, 0, CIRON_SHA_BLOCK_BYTES - fill);
+		blocks(state, block, 1);
+		fill = 0;
+	}
+	memset(block + fill, 0, CIRON_SHA_BLOCK_BYTES - 8 - fill);
+	store_be32(block + CIRON_SHA_BLOCK_BYTES - 8, (uint32_t) (length >> 29));
+	store_be32(block + CIRON_SHA_BLOCK_BYTES - 4, (uint32_t) (length << 3));
+	blocks(state, block, 1);
+}
+
+void ciron_sha1_init(struct CironSha1 *c) {
+	static const uint32_t initial[5] = {
+		0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+	};
+
+	ciron_sha1_resume(c, initial, 0);
+}
+
+void ciron_sha1_resume(struct CironSha1 *c, const uint32_t *state,
+		uint64_t length) {
+	memcpy(c->state, state, sizeof(c->state));
+	c->length = length;
+	c->fill = 0;
+}
+
+void ciron_sha1_update(struct CironSha1 *c, const unsigned char *data,
+		size_t len) {
+	update(ciron_sha1_blocks, c->state, &c->length, c->block, &c->fill, data,
+			len);
+}
+
+void ciron_sha1_final(struct CironSha1 *c, unsigned char *digest) {
+	int i;
+
+	finish(ciron_sha1_blocks, c->state, c->length, c->block, c->fill);
+	for (i = 0; i < 5; i++) {
+		store_be32(digest + 4 * i, c->state[i]);
+	}
+}
+
+void ciron_sha256_init(struct CironSha256 *c) {
+	static const uint32_t initial[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(c->state, initial, sizeof(c->state));
+	c->length = 0;
+	c->fill = 0;
+}
+
+void ciron_sha256_update(struct CironSha256 *c, const unsigned char *data,
+		size_t len) {
+	update(ciron_sha256_blocks, c->state, &c->length, c->block, &c->fill, data,
+			len);
+}
+
+void ciron_sha256_final(struct CironSha256 *c, unsigned char *digest) {
+	int i;
+
+	finish(ciron_sha256_blocks, c->state, c->length, c->block, c->fill);
+	for (i = 0; i < 8; i++) {
+		store_be32(digest + 4 * i, c->state[i]);
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef CIRON_SHA_H
+#define CIRON_SHA_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SHA-1 and SHA-256 (FIPS 180-4) for the native crypto implementation.
+ *
+ * The compression functions have a portable implementation and one using
+ * the x86 SHA extensions. ciron_sha1_blocks() and ciron_sha256_blocks()
+ * use the one selected for the "sha" primitive of the registry
+ * (registry.h), which is the latter if the CPU supports it.
+ */
+
+#define CIRON_SHA_BLOCK_BYTES 64
+#define CIRON_SHA1_DIGEST_BYTES 20
+#define CIRON_SHA256_DIGEST_BYTES 32
+
+/** Hashing state for incremental SHA-1.
+ */
+struct CironSha1 {
+	uint32_t state[5];
+	uint64_t length;
+	unsigned char block[CIRON_SHA_BLOCK_BYTES];
+	size_t fill;
+};
+
+/** Hashing state for incremental SHA-256.
+ */
+struct CironSha256 {
+	uint32_t state[8];
+	uint64_t length;
+	unsigned char block[CIRON_SHA_BLOCK_BYTES];
+	size_t fill;
+};
+
+/** The SHA-256 round constants.
+ */
+extern const uint32_t ciron_sha256_k[64];
+
+/** Compress nblocks 64 byte blocks of data into the SHA-1 chaining state.
+ */
+void ciron_sha1_blocks(uint32_t *state, const unsigned char *data, size_t nblocks);
+void ciron_sha1_blocks_generic(uint32_t *state, const unsigned char *data, size_t nblocks);
+#ifdef CIRON_X86_INTRINSICS
+void ciron_sha1_blocks_shani(uint32_t *state, const unsigned char *data, size_t nblocks);
+#endif
+
+/** Compress nblocks 64 byte blocks of data into the SHA-256 chaining state.
+ */
+void ciron_sha256_blocks(uint32_t *state, const unsigned char *data, size_t nblocks);
+void ciron_sha256_blocks_generic(uint32_t *state, const unsigned char *data, size_t nblocks);
+#ifdef CIRON_X86_INTRINSICS
+void ciron_sha256_blocks_shani(uint32_t *state, const unsigned char *data, size_t nblocks);
+#endif
+
+void ciron_sha1_init(struct CironSha1 *c);
+
+/** Initialize c to continue hashing from a chaining state captured after
+ * length bytes have been hashed. length must be a multiple of the block size.
+ */
+void ciron_sha1_resume(struct CironSha1 *c, const uint32_t *state, uint64_t length);
+void ciron_sha1_update(struct CironSha1 *c, const unsigned char *data, size_t len);
+void ciron_sha1_final(struct CironSha1 *c, unsigned char *digest);
+
+void ciron_sha256_init(struct CironSha256 *c);
+void ciron_sha256_update(struct CironSha256 *c, const unsigned char *data, size_t len);
+void ciron_sha256_final(struct CironSha256 *c, unsigned char *digest);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_SHA_H */
@@ -0,0 +1,224 @@
+#include <string.h>
+#include "sha_mb.h"
+#include "registry.h"
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+typedef void (*kernel_function)(uint32_t *state, const unsigned char *const *blocks);
+
+static uint32_t load_be32(const unsigned char *p) {
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+			| ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+#ifdef CIRON_X86_INTRINSICS
+
+#define LANES 4
+#define VECTOR vector4
+#define TARGET __attribute__((target("sse4.1")))
+#define SHA1_MB sha1_sse41
+#define SHA256_MB sha256_sse41
+#include "sha_mb_lanes.h"
+#undef LANES
+#undef VECTOR
+#undef TARGET
+#undef SHA1_MB
+#undef SHA256_MB
+
+#define LANES 8
+#define VECTOR vector8
+#define TARGET __attribute__((target("avx2")))
+#define SHA1_MB sha1_avx2
+#define SHA256_MB sha256_avx2
+#include "sha_mb_lanes.h"
+#undef LANES
+#undef VECTOR
+#undef TARGET
+#undef SHA1_MB
+#undef SHA256_MB
+
+#define LANES 16
+#define VECTOR vector16
+#define TARGET __attribute__((target("avx512f")))
+#define SHA1_MB sha1_avx512
+#define SHA256_MB sha256_avx512
+#include "sha_mb_lanes.h"
+#undef LANES
+#undef VECTOR
+#undef TARGET
+#undef SHA1_MB
+#undef SHA256_MB
+
+#endif /* CIRON_X86_INTRINSICS */
+
+struct sha_mb_functions {
+	unsigned int lanes;
+	kernel_function sha1;
+	kernel_function sha256;
+};
+
+/* A single lane is always hashed with the single-buffer functions of sha.h */
+static const struct sha_mb_functions serial = { 1, NULL, NULL };
+
+#ifdef CIRON_X86_INTRINSICS
+static const struct sha_mb_functions sse41 = { 4, sha1_sse41, sha256_sse41 };
+static const struct sha_mb_functions avx2 = { 8, sha1_avx2, sha256_avx2 };
+static const struct sha_mb_functions avx512 = { 16, sha1_avx512, sha256_avx512 };
+#endif
+
+/*
+ * With the SHA extensions, one message is hashed about as fast as 8 with
+ * AVX2, so these are only preferred over AVX-512.
+ */
+static const struct CironImplementation implementations[] = {
+#ifdef CIRON_X86_INTRINSICS
+	{ "avx512", CIRON_CPU_AVX512, &avx512 },
+	{ "serial", CIRON_CPU_SHA, &serial },
+	{ "avx2", CIRON_CPU_AVX2, &avx2 },
+	{ "sse41", CIRON_CPU_SSE41, &sse41 },
+#endif
+	{ "serial", 0, &serial },
+	{ NULL, 0, NULL }
+};
+
+struct CironPrimitive ciron_sha_mb_primitive = { "sha_mb", implementations, NULL };
+
+static const unsigned char zero_block[CIRON_SHA_BLOCK_BYTES];
+
+/*
+ * Takes the next job with blocks for a lane and loads its state into the
+ * lane. Returns NULL if there is none left.
+ */
+static struct CironShaMbJob *next_job(struct CironShaMbJob *jobs, size_t njobs,
+		size_t *next, uint32_t *state, unsigned int lanes, unsigned int lane,
+		size_t words) {
+	struct CironShaMbJob *job;
+	size_t i;
+
+	while (*next < njobs) {
+		job = &jobs[(*next)++];
+		if (job->nblocks + job->tail_blocks > 0) {
+			for (i = 0; i < words; i++) {
+				state[i * lanes + lane] = job->state[i];
+			}
+			return job;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Compresses the blocks of a job the kernel has not done yet with the
+ * single-buffer function.
+ */
+static void finish_job(struct CironShaMbJob *job, size_t done,
+		void (*blocks_function)(uint32_t *, const unsigned char *, size_t)) {
+	if (done < job->nblocks) {
+		blocks_function(job->state, job->data + done * CIRON_SHA_BLOCK_BYTES,
+				job->nblocks - done);
+		done = job->nblocks;
+	}
+	if (done < job->nblocks + job->tail_blocks) {
+		blocks_function(job->state,
+				job->tail + (done - job->nblocks) * CIRON_SHA_BLOCK_BYTES,
+				job->nblocks + job->tail_blocks - done);
+	}
+}
+
+/*
+ * Runs the jobs through the lanes of a kernel. Every lane compresses the
+ * blocks of one job and takes the next job when it is done. Lanes without
+ * a job compress a block of zeros whose result is ignored. Because a lane
+ * only runs out of jobs when there are no more, a single active lane is
+ * the last job, which is finished with the single-buffer function.
+ */
+static void run(unsigned int lanes, kernel_function kernel,
+		void (*blocks_function)(uint32_t *, const unsigned char *, size_t),
+		size_t words, struct CironShaMbJob *jobs, size_t njobs) {
+	uint32_t state[8 * CIRON_SHA_MB_MAX_LANES];
+	const unsigned char *blocks[CIRON_SHA_MB_MAX_LANES];
+	struct CironShaMbJob *current[CIRON_SHA_MB_MAX_LANES];
+	size_t done[CIRON_SHA_MB_MAX_LANES];
+	struct CironShaMbJob *job;
+	unsigned int active;
+	unsigned int last = 0;
+	unsigned int l;
+	size_t next = 0;
+	size_t i;
+
+	for (l = 0; l < lanes; l++) {
+		current[l] = next_job(jobs, njobs, &next, state, lanes, l, words);
+		done[l] = 0;
+	}
+	for (;;) {
+		active = 0;
+		for (l = 0; l < lanes; l++) {
+			if ((job = current[l]) == NULL) {
+				blocks[l] = zero_block;
+				continue;
+			}
+			if (done[l] < job->nblocks) {
+				blocks[l] = job->data + done[l] * CIRON_SHA_BLOCK_BYTES;
+			} else {
+				blocks[l] = job->tail + (done[l] - job->nblocks) * CIRON_SHA_BLOCK_BYTES;
+			}
+			active++;
+			last = l;
+		}
+		if (active == 0) {
+			return;
+		}
+		if (active == 1) {
+			job = current[last];
+			for (i = 0; i < words; i++) {
+				job->state[i] = state[i * lanes + last];
+			}
+			finish_job(job, done[last], blocks_function);
+			current[last] = next_job(jobs, njobs, &next, state, lanes, last, words);
+			done[last] = 0;
+			continue;
+		}
+		kernel(state, blocks);
+		for (l = 0; l < lanes; l++) {
+			if ((job = current[l]) == NULL) {
+				continue;
+			}
+			if (++done[l] < job->nblocks + job->tail_blocks) {
+				continue;
+			}
+			for (i = 0; i < words; i++) {
+				job->state[i] = state[i * lanes + l];
+			}
+			current[l] = next_job(jobs, njobs, &next, state, lanes, l, words);
+			done[l] = 0;
+		}
+	}
+}
+
+void ciron_sha1_mb(struct CironShaMbJob *jobs, size_t njobs) {
+	const struct sha_mb_functions *f = ciron_primitive_functions(&ciron_sha_mb_primitive);
+
+	run(f->lanes, f->sha1, ciron_sha1_blocks, 5, jobs, njobs);
+}
+
+void ciron_sha256_mb(struct CironShaMbJob *jobs, size_t njobs) {
+	const struct sha_mb_functions *f = ciron_primitive_functions(&ciron_sha_mb_primitive);
+
+	run(f->lanes, f->sha256, ciron_sha256_blocks, 8, jobs, njobs);
+}
+
+size_t ciron_sha_pad(unsigned char *block, size_t used, uint64_t message_len) {
+	size_t nblocks;
+	int i;
+
+	nblocks = (used + 9 + CIRON_SHA_BLOCK_BYTES - 1) / CIRON_SHA_BLOCK_BYTES;
+	block[used] = 0x80;
+	memset(block + used + 1, 0, nblocks * CIRON_SHA_BLOCK_BYTES - used - 1);
+	message_len *= 8;
+	for (i = 1; i <= 8; i++) {
+		block[nblocks * CIRON_SHA_BLOCK_BYTES - i] = (unsigned char) message_len;
+		message_len >>= 8;
+	}
+	return nblocks;
+}
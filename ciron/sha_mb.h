@@ -0,0 +1,67 @@
+#ifndef CIRON_SHA_MB_H
+#define CIRON_SHA_MB_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Multi-buffer SHA-1 and SHA-256 for the batch functions of the native
+ * crypto implementation.
+ *
+ * The messages ciron hashes are a few blocks long, so a single hash
+ * cannot use the width of the SIMD registers. The multi-buffer functions
+ * hash independent messages side by side instead, one message per 32 bit
+ * lane of a vector register: 4 lanes with SSE4.1, 8 with AVX2 and 16 with
+ * AVX-512. The implementation is selected by the "sha_mb" primitive of the
+ * registry (registry.h).
+ */
+
+/** Largest number of lanes of any implementation.
+ */
+#define CIRON_SHA_MB_MAX_LANES 16
+
+/** A message for ciron_sha1_mb() and ciron_sha256_mb().
+ *
+ * The message is given as complete blocks, the last of them containing
+ * the padding (see ciron_sha_pad()). To avoid copying, the blocks can be
+ * split into two parts: data, which usually points into the message, and
+ * tail, which holds the rest of the message and the padding.
+ */
+struct CironShaMbJob {
+	/** Chaining state, 5 words for SHA-1 and 8 for SHA-256; updated */
+	uint32_t *state;
+	/** First part of the blocks */
+	const unsigned char *data;
+	size_t nblocks;
+	/** Second part of the blocks, compressed after data */
+	const unsigned char *tail;
+	size_t tail_blocks;
+};
+
+/** Compress the blocks of all jobs into their states.
+ *
+ * Jobs must not share a state.
+ */
+void ciron_sha1_mb(struct CironShaMbJob *jobs, size_t njobs);
+void ciron_sha256_mb(struct CironShaMbJob *jobs, size_t njobs);
+
+/** Pad a message in its last blocks.
+ *
+ * block holds the last used bytes of a message of length message_len
+ * bytes (including everything hashed before, like HMAC pad blocks).
+ * Appends the SHA-1/SHA-256 padding and returns the resulting number of
+ * blocks, 1 or 2. block must have room for 2 blocks and used must be
+ * less than 2 * CIRON_SHA_BLOCK_BYTES - 8.
+ */
+size_t ciron_sha_pad(unsigned char *block, size_t used, uint64_t message_len);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* !defined CIRON_SHA_MB_H */
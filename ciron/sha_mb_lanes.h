@@ -0,0 +1,126 @@
+/*
+ * Multi-buffer SHA-1 and SHA-256 compression functions for one vector
+ * width. sha_mb.c includes this file once per width with the following
+ * macros defined:
+ *
+ *   LANES      number of 32 bit lanes of the vectors
+ *   VECTOR     name of the vector type to define
+ *   TARGET     attribute enabling the instruction set for the functions
+ *   SHA1_MB    name of the SHA-1 function
+ *   SHA256_MB  name of the SHA-256 function
+ *
+ * The vectors are GCC vector extensions, so the compiler maps the
+ * operations to the instructions of the target. The functions compress
+ * one block per lane. The states are stored transposed: word i of lane l
+ * is state[i * LANES + l].
+ */
+
+typedef uint32_t VECTOR __attribute__((vector_size(4 * LANES)));
+
+TARGET static void SHA1_MB(uint32_t *state, const unsigned char *const *blocks) {
+	VECTOR w[16];
+	VECTOR s[5];
+	VECTOR a, b, c, d, e, t;
+	int i, l;
+
+	for (i = 0; i < 16; i++) {
+		for (l = 0; l < LANES; l++) {
+			w[i][l] = load_be32(blocks[l] + 4 * i);
+		}
+	}
+	memcpy(s, state, sizeof(s));
+	a = s[0];
+	b = s[1];
+	c = s[2];
+	d = s[3];
+	e = s[4];
+
+#define SHA1_MB_ROUND(f, k) \
+	do { \
+		if (i >= 16) { \
+			t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15]; \
+			w[i & 15] = ROL32(t, 1); \
+		} \
+		t = ROL32(a, 5) + (f) + e + (k) + w[i & 15]; \
+		e = d; \
+		d = c; \
+		c = ROL32(b, 30); \
+		b = a; \
+		a = t; \
+	} while (0)
+
+	for (i = 0; i < 20; i++) {
+		SHA1_MB_ROUND((b & c) | (~b & d), 0x5a827999U);
+	}
+	for (; i < 40; i++) {
+		SHA1_MB_ROUND(b ^ c ^ d, 0x6ed9eba1U);
+	}
+	for (; i < 60; i++) {
+		SHA1_MB_ROUND((b & c) | (b & d) | (c & d), 0x8f1bbcdcU);
+	}
+	for (; i < 80; i++) {
+		SHA1_MB_ROUND(b ^ c ^ d, 0xca62c1d6U);
+	}
+#undef SHA1_MB_ROUND
+
+	s[0] += a;
+	s[1] += b;
+	s[2] += c;
+	s[3] += d;
+	s[4] += e;
+	memcpy(state, s, sizeof(s));
+}
+
+TARGET static void SHA256_MB(uint32_t *state, const unsigned char *const *blocks) {
+	VECTOR w[16];
+	VECTOR s[8];
+	VECTOR a, b, c, d, e, f, g, h, t1, t2;
+	int i, l;
+
+	for (i = 0; i < 16; i++) {
+		for (l = 0; l < LANES; l++) {
+			w[i][l] = load_be32(blocks[l] + 4 * i);
+		}
+	}
+	memcpy(s, state, sizeof(s));
+	a = s[0];
+	b = s[1];
+	c = s[2];
+	d = s[3];
+	e = s[4];
+	f = s[5];
+	g = s[6];
+	h = s[7];
+
+	for (i = 0; i < 64; i++) {
+		if (i >= 16) {
+			t1 = w[(i + 1) & 15];
+			t2 = w[(i + 14) & 15];
+			w[i & 15] += (ROR32(t1, 7) ^ ROR32(t1, 18) ^ (t1 >> 3))
+					+ w[(i + 9) & 15]
+					+ (ROR32(t2, 17) ^ ROR32(t2, 19) ^ (t2 >> 10));
+		}
+		t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25))
+				+ ((e & f) ^ (~e & g)) + ciron_sha256_k[i] + w[i & 15];
+		t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22))
+				+ ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	s[0] += a;
+	s[1] += b;
+	s[2] += c;
+	s[3] += d;
+	s[4] += e;
+	s[5] += f;
+	s[6] += g;
+	s[7] += h;
+	memcpy(state, s, sizeof(s));
+}
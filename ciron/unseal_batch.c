@@ -0,0 +1,253 @@
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "ciron.h"
+#include "common.h"
+#include "atomics.h"
+
+/*
+ * ciron_unseal_batch(), unsealing a batch on several threads.
+ *
+ * The threads take chunks of CIRON_BATCH_ITEMS items from a shared cursor
+ * and unseal them with ciron_unseal_chunk() of seal.c, each with a
+ * sealer of its own. Identical tokens are found with a hash table in the
+ * caller-supplied buffer beforehand and unsealed once.
+ */
+
+/*
+ * ciron_unseal_batch() starts at most this many threads, including the
+ * calling one.
+ */
+#define MAX_UNSEAL_THREADS 64
+
+/*
+ * A batch unsealed by several threads.
+ */
+struct unseal_batch {
+	CironBatchItem items;
+	size_t nitems;
+	/*
+	 * For every item the index of the first identical one, which is the
+	 * item itself if there is none before it. NULL without deduplication.
+	 */
+	size_t *first;
+	/* Index of the first item no thread has taken yet */
+	size_t next;
+};
+
+/*
+ * A thread of ciron_unseal_batch() with its own context for the errors
+ * and its own sealer.
+ */
+struct unseal_worker {
+	struct unseal_batch *batch;
+	struct CironContext context;
+	struct CironSealer sealer;
+	pthread_t thread;
+};
+
+/*
+ * Takes chunks of CIRON_BATCH_ITEMS items from the batch and unseals them until
+ * all are taken. Items identical to an earlier one are left out.
+ */
+static void unseal_worker_run(struct unseal_worker *w) {
+	struct unseal_batch *b = w->batch;
+	struct CironBatchItem chunk[CIRON_BATCH_ITEMS];
+	size_t map[CIRON_BATCH_ITEMS];
+	size_t start, end, i, n;
+
+	for (;;) {
+		start = __atomic_fetch_add(&b->next, CIRON_BATCH_ITEMS, __ATOMIC_RELAXED);
+		if (start >= b->nitems) {
+			return;
+		}
+		end = b->nitems - start < CIRON_BATCH_ITEMS ? b->nitems : start + CIRON_BATCH_ITEMS;
+		n = 0;
+		for (i = start; i < end; i++) {
+			if (b->first == NULL || b->first[i] == i) {
+				chunk[n] = b->items[i];
+				map[n] = i;
+				n++;
+			}
+		}
+		if (n > 0) {
+			ciron_unseal_chunk(&w->context, &w->sealer, chunk, n);
+		}
+		for (i = 0; i < n; i++) {
+			b->items[map[i]].error = chunk[i].error;
+			b->items[map[i]].result_len = chunk[i].result_len;
+		}
+	}
+}
+
+static void *unseal_worker_main(void *arg) {
+	unseal_worker_run(arg);
+	return NULL;
+}
+
+/*
+ * Number of slots of the hash table of ciron_unseal_batch(), at least
+ * twice the number of items.
+ */
+static size_t unseal_batch_slots(size_t nitems) {
+	size_t nslots = 2;
+
+	while (nslots < 2 * nitems) {
+		nslots *= 2;
+	}
+	return nslots;
+}
+
+CironError ciron_calculate_unseal_batch_buffer_length(CironContext context,
+		size_t nitems, size_t *result_len) {
+	if (nitems > (SIZE_MAX - sizeof(size_t)) / (5 * sizeof(size_t))) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR, "Batch of %zu items too large", nitems);
+	}
+	*result_len = sizeof(size_t) - 1
+			+ (unseal_batch_slots(nitems) + nitems) * sizeof(size_t);
+	return CIRON_OK;
+}
+
+/*
+ * Sets first of the batch, in the buffer, to the index of the first item
+ * with the same token and password for every item. Uses a hash table with
+ * open addressing in the buffer behind first, whose slots hold the index
+ * of an item plus 1, or 0 if they are empty.
+ */
+static CironError unseal_batch_dedupe(CironContext context,
+		struct unseal_batch *b, unsigned char *buffer, size_t buffer_len) {
+	CironError e;
+	CironBatchItem item, other;
+	size_t needed = 0, nslots, mask, *slots, i, j;
+	uintptr_t misalignment;
+
+	if ((e = ciron_calculate_unseal_batch_buffer_length(context, b->nitems,
+			&needed)) != CIRON_OK) {
+		return e;
+	}
+	if (buffer_len < needed) {
+		return ciron_set_error(context, __FILE__, __LINE__, NO_CRYPTO_ERROR,
+				CIRON_OVERFLOW_ERROR,
+				"Batch buffer of %zu bytes too small, %zu needed",
+				buffer_len, needed);
+	}
+	misalignment = (uintptr_t) buffer % sizeof(size_t);
+	if (misalignment != 0) {
+		buffer += sizeof(size_t) - misalignment;
+	}
+	nslots = unseal_batch_slots(b->nitems);
+	mask = nslots - 1;
+	slots = (size_t *) buffer;
+	b->first = slots + nslots;
+	memset(slots, 0, nslots * sizeof(size_t));
+
+	for (i = 0; i < b->nitems; i++) {
+		item = &b->items[i];
+		b->first[i] = i;
+		for (j = ciron_hash(item->data, item->data_len) & mask; slots[j] != 0;
+				j = (j + 1) & mask) {
+			other = &b->items[slots[j] - 1];
+			if (other->data_len == item->data_len
+					&& other->password == item->password
+					&& memcmp(other->data, item->data, item->data_len) == 0) {
+				b->first[i] = slots[j] - 1;
+				break;
+			}
+		}
+		if (slots[j] == 0) {
+			slots[j] = i + 1;
+		}
+	}
+	return CIRON_OK;
+}
+
+CironError ciron_unseal_batch(CironContext context, CironBatchItem items,
+		size_t nitems, unsigned int nthreads, unsigned char *buffer,
+		size_t buffer_len) {
+	struct unseal_worker workers[MAX_UNSEAL_THREADS];
+	struct unseal_batch batch;
+	CironBatchItem item, first_item;
+	CironError e, first = CIRON_OK;
+	unsigned int nstarted, t;
+	long ncpus;
+	size_t i;
+
+	if (nthreads == 0) {
+		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpus > 0 ? (unsigned int) ncpus : 1;
+	}
+	if (nthreads > MAX_UNSEAL_THREADS) {
+		nthreads = MAX_UNSEAL_THREADS;
+	}
+	/* There is no work for more threads than chunks */
+	if (nthreads > (nitems + CIRON_BATCH_ITEMS - 1) / CIRON_BATCH_ITEMS) {
+		nthreads = nitems > CIRON_BATCH_ITEMS ? (nitems + CIRON_BATCH_ITEMS - 1) / CIRON_BATCH_ITEMS : 1;
+	}
+
+	batch.items = items;
+	batch.nitems = nitems;
+	batch.first = NULL;
+	batch.next = 0;
+	e = CIRON_OK;
+	if (buffer != NULL) {
+		e = unseal_batch_dedupe(context, &batch, buffer, buffer_len);
+	}
+	if (e == CIRON_OK) {
+		e = ciron_sealer_init(context, &workers[0].sealer);
+	}
+	if (e != CIRON_OK) {
+		for (i = 0; i < nitems; i++) {
+			items[i].error = e;
+		}
+		return e;
+	}
+
+	/*
+	 * The calling thread is the first worker. Threads that cannot be
+	 * started leave their share to the others.
+	 */
+	for (t = 0; t < nthreads; t++) {
+		workers[t].batch = &batch;
+		ciron_context_init(&workers[t].context, context->encryption_options,
+				context->integrity_options);
+	}
+	for (nstarted = 1; nstarted < nthreads; nstarted++) {
+		if (ciron_sealer_init(&workers[nstarted].context,
+				&workers[nstarted].sealer) != CIRON_OK) {
+			break;
+		}
+		if (pthread_create(&workers[nstarted].thread, NULL, unseal_worker_main,
+				&workers[nstarted]) != 0) {
+			ciron_sealer_cleanup(&workers[nstarted].sealer);
+			break;
+		}
+	}
+	unseal_worker_run(&workers[0]);
+	for (t = 0; t < nstarted; t++) {
+		if (t > 0) {
+			pthread_join(workers[t].thread, NULL);
+		}
+		ciron_sealer_cleanup(&workers[t].sealer);
+		if (workers[t].context.error != CIRON_OK) {
+			*context = workers[t].context;
+		}
+	}
+
+	for (i = 0; i < nitems; i++) {
+		item = &items[i];
+		if (batch.first != NULL && batch.first[i] != i) {
+			first_item = &items[batch.first[i]];
+			item->error = first_item->error;
+			item->result_len = first_item->error == CIRON_OK ? first_item->result_len : 0;
+			if (item->error == CIRON_OK && item->result != first_item->result) {
+				memcpy(item->result, first_item->result, item->result_len);
+			}
+		}
+		if (first == CIRON_OK) {
+			first = item->error;
+		}
+	}
+	return first;
+}
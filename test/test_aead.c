@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "crypto.h"
+#include "aead.h"
+#include "registry.h"
+#include "test.h"
+
+#define MAXLEN 300
+
+struct CironContext ctx;
+
+static unsigned char data[MAXLEN];
+
+static void fill_data(void) {
+	size_t i;
+	for (i = 0; i < MAXLEN; i++) {
+		data[i] = (unsigned char) (i * 167 + 13);
+	}
+}
+
+static int implementation_supported(const struct CironImplementation *i) {
+	return (i->cpu_features & ciron_cpu_features()) == i->cpu_features;
+}
+
+static size_t from_hex(const char *hex, unsigned char *buf) {
+	size_t n = 0;
+	unsigned int b;
+
+	while (hex[0] != '\0' && sscanf(hex, "%2x", &b) == 1) {
+		buf[n++] = (unsigned char) b;
+		hex += 2;
+	}
+	return n;
+}
+
+/*
+ * Test cases 2, 13, 14 and 16 of McGrew and Viega, "The Galois/Counter
+ * Mode of Operation (GCM)".
+ */
+static const struct {
+	const char *key;
+	const char *iv;
+	const char *aad;
+	const char *plaintext;
+	const char *ciphertext;
+	const char *tag;
+} GCM_VECTORS[] = {
+	{ "00000000000000000000000000000000", "000000000000000000000000", "",
+		"00000000000000000000000000000000", "0388dace60b6a392f328c2b971b2fe78",
+		"ab6e47d42cec13bdf53a67b21257bddf" },
+	{ "0000000000000000000000000000000000000000000000000000000000000000",
+		"000000000000000000000000", "", "", "",
+		"530f8afbc74536b9a963b4f1c4cb738b" },
+	{ "0000000000000000000000000000000000000000000000000000000000000000",
+		"000000000000000000000000", "",
+		"00000000000000000000000000000000", "cea7403d4d606b6e074ec5d3baf39d18",
+		"d0d1c8a799996bf0265b98b5d48ab919" },
+	{ "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+		"cafebabefacedbaddecaf888", "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+		"d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+		"1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+		"522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+		"8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+		"76fc6ece0f4e1768cddf8853bb2d551b" }
+};
+
+/*
+ * Runs the GCM test vectors with every implementation of the ghash and
+ * the aes primitives.
+ */
+int test_aes_gcm_vectors() {
+	unsigned char key[32], iv[12], aad[32], plaintext[64], ciphertext[64], tag[16];
+	unsigned char buf[64], computed_tag[16];
+	size_t key_len, aad_len, len;
+	struct CironPrimitive *ghash = ciron_find_primitive("ghash");
+	struct CironPrimitive *aes = ciron_find_primitive("aes");
+	const struct CironImplementation *g, *a;
+	size_t v;
+
+	EXPECT_TRUE(ghash != NULL && aes != NULL);
+	for (g = ghash->implementations; g->name != NULL; g++) {
+		for (a = aes->implementations; a->name != NULL; a++) {
+			if (!implementation_supported(g) || !implementation_supported(a)) {
+				continue;
+			}
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "ghash", g->name));
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "aes", a->name));
+			for (v = 0; v < sizeof(GCM_VECTORS) / sizeof(GCM_VECTORS[0]); v++) {
+				key_len = from_hex(GCM_VECTORS[v].key, key);
+				from_hex(GCM_VECTORS[v].iv, iv);
+				aad_len = from_hex(GCM_VECTORS[v].aad, aad);
+				len = from_hex(GCM_VECTORS[v].plaintext, plaintext);
+				from_hex(GCM_VECTORS[v].ciphertext, ciphertext);
+				from_hex(GCM_VECTORS[v].tag, tag);
+
+				ciron_aes_gcm_encrypt(key, key_len * 8, iv, aad, aad_len, plaintext,
+						len, buf, computed_tag);
+				EXPECT_BYTE_EQUAL(ciphertext, buf, len);
+				EXPECT_BYTE_EQUAL(tag, computed_tag, sizeof(tag));
+
+				memset(buf, 0, sizeof(buf));
+				EXPECT_INT_EQUAL(0, ciron_aes_gcm_decrypt(key, key_len * 8, iv, aad,
+						aad_len, ciphertext, len, tag, buf));
+				EXPECT_BYTE_EQUAL(plaintext, buf, len);
+
+				tag[v % sizeof(tag)] ^= 0x01;
+				EXPECT_INT_EQUAL(-1, ciron_aes_gcm_decrypt(key, key_len * 8, iv, aad,
+						aad_len, ciphertext, len, tag, buf));
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Test vector of RFC 8439, section 2.8.2.
+ */
+int test_chacha20_poly1305_vector() {
+	const char *plaintext = "Ladies and Gentlemen of the class of '99: If I could "
+			"offer you only one tip for the future, sunscreen would be it.";
+	unsigned char key[32], iv[12], aad[12], ciphertext[114], tag[16];
+	unsigned char buf[114], computed_tag[16];
+	size_t len = strlen(plaintext);
+
+	from_hex("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f", key);
+	from_hex("070000004041424344454647", iv);
+	from_hex("50515253c0c1c2c3c4c5c6c7", aad);
+	from_hex("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+			"3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+			"92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+			"3ff4def08e4b7a9de576d26586cec64b6116", ciphertext);
+	from_hex("1ae10b594f09e26a7e902ecbd0600691", tag);
+	EXPECT_SIZE_T_EQUAL(sizeof(ciphertext), len);
+
+	ciron_chacha20_poly1305_encrypt(key, iv, aad, sizeof(aad),
+			(const unsigned char *) plaintext, len, buf, computed_tag);
+	EXPECT_BYTE_EQUAL(ciphertext, buf, len);
+	EXPECT_BYTE_EQUAL(tag, computed_tag, sizeof(tag));
+
+	memset(buf, 0, sizeof(buf));
+	EXPECT_INT_EQUAL(0, ciron_chacha20_poly1305_decrypt(key, iv, aad, sizeof(aad),
+			ciphertext, len, tag, buf));
+	EXPECT_BYTE_EQUAL(plaintext, buf, len);
+
+	aad[0] ^= 0x80;
+	EXPECT_INT_EQUAL(-1, ciron_chacha20_poly1305_decrypt(key, iv, aad, sizeof(aad),
+			ciphertext, len, tag, buf));
+	return 0;
+}
+
+/*
+ * Absorbs the same blocks with every implementation of the ghash
+ * primitive and compares the states.
+ */
+int test_ghash_implementations_match() {
+	unsigned char expected[CIRON_GHASH_BLOCK_BYTES];
+	unsigned char x[CIRON_GHASH_BLOCK_BYTES];
+	struct CironPrimitive *p = ciron_find_primitive("ghash");
+	const struct CironImplementation *i;
+	size_t nblocks;
+
+	fill_data();
+	EXPECT_TRUE(p != NULL);
+	for (nblocks = 0; nblocks < MAXLEN / CIRON_GHASH_BLOCK_BYTES - 1; nblocks++) {
+		memcpy(expected, data + 7, sizeof(expected));
+		ciron_ghash_generic(expected, data, data + CIRON_GHASH_BLOCK_BYTES, nblocks);
+		for (i = p->implementations; i->name != NULL; i++) {
+			if (!implementation_supported(i)) {
+				continue;
+			}
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "ghash", i->name));
+			memcpy(x, data + 7, sizeof(x));
+			ciron_ghash(x, data, data + CIRON_GHASH_BLOCK_BYTES, nblocks);
+			EXPECT_BYTE_EQUAL(expected, x, sizeof(x));
+		}
+	}
+	return 0;
+}
+
+/*
+ * Encrypts data of different lengths with every crypto implementation
+ * and compares the results with the native one.
+ */
+int test_crypto_implementations_match() {
+	static unsigned char expected[MAXLEN];
+	static unsigned char buf[MAXLEN];
+	unsigned char expected_tag[MAX_TAG_BYTES];
+	unsigned char tag[MAX_TAG_BYTES];
+	CironAlgorithm algorithms[] = { CIRON_AES_256_GCM, CIRON_CHACHA20_POLY1305 };
+	struct CironPrimitive *p = ciron_find_primitive("crypto");
+	const struct CironImplementation *i;
+	const unsigned char *key = data + 3;
+	const unsigned char *iv = data + 50;
+	size_t a, len, aad_len;
+
+	fill_data();
+	EXPECT_TRUE(p != NULL);
+	ciron_context_init(&ctx, CIRON_AES_256_GCM_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	for (a = 0; a < 2; a++) {
+		for (len = 0; len < MAXLEN; len += 37) {
+			aad_len = len % 41;
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "crypto", "native"));
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_aead_encrypt(&ctx, algorithms[a], key, iv,
+					data + 100, aad_len, data, len, expected, expected_tag));
+			for (i = p->implementations; i->name != NULL; i++) {
+				if (!implementation_supported(i)) {
+					continue;
+				}
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "crypto", i->name));
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_aead_encrypt(&ctx, algorithms[a], key,
+						iv, data + 100, aad_len, data, len, buf, tag));
+				EXPECT_BYTE_EQUAL(expected, buf, len);
+				EXPECT_BYTE_EQUAL(expected_tag, tag, sizeof(tag));
+
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_aead_decrypt(&ctx, algorithms[a], key,
+						iv, data + 100, aad_len, expected, len, tag, buf));
+				EXPECT_BYTE_EQUAL(data, buf, len);
+
+				tag[len % sizeof(tag)] ^= 0x10;
+				EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_aead_decrypt(&ctx,
+						algorithms[a], key, iv, data + 100, aad_len, expected, len, tag,
+						buf));
+			}
+		}
+	}
+	EXPECT_INT_EQUAL(CIRON_ERROR_UNKNOWN_ALGORITHM, ciron_aead_encrypt(&ctx,
+			CIRON_AES_256_CBC, key, iv, NULL, 0, data, 16, buf, tag));
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	RUNTEST(argv[0], test_aes_gcm_vectors);
+	RUNTEST(argv[0], test_chacha20_poly1305_vector);
+	RUNTEST(argv[0], test_ghash_implementations_match);
+	RUNTEST(argv[0], test_crypto_implementations_match);
+	return 0;
+}
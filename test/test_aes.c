@@ -0,0 +1,197 @@
+#include "ciron.h"
+#include "aes.h"
+#include "registry.h"
+#include "test.h"
+
+/*
+ * The test vectors are from NIST SP 800-38A, appendix F.2.
+ */
+static const unsigned char IV[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+			0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+
+static const unsigned char PLAINTEXT[] = { 0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+			0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+			0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+			0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+			0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11,
+			0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+			0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17,
+			0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10 };
+
+static const unsigned char KEY_128[] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+			0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+
+static const unsigned char CIPHERTEXT_128[] = { 0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46,
+			0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+			0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee,
+			0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+			0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b,
+			0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+			0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09,
+			0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7 };
+
+static const unsigned char KEY_256[] = { 0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe,
+			0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+			0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7,
+			0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4 };
+
+static const unsigned char CIPHERTEXT_256[] = { 0xf5, 0x8c, 0x4c, 0x04, 0xd6, 0xe5, 0xf1, 0xba,
+			0x77, 0x9e, 0xab, 0xfb, 0x5f, 0x7b, 0xfb, 0xd6,
+			0x9c, 0xfc, 0x4e, 0x96, 0x7e, 0xdb, 0x80, 0x8d,
+			0x67, 0x9f, 0x77, 0x7b, 0xc6, 0x70, 0x2c, 0x7d,
+			0x39, 0xf2, 0x33, 0x69, 0xa9, 0xd9, 0xba, 0xcf,
+			0xa5, 0x30, 0xe2, 0x63, 0x04, 0x23, 0x14, 0x61,
+			0xb2, 0xeb, 0x05, 0xe2, 0xc3, 0x9b, 0xe9, 0xfc,
+			0xda, 0x6c, 0x19, 0x07, 0x8c, 0x6a, 0x9d, 0x1b };
+
+typedef int (*set_key_function)(struct CironAesKey *, const unsigned char *,
+		unsigned int);
+typedef void (*cbc_function)(const struct CironAesKey *, unsigned char *,
+		const unsigned char *, unsigned char *, size_t);
+
+/*
+ * Encrypts and decrypts the four test blocks in one call and, to check
+ * that the IV is chained, block by block. Decryption is also done in
+ * place.
+ */
+static int check_cbc(set_key_function set_key, cbc_function encrypt,
+		cbc_function decrypt, const unsigned char *key_bytes,
+		unsigned int key_bits, const unsigned char *expected) {
+	struct CironAesKey key;
+	unsigned char iv[CIRON_AES_BLOCK_BYTES];
+	unsigned char buf[sizeof(PLAINTEXT)];
+	size_t i;
+
+	EXPECT_INT_EQUAL(0, set_key(&key, key_bytes, key_bits));
+
+	memcpy(iv, IV, sizeof(iv));
+	encrypt(&key, iv, PLAINTEXT, buf, 4);
+	EXPECT_BYTE_EQUAL(expected, buf, sizeof(buf));
+	EXPECT_BYTE_EQUAL(expected + 48, iv, sizeof(iv));
+
+	memcpy(iv, IV, sizeof(iv));
+	for (i = 0; i < 4; i++) {
+		encrypt(&key, iv, PLAINTEXT + 16 * i, buf + 16 * i, 1);
+	}
+	EXPECT_BYTE_EQUAL(expected, buf, sizeof(buf));
+
+	memcpy(iv, IV, sizeof(iv));
+	decrypt(&key, iv, buf, buf, 4);
+	EXPECT_BYTE_EQUAL(PLAINTEXT, buf, sizeof(buf));
+
+	memcpy(iv, IV, sizeof(iv));
+	for (i = 0; i < 4; i++) {
+		decrypt(&key, iv, expected + 16 * i, buf + 16 * i, 1);
+	}
+	EXPECT_BYTE_EQUAL(PLAINTEXT, buf, sizeof(buf));
+
+	return 0;
+}
+
+int AES_CBC_Test() {
+	if (check_cbc(ciron_aes_set_key, ciron_aes_cbc_encrypt,
+			ciron_aes_cbc_decrypt, KEY_128, 128, CIPHERTEXT_128) != 0) {
+		return 1;
+	}
+	return check_cbc(ciron_aes_set_key, ciron_aes_cbc_encrypt,
+			ciron_aes_cbc_decrypt, KEY_256, 256, CIPHERTEXT_256);
+}
+
+int AES_CBC_Generic_Test() {
+	if (check_cbc(ciron_aes_set_key_generic, ciron_aes_cbc_encrypt_generic,
+			ciron_aes_cbc_decrypt_generic, KEY_128, 128, CIPHERTEXT_128) != 0) {
+		return 1;
+	}
+	return check_cbc(ciron_aes_set_key_generic, ciron_aes_cbc_encrypt_generic,
+			ciron_aes_cbc_decrypt_generic, KEY_256, 256, CIPHERTEXT_256);
+}
+
+int AES_CBC_AESNI_Test() {
+#ifdef CIRON_X86_INTRINSICS
+	if (!(ciron_cpu_features() & CIRON_CPU_AESNI)) {
+		return 0;
+	}
+	if (check_cbc(ciron_aes_set_key_aesni, ciron_aes_cbc_encrypt_aesni,
+			ciron_aes_cbc_decrypt_aesni, KEY_128, 128, CIPHERTEXT_128) != 0) {
+		return 1;
+	}
+	return check_cbc(ciron_aes_set_key_aesni, ciron_aes_cbc_encrypt_aesni,
+			ciron_aes_cbc_decrypt_aesni, KEY_256, 256, CIPHERTEXT_256);
+#else
+	return 0;
+#endif
+}
+
+#define NJOBS 21
+
+/*
+ * Encrypts jobs of different lengths, some in place and some with 128
+ * instead of 256 bit keys, with every implementation of
+ * ciron_aes_cbc_encrypt_multi() and compares the results with the generic
+ * single-job function.
+ */
+int AES_CBC_Multi_Test() {
+	static unsigned char data[NJOBS][16 * CIRON_AES_BLOCK_BYTES];
+	static unsigned char out[NJOBS][16 * CIRON_AES_BLOCK_BYTES];
+	static unsigned char expected[NJOBS][16 * CIRON_AES_BLOCK_BYTES];
+	unsigned char ivs[NJOBS][CIRON_AES_BLOCK_BYTES];
+	unsigned char expected_ivs[NJOBS][CIRON_AES_BLOCK_BYTES];
+	struct CironAesKey keys[NJOBS];
+	struct CironAesCbcJob jobs[NJOBS];
+	unsigned char key_bytes[32];
+	struct CironContext ctx;
+	struct CironPrimitive *p = ciron_find_primitive("aes");
+	const struct CironImplementation *impl;
+	size_t i, j;
+
+	EXPECT_TRUE(p != NULL);
+	for (impl = p->implementations; impl->name != NULL; impl++) {
+		if ((impl->cpu_features & ciron_cpu_features()) != impl->cpu_features) {
+			continue;
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "aes", impl->name));
+		for (i = 0; i < NJOBS; i++) {
+			for (j = 0; j < sizeof(key_bytes); j++) {
+				key_bytes[j] = (unsigned char) (i * 31 + j);
+			}
+			EXPECT_INT_EQUAL(0, ciron_aes_set_key_generic(&keys[i], key_bytes,
+					i % 5 == 3 ? 128 : 256));
+			for (j = 0; j < sizeof(data[i]); j++) {
+				data[i][j] = (unsigned char) (i * 7 + j * 13);
+			}
+			memcpy(ivs[i], PLAINTEXT + i % 3, CIRON_AES_BLOCK_BYTES);
+			memcpy(expected_ivs[i], ivs[i], CIRON_AES_BLOCK_BYTES);
+
+			jobs[i].key = &keys[i];
+			jobs[i].iv = ivs[i];
+			jobs[i].in = data[i];
+			jobs[i].out = i % 4 == 1 ? data[i] : out[i];
+			jobs[i].nblocks = (i * 5) % 17;
+			ciron_aes_cbc_encrypt_generic(&keys[i], expected_ivs[i], data[i],
+					expected[i], jobs[i].nblocks);
+		}
+		ciron_aes_cbc_encrypt_multi(jobs, NJOBS);
+		for (i = 0; i < NJOBS; i++) {
+			EXPECT_BYTE_EQUAL(expected[i], jobs[i].out,
+					jobs[i].nblocks * CIRON_AES_BLOCK_BYTES);
+			EXPECT_BYTE_EQUAL(expected_ivs[i], ivs[i], CIRON_AES_BLOCK_BYTES);
+		}
+	}
+	return 0;
+}
+
+int AES_Unsupported_Key_Size_Test() {
+	struct CironAesKey key;
+
+	EXPECT_INT_EQUAL(-1, ciron_aes_set_key(&key, KEY_256, 192));
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	RUNTEST(argv[0],AES_CBC_Test);
+	RUNTEST(argv[0],AES_CBC_Generic_Test);
+	RUNTEST(argv[0],AES_CBC_AESNI_Test);
+	RUNTEST(argv[0],AES_CBC_Multi_Test);
+	RUNTEST(argv[0],AES_Unsupported_Key_Size_Test);
+	return 0;
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "test.h"
+
+#define MAXBUF 1024
+#define NREQUESTS 40
+#define NWORKERS 3
+
+struct CironContext ctx;
+
+static unsigned char password_id[] = "async";
+static unsigned char password[] = "password_of_the_async_tests";
+
+static unsigned char async_buffer[64 * 1024];
+static unsigned char data[NREQUESTS * 4];
+static unsigned char cryptbufs[NREQUESTS][MAXBUF];
+static unsigned char tokens[NREQUESTS][MAXBUF];
+static unsigned char results[NREQUESTS][MAXBUF];
+static struct CironAsyncRequest requests[NREQUESTS];
+static int indexes[NREQUESTS];
+
+static void fill_request(int i, CironPreparedPassword prepared,
+		const unsigned char *input, size_t input_len, unsigned char *result) {
+	memset(&requests[i], 0, sizeof(requests[i]));
+	requests[i].item.data = input;
+	requests[i].item.data_len = input_len;
+	requests[i].item.password_id = password_id;
+	requests[i].item.password_id_len = strlen((char *) password_id);
+	requests[i].item.password = prepared;
+	requests[i].item.buffer_encrypted_bytes = cryptbufs[i];
+	requests[i].item.result = result;
+	requests[i].item.error = CIRON_OVERFLOW_ERROR;
+	requests[i].user_data = &indexes[i];
+}
+
+/*
+ * Waits for the descriptor and reaps until all n submitted requests have
+ * completed. Returns the number of requests reaped more than once.
+ */
+static int reap_all(CironAsync async, int n) {
+	CironAsyncRequest reaped[7];
+	struct pollfd pfd;
+	int seen[NREQUESTS];
+	int nreaped = 0, duplicates = 0;
+	size_t k, m;
+
+	memset(seen, 0, sizeof(seen));
+	pfd.fd = ciron_async_fd(async);
+	pfd.events = POLLIN;
+	while (nreaped < n) {
+		if (poll(&pfd, 1, 10000) != 1) {
+			return -1;
+		}
+		do {
+			m = ciron_async_reap(async, reaped, 7);
+			for (k = 0; k < m; k++) {
+				duplicates += seen[*(int *) reaped[k]->user_data]++;
+			}
+			nreaped += m;
+		} while (m == 7);
+	}
+	return duplicates;
+}
+
+int test_async_ok() {
+	struct CironAsync async;
+	struct CironPreparedPassword prepared;
+	struct CironAsyncRequest extra;
+	CironAsyncRequest reaped[1];
+	size_t len;
+	int i;
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 5 + 3);
+	}
+	for (i = 0; i < NREQUESTS; i++) {
+		indexes[i] = i;
+	}
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, strlen((char *) password), &prepared));
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_calculate_async_buffer_length(&ctx, 0, NREQUESTS, &len));
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_calculate_async_buffer_length(&ctx, NWORKERS, 0, &len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_async_buffer_length(&ctx, NWORKERS, NREQUESTS, &len));
+	EXPECT_TRUE(len < sizeof(async_buffer));
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_async_init(&ctx, &async, NWORKERS, NREQUESTS, async_buffer, len - 1));
+	/* The buffer need not be aligned */
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_async_init(&ctx, &async, NWORKERS, NREQUESTS, async_buffer + 1, len));
+	EXPECT_TRUE(ciron_async_fd(&async) >= 0);
+
+	for (i = 0; i < NREQUESTS; i++) {
+		fill_request(i, &prepared, data + i, i * 3, tokens[i]);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_async_submit_seal(&ctx, &async, &requests[i]));
+	}
+	/* No more requests than the depth are in flight */
+	memset(&extra, 0, sizeof(extra));
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_async_submit_seal(&ctx, &async, &extra));
+	EXPECT_INT_EQUAL(0, reap_all(&async, NREQUESTS));
+	for (i = 0; i < NREQUESTS; i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, requests[i].item.error);
+		EXPECT_INT_EQUAL(CIRON_ASYNC_SEAL, requests[i].operation);
+	}
+
+	/* Unseal the tokens, one with a modified encryption salt */
+	tokens[17][60] = tokens[17][60] == '0' ? '1' : '0';
+	for (i = 0; i < NREQUESTS; i++) {
+		fill_request(i, &prepared, tokens[i], requests[i].item.result_len, results[i]);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_async_submit_unseal(&ctx, &async, &requests[i]));
+	}
+	EXPECT_INT_EQUAL(0, reap_all(&async, NREQUESTS));
+	for (i = 0; i < NREQUESTS; i++) {
+		if (i == 17) {
+			EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, requests[i].item.error);
+			continue;
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, requests[i].item.error);
+		EXPECT_SIZE_T_EQUAL((size_t) (i * 3), requests[i].item.result_len);
+		EXPECT_BYTE_EQUAL(data + i, results[i], requests[i].item.result_len);
+	}
+
+	/* Nothing has completed */
+	EXPECT_SIZE_T_EQUAL((size_t) 0, ciron_async_reap(&async, reaped, 1));
+	ciron_async_cleanup(&async);
+	return 0;
+}
+
+int test_async_cleanup_completes_requests() {
+	struct CironAsync async;
+	struct CironPreparedPassword prepared;
+	size_t len;
+	int i;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, strlen((char *) password), &prepared));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_async_buffer_length(&ctx, 1, NREQUESTS, &len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_async_init(&ctx, &async, 1, NREQUESTS, async_buffer, len));
+	for (i = 0; i < NREQUESTS; i++) {
+		fill_request(i, &prepared, data, 10, tokens[i]);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_async_submit_seal(&ctx, &async, &requests[i]));
+	}
+	ciron_async_cleanup(&async);
+	for (i = 0; i < NREQUESTS; i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, requests[i].item.error);
+		EXPECT_TRUE(requests[i].item.result_len > 0);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+
+	RUNTEST(argv[0], test_async_ok);
+	RUNTEST(argv[0], test_async_cleanup_completes_requests);
+
+	return 0;
+}
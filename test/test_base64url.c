@@ -1,6 +1,7 @@
 #include "common.h"
 #include "test.h"
 #include "base64url.h"
+#include "registry.h"
 
 struct CironContext context;
 
@@ -127,10 +128,47 @@ int test_base64url_decodes_correctly() {
 	return 0;
 }
 
+/*
+ * Checks strings long enough for the SIMD kernels with every
+ * implementation the CPU supports, with an invalid character at every
+ * position.
+ */
+int test_base64url_valid() {
+	unsigned char chars[100];
+	const char *bad = "=+/*. \x80";
+	const char *selected = ciron_get_implementation("base64url");
+	const struct CironImplementation *i;
+	size_t n, pos, b;
+
+	for (n = 0; n < sizeof(chars); n++) {
+		chars[n] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"[n % 64];
+	}
+	for (i = ciron_base64url_primitive.implementations; i->name != NULL; i++) {
+		if (ciron_set_implementation(&context, "base64url", i->name) != CIRON_OK) {
+			continue;
+		}
+		EXPECT_TRUE(ciron_base64url_valid(chars, 0));
+		EXPECT_TRUE(ciron_base64url_valid(chars, 99));
+		EXPECT_TRUE(ciron_base64url_valid(chars, 98));
+		EXPECT_TRUE(!ciron_base64url_valid(chars, 97));
+		EXPECT_TRUE(!ciron_base64url_valid(chars, 1));
+		for (pos = 0; pos < 99; pos++) {
+			for (b = 0; b < strlen(bad); b++) {
+				chars[pos] = (unsigned char) bad[b];
+				EXPECT_TRUE(!ciron_base64url_valid(chars, 99));
+			}
+			chars[pos] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"[pos % 64];
+		}
+	}
+	ciron_set_implementation(&context, "base64url", selected);
+	return 0;
+}
+
 int main(int argc, char **argv) {
 
 	RUNTEST(argv[0], test_base64url_encodes_correctly);
 	RUNTEST(argv[0], test_base64url_decodes_correctly);
+	RUNTEST(argv[0], test_base64url_valid);
 
 	return 0;
 }
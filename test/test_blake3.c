@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "crypto.h"
+#include "blake3.h"
+#include "registry.h"
+#include "test.h"
+
+#define MAXLEN 102400
+#define NJOBS 5
+
+struct CironContext ctx;
+
+static unsigned char data[MAXLEN];
+
+static void fill_data(void) {
+	size_t i;
+	for (i = 0; i < MAXLEN; i++) {
+		data[i] = (unsigned char) (i % 251);
+	}
+}
+
+static int implementation_supported(const struct CironImplementation *i) {
+	return (i->cpu_features & ciron_cpu_features()) == i->cpu_features;
+}
+
+static size_t from_hex(const char *hex, unsigned char *buf) {
+	size_t n = 0;
+	unsigned int b;
+
+	while (hex[0] != '\0' && sscanf(hex, "%2x", &b) == 1) {
+		buf[n++] = (unsigned char) b;
+		hex += 2;
+	}
+	return n;
+}
+
+/*
+ * Keyed hashes of the official BLAKE3 test vectors, whose input is the
+ * byte sequence 0, 1, ..., 250, 0, 1, ...
+ */
+static const struct {
+	size_t len;
+	const char *hash;
+} VECTORS[] = {
+	{ 0, "92b2b75604ed3c761f9d6f62392c8a92"
+			"27ad0ea3f09573e783f1498a4ed60d26" },
+	{ 1, "6d7878dfff2f485635d39013278ae14f"
+			"1454b8c0a3a2d34bc1ab38228a80c95b" },
+	{ 1023, "c951ecdf03288d0fcc96ee3413563d8a"
+			"6d3589547f2c2fb36d9786470f1b9d6e" },
+	{ 1024, "75c46f6f3d9eb4f55ecaaee480db732e"
+			"6c2105546f1e675003687c31719c7ba4" },
+	{ 1025, "357dc55de0c7e382c900fd6e320acc04"
+			"146be01db6a8ce7210b7189bd664ea69" },
+	{ 2048, "879cf1fa2ea0e79126cb1063617a05b6"
+			"ad9d0b696d0d757cf053439f60a99dd1" },
+	{ 2049, "9f29700902f7c86e514ddc4df1e3049f"
+			"258b2472b6dd5267f61bf13983b78dd5" },
+	{ 3072, "044a0e7b172a312dc02a4c9a818c036f"
+			"fa2776368d7f528268d2e6b5df191770" },
+	{ 4097, "00df940cd36bb9fa7cbbc3556744e0db"
+			"c8191401afe70520ba292ee3ca80abbc" },
+	{ 8193, "954a2a75420c8d6547e3ba5b98d963e6"
+			"fa6491addc8c023189cc519821b4a1f5" },
+	{ 16384, "9e9fc4eb7cf081ea7c47d1807790ed21"
+			"1bfec56aa25bb7037784c13c4b707b0d" },
+	{ 31744, "efa53b389ab67c593dba624d898d0f73"
+			"53ab99e4ac9d42302ee64cbf9939a419" },
+	{ 102400, "1c35d1a5811083fd7119f5d5d1ba027b"
+			"4d01c0c6c49fb6ff2cf75393ea5db4a7" }
+};
+
+static const unsigned char *KEY = (const unsigned char *) "whats the Elvish word for friend";
+
+/*
+ * Runs the test vectors with every implementation of the blake3 primitive.
+ */
+int test_blake3_keyed_vectors() {
+	unsigned char expected[CIRON_BLAKE3_OUT_BYTES];
+	unsigned char out[CIRON_BLAKE3_OUT_BYTES];
+	struct CironPrimitive *p = ciron_find_primitive("blake3");
+	const struct CironImplementation *i;
+	size_t v;
+
+	fill_data();
+	EXPECT_TRUE(p != NULL);
+	for (i = p->implementations; i->name != NULL; i++) {
+		if (!implementation_supported(i)) {
+			continue;
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "blake3", i->name));
+		for (v = 0; v < sizeof(VECTORS) / sizeof(VECTORS[0]); v++) {
+			from_hex(VECTORS[v].hash, expected);
+			ciron_blake3_keyed(KEY, data, VECTORS[v].len, out);
+			EXPECT_BYTE_EQUAL(expected, out, sizeof(out));
+		}
+	}
+	return 0;
+}
+
+/*
+ * Hashes data of different lengths in parts of different sizes with every
+ * implementation of the blake3 primitive and compares the results with
+ * the one-shot hash.
+ */
+int test_blake3_incremental() {
+	size_t lengths[] = { 0, 1, 1023, 1024, 1025, 4096, 9000, MAXLEN };
+	size_t parts[] = { 1, 63, 1024, 1500, 5000 };
+	unsigned char expected[CIRON_BLAKE3_OUT_BYTES];
+	unsigned char out[CIRON_BLAKE3_OUT_BYTES];
+	struct CironPrimitive *p = ciron_find_primitive("blake3");
+	const struct CironImplementation *i;
+	struct CironBlake3 h;
+	size_t l, n, pos;
+
+	fill_data();
+	EXPECT_TRUE(p != NULL);
+	for (i = p->implementations; i->name != NULL; i++) {
+		if (!implementation_supported(i)) {
+			continue;
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "blake3", i->name));
+		for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+			ciron_blake3_keyed(KEY, data, lengths[l], expected);
+			for (n = 0; n < sizeof(parts) / sizeof(parts[0]); n++) {
+				ciron_blake3_init_keyed(&h, KEY);
+				for (pos = 0; pos < lengths[l]; pos += parts[n]) {
+					ciron_blake3_update(&h, data + pos, lengths[l] - pos < parts[n]
+							? lengths[l] - pos : parts[n]);
+				}
+				ciron_blake3_final(&h, out);
+				EXPECT_BYTE_EQUAL(expected, out, sizeof(out));
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Calculates BLAKE3 MACs with every crypto implementation, with and
+ * without MAC objects and in parts, and compares them with the keyed hash.
+ */
+int test_crypto_implementations_match() {
+	unsigned char key[MAX_KEY_BYTES];
+	unsigned char expected[NJOBS][MAX_HMAC_BYTES];
+	unsigned char results[NJOBS][MAX_HMAC_BYTES];
+	struct CironMacJob jobs[NJOBS];
+	struct CironPrimitive *p = ciron_find_primitive("crypto");
+	const struct CironImplementation *i;
+	struct CironMac *mac;
+	const unsigned char *password = (const unsigned char *) "some_not_random_password";
+	const unsigned char *salt = (const unsigned char *) "0123456789abcdef";
+	size_t len, j;
+
+	fill_data();
+	EXPECT_TRUE(p != NULL);
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_BLAKE3_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "crypto", "native"));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_generate_key(&ctx, password, 24, salt, 16,
+			CIRON_BLAKE3, 1, key));
+	for (j = 0; j < NJOBS; j++) {
+		jobs[j].key = key;
+		jobs[j].key_len = CIRON_BLAKE3_KEY_BYTES;
+		jobs[j].data = data + j;
+		jobs[j].data_len = 1000 * j * j;
+		jobs[j].result = results[j];
+		ciron_blake3_keyed(key, jobs[j].data, jobs[j].data_len, expected[j]);
+	}
+
+	for (i = p->implementations; i->name != NULL; i++) {
+		if (!implementation_supported(i)) {
+			continue;
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "crypto", i->name));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_hmac(&ctx, CIRON_BLAKE3, password, 24,
+				salt, 16, 1, data + 3, 9000, results[0], &len));
+		EXPECT_SIZE_T_EQUAL((size_t) CIRON_BLAKE3_OUT_BYTES, len);
+		EXPECT_BYTE_EQUAL(expected[3], results[0], len);
+
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_mac_new(&ctx, CIRON_BLAKE3, &mac));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_mac(&ctx, mac, key, CIRON_BLAKE3_KEY_BYTES,
+				data + 1, 1000, results[0], &len));
+		EXPECT_BYTE_EQUAL(expected[1], results[0], len);
+
+		memset(results, 0, sizeof(results));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_mac_batch(&ctx, mac, jobs, NJOBS));
+		for (j = 0; j < NJOBS; j++) {
+			EXPECT_SIZE_T_EQUAL((size_t) CIRON_BLAKE3_OUT_BYTES, jobs[j].result_len);
+			EXPECT_BYTE_EQUAL(expected[j], results[j], CIRON_BLAKE3_OUT_BYTES);
+		}
+
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_mac_init(&ctx, mac, key, CIRON_BLAKE3_KEY_BYTES));
+		for (j = 0; j < 16000; j += 1000) {
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_mac_update(&ctx, mac, data + 4 + j, 1000));
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_mac_final(&ctx, mac, results[0], &len));
+		EXPECT_SIZE_T_EQUAL((size_t) CIRON_BLAKE3_OUT_BYTES, len);
+		EXPECT_BYTE_EQUAL(expected[4], results[0], len);
+
+		/* BLAKE3 keys have exactly 32 bytes */
+		EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_mac(&ctx, mac, key, 16,
+				data, 100, results[0], &len));
+		ciron_mac_free(mac);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	RUNTEST(argv[0], test_blake3_keyed_vectors);
+	RUNTEST(argv[0], test_blake3_incremental);
+	RUNTEST(argv[0], test_crypto_implementations_match);
+	return 0;
+}
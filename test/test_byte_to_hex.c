@@ -25,6 +25,26 @@ int test_bytes_to_hex() {
 	return 0;
 }
 
+int test_hex_valid() {
+	unsigned char chars[80];
+	const char *bad = "gG/:@`*\x80";
+	size_t n, pos, b;
+
+	for (n = 0; n < sizeof(chars); n++) {
+		chars[n] = "0123456789abcdefABCDEF"[n % 22];
+	}
+	EXPECT_TRUE(ciron_hex_valid(chars, 0));
+	EXPECT_TRUE(ciron_hex_valid(chars, sizeof(chars)));
+	for (pos = 0; pos < sizeof(chars); pos++) {
+		for (b = 0; b < strlen(bad); b++) {
+			chars[pos] = (unsigned char) bad[b];
+			EXPECT_TRUE(!ciron_hex_valid(chars, sizeof(chars)));
+		}
+		chars[pos] = "0123456789abcdefABCDEF"[pos % 22];
+	}
+	return 0;
+}
+
 /*
 
  Test vectors from http://www.ietf.org/rfc/rfc4648.txt section 10.
@@ -146,6 +166,7 @@ int test_ciron_base64_decode() {
 int main(int argc, char **argv) {
 
 	RUNTEST(argv[0],test_bytes_to_hex);
+	RUNTEST(argv[0],test_hex_valid);
 
 	return 0;
 }
@@ -168,6 +168,53 @@ int PBKDF2_HMAC_SHA1_Test_6() {
 	return 0;
 }
 
+/*
+ * Test cases 2 and 5 from above, but using a prepared password.
+ */
+int PBKDF2_HMAC_SHA1_Prepared_Test() {
+	unsigned char key[1024];
+	struct CironPreparedPassword prepared;
+	const unsigned char *password = (unsigned char*)"password";
+	const unsigned char salt[4] = { 's', 'a', 'l', 't' };
+	const unsigned char expected[] = { 0xea, 0x6c, 0x01, 0x4d, 0xc7, 0x2d, 0x6f, 0x8c,
+			0xcd, 0x1e, 0xd9, 0x2a, 0xce, 0x1d, 0x41, 0xf0, 0xd8, 0xde, 0x89,
+			0x57 };
+	const unsigned char *pwd = (unsigned char *)"passwordPASSWORDpassword";
+	const unsigned char *slt = (unsigned char *)"saltSALTsaltSALTsaltSALTsaltSALTsalt";
+	const unsigned char expected5[] = { 0x3d, 0x2e, 0xec, 0x4f, 0xe4, 0x1c, 0x84, 0x9b,
+			0x80, 0xc8, 0xd8, 0x36, 0x62, 0xc0, 0xe4, 0x4a, 0x8b, 0x29, 0x1a,
+			0x96, 0x4c, 0xf2, 0xf0, 0x70, 0x38 };
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, 8, &prepared));
+	ciron_generate_key_prepared(&ctx, &prepared, salt, 4, &Test20bytesKeyLen, 2, key);
+	EXPECT_BYTE_EQUAL(expected, key, 20);
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 24, &prepared));
+	ciron_generate_key_prepared(&ctx, &prepared, slt, 36, &Test25bytesKeyLen, 4096, key);
+	EXPECT_BYTE_EQUAL(expected5, key, 25);
+
+	return 0;
+}
+
+/*
+ * Passwords longer than the SHA-1 block size are hashed before use as the
+ * HMAC key. Check that preparing them yields the same keys.
+ */
+int PBKDF2_HMAC_SHA1_Prepared_Long_Password_Test() {
+	unsigned char key[1024];
+	unsigned char expected[1024];
+	struct CironPreparedPassword prepared;
+	const unsigned char *pwd = (unsigned char *)"passwordPASSWORDpasswordPASSWORDpasswordPASSWORDpasswordPASSWORDpassword";
+	const unsigned char salt[4] = { 's', 'a', 'l', 't' };
+
+	ciron_generate_key(&ctx, pwd, 72, salt, 4, CIRON_AES_256_CBC, 3, expected);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 72, &prepared));
+	ciron_generate_key_prepared(&ctx, &prepared, salt, 4, CIRON_AES_256_CBC, 3, key);
+	EXPECT_BYTE_EQUAL(expected, key, 32);
+
+	return 0;
+}
+
 /*
  * These tests the key generation functions, using the test cases provided in
  * http://tools.ietf.org/html/rfc6070
@@ -181,5 +228,7 @@ int main(int argc, char **argv) {
 	*/
 	RUNTEST(argv[0],PBKDF2_HMAC_SHA1_Test_5);
 	RUNTEST(argv[0],PBKDF2_HMAC_SHA1_Test_6);
+	RUNTEST(argv[0],PBKDF2_HMAC_SHA1_Prepared_Test);
+	RUNTEST(argv[0],PBKDF2_HMAC_SHA1_Prepared_Long_Password_Test);
 	return 0;
 }
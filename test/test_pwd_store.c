@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "test.h"
+
+#define MAXBUF 1024
+#define NREADERS 4
+#define NPUBLICATIONS 200
+#define INDEX_BUFFER_BYTES 128
+
+struct CironContext ctx;
+
+static unsigned char store_buffer[64 * (NREADERS + 1)];
+
+static unsigned char password_id[] = "current";
+static unsigned char password_a[] = "password_of_generation_a";
+static unsigned char password_b[] = "password_of_generation_b";
+
+/*
+ * Fills an indexed table of one entry, with its index in the supplied
+ * buffer of INDEX_BUFFER_BYTES bytes.
+ */
+static CironError fill_table(struct CironIndexedPwdTable *indexed,
+		struct CironPwdTableEntry *entry, unsigned char *password,
+		unsigned char *index_buffer) {
+	struct CironPwdTable table;
+
+	entry->password_id = password_id;
+	entry->password_id_len = strlen((char *) password_id);
+	entry->password = password;
+	entry->password_len = strlen((char *) password);
+	table.nentries = 1;
+	table.entries = entry;
+	return ciron_pwd_table_index(&ctx, indexed, &table, index_buffer, INDEX_BUFFER_BYTES);
+}
+
+static CironError unseal_with(CironIndexedPwdTable table, const unsigned char *token, size_t token_len) {
+	unsigned char cryptbuf[MAXBUF];
+	unsigned char resultbuf[MAXBUF];
+	size_t result_len;
+
+	return ciron_unseal_indexed(&ctx, token, token_len, table, NULL, 0, cryptbuf, resultbuf, &result_len);
+}
+
+int test_password_store_publish_ok() {
+	struct CironPasswordStore store;
+	struct CironIndexedPwdTable table_a, table_b;
+	struct CironPwdTableEntry entry_a, entry_b;
+	unsigned char index_buffers[2][INDEX_BUFFER_BYTES];
+	const unsigned char data[] = { 'T','e','s','t'};
+	unsigned char cryptbuf[MAXBUF];
+	unsigned char sealbuf[MAXBUF];
+	size_t len, sealed_len;
+	unsigned int reader, other, n;
+	CironIndexedPwdTable table;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, fill_table(&table_a, &entry_a, password_a, index_buffers[0]));
+	EXPECT_INT_EQUAL(CIRON_OK, fill_table(&table_b, &entry_b, password_b, index_buffers[1]));
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_calculate_password_store_buffer_length(&ctx, 0, &len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_password_store_buffer_length(&ctx, 2, &len));
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_password_store_init(&ctx, &store, &table_a, 2, store_buffer, len - 1));
+	/* The buffer need not be aligned */
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_store_init(&ctx, &store, &table_a, 2, store_buffer + 1, len));
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_store_register(&ctx, &store, &reader));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_store_register(&ctx, &store, &other));
+	EXPECT_TRUE(reader != other);
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_password_store_register(&ctx, &store, &n));
+	ciron_password_store_unregister(&store, other);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_store_register(&ctx, &store, &n));
+	EXPECT_INT_EQUAL(other, n);
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), password_id, strlen((char *) password_id), password_a, strlen((char *) password_a), cryptbuf, sealbuf, &sealed_len));
+	table = ciron_password_store_enter(&store, reader);
+	EXPECT_TRUE(table == &table_a);
+	EXPECT_INT_EQUAL(CIRON_OK, unseal_with(table, sealbuf, sealed_len));
+	ciron_password_store_leave(&store, reader);
+
+	/* Readers outside the store do not hold up the publication */
+	EXPECT_TRUE(ciron_password_store_publish(&store, &table_b) == &table_a);
+	table = ciron_password_store_enter(&store, reader);
+	EXPECT_TRUE(table == &table_b);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, unseal_with(table, sealbuf, sealed_len));
+	ciron_password_store_leave(&store, reader);
+	return 0;
+}
+
+/*
+ * Readers unseal tokens with the tables of the store while the main thread
+ * publishes two tables in turn and, each time, poisons the table it gets
+ * back until it publishes it again. A reader seeing a poisoned table fails.
+ */
+struct reader_state {
+	CironPasswordStore store;
+	const unsigned char *token;
+	size_t token_len;
+	int done;
+	unsigned long unsealed;
+	unsigned long failed;
+};
+
+static void *read_store(void *arg) {
+	struct reader_state *state = arg;
+	struct CironContext context;
+	unsigned char cryptbuf[MAXBUF];
+	unsigned char resultbuf[MAXBUF];
+	size_t result_len;
+	unsigned int reader;
+	CironIndexedPwdTable table;
+
+	ciron_context_init(&context, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	if (ciron_password_store_register(&context, state->store, &reader) != CIRON_OK) {
+		__atomic_add_fetch(&state->failed, 1, __ATOMIC_SEQ_CST);
+		return NULL;
+	}
+	while (!__atomic_load_n(&state->done, __ATOMIC_SEQ_CST)) {
+		table = ciron_password_store_enter(state->store, reader);
+		if (ciron_unseal_indexed(&context, state->token, state->token_len, table, NULL, 0,
+				cryptbuf, resultbuf, &result_len) != CIRON_OK) {
+			__atomic_add_fetch(&state->failed, 1, __ATOMIC_SEQ_CST);
+		}
+		ciron_password_store_leave(state->store, reader);
+		__atomic_add_fetch(&state->unsealed, 1, __ATOMIC_SEQ_CST);
+	}
+	ciron_password_store_unregister(state->store, reader);
+	return NULL;
+}
+
+int test_password_store_concurrent_ok() {
+	struct CironPasswordStore store;
+	struct CironIndexedPwdTable tables[2];
+	struct CironPwdTableEntry entries[2];
+	unsigned char index_buffers[2][INDEX_BUFFER_BYTES];
+	struct reader_state state;
+	const unsigned char data[] = { 'T','e','s','t'};
+	unsigned char cryptbuf[MAXBUF];
+	unsigned char sealbuf[MAXBUF];
+	size_t len, sealed_len;
+	pthread_t threads[NREADERS];
+	CironIndexedPwdTable previous, next;
+	unsigned long unsealed;
+	int i;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, fill_table(&tables[0], &entries[0], password_a, index_buffers[0]));
+	EXPECT_INT_EQUAL(CIRON_OK, fill_table(&tables[1], &entries[1], password_a, index_buffers[1]));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), password_id, strlen((char *) password_id), password_a, strlen((char *) password_a), cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_password_store_buffer_length(&ctx, NREADERS, &len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_store_init(&ctx, &store, &tables[0], NREADERS, store_buffer, len));
+
+	memset(&state, 0, sizeof(state));
+	state.store = &store;
+	state.token = sealbuf;
+	state.token_len = sealed_len;
+	for (i = 0; i < NREADERS; i++) {
+		EXPECT_INT_EQUAL(0, pthread_create(&threads[i], NULL, read_store, &state));
+	}
+	for (i = 1; i <= NPUBLICATIONS; i++) {
+		next = &tables[i & 1];
+		next->table.entries[0].password = password_a;
+		previous = ciron_password_store_publish(&store, next);
+		EXPECT_TRUE(previous == &tables[!(i & 1)]);
+		previous->table.entries[0].password = password_b;
+
+		/* Give the readers time to use a table they should not have */
+		unsealed = __atomic_load_n(&state.unsealed, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&state.unsealed, __ATOMIC_SEQ_CST) < unsealed + 2 * NREADERS) {
+			sched_yield();
+		}
+	}
+	__atomic_store_n(&state.done, 1, __ATOMIC_SEQ_CST);
+	for (i = 0; i < NREADERS; i++) {
+		EXPECT_INT_EQUAL(0, pthread_join(threads[i], NULL));
+	}
+	EXPECT_TRUE(state.unsealed > 0);
+	EXPECT_INT_EQUAL(0, (int) state.failed);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+
+	RUNTEST(argv[0], test_password_store_publish_ok);
+	RUNTEST(argv[0], test_password_store_concurrent_ok);
+
+	return 0;
+}
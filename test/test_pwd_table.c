@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "test.h"
+
+#define NENTRIES 1000
+#define MAXBUF 1024
+
+struct CironContext ctx;
+
+static struct CironPwdTableEntry entries[NENTRIES];
+static char ids[NENTRIES][64];
+static char passwords[NENTRIES][32];
+static unsigned char index_buffer[NENTRIES * 64];
+
+/*
+ * Fills the table with short IDs and with long ones that only differ
+ * after the bytes the index stores. The last entry repeats the ID of
+ * the first one with another password.
+ */
+static void fill_table(struct CironPwdTable *table) {
+	int i;
+
+	for (i = 0; i < NENTRIES; i++) {
+		if (i == NENTRIES - 1) {
+			strcpy(ids[i], ids[0]);
+		} else if (i % 2) {
+			sprintf(ids[i], "tenant%d", i);
+		} else {
+			sprintf(ids[i], "a_long_password_id_of_tenant_%d", i);
+		}
+		sprintf(passwords[i], "password_of_tenant_%d", i);
+		entries[i].password_id = (unsigned char *) ids[i];
+		entries[i].password_id_len = strlen(ids[i]);
+		entries[i].password = (unsigned char *) passwords[i];
+		entries[i].password_len = strlen(passwords[i]);
+	}
+	table->nentries = NENTRIES;
+	table->entries = entries;
+}
+
+int test_pwd_table_index_ok() {
+	struct CironPwdTable table, empty;
+	struct CironIndexedPwdTable indexed;
+	const char *missing[] = { "tenant", "tenant1000", "tenant2", "a_long_password_id_of_tenant_1", "" };
+	size_t len;
+	int i;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	fill_table(&table);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_pwd_index_buffer_length(&ctx, NENTRIES, &len));
+	EXPECT_TRUE(len < sizeof(index_buffer));
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_pwd_table_index(&ctx, &indexed, &table, index_buffer, len - 1));
+
+	/* The buffer need not be aligned */
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_pwd_table_index(&ctx, &indexed, &table, index_buffer + 1, len));
+	for (i = 0; i < NENTRIES - 1; i++) {
+		EXPECT_TRUE(ciron_pwd_table_find(&indexed, (unsigned char *) ids[i], strlen(ids[i])) == &entries[i]);
+	}
+	for (i = 0; i < sizeof(missing) / sizeof(missing[0]); i++) {
+		EXPECT_TRUE(ciron_pwd_table_find(&indexed, (unsigned char *) missing[i], strlen(missing[i])) == NULL);
+	}
+
+	/* Without the index, the same entries are found */
+	ciron_pwd_table_unindexed(&indexed, &table);
+	for (i = 0; i < NENTRIES; i++) {
+		EXPECT_TRUE(ciron_pwd_table_find(&indexed, (unsigned char *) ids[i], strlen(ids[i])) == &entries[i == NENTRIES - 1 ? 0 : i]);
+	}
+
+	empty.nentries = 0;
+	empty.entries = entries;
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_pwd_index_buffer_length(&ctx, 0, &len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_pwd_table_index(&ctx, &indexed, &empty, index_buffer, len));
+	EXPECT_TRUE(ciron_pwd_table_find(&indexed, (unsigned char *) ids[1], strlen(ids[1])) == NULL);
+	return 0;
+}
+
+int test_unseal_with_pwd_index_ok() {
+	struct CironPwdTable table;
+	struct CironIndexedPwdTable indexed;
+	struct CironTokenView view;
+	const unsigned char data[] = { 'T','e','s','t'};
+	unsigned char cryptbuf[MAXBUF];
+	unsigned char sealbuf[MAXBUF];
+	unsigned char resultbuf[MAXBUF];
+	size_t len, sealed_len, result_len;
+	int i;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	fill_table(&table);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_pwd_index_buffer_length(&ctx, NENTRIES, &len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_pwd_table_index(&ctx, &indexed, &table, index_buffer, len));
+	for (i = 776; i < 779; i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), entries[i].password_id, entries[i].password_id_len, entries[i].password, entries[i].password_len, cryptbuf, sealbuf, &sealed_len));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_indexed(&ctx, sealbuf, sealed_len, &indexed, NULL, 0, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL(sizeof(data), result_len);
+		EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_verify_indexed(&ctx, sealbuf, sealed_len, &indexed, NULL, 0));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_token_view(&ctx, sealbuf, sealed_len, &view));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_view_indexed(&ctx, sealbuf, &view, &indexed, NULL, 0, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL(sizeof(data), result_len);
+		/* The plain table works as before */
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf, sealed_len, &table, NULL, 0, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL(sizeof(data), result_len);
+	}
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), (unsigned char *) "tenant1000", 10, entries[1].password, entries[1].password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_PASSWORD_ROTATION_ERROR, ciron_unseal_indexed(&ctx, sealbuf, sealed_len, &indexed, NULL, 0, cryptbuf, resultbuf, &result_len));
+	return 0;
+}
+
+int test_unseal_with_prepared_pwd_table_ok() {
+	struct CironPwdTable table;
+	struct CironIndexedPwdTable indexed;
+	static struct CironPreparedPassword prepared[NENTRIES];
+	const unsigned char data[] = { 'T','e','s','t'};
+	unsigned char cryptbuf[MAXBUF];
+	unsigned char sealbuf[MAXBUF];
+	unsigned char resultbuf[MAXBUF];
+	size_t len, sealed_len, result_len;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	fill_table(&table);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_pwd_index_buffer_length(&ctx, NENTRIES, &len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_pwd_table_index(&ctx, &indexed, &table, index_buffer, len));
+	EXPECT_TRUE(indexed.prepared == NULL);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_pwd_table_prepare(&ctx, &indexed, prepared));
+	EXPECT_TRUE(indexed.prepared == prepared);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), entries[42].password_id, entries[42].password_id_len, entries[42].password, entries[42].password_len, cryptbuf, sealbuf, &sealed_len));
+
+	/* Unsealing uses the prepared password, not the one of the entry */
+	passwords[42][0] = 'X';
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_indexed(&ctx, sealbuf, sealed_len, &indexed, NULL, 0, cryptbuf, resultbuf, &result_len));
+	EXPECT_SIZE_T_EQUAL(sizeof(data), result_len);
+	EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal(&ctx, sealbuf, sealed_len, &table, NULL, 0, cryptbuf, resultbuf, &result_len));
+
+	/* Indexing the table again drops the prepared passwords */
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_pwd_table_index(&ctx, &indexed, &table, index_buffer, len));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal_indexed(&ctx, sealbuf, sealed_len, &indexed, NULL, 0, cryptbuf, resultbuf, &result_len));
+	return 0;
+}
+
+int main(int argc, char **argv) {
+
+	RUNTEST(argv[0], test_pwd_table_index_ok);
+	RUNTEST(argv[0], test_unseal_with_pwd_index_ok);
+	RUNTEST(argv[0], test_unseal_with_prepared_pwd_table_ok);
+
+	return 0;
+}
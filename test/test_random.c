@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "random.h"
+#include "test.h"
+
+#define MAXBUF 4096
+#define DRAW_BYTES 32
+
+struct CironContext ctx;
+
+unsigned char cryptbuf[MAXBUF];
+unsigned char sealbuf1[MAXBUF];
+unsigned char sealbuf2[MAXBUF];
+unsigned char unsealbuf[MAXBUF];
+
+const unsigned char password[] = { 's' , 'e' , 'c' , 'r' , 'e' , 't'};
+const size_t password_len = 6;
+
+const unsigned char data[] = { 'T','e','s','t'};
+const size_t data_len = 4;
+
+/*
+ * Deterministic source counting up from *arg.
+ */
+static int counting_source(void *arg, unsigned char *buf, size_t nbytes) {
+	unsigned char *next = arg;
+
+	while (nbytes-- > 0) {
+		*buf++ = (*next)++;
+	}
+	return 0;
+}
+
+static int failing_source(void *arg, unsigned char *buf, size_t nbytes) {
+	return -1;
+}
+
+/*
+ * Test vector of RFC 8439, section 2.3.2.
+ */
+int test_chacha20_block() {
+	unsigned char key[CIRON_CHACHA20_KEY_BYTES];
+	const unsigned char nonce[] = { 0, 0, 0, 0x09, 0, 0, 0, 0x4a, 0, 0, 0, 0 };
+	const unsigned char expected[] = {
+		0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+		0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+		0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+		0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+	};
+	unsigned char block[2 * CIRON_CHACHA20_BLOCK_BYTES];
+	unsigned char second[CIRON_CHACHA20_BLOCK_BYTES];
+	int i;
+
+	for (i = 0; i < CIRON_CHACHA20_KEY_BYTES; i++) {
+		key[i] = (unsigned char) i;
+	}
+	ciron_chacha20(key, nonce, 1, block, 2);
+	EXPECT_BYTE_EQUAL(expected, block, sizeof(expected));
+
+	/* The second block is the one of the next counter */
+	ciron_chacha20(key, nonce, 2, second, 1);
+	EXPECT_BYTE_EQUAL(second, block + CIRON_CHACHA20_BLOCK_BYTES, sizeof(second));
+
+	return 0;
+}
+
+/*
+ * Draws more than a pool holds and checks that successive draws differ.
+ */
+int test_random_bytes_differ() {
+	static unsigned char a[3 * MAXBUF / 4];
+	static unsigned char b[3 * MAXBUF / 4];
+	static const unsigned char zero[DRAW_BYTES];
+	size_t i;
+
+	EXPECT_INT_EQUAL(0, ciron_random_bytes(a, sizeof(a)));
+	EXPECT_INT_EQUAL(0, ciron_random_bytes(b, sizeof(b)));
+	for (i = 0; i + DRAW_BYTES <= sizeof(a); i += DRAW_BYTES) {
+		EXPECT_TRUE(memcmp(a + i, zero, DRAW_BYTES) != 0);
+		EXPECT_TRUE(memcmp(a + i, b + i, DRAW_BYTES) != 0);
+	}
+	return 0;
+}
+
+/*
+ * A child must not hand out the bytes its parent has left in the pool.
+ */
+int test_random_bytes_differ_after_fork() {
+	unsigned char parent[DRAW_BYTES];
+	unsigned char child[DRAW_BYTES];
+	int fds[2];
+	int status;
+	pid_t pid;
+
+	/* Seed the pool of this thread before forking */
+	EXPECT_INT_EQUAL(0, ciron_random_bytes(parent, 1));
+
+	EXPECT_INT_EQUAL(0, pipe(fds));
+	if ((pid = fork()) == 0) {
+		close(fds[0]);
+		if (ciron_random_bytes(child, DRAW_BYTES) != 0
+				|| write(fds[1], child, DRAW_BYTES) != DRAW_BYTES) {
+			_exit(1);
+		}
+		_exit(0);
+	}
+	EXPECT_TRUE(pid > 0);
+	close(fds[1]);
+	EXPECT_INT_EQUAL(DRAW_BYTES, (int) read(fds[0], child, DRAW_BYTES));
+	close(fds[0]);
+	EXPECT_TRUE(waitpid(pid, &status, 0) == pid);
+	EXPECT_INT_EQUAL(0, status);
+
+	EXPECT_INT_EQUAL(0, ciron_random_bytes(parent, DRAW_BYTES));
+	EXPECT_TRUE(memcmp(parent, child, DRAW_BYTES) != 0);
+	return 0;
+}
+
+/*
+ * With a deterministic source sealing produces the same token again.
+ */
+int test_random_source() {
+	unsigned char next;
+	size_t len1, len2, unseal_len;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	ciron_set_random_source(counting_source, &next);
+	next = 0;
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, data_len, NULL, 0, password,
+			password_len, cryptbuf, sealbuf1, &len1));
+	next = 0;
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, data_len, NULL, 0, password,
+			password_len, cryptbuf, sealbuf2, &len2));
+	EXPECT_SIZE_T_EQUAL(len1, len2);
+	EXPECT_BYTE_EQUAL(sealbuf1, sealbuf2, len1);
+
+	/* The encryption salt is the first random value of the token */
+	EXPECT_TRUE(memcmp(sealbuf1 + 8, "000102030405", 12) == 0);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf1, len1, NULL, password,
+			password_len, cryptbuf, unsealbuf, &unseal_len));
+	EXPECT_SIZE_T_EQUAL(data_len, unseal_len);
+	EXPECT_BYTE_EQUAL(data, unsealbuf, data_len);
+
+	ciron_set_random_source(failing_source, NULL);
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_seal(&ctx, data, data_len, NULL, 0,
+			password, password_len, cryptbuf, sealbuf2, &len2));
+
+	/* The pool is back */
+	ciron_set_random_source(NULL, NULL);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, data_len, NULL, 0, password,
+			password_len, cryptbuf, sealbuf2, &len2));
+	EXPECT_SIZE_T_EQUAL(len1, len2);
+	EXPECT_TRUE(memcmp(sealbuf1, sealbuf2, len1) != 0);
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	RUNTEST(argv[0], test_chacha20_block);
+	RUNTEST(argv[0], test_random_bytes_differ);
+	RUNTEST(argv[0], test_random_bytes_differ_after_fork);
+	RUNTEST(argv[0], test_random_source);
+	return 0;
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "base64url.h"
+#include "registry.h"
+#include "test.h"
+
+#define MAXBUF 4096
+#define NDATA 300
+
+struct CironContext ctx;
+
+unsigned char cryptbuf[MAXBUF];
+unsigned char sealbuf[MAXBUF];
+unsigned char unsealbuf[MAXBUF];
+
+const unsigned char password[] = { 's' , 'e' , 'c' , 'r' , 'e' , 't'};
+const size_t password_len = 6;
+
+static unsigned char data[NDATA];
+
+/*
+ * Fills data with bytes that hit all characters of the encodings.
+ */
+static void fill_data(void) {
+	size_t i;
+	for (i = 0; i < NDATA; i++) {
+		data[i] = (unsigned char) (i * 167 + 13);
+	}
+}
+
+static int implementation_supported(const struct CironImplementation *i) {
+	return (i->cpu_features & ciron_cpu_features()) == i->cpu_features;
+}
+
+/*
+ * Encodes and decodes all lengths of data with every implementation of
+ * the base64url primitive and compares the results with the scalar one.
+ * Decoding is also checked with an invalid character at every position.
+ */
+int test_base64url_implementations_match_scalar() {
+	static unsigned char expected[2 * NDATA];
+	static unsigned char encoded[2 * NDATA];
+	static unsigned char decoded_expected[NDATA];
+	static unsigned char decoded[NDATA];
+	struct CironPrimitive *p = ciron_find_primitive("base64url");
+	const struct CironImplementation *i;
+	size_t len, pos, expected_len, encoded_len, decoded_expected_len, decoded_len;
+
+	fill_data();
+	EXPECT_TRUE(p != NULL);
+	for (i = p->implementations; i->name != NULL; i++) {
+		if (!implementation_supported(i)) {
+			continue;
+		}
+		for (len = 0; len <= 200; len++) {
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "base64url", "scalar"));
+			ciron_base64url_encode(data, len, expected, &expected_len);
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "base64url", i->name));
+			ciron_base64url_encode(data, len, encoded, &encoded_len);
+			EXPECT_SIZE_T_EQUAL(expected_len, encoded_len);
+			EXPECT_BYTE_EQUAL(expected, encoded, encoded_len);
+
+			if (encoded_len < 2) {
+				continue;
+			}
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_base64url_decode(&ctx, encoded, encoded_len,
+					decoded, &decoded_len));
+			EXPECT_SIZE_T_EQUAL(len, decoded_len);
+			EXPECT_BYTE_EQUAL(data, decoded, len);
+
+			for (pos = 0; pos < encoded_len; pos += 7) {
+				encoded[pos] = (pos % 2) ? '+' : 0xe9;
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "base64url", "scalar"));
+				ciron_base64url_decode(&ctx, encoded, encoded_len, decoded_expected,
+						&decoded_expected_len);
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "base64url", i->name));
+				ciron_base64url_decode(&ctx, encoded, encoded_len, decoded, &decoded_len);
+				EXPECT_SIZE_T_EQUAL(decoded_expected_len, decoded_len);
+				EXPECT_BYTE_EQUAL(decoded_expected, decoded, decoded_len);
+				encoded[pos] = expected[pos];
+			}
+		}
+	}
+	return 0;
+}
+
+int test_hex_implementations_match_scalar() {
+	static unsigned char expected[2 * NDATA];
+	static unsigned char encoded[2 * NDATA];
+	struct CironPrimitive *p = ciron_find_primitive("hex");
+	const struct CironImplementation *i;
+	size_t len;
+
+	fill_data();
+	EXPECT_TRUE(p != NULL);
+	for (i = p->implementations; i->name != NULL; i++) {
+		if (!implementation_supported(i)) {
+			continue;
+		}
+		for (len = 0; len <= 200; len++) {
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "hex", "scalar"));
+			ciron_bytes_to_hex(data, len, expected);
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "hex", i->name));
+			ciron_bytes_to_hex(data, len, encoded);
+			EXPECT_BYTE_EQUAL(expected, encoded, 2 * len);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Unseals a token sealed by hapi iron and seals and unseals data with
+ * every combination of crypto, AES and SHA implementations.
+ */
+int test_crypto_implementations_seal_and_unseal() {
+	const unsigned char expected[] = { 'T','e','s','t'};
+	unsigned char *token =
+			(unsigned char *) "Fe26.1**631b0bba26b306c9803ae7509816fa08905f9827bc4eec0517c93e5772e49d2c*hMXUUOqIlobjwLVgc0Xm7Q*P-bwmfd6vOwkjsB2k4neLQ*3a14c99729334d3e9384f2636913f92da6b583db6251530852ec31640fd1d654*Rzuqqx9QIw3MDrTW3muP2aWVahdZoTSAXucYnmrj16U";
+	struct CironPrimitive *crypto = ciron_find_primitive("crypto");
+	struct CironPrimitive *aes = ciron_find_primitive("aes");
+	struct CironPrimitive *sha = ciron_find_primitive("sha");
+	const struct CironImplementation *c, *a, *s;
+	size_t sealed_len, result_len;
+
+	fill_data();
+	EXPECT_TRUE(crypto != NULL && aes != NULL && sha != NULL);
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	for (c = crypto->implementations; c->name != NULL; c++) {
+		for (a = aes->implementations; a->name != NULL; a++) {
+			for (s = sha->implementations; s->name != NULL; s++) {
+				if (!implementation_supported(c) || !implementation_supported(a)
+						|| !implementation_supported(s)) {
+					continue;
+				}
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "crypto", c->name));
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "aes", a->name));
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "sha", s->name));
+
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, token, strlen((char *) token),
+						NULL, password, password_len, cryptbuf, unsealbuf, &result_len));
+				EXPECT_SIZE_T_EQUAL(sizeof(expected), result_len);
+				EXPECT_BYTE_EQUAL(expected, unsealbuf, result_len);
+
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, 100, NULL, 0,
+						password, password_len, cryptbuf, sealbuf, &sealed_len));
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf, sealed_len,
+						NULL, password, password_len, cryptbuf, unsealbuf, &result_len));
+				EXPECT_SIZE_T_EQUAL((size_t) 100, result_len);
+				EXPECT_BYTE_EQUAL(data, unsealbuf, result_len);
+			}
+		}
+	}
+	return 0;
+}
+
+int test_set_implementation_fails_on_unknown_names() {
+	EXPECT_INT_EQUAL(CIRON_ERROR_UNKNOWN_ALGORITHM,
+			ciron_set_implementation(&ctx, "md5", "scalar"));
+	EXPECT_INT_EQUAL(CIRON_ERROR_UNKNOWN_ALGORITHM,
+			ciron_set_implementation(&ctx, "hex", "avx"));
+	EXPECT_TRUE(ciron_get_implementation("md5") == NULL);
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "hex", "scalar"));
+	EXPECT_STR_EQUAL("scalar", ciron_get_implementation("hex"));
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	RUNTEST(argv[0], test_base64url_implementations_match_scalar);
+	RUNTEST(argv[0], test_hex_implementations_match_scalar);
+	RUNTEST(argv[0], test_crypto_implementations_seal_and_unseal);
+	RUNTEST(argv[0], test_set_implementation_fails_on_unknown_names);
+	return 0;
+}
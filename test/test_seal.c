@@ -19,6 +19,15 @@ const size_t password_len = 6;
 const unsigned char password_id[] = { '1','4','8'};
 const size_t password_id_len = 3;
 
+/*
+ * Changes a character of a token to another one that is both a hex digit
+ * and base64url, so that the token still passes ciron_token_check() and
+ * only fails the integrity check.
+ */
+static void tamper(unsigned char *c) {
+	*c = *c == '0' ? '1' : '0';
+}
+
 int test_length_of_sealed() {
 	ciron_context_init(&ctx,CIRON_DEFAULT_ENCRYPTION_OPTIONS,CIRON_DEFAULT_INTEGRITY_OPTIONS);
 	const unsigned char data[] = { 'T','e','s','t'};
@@ -138,6 +147,1010 @@ int test_unseal_iron_token_ok() {
 	return 0;
 }
 
+int test_seal_prepared_unseal_ok() {
+	struct CironPreparedPassword prepared;
+	const unsigned char data[] = { 'T','e','s','t'};
+	size_t data_len = 4;
+	size_t sealed_len;
+	size_t result_len;
+	unsigned char resultbuf[MAXBUF];
+
+	ciron_context_init(&ctx,CIRON_DEFAULT_ENCRYPTION_OPTIONS,CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, password_len, &prepared));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal_prepared(&ctx, data, data_len, password_id, password_id_len, &prepared, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_SIZE_T_EQUAL((size_t)227+password_id_len, sealed_len);
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+	EXPECT_SIZE_T_EQUAL(data_len, result_len);
+	EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+
+	return 0;
+}
+
+int test_unseal_prepared_iron_token_ok() {
+	struct CironPreparedPassword prepared;
+	const unsigned char *expected = (unsigned char *)"{\"a\":1,\"b\":2,\"c\":[3,4,5],\"d\":{\"e\":\"f\"}}";
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	unsigned char *data =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	size_t data_len = 269;
+	size_t result_len;
+
+	ciron_context_init(&ctx,CIRON_DEFAULT_ENCRYPTION_OPTIONS,CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 24, &prepared));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_prepared(&ctx, data, data_len, &prepared, cryptbuf, sealbuf, &result_len));
+	EXPECT_SIZE_T_EQUAL(strlen((char*)expected), result_len);
+	EXPECT_BYTE_EQUAL(expected, sealbuf,result_len);
+
+	/* A wrong prepared password must not validate */
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 23, &prepared));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal_prepared(&ctx, data, data_len, &prepared, cryptbuf, sealbuf, &result_len));
+
+	return 0;
+}
+
+int test_sealer_seal_unseal_ok() {
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	const unsigned char data[] = { 'T','e','s','t'};
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	size_t sealed_len;
+	size_t result_len;
+	unsigned char resultbuf[MAXBUF];
+	int i;
+
+	ciron_context_init(&ctx,CIRON_DEFAULT_ENCRYPTION_OPTIONS,CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 24, &prepared));
+
+	/* Reuse the sealer to check that its contexts are properly re-keyed */
+	for(i = 0; i < 3; i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal(&ctx, &sealer, data, 4, password_id, password_id_len, &prepared, cryptbuf, sealbuf, &sealed_len));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, pwd, 24, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL((size_t)4, result_len);
+		EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_unseal(&ctx, &sealer, iron_token, 269, &prepared, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL((size_t)39, result_len);
+	}
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_sealer_unseal(&ctx, &sealer, iron_token, 268, &prepared, cryptbuf, resultbuf, &result_len));
+
+	ciron_sealer_cleanup(&sealer);
+	return 0;
+}
+
+#define NITEMS 20
+
+int test_sealer_batch_ok() {
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	struct CironBatchItem items[NITEMS];
+	const unsigned char data[] = { 'T','e','s','t'};
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	static unsigned char sealbufs[NITEMS][512];
+	static unsigned char cryptbufs[NITEMS][512];
+	static unsigned char resultbufs[NITEMS][512];
+	size_t result_len;
+	unsigned char resultbuf[MAXBUF];
+	int i;
+
+	ciron_context_init(&ctx,CIRON_DEFAULT_ENCRYPTION_OPTIONS,CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 24, &prepared));
+
+	/* More items than fit into one chunk */
+	for(i = 0; i < NITEMS; i++) {
+		items[i].data = data;
+		items[i].data_len = 1 + i % 4;
+		items[i].password_id = password_id;
+		items[i].password_id_len = i % 2 ? password_id_len : 0;
+		items[i].password = &prepared;
+		items[i].buffer_encrypted_bytes = cryptbufs[i];
+		items[i].result = sealbufs[i];
+	}
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal_batch(&ctx, &sealer, items, NITEMS));
+	for(i = 0; i < NITEMS; i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, items[i].error);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbufs[i], items[i].result_len, NULL, pwd, 24, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL((size_t)(1 + i % 4), result_len);
+		EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+	}
+
+	/* Unseal the tokens just sealed, one of them modified, and one of iron */
+	for(i = 0; i < NITEMS; i++) {
+		items[i].data = sealbufs[i];
+		items[i].data_len = items[i].result_len;
+		items[i].result = resultbufs[i];
+	}
+	tamper(&sealbufs[5][items[5].data_len - 10]);
+	items[7].data = iron_token;
+	items[7].data_len = 269;
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_sealer_unseal_batch(&ctx, &sealer, items, NITEMS));
+	for(i = 0; i < NITEMS; i++) {
+		if(i == 5) {
+			EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, items[i].error);
+			continue;
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, items[i].error);
+		if(i == 7) {
+			EXPECT_SIZE_T_EQUAL((size_t)39, items[i].result_len);
+			continue;
+		}
+		EXPECT_SIZE_T_EQUAL((size_t)(1 + i % 4), items[i].result_len);
+		EXPECT_BYTE_EQUAL(data, resultbufs[i], items[i].result_len);
+	}
+
+	/* An item with an invalid password ID fails alone */
+	for(i = 0; i < NITEMS; i++) {
+		items[i].data = data;
+		items[i].data_len = 1 + i % 4;
+		items[i].password_id = i == 3 ? (unsigned char *) "key-1" : password_id;
+		items[i].password_id_len = i == 3 ? 5 : password_id_len;
+		items[i].result = sealbufs[i];
+	}
+	EXPECT_INT_EQUAL(CIRON_PASSWORD_ROTATION_ERROR, ciron_sealer_seal_batch(&ctx, &sealer, items, NITEMS));
+	for(i = 0; i < NITEMS; i++) {
+		EXPECT_INT_EQUAL(i == 3 ? CIRON_PASSWORD_ROTATION_ERROR : CIRON_OK, items[i].error);
+	}
+
+	ciron_sealer_cleanup(&sealer);
+	return 0;
+}
+
+/*
+ * Seals with a sealer but without encryption buffer, for data lengths
+ * around the chunk size, alone and in a batch. AEAD sealers need the
+ * buffer.
+ */
+int test_sealer_seal_without_encryption_buffer() {
+	size_t lengths[] = { 0, 1, 15, 16, 767, 768, 769, 1536, 2500 };
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	struct CironBatchItem items[NITEMS];
+	static unsigned char data[2500];
+	static unsigned char sealbufs[NITEMS][512];
+	static unsigned char cryptbufs[NITEMS][512];
+	unsigned char resultbuf[MAXBUF];
+	size_t sealed_len, result_len, expected_len;
+	size_t i;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 31 + 7);
+	}
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, password_len, &prepared));
+
+	for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_seal_buffer_length(&ctx, lengths[i], password_id_len, &expected_len));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal(&ctx, &sealer, data, lengths[i], password_id, password_id_len, &prepared, NULL, sealbuf, &sealed_len));
+		EXPECT_SIZE_T_EQUAL(expected_len, sealed_len);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL(lengths[i], result_len);
+		EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+	}
+
+	for(i = 0; i < NITEMS; i++) {
+		items[i].data = data + i;
+		items[i].data_len = 100 + i;
+		items[i].password_id = password_id;
+		items[i].password_id_len = password_id_len;
+		items[i].password = &prepared;
+		items[i].buffer_encrypted_bytes = i % 3 ? cryptbufs[i] : NULL;
+		items[i].result = sealbufs[i];
+	}
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal_batch(&ctx, &sealer, items, NITEMS));
+	for(i = 0; i < NITEMS; i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, items[i].error);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbufs[i], items[i].result_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL(100 + i, result_len);
+		EXPECT_BYTE_EQUAL(data + i, resultbuf, result_len);
+	}
+	ciron_sealer_cleanup(&sealer);
+
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_seal(&ctx, data, 10, NULL, 0, password, password_len, NULL, sealbuf, &sealed_len));
+	ciron_context_init(&ctx, CIRON_AES_256_GCM_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_sealer_seal(&ctx, &sealer, data, 10, NULL, 0, &prepared, NULL, sealbuf, &sealed_len));
+	ciron_sealer_cleanup(&sealer);
+	return 0;
+}
+
+/*
+ * Unseals with a sealer but without encryption buffer, for data lengths
+ * around the chunk size, alone and in a batch. AEAD tokens need the
+ * buffer.
+ */
+int test_sealer_unseal_without_encryption_buffer() {
+	size_t lengths[] = { 0, 1, 15, 16, 767, 768, 769, 1536, 2500 };
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	struct CironBatchItem items[NITEMS];
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	static unsigned char data[2500];
+	static unsigned char sealbufs[NITEMS][512];
+	static unsigned char cryptbufs[NITEMS][512];
+	static unsigned char resultbufs[NITEMS][512];
+	unsigned char resultbuf[MAXBUF];
+	size_t sealed_len, result_len;
+	size_t i;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 29 + 3);
+	}
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, password_len, &prepared));
+
+	for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, lengths[i], password_id, password_id_len, password, password_len, cryptbuf, sealbuf, &sealed_len));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_unseal(&ctx, &sealer, sealbuf, sealed_len, &prepared, NULL, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL(lengths[i], result_len);
+		EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+	}
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, NULL, resultbuf, &result_len));
+
+	for(i = 0; i < NITEMS; i++) {
+		items[i].data = data + i;
+		items[i].data_len = 100 + i;
+		items[i].password_id = password_id;
+		items[i].password_id_len = password_id_len;
+		items[i].password = &prepared;
+		items[i].buffer_encrypted_bytes = cryptbufs[i];
+		items[i].result = sealbufs[i];
+	}
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal_batch(&ctx, &sealer, items, NITEMS));
+	for(i = 0; i < NITEMS; i++) {
+		items[i].data = sealbufs[i];
+		items[i].data_len = items[i].result_len;
+		items[i].buffer_encrypted_bytes = i % 3 ? cryptbufs[i] : NULL;
+		items[i].result = resultbufs[i];
+	}
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_unseal_batch(&ctx, &sealer, items, NITEMS));
+	for(i = 0; i < NITEMS; i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, items[i].error);
+		EXPECT_SIZE_T_EQUAL(100 + i, items[i].result_len);
+		EXPECT_BYTE_EQUAL(data + i, resultbufs[i], items[i].result_len);
+	}
+	ciron_sealer_cleanup(&sealer);
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 24, &prepared));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_unseal(&ctx, &sealer, iron_token, 269, &prepared, NULL, resultbuf, &result_len));
+	EXPECT_SIZE_T_EQUAL((size_t)39, result_len);
+	ciron_sealer_cleanup(&sealer);
+
+	ciron_context_init(&ctx, CIRON_AES_256_GCM_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal(&ctx, &sealer, data, 10, NULL, 0, &prepared, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_sealer_unseal(&ctx, &sealer, sealbuf, sealed_len, &prepared, NULL, resultbuf, &result_len));
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_sealer_unseal(&ctx, &sealer, iron_token, 269, &prepared, NULL, resultbuf, &result_len));
+	ciron_sealer_cleanup(&sealer);
+	return 0;
+}
+
+/*
+ * Seals in place with the data at the end and at the start of the token
+ * buffer, for data lengths around the chunk size and both token formats.
+ */
+int test_seal_inplace_ok() {
+	CironOptions options[] = { CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_AES_256_GCM_OPTIONS };
+	size_t lengths[] = { 0, 1, 15, 16, 767, 768, 769, 1536, 2500 };
+	static unsigned char data[2500];
+	unsigned char resultbuf[MAXBUF];
+	size_t sealed_len, result_len, expected_len;
+	size_t i, o;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 13 + 5);
+	}
+	for(o = 0; o < 2; o++) {
+		ciron_context_init(&ctx, options[o], CIRON_DEFAULT_INTEGRITY_OPTIONS);
+		for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_seal_buffer_length(&ctx, lengths[i], password_id_len, &expected_len));
+			EXPECT_TRUE(expected_len <= MAXBUF);
+
+			memcpy(sealbuf + expected_len - lengths[i], data, lengths[i]);
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_seal_inplace(&ctx, sealbuf + expected_len - lengths[i], lengths[i], password_id, password_id_len, password, password_len, sealbuf, &sealed_len));
+			EXPECT_SIZE_T_EQUAL(expected_len, sealed_len);
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+			EXPECT_SIZE_T_EQUAL(lengths[i], result_len);
+			EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+
+			memcpy(sealbuf, data, lengths[i]);
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_seal_inplace(&ctx, sealbuf, lengths[i], NULL, 0, password, password_len, sealbuf, &sealed_len));
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+			EXPECT_SIZE_T_EQUAL(lengths[i], result_len);
+			EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Unseals in place, for data lengths around the chunk size and both token
+ * formats, and fails on a modified token.
+ */
+int test_unseal_inplace_ok() {
+	CironOptions options[] = { CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_CHACHA20_POLY1305_OPTIONS };
+	size_t lengths[] = { 0, 1, 15, 16, 767, 768, 769, 1536, 2500 };
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	const char *iron_token = "Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	static unsigned char data[2500];
+	unsigned char *result;
+	size_t sealed_len, result_len;
+	size_t i, o;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 11 + 1);
+	}
+	for(o = 0; o < 2; o++) {
+		ciron_context_init(&ctx, options[o], CIRON_DEFAULT_INTEGRITY_OPTIONS);
+		for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, lengths[i], password_id, password_id_len, password, password_len, cryptbuf, sealbuf, &sealed_len));
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_inplace(&ctx, sealbuf, sealed_len, NULL, password, password_len, &result, &result_len));
+			EXPECT_TRUE(result > sealbuf && result < sealbuf + sealed_len);
+			EXPECT_SIZE_T_EQUAL(lengths[i], result_len);
+			EXPECT_BYTE_EQUAL(data, result, result_len);
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, 100, NULL, 0, password, password_len, cryptbuf, sealbuf, &sealed_len));
+		tamper(&sealbuf[sealed_len - 60]);
+		EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal_inplace(&ctx, sealbuf, sealed_len, NULL, password, password_len, &result, &result_len));
+	}
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	memcpy(sealbuf, iron_token, 269);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_inplace(&ctx, sealbuf, 269, NULL, pwd, 24, &result, &result_len));
+	EXPECT_SIZE_T_EQUAL((size_t)39, result_len);
+	return 0;
+}
+
+/*
+ * Seals and unseals with both AEAD option sets, directly, with a sealer
+ * and in a batch, and unseals an Fe26.1 token with the same contexts.
+ */
+int test_aead_seal_unseal_ok() {
+	CironOptions options[] = { CIRON_AES_256_GCM_OPTIONS, CIRON_CHACHA20_POLY1305_OPTIONS };
+	const char *prefixes[] = { "Ci26.G*148*", "Ci26.C*148*" };
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	struct CironBatchItem items[NITEMS];
+	const unsigned char data[] = { 'T','e','s','t','i','n','g'};
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	static unsigned char sealbufs[NITEMS][512];
+	static unsigned char cryptbufs[NITEMS][512];
+	static unsigned char resultbufs[NITEMS][512];
+	unsigned char resultbuf[MAXBUF];
+	size_t sealed_len, result_len, expected_len;
+	int o, i;
+
+	for(o = 0; o < 2; o++) {
+		ciron_context_init(&ctx, options[o], CIRON_DEFAULT_INTEGRITY_OPTIONS);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), password_id, password_id_len, password, password_len, cryptbuf, sealbuf, &sealed_len));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_seal_buffer_length(&ctx, sizeof(data), password_id_len, &expected_len));
+		EXPECT_SIZE_T_EQUAL(expected_len, sealed_len);
+		EXPECT_BYTE_EQUAL(prefixes[o], sealbuf, strlen(prefixes[o]));
+
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_unseal_buffer_length(&ctx, sealed_len, &expected_len));
+		EXPECT_TRUE(expected_len >= sizeof(data));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL(sizeof(data), result_len);
+		EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+
+		/* The tag covers the header as well as the encrypted data */
+		sealbuf[7] ^= 1;
+		EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+		sealbuf[7] ^= 1;
+		tamper(&sealbuf[sealed_len - 25]);
+		EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+
+		/* Fe26.1 tokens are still accepted */
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_unseal_buffer_length(&ctx, 269, &expected_len));
+		EXPECT_TRUE(expected_len >= 39);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, iron_token, 269, NULL, pwd, 24, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL((size_t)39, result_len);
+
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 24, &prepared));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal(&ctx, &sealer, data, sizeof(data), NULL, 0, &prepared, cryptbuf, sealbuf, &sealed_len));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_unseal(&ctx, &sealer, sealbuf, sealed_len, &prepared, cryptbuf, resultbuf, &result_len));
+		EXPECT_BYTE_EQUAL(data, resultbuf, sizeof(data));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_unseal(&ctx, &sealer, iron_token, 269, &prepared, cryptbuf, resultbuf, &result_len));
+		EXPECT_SIZE_T_EQUAL((size_t)39, result_len);
+
+		for(i = 0; i < NITEMS; i++) {
+			items[i].data = data;
+			items[i].data_len = 1 + i % 7;
+			items[i].password_id = password_id;
+			items[i].password_id_len = i % 2 ? password_id_len : 0;
+			items[i].password = &prepared;
+			items[i].buffer_encrypted_bytes = cryptbufs[i];
+			items[i].result = sealbufs[i];
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal_batch(&ctx, &sealer, items, NITEMS));
+		for(i = 0; i < NITEMS; i++) {
+			items[i].data = sealbufs[i];
+			items[i].data_len = items[i].result_len;
+			items[i].result = resultbufs[i];
+		}
+		items[3].data = iron_token;
+		items[3].data_len = 269;
+		(ciron_sealer_unseal_batch(&ctx, &sealer, items, NITEMS));
+		for(i = 0; i < NITEMS; i++) {
+			EXPECT_INT_EQUAL(CIRON_OK, items[i].error);
+			EXPECT_SIZE_T_EQUAL((size_t)(i == 3 ? 39 : 1 + i % 7), items[i].result_len);
+		}
+		ciron_sealer_cleanup(&sealer);
+	}
+	return 0;
+}
+
+/*
+ * Contexts without AEAD options have not sized their buffers for AEAD
+ * tokens and reject them.
+ */
+int test_unseal_fails_on_aead_token_with_cbc_options() {
+	size_t sealed_len, result_len;
+	unsigned char resultbuf[MAXBUF];
+	const unsigned char data[] = { 'T','e','s','t'};
+
+	ciron_context_init(&ctx, CIRON_AES_256_GCM_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), NULL, 0, password, password_len, cryptbuf, sealbuf, &sealed_len));
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+	return 0;
+}
+
+/*
+ * Seals and unseals with keyed BLAKE3 instead of HMAC-SHA256, which
+ * tokens with an HMAC-SHA256 do not pass.
+ */
+int test_blake3_integrity_seal_unseal_ok() {
+	static unsigned char data[3000];
+	static unsigned char bigcryptbuf[4000];
+	static unsigned char bigsealbuf[5000];
+	static unsigned char resultbuf[4000];
+	size_t sealed_len, result_len, expected_len, i;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char)i;
+	}
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_BLAKE3_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), password_id, password_id_len, password, password_len, bigcryptbuf, bigsealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_seal_buffer_length(&ctx, sizeof(data), password_id_len, &expected_len));
+	EXPECT_SIZE_T_EQUAL(expected_len, sealed_len);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, bigsealbuf, sealed_len, NULL, password, password_len, bigcryptbuf, resultbuf, &result_len));
+	EXPECT_SIZE_T_EQUAL(sizeof(data), result_len);
+	EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal(&ctx, bigsealbuf, sealed_len, NULL, password, password_len, bigcryptbuf, resultbuf, &result_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, 10, NULL, 0, password, password_len, cryptbuf, sealbuf, &sealed_len));
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_BLAKE3_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal(&ctx, sealbuf, sealed_len, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+	return 0;
+}
+
+/*
+ * Unseals ranges at and around block and chunk boundaries and compares
+ * them with the data. The HMAC is still checked and AEAD sealers cannot
+ * unseal ranges.
+ */
+int test_sealer_unseal_range_ok() {
+	size_t lengths[] = { 0, 1, 16, 100, 2500 };
+	size_t offsets[] = { 0, 1, 15, 16, 17, 99, 767, 768, 770, 2480, 2500, 3000 };
+	size_t range_lengths[] = { 0, 1, 16, 33, 800, 5000 };
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	static unsigned char data[2500];
+	static unsigned char resultbuf[MAXBUF];
+	size_t sealed_len, result_len, expected_len;
+	size_t i, o, r;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 17 + 9);
+	}
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, password_len, &prepared));
+	for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal(&ctx, &sealer, data, lengths[i], password_id, password_id_len, &prepared, NULL, sealbuf, &sealed_len));
+		for(o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+			for(r = 0; r < sizeof(range_lengths) / sizeof(range_lengths[0]); r++) {
+				expected_len = offsets[o] >= lengths[i] ? 0 : lengths[i] - offsets[o];
+				expected_len = expected_len < range_lengths[r] ? expected_len : range_lengths[r];
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_unseal_range(&ctx, &sealer, sealbuf, sealed_len, &prepared, offsets[o], range_lengths[r], resultbuf, &result_len));
+				EXPECT_SIZE_T_EQUAL(expected_len, result_len);
+				EXPECT_BYTE_EQUAL(data + offsets[o], resultbuf, result_len);
+			}
+		}
+	}
+	tamper(&sealbuf[sealed_len - 60]);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_sealer_unseal_range(&ctx, &sealer, sealbuf, sealed_len, &prepared, 0, 10, resultbuf, &result_len));
+	ciron_sealer_cleanup(&sealer);
+
+	ciron_context_init(&ctx, CIRON_AES_256_GCM_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal(&ctx, &sealer, data, 10, NULL, 0, &prepared, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_sealer_unseal_range(&ctx, &sealer, sealbuf, sealed_len, &prepared, 0, 10, resultbuf, &result_len));
+	ciron_sealer_cleanup(&sealer);
+	return 0;
+}
+
+/*
+ * Verifies tokens without unsealing them, with a password, a password
+ * table and a sealer, and fails on modified tokens, wrong passwords and
+ * AEAD tokens.
+ */
+int test_verify_ok() {
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	const unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	struct CironPwdTableEntry entry = { 3, 6, (unsigned char *) "148", (unsigned char *) "secret" };
+	struct CironPwdTable table = { 1, &entry };
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	unsigned char data[100];
+	size_t sealed_len;
+
+	memset(data, 'x', sizeof(data));
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_verify(&ctx, iron_token, 269, NULL, pwd, 24));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), password_id, password_id_len, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_verify(&ctx, sealbuf, sealed_len, NULL, password, password_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_verify(&ctx, sealbuf, sealed_len, &table, NULL, 0));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_verify(&ctx, sealbuf, sealed_len, NULL, pwd, 24));
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, password_len, &prepared));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_verify(&ctx, &sealer, sealbuf, sealed_len, &prepared));
+	tamper(&sealbuf[sealed_len - 60]);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_verify(&ctx, sealbuf, sealed_len, NULL, password, password_len));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_sealer_verify(&ctx, &sealer, sealbuf, sealed_len, &prepared));
+	ciron_sealer_cleanup(&sealer);
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_BLAKE3_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), NULL, 0, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_verify(&ctx, sealbuf, sealed_len, NULL, password, password_len));
+
+	ciron_context_init(&ctx, CIRON_CHACHA20_POLY1305_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_verify(&ctx, iron_token, 269, NULL, pwd, 24));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), NULL, 0, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_verify(&ctx, sealbuf, sealed_len, NULL, password, password_len));
+	return 0;
+}
+
+int test_token_view_ok() {
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	const unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	const unsigned char data[] = { 'T','e','s','t','i','n','g'};
+	struct CironTokenView view;
+	unsigned char resultbuf[MAXBUF];
+	size_t sealed_len, result_len;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_token_view(&ctx, iron_token, 269, &view));
+	EXPECT_SIZE_T_EQUAL((size_t)0, view.prefix.offset);
+	EXPECT_SIZE_T_EQUAL((size_t)6, view.prefix.len);
+	EXPECT_SIZE_T_EQUAL((size_t)7, view.password_id.offset);
+	EXPECT_SIZE_T_EQUAL((size_t)0, view.password_id.len);
+	EXPECT_SIZE_T_EQUAL((size_t)8, view.encryption_salt.offset);
+	EXPECT_SIZE_T_EQUAL((size_t)64, view.encryption_salt.len);
+	EXPECT_SIZE_T_EQUAL((size_t)73, view.iv.offset);
+	EXPECT_SIZE_T_EQUAL((size_t)22, view.iv.len);
+	EXPECT_SIZE_T_EQUAL((size_t)96, view.encrypted.offset);
+	EXPECT_SIZE_T_EQUAL((size_t)64, view.encrypted.len);
+	EXPECT_SIZE_T_EQUAL((size_t)161, view.integrity_salt.offset);
+	EXPECT_SIZE_T_EQUAL((size_t)64, view.integrity_salt.len);
+	EXPECT_SIZE_T_EQUAL((size_t)226, view.hmac.offset);
+	EXPECT_SIZE_T_EQUAL((size_t)43, view.hmac.len);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_view(&ctx, iron_token, &view, NULL, pwd, 24, cryptbuf, resultbuf, &result_len));
+	EXPECT_SIZE_T_EQUAL((size_t)39, result_len);
+
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_view(&ctx, (unsigned char *)"Fe26.2**a*b*c*d*e", 17, &view));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_view(&ctx, iron_token, 160, &view));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_view(&ctx, iron_token, 6, &view));
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), password_id, password_id_len, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_token_view(&ctx, sealbuf, sealed_len, &view));
+	EXPECT_SIZE_T_EQUAL(password_id_len, view.password_id.len);
+	EXPECT_SIZE_T_EQUAL(sealed_len, view.hmac.offset + view.hmac.len);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_view(&ctx, sealbuf, &view, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+	EXPECT_SIZE_T_EQUAL(sizeof(data), result_len);
+	EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+
+	/* AEAD tokens have no integrity salt, the last field is the tag */
+	ciron_context_init(&ctx, CIRON_AES_256_GCM_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), NULL, 0, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_token_view(&ctx, sealbuf, sealed_len, &view));
+	EXPECT_SIZE_T_EQUAL((size_t)0, view.integrity_salt.len);
+	EXPECT_SIZE_T_EQUAL((size_t)22, view.hmac.len);
+	EXPECT_SIZE_T_EQUAL(sealed_len, view.hmac.offset + view.hmac.len);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_view(&ctx, sealbuf, &view, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+	EXPECT_BYTE_EQUAL(data, resultbuf, sizeof(data));
+	return 0;
+}
+
+/*
+ * Malformed tokens are rejected by ciron_token_check() and, before any
+ * key is derived, by ciron_unseal() with a parse error.
+ */
+int test_token_check_ok() {
+	const unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	/* A character of each salt, the IV, the encrypted data and the HMAC */
+	const size_t positions[] = { 8, 73, 100, 170, 230 };
+	const unsigned char data[] = { 'T','e','s','t','i','n','g'};
+	unsigned char token[300];
+	unsigned char resultbuf[MAXBUF];
+	size_t sealed_len, result_len, i;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_token_check(&ctx, iron_token, 269));
+	for (i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+		memcpy(token, iron_token, 269);
+		token[positions[i]] = '.';
+		EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_check(&ctx, token, 269));
+		EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_unseal(&ctx, token, 269, NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+	}
+
+	/*
+	 * Upper case hex digits are accepted. The password ID must be a word,
+	 * for sealing as well as unsealing.
+	 */
+	memcpy(token, iron_token, 269);
+	token[9] = 'F';
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_token_check(&ctx, token, 269));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), (unsigned char *)"key_1", 5, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_token_check(&ctx, sealbuf, sealed_len));
+	EXPECT_INT_EQUAL(CIRON_PASSWORD_ROTATION_ERROR, ciron_seal(&ctx, data, sizeof(data), (unsigned char *)"key-1", 5, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	memcpy(token, "Fe26.1*a-b", 10);
+	memcpy(token + 10, iron_token + 7, 262);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_check(&ctx, token, 272));
+	token[8] = '_';
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_token_check(&ctx, token, 272));
+
+	/* The lengths of the fields follow from the options */
+	memcpy(token, iron_token, 96);
+	memcpy(token + 96, iron_token + 100, 169 - 4);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_check(&ctx, token, 265));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_check(&ctx, iron_token, 268));
+
+	ciron_context_init(&ctx, CIRON_CHACHA20_POLY1305_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), NULL, 0, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_token_check(&ctx, sealbuf, sealed_len));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_check(&ctx, sealbuf, sealed_len - 1));
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_check(&ctx, iron_token, 200));
+	return 0;
+}
+
+/*
+ * Errors are formatted by ciron_get_error() only, from arguments recorded
+ * when they occurred. Strings are copied, the token may change meanwhile.
+ */
+int test_error_message_ok() {
+	const unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	struct CironPwdTableEntry entry = { 3, 6, (unsigned char *) "149", (unsigned char *) "secret" };
+	struct CironPwdTable table = { 1, &entry };
+	const unsigned char data[] = { 'T','e','s','t'};
+	const char *expected;
+	unsigned char token[300];
+	unsigned char resultbuf[MAXBUF];
+	size_t sealed_len, result_len;
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_get_error_code(&ctx));
+	EXPECT_STR_EQUAL("", ciron_get_error(&ctx));
+
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, sizeof(data), password_id, password_id_len, password, password_len, cryptbuf, sealbuf, &sealed_len));
+	EXPECT_INT_EQUAL(CIRON_PASSWORD_ROTATION_ERROR, ciron_unseal(&ctx, sealbuf, sealed_len, &table, NULL, 0, cryptbuf, resultbuf, &result_len));
+	memset(sealbuf, 'x', sealed_len);
+	expected = "Password with ID 148 not found in ";
+	EXPECT_BYTE_EQUAL(expected, ciron_get_error(&ctx), strlen(expected));
+	EXPECT_BYTE_EQUAL(expected, ciron_get_error(&ctx), strlen(expected));
+	EXPECT_INT_EQUAL(CIRON_PASSWORD_ROTATION_ERROR, ciron_get_error_code(&ctx));
+	EXPECT_TRUE(ciron_get_crypto_error(&ctx) == 0);
+
+	memcpy(token, iron_token, 8);
+	memcpy(token + 8, iron_token + 9, 260);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, ciron_token_check(&ctx, token, 268));
+	expected = "Expected encryption salt length of 64, but got 63 in ";
+	EXPECT_BYTE_EQUAL(expected, ciron_get_error(&ctx), strlen(expected));
+	return 0;
+}
+
+/*
+ * A deterministic random source, so that tokens sealed in different ways
+ * can be compared.
+ */
+static int counting_source(void *arg, unsigned char *buf, size_t nbytes) {
+	unsigned char *next = arg;
+	size_t i;
+
+	for(i = 0; i < nbytes; i++) {
+		buf[i] = (*next)++;
+	}
+	return 0;
+}
+
+/*
+ * Seals data in pieces of the given size with a stream to buf.
+ */
+static CironError stream_seal(CironSealer sealer, CironPreparedPassword prepared,
+		const unsigned char *data, size_t data_len, size_t piece,
+		unsigned char *buf, size_t *plen) {
+	struct CironStream stream;
+	CironError e;
+	size_t n, len;
+
+	if ((e = ciron_seal_init(&ctx, &stream, sealer, password_id, password_id_len, prepared, buf, &len)) != CIRON_OK) {
+		return e;
+	}
+	*plen = len;
+	for(n = 0; n < data_len; n += piece) {
+		if ((e = ciron_seal_update(&ctx, &stream, data + n, data_len - n < piece ? data_len - n : piece, buf + *plen, &len)) != CIRON_OK) {
+			return e;
+		}
+		*plen += len;
+	}
+	if ((e = ciron_seal_final(&ctx, &stream, buf + *plen, &len)) != CIRON_OK) {
+		return e;
+	}
+	*plen += len;
+	return CIRON_OK;
+}
+
+/*
+ * Unseals the token in pieces of the given size with a stream to buf,
+ * passing its last tail_len bytes to ciron_unseal_init().
+ */
+static CironError stream_unseal(CironSealer sealer, CironPreparedPassword prepared,
+		const unsigned char *token, size_t token_len, size_t tail_len, size_t piece,
+		unsigned char *buf, size_t *plen) {
+	struct CironStream stream;
+	CironError e;
+	size_t n, len;
+
+	if ((e = ciron_unseal_init(&ctx, &stream, sealer, prepared, token + token_len - tail_len, tail_len)) != CIRON_OK) {
+		return e;
+	}
+	*plen = 0;
+	for(n = 0; n < token_len; n += piece) {
+		if ((e = ciron_unseal_update(&ctx, &stream, token + n, token_len - n < piece ? token_len - n : piece, buf + *plen, &len)) != CIRON_OK) {
+			return e;
+		}
+		*plen += len;
+	}
+	if ((e = ciron_unseal_final(&ctx, &stream, buf + *plen, &len)) != CIRON_OK) {
+		return e;
+	}
+	*plen += len;
+	return CIRON_OK;
+}
+
+/*
+ * Seals and unseals in pieces of several sizes with both integrity
+ * algorithms. The tokens are the same as those of ciron_sealer_seal()
+ * with the same salts and IVs. Streams need a CBC sealer.
+ */
+int test_stream_seal_unseal_ok() {
+	CironOptions integrity_options[] = { CIRON_DEFAULT_INTEGRITY_OPTIONS, CIRON_BLAKE3_INTEGRITY_OPTIONS };
+	size_t lengths[] = { 0, 1, 15, 16, 767, 768, 769, 2500 };
+	size_t pieces[] = { 1, 7, 16, 100, 1000, 3000 };
+	const unsigned char *pwd = (unsigned char *)"some_not_random_password";
+	unsigned char *iron_token =
+			(unsigned char *)"Fe26.1**f9eebba02da4315acd770116b07a32aa4e7a7fe5fa89e0b89d2157c5d05891ef*_vDwAc4vMs448xng9Xgc2g*lc48O_ArSZlw3cGHkYKEH0XWHimPPQV9V52vPEimWgs2FHxyoAS5gk1W20-QHrIA*4a4818478f2d3b12536d4f0844ecc8c37d10e99b2f96bd63ab212bb1dc98aa3e*S-LG1fLECD_I2Pw2TsIXosc8fhKEsjil54ifAfEv5Xw";
+	struct CironSealer sealer;
+	struct CironPreparedPassword prepared;
+	struct CironStream stream;
+	static unsigned char data[2500];
+	static unsigned char streambuf[MAXBUF];
+	static unsigned char resultbuf[MAXBUF];
+	unsigned char next;
+	size_t sealed_len, stream_len, result_len, max_len;
+	size_t i, o, p;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 7 + 2);
+	}
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, password_len, &prepared));
+	for(o = 0; o < 2; o++) {
+		ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, integrity_options[o]);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+		for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+			next = (unsigned char) i;
+			ciron_set_random_source(counting_source, &next);
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_seal(&ctx, &sealer, data, lengths[i], password_id, password_id_len, &prepared, cryptbuf, sealbuf, &sealed_len));
+			for(p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+				next = (unsigned char) i;
+				EXPECT_INT_EQUAL(CIRON_OK, stream_seal(&sealer, &prepared, data, lengths[i], pieces[p], streambuf, &stream_len));
+				EXPECT_SIZE_T_EQUAL(sealed_len, stream_len);
+				EXPECT_BYTE_EQUAL(sealbuf, streambuf, sealed_len);
+
+				EXPECT_INT_EQUAL(CIRON_OK, stream_unseal(&sealer, &prepared, sealbuf, sealed_len, 120, pieces[p], resultbuf, &result_len));
+				EXPECT_SIZE_T_EQUAL(lengths[i], result_len);
+				EXPECT_BYTE_EQUAL(data, resultbuf, result_len);
+			}
+			ciron_set_random_source(NULL, NULL);
+		}
+
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_stream_buffer_length(&ctx, 100, password_id_len, &max_len));
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal_init(&ctx, &stream, &sealer, password_id, password_id_len, &prepared, streambuf, &stream_len));
+		EXPECT_TRUE(stream_len <= max_len);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal_update(&ctx, &stream, data, 100, streambuf, &stream_len));
+		EXPECT_TRUE(stream_len <= max_len);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal_final(&ctx, &stream, streambuf, &stream_len));
+		EXPECT_TRUE(stream_len <= max_len);
+
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, data, 100, NULL, 0, password, password_len, cryptbuf, sealbuf, &sealed_len));
+		EXPECT_INT_EQUAL(CIRON_OK, stream_unseal(&sealer, &prepared, sealbuf, sealed_len, sealed_len, 9, resultbuf, &result_len));
+		EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, stream_unseal(&sealer, &prepared, sealbuf, sealed_len, 20, 9, resultbuf, &result_len));
+		tamper(&sealbuf[50]);
+		EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, stream_unseal(&sealer, &prepared, sealbuf, sealed_len, 120, 9, resultbuf, &result_len));
+		ciron_sealer_cleanup(&sealer);
+	}
+
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, pwd, 24, &prepared));
+	EXPECT_INT_EQUAL(CIRON_OK, stream_unseal(&sealer, &prepared, iron_token, 269, 120, 5, resultbuf, &result_len));
+	EXPECT_SIZE_T_EQUAL((size_t)39, result_len);
+
+	/* The password ID is checked like by ciron_unseal() */
+	memcpy(streambuf, "Fe26.1*a-b", 10);
+	memcpy(streambuf + 10, iron_token + 7, 262);
+	EXPECT_INT_EQUAL(CIRON_TOKEN_PARSE_ERROR, stream_unseal(&sealer, &prepared, streambuf, 272, 120, 5, resultbuf, &result_len));
+	EXPECT_INT_EQUAL(CIRON_PASSWORD_ROTATION_ERROR, ciron_seal_init(&ctx, &stream, &sealer, (unsigned char *)"a-b", 3, &prepared, streambuf, &stream_len));
+	ciron_sealer_cleanup(&sealer);
+
+	ciron_context_init(&ctx, CIRON_AES_256_GCM_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_sealer_init(&ctx, &sealer));
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_seal_init(&ctx, &stream, &sealer, NULL, 0, &prepared, streambuf, &stream_len));
+	EXPECT_INT_EQUAL(CIRON_CRYPTO_ERROR, ciron_unseal_init(&ctx, &stream, &sealer, &prepared, iron_token, 269));
+	ciron_sealer_cleanup(&sealer);
+	return 0;
+}
+/*
+ * Seals payloads of several lengths into an arena, with both a CBC and
+ * an AEAD algorithm. The tokens are the same as those of ciron_seal()
+ * with the same salts and IVs.
+ */
+#define NPAYLOADS 37
+
+int test_seal_batch_ok() {
+	CironOptions encryption_options[] = { CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_AES_256_GCM_OPTIONS };
+	struct CironPayload payloads[NPAYLOADS];
+	size_t offsets[NPAYLOADS + 1];
+	CironError errors[NPAYLOADS];
+	static unsigned char data[NPAYLOADS + 190];
+	static unsigned char arena[NPAYLOADS * 600];
+	unsigned char resultbuf[MAXBUF];
+	unsigned char next;
+	size_t arena_len, sealed_len, result_len;
+	int i, o;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 5 + 1);
+	}
+	for(i = 0; i < NPAYLOADS; i++) {
+		payloads[i].data = data + i;
+		payloads[i].data_len = i * 13 % 190;
+	}
+	for(o = 0; o < 2; o++) {
+		ciron_context_init(&ctx, encryption_options[o], CIRON_DEFAULT_INTEGRITY_OPTIONS);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_seal_batch_buffer_length(&ctx, payloads, NPAYLOADS, password_id_len, &arena_len));
+		EXPECT_TRUE(arena_len <= sizeof(arena));
+
+		next = 0;
+		ciron_set_random_source(counting_source, &next);
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_seal_batch(&ctx, payloads, NPAYLOADS, password_id, password_id_len, password, password_len, arena, arena_len, offsets, errors));
+		EXPECT_SIZE_T_EQUAL((size_t)0, offsets[0]);
+		next = 0;
+		for(i = 0; i < NPAYLOADS; i++) {
+			EXPECT_INT_EQUAL(CIRON_OK, errors[i]);
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_seal(&ctx, payloads[i].data, payloads[i].data_len, password_id, password_id_len, password, password_len, cryptbuf, sealbuf, &sealed_len));
+			EXPECT_SIZE_T_EQUAL(sealed_len, offsets[i + 1] - offsets[i]);
+			EXPECT_BYTE_EQUAL(sealbuf, arena + offsets[i], sealed_len);
+		}
+		ciron_set_random_source(NULL, NULL);
+
+		for(i = 0; i < NPAYLOADS; i++) {
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal(&ctx, arena + offsets[i], offsets[i + 1] - offsets[i], NULL, password, password_len, cryptbuf, resultbuf, &result_len));
+			EXPECT_SIZE_T_EQUAL(payloads[i].data_len, result_len);
+			EXPECT_BYTE_EQUAL(payloads[i].data, resultbuf, result_len);
+		}
+
+		EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_seal_batch(&ctx, payloads, NPAYLOADS, password_id, password_id_len, password, password_len, arena, arena_len - 1, offsets, errors));
+		for(i = 0; i < NPAYLOADS; i++) {
+			EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, errors[i]);
+			EXPECT_SIZE_T_EQUAL((size_t)0, offsets[i + 1]);
+		}
+		EXPECT_INT_EQUAL(CIRON_PASSWORD_ROTATION_ERROR, ciron_seal_batch(&ctx, payloads, NPAYLOADS, (unsigned char *)"a-b", 3, password, password_len, arena, arena_len, offsets, errors));
+		EXPECT_INT_EQUAL(CIRON_PASSWORD_ROTATION_ERROR, errors[0]);
+	}
+	return 0;
+}
+
+/*
+ * Unseals a batch of tokens, many of them more than once, on several
+ * threads, with and without deduplication and encryption buffers. One
+ * token is modified, its copies fail like itself.
+ */
+#define NTOKENS 40
+#define NBATCH 300
+
+int test_unseal_batch_ok() {
+	struct CironPreparedPassword prepared;
+	struct CironPayload payloads[NTOKENS];
+	size_t offsets[NTOKENS + 1];
+	CironError errors[NTOKENS];
+	static struct CironBatchItem items[NBATCH];
+	static unsigned char data[NTOKENS + 100];
+	static unsigned char arena[NTOKENS * 400];
+	static unsigned char cryptbufs[NBATCH][128];
+	static unsigned char resultbufs[NBATCH][128];
+	static unsigned char batchbuf[NBATCH * 48];
+	size_t arena_len, batch_len;
+	unsigned int threads[] = { 1, 3, 0 };
+	int i, k, t;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) (i * 3 + 7);
+	}
+	for(i = 0; i < NTOKENS; i++) {
+		payloads[i].data = data + i;
+		payloads[i].data_len = i * 7 % 100;
+	}
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, password_len, &prepared));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_seal_batch_buffer_length(&ctx, payloads, NTOKENS, password_id_len, &arena_len));
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_seal_batch(&ctx, payloads, NTOKENS, password_id, password_id_len, password, password_len, arena, arena_len, offsets, errors));
+	tamper(&arena[offsets[11] + 50]);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_calculate_unseal_batch_buffer_length(&ctx, NBATCH, &batch_len));
+	EXPECT_TRUE(batch_len <= sizeof(batchbuf));
+
+	for(t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+		for(k = 0; k < 2; k++) {
+			for(i = 0; i < NBATCH; i++) {
+				items[i].data = arena + offsets[i * 17 % NTOKENS];
+				items[i].data_len = offsets[i * 17 % NTOKENS + 1] - offsets[i * 17 % NTOKENS];
+				items[i].password = &prepared;
+				items[i].buffer_encrypted_bytes = i % 3 ? cryptbufs[i] : NULL;
+				items[i].result = resultbufs[i];
+				items[i].result_len = 0;
+			}
+			EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_unseal_batch(&ctx, items, NBATCH, threads[t], k ? batchbuf + 1 : NULL, batch_len));
+			EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, ciron_get_error_code(&ctx));
+			for(i = 0; i < NBATCH; i++) {
+				if(i * 17 % NTOKENS == 11) {
+					EXPECT_INT_EQUAL(CIRON_TOKEN_VALIDATION_ERROR, items[i].error);
+					continue;
+				}
+				EXPECT_INT_EQUAL(CIRON_OK, items[i].error);
+				EXPECT_SIZE_T_EQUAL(payloads[i * 17 % NTOKENS].data_len, items[i].result_len);
+				EXPECT_BYTE_EQUAL(payloads[i * 17 % NTOKENS].data, resultbufs[i], items[i].result_len);
+			}
+		}
+	}
+
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, ciron_unseal_batch(&ctx, items, NBATCH, 2, batchbuf, batch_len - 1));
+	EXPECT_INT_EQUAL(CIRON_OVERFLOW_ERROR, items[0].error);
+	EXPECT_INT_EQUAL(CIRON_OK, ciron_unseal_batch(&ctx, items, 0, 0, batchbuf, batch_len));
+	return 0;
+}
 
 int main(int argc, char **argv) {
 	RUNTEST(argv[0], test_length_of_sealed);
@@ -147,5 +1160,24 @@ int main(int argc, char **argv) {
 	RUNTEST(argv[0], test_unseal_fails_on_invalid_hmac);
 	RUNTEST(argv[0], test_unseal_fails_on_wrong_password);
 	RUNTEST(argv[0], test_unseal_iron_token_ok);
+	RUNTEST(argv[0], test_seal_prepared_unseal_ok);
+	RUNTEST(argv[0], test_unseal_prepared_iron_token_ok);
+	RUNTEST(argv[0], test_sealer_seal_unseal_ok);
+	RUNTEST(argv[0], test_sealer_batch_ok);
+	RUNTEST(argv[0], test_sealer_seal_without_encryption_buffer);
+	RUNTEST(argv[0], test_sealer_unseal_without_encryption_buffer);
+	RUNTEST(argv[0], test_seal_inplace_ok);
+	RUNTEST(argv[0], test_unseal_inplace_ok);
+	RUNTEST(argv[0], test_aead_seal_unseal_ok);
+	RUNTEST(argv[0], test_unseal_fails_on_aead_token_with_cbc_options);
+	RUNTEST(argv[0], test_blake3_integrity_seal_unseal_ok);
+	RUNTEST(argv[0], test_stream_seal_unseal_ok);
+	RUNTEST(argv[0], test_sealer_unseal_range_ok);
+	RUNTEST(argv[0], test_verify_ok);
+	RUNTEST(argv[0], test_token_view_ok);
+	RUNTEST(argv[0], test_token_check_ok);
+	RUNTEST(argv[0], test_error_message_ok);
+	RUNTEST(argv[0], test_seal_batch_ok);
+	RUNTEST(argv[0], test_unseal_batch_ok);
 	return 0;
 }
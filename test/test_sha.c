@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include "sha.h"
+#include "test.h"
+
+static const char ABC[] = "abc";
+static const char ABC448[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+/*
+ * The test vectors are from FIPS 180-2, appendix A and B.
+ */
+int SHA1_Abc_Test() {
+	struct CironSha1 c;
+	unsigned char digest[CIRON_SHA1_DIGEST_BYTES];
+	const unsigned char expected[] = { 0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a,
+			0xba, 0x3e, 0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c,
+			0x9c, 0xd0, 0xd8, 0x9d };
+
+	ciron_sha1_init(&c);
+	ciron_sha1_update(&c, (const unsigned char *) ABC, strlen(ABC));
+	ciron_sha1_final(&c, digest);
+	EXPECT_BYTE_EQUAL(expected, digest, CIRON_SHA1_DIGEST_BYTES);
+
+	return 0;
+}
+
+int SHA1_Two_Blocks_Test() {
+	struct CironSha1 c;
+	unsigned char digest[CIRON_SHA1_DIGEST_BYTES];
+	const unsigned char expected[] = { 0x84, 0x98, 0x3e, 0x44, 0x1c, 0x3b, 0xd2, 0x6e,
+			0xba, 0xae, 0x4a, 0xa1, 0xf9, 0x51, 0x29, 0xe5,
+			0xe5, 0x46, 0x70, 0xf1 };
+
+	ciron_sha1_init(&c);
+	ciron_sha1_update(&c, (const unsigned char *) ABC448, strlen(ABC448));
+	ciron_sha1_final(&c, digest);
+	EXPECT_BYTE_EQUAL(expected, digest, CIRON_SHA1_DIGEST_BYTES);
+
+	return 0;
+}
+
+/*
+ * One million 'a', fed in uneven pieces to exercise the buffering.
+ */
+int SHA1_Million_Test() {
+	struct CironSha1 c;
+	unsigned char digest[CIRON_SHA1_DIGEST_BYTES];
+	unsigned char data[1000];
+	const unsigned char expected[] = { 0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4,
+			0xf6, 0x1e, 0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31,
+			0x65, 0x34, 0x01, 0x6f };
+	size_t done;
+	size_t n;
+
+	memset(data, 'a', sizeof(data));
+	ciron_sha1_init(&c);
+	for (done = 0, n = 1; done < 1000000; done += n, n = n % 991 + 7) {
+		if (n > 1000000 - done) {
+			n = 1000000 - done;
+		}
+		ciron_sha1_update(&c, data, n);
+	}
+	ciron_sha1_final(&c, digest);
+	EXPECT_BYTE_EQUAL(expected, digest, CIRON_SHA1_DIGEST_BYTES);
+
+	return 0;
+}
+
+int SHA256_Abc_Test() {
+	struct CironSha256 c;
+	unsigned char digest[CIRON_SHA256_DIGEST_BYTES];
+	const unsigned char expected[] = { 0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+			0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+			0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+			0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+
+	ciron_sha256_init(&c);
+	ciron_sha256_update(&c, (const unsigned char *) ABC, strlen(ABC));
+	ciron_sha256_final(&c, digest);
+	EXPECT_BYTE_EQUAL(expected, digest, CIRON_SHA256_DIGEST_BYTES);
+
+	return 0;
+}
+
+int SHA256_Two_Blocks_Test() {
+	struct CironSha256 c;
+	unsigned char digest[CIRON_SHA256_DIGEST_BYTES];
+	const unsigned char expected[] = { 0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+			0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+			0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+			0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1 };
+
+	ciron_sha256_init(&c);
+	ciron_sha256_update(&c, (const unsigned char *) ABC448, strlen(ABC448));
+	ciron_sha256_final(&c, digest);
+	EXPECT_BYTE_EQUAL(expected, digest, CIRON_SHA256_DIGEST_BYTES);
+
+	return 0;
+}
+
+int SHA256_Million_Test() {
+	struct CironSha256 c;
+	unsigned char digest[CIRON_SHA256_DIGEST_BYTES];
+	unsigned char data[1000];
+	const unsigned char expected[] = { 0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92,
+			0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+			0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e,
+			0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0 };
+	size_t done;
+	size_t n;
+
+	memset(data, 'a', sizeof(data));
+	ciron_sha256_init(&c);
+	for (done = 0, n = 1; done < 1000000; done += n, n = n % 991 + 7) {
+		if (n > 1000000 - done) {
+			n = 1000000 - done;
+		}
+		ciron_sha256_update(&c, data, n);
+	}
+	ciron_sha256_final(&c, digest);
+	EXPECT_BYTE_EQUAL(expected, digest, CIRON_SHA256_DIGEST_BYTES);
+
+	return 0;
+}
+
+/*
+ * The SHA extension implementations must produce the same chaining
+ * states as the portable ones. Only run where the CPU has them.
+ */
+int SHA_Extensions_Match_Generic_Test() {
+#ifdef CIRON_X86_INTRINSICS
+	unsigned int required = CIRON_CPU_SHA | CIRON_CPU_SSE41 | CIRON_CPU_SSSE3;
+	unsigned char data[7 * CIRON_SHA_BLOCK_BYTES];
+	uint32_t generic[8];
+	uint32_t shani[8];
+	size_t i;
+
+	if ((ciron_cpu_features() & required) != required) {
+		return 0;
+	}
+	srand(1);
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = (unsigned char) rand();
+	}
+	for (i = 0; i < 8; i++) {
+		generic[i] = shani[i] = (uint32_t) rand();
+	}
+	ciron_sha1_blocks_generic(generic, data, 7);
+	ciron_sha1_blocks_shani(shani, data, 7);
+	EXPECT_BYTE_EQUAL(generic, shani, 5 * sizeof(uint32_t));
+
+	ciron_sha256_blocks_generic(generic, data, 7);
+	ciron_sha256_blocks_shani(shani, data, 7);
+	EXPECT_BYTE_EQUAL(generic, shani, 8 * sizeof(uint32_t));
+#endif
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	RUNTEST(argv[0],SHA1_Abc_Test);
+	RUNTEST(argv[0],SHA1_Two_Blocks_Test);
+	RUNTEST(argv[0],SHA1_Million_Test);
+	RUNTEST(argv[0],SHA256_Abc_Test);
+	RUNTEST(argv[0],SHA256_Two_Blocks_Test);
+	RUNTEST(argv[0],SHA256_Million_Test);
+	RUNTEST(argv[0],SHA_Extensions_Match_Generic_Test);
+	return 0;
+}
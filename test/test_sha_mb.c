@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ciron.h"
+#include "common.h"
+#include "crypto.h"
+#include "registry.h"
+#include "sha_mb.h"
+#include "test.h"
+
+#define NJOBS 37
+#define MAXLEN 300
+
+struct CironContext ctx;
+
+static unsigned char data[MAXLEN];
+
+static void fill_data(void) {
+	size_t i;
+	for (i = 0; i < MAXLEN; i++) {
+		data[i] = (unsigned char) (i * 167 + 13);
+	}
+}
+
+static int implementation_supported(const struct CironImplementation *i) {
+	return (i->cpu_features & ciron_cpu_features()) == i->cpu_features;
+}
+
+/*
+ * Hashes messages of different lengths with every implementation of the
+ * sha_mb primitive, the complete blocks in place and the rest in the
+ * tail, and compares the results with the single-buffer functions.
+ */
+int test_sha_mb_implementations_match_sha() {
+	static unsigned char tails[NJOBS][2 * CIRON_SHA_BLOCK_BYTES];
+	struct CironShaMbJob jobs[NJOBS];
+	uint32_t states1[NJOBS][5];
+	uint32_t states256[NJOBS][8];
+	unsigned char expected[CIRON_SHA256_DIGEST_BYTES];
+	unsigned char digest[CIRON_SHA256_DIGEST_BYTES];
+	struct CironSha1 sha1;
+	struct CironSha256 sha256;
+	struct CironPrimitive *p = ciron_find_primitive("sha_mb");
+	const struct CironImplementation *i;
+	size_t j, len, full;
+	int w;
+
+	fill_data();
+	EXPECT_TRUE(p != NULL);
+	for (i = p->implementations; i->name != NULL; i++) {
+		if (!implementation_supported(i)) {
+			continue;
+		}
+		EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "sha_mb", i->name));
+
+		/* Message lengths vary, so the jobs end at different times */
+		for (j = 0; j < NJOBS; j++) {
+			len = (j * 97) % MAXLEN;
+			full = len / CIRON_SHA_BLOCK_BYTES;
+			memcpy(tails[j], data + full * CIRON_SHA_BLOCK_BYTES, len % CIRON_SHA_BLOCK_BYTES);
+			jobs[j].data = data;
+			jobs[j].nblocks = full;
+			jobs[j].tail = tails[j];
+			jobs[j].tail_blocks = ciron_sha_pad(tails[j], len % CIRON_SHA_BLOCK_BYTES, len);
+		}
+
+		for (j = 0; j < NJOBS; j++) {
+			ciron_sha1_init(&sha1);
+			memcpy(states1[j], sha1.state, sizeof(states1[j]));
+			jobs[j].state = states1[j];
+		}
+		ciron_sha1_mb(jobs, NJOBS);
+		for (j = 0; j < NJOBS; j++) {
+			ciron_sha1_init(&sha1);
+			ciron_sha1_update(&sha1, data, (j * 97) % MAXLEN);
+			ciron_sha1_final(&sha1, expected);
+			for (w = 0; w < 5; w++) {
+				digest[4 * w] = (unsigned char) (states1[j][w] >> 24);
+				digest[4 * w + 1] = (unsigned char) (states1[j][w] >> 16);
+				digest[4 * w + 2] = (unsigned char) (states1[j][w] >> 8);
+				digest[4 * w + 3] = (unsigned char) states1[j][w];
+			}
+			EXPECT_BYTE_EQUAL(expected, digest, CIRON_SHA1_DIGEST_BYTES);
+		}
+
+		for (j = 0; j < NJOBS; j++) {
+			ciron_sha256_init(&sha256);
+			memcpy(states256[j], sha256.state, sizeof(states256[j]));
+			jobs[j].state = states256[j];
+		}
+		ciron_sha256_mb(jobs, NJOBS);
+		for (j = 0; j < NJOBS; j++) {
+			ciron_sha256_init(&sha256);
+			ciron_sha256_update(&sha256, data, (j * 97) % MAXLEN);
+			ciron_sha256_final(&sha256, expected);
+			for (w = 0; w < 8; w++) {
+				digest[4 * w] = (unsigned char) (states256[j][w] >> 24);
+				digest[4 * w + 1] = (unsigned char) (states256[j][w] >> 16);
+				digest[4 * w + 2] = (unsigned char) (states256[j][w] >> 8);
+				digest[4 * w + 3] = (unsigned char) states256[j][w];
+			}
+			EXPECT_BYTE_EQUAL(expected, digest, CIRON_SHA256_DIGEST_BYTES);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Derives keys, encrypts and calculates MACs in batches with every crypto
+ * and sha_mb implementation and compares them with the single calls.
+ */
+int test_batches_match_single_calls() {
+	static const unsigned char salt[] = "a5d3c2b9e7f1a0c4d6b8e2f3a1c5d7b9";
+	static const unsigned char *password = (const unsigned char *) "some_not_random_password";
+	struct CironPreparedPassword prepared;
+	struct CironKeyJob key_jobs[NJOBS];
+	struct CironMacJob mac_jobs[NJOBS];
+	struct CironCipherJob cipher_jobs[NJOBS];
+	static unsigned char encrypted[NJOBS][MAXLEN + CIPHER_BLOCK_SIZE];
+	static unsigned char expected_encrypted[MAXLEN + CIPHER_BLOCK_SIZE];
+	unsigned char keys[NJOBS][MAX_KEY_BYTES];
+	unsigned char macs[NJOBS][MAX_HMAC_BYTES];
+	unsigned char expected[MAX_KEY_BYTES];
+	size_t expected_len;
+	struct CironMac *mac;
+	struct CironCipher *cipher;
+	struct CironPrimitive *crypto = ciron_find_primitive("crypto");
+	struct CironPrimitive *sha_mb = ciron_find_primitive("sha_mb");
+	const struct CironImplementation *c, *s;
+	size_t j;
+
+	fill_data();
+	EXPECT_TRUE(crypto != NULL && sha_mb != NULL);
+	ciron_context_init(&ctx, CIRON_DEFAULT_ENCRYPTION_OPTIONS, CIRON_DEFAULT_INTEGRITY_OPTIONS);
+	for (c = crypto->implementations; c->name != NULL; c++) {
+		for (s = sha_mb->implementations; s->name != NULL; s++) {
+			if (!implementation_supported(c) || !implementation_supported(s)) {
+				continue;
+			}
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "crypto", c->name));
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_set_implementation(&ctx, "sha_mb", s->name));
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_password_prepare(&ctx, password, 24, &prepared));
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_mac_new(&ctx, CIRON_SHA_256, &mac));
+
+			/* AES-256 needs two PBKDF2 blocks, AES-128 one */
+			for (j = 0; j < NJOBS; j++) {
+				key_jobs[j].password = &prepared;
+				key_jobs[j].salt = salt;
+				key_jobs[j].salt_len = j % 32;
+				key_jobs[j].algorithm = (j % 3) ? CIRON_AES_256_CBC : CIRON_AES_128_CBC;
+				key_jobs[j].iterations = 1 + j % 4;
+				key_jobs[j].key = keys[j];
+			}
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_generate_keys_prepared(&ctx, key_jobs, NJOBS));
+			for (j = 0; j < NJOBS; j++) {
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_generate_key_prepared(&ctx, &prepared,
+						key_jobs[j].salt, key_jobs[j].salt_len, key_jobs[j].algorithm,
+						key_jobs[j].iterations, expected));
+				EXPECT_BYTE_EQUAL(expected, keys[j], NBYTES(key_jobs[j].algorithm->key_bits));
+			}
+
+			for (j = 0; j < NJOBS; j++) {
+				mac_jobs[j].key = keys[j];
+				mac_jobs[j].key_len = 1 + j % MAX_KEY_BYTES;
+				mac_jobs[j].data = data;
+				mac_jobs[j].data_len = (j * 97) % MAXLEN;
+				mac_jobs[j].result = macs[j];
+			}
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_mac_batch(&ctx, mac, mac_jobs, NJOBS));
+			for (j = 0; j < NJOBS; j++) {
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_mac(&ctx, mac, mac_jobs[j].key,
+						mac_jobs[j].key_len, mac_jobs[j].data, mac_jobs[j].data_len,
+						expected, &expected_len));
+				EXPECT_SIZE_T_EQUAL(expected_len, mac_jobs[j].result_len);
+				EXPECT_BYTE_EQUAL(expected, macs[j], expected_len);
+			}
+			ciron_mac_free(mac);
+
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_cipher_new(&ctx, CIRON_AES_256_CBC, &cipher));
+			for (j = 0; j < NJOBS; j++) {
+				cipher_jobs[j].key = keys[j];
+				cipher_jobs[j].iv = salt + j % 16;
+				cipher_jobs[j].data = data;
+				cipher_jobs[j].data_len = (j * 97) % MAXLEN;
+				cipher_jobs[j].buf = encrypted[j];
+			}
+			EXPECT_INT_EQUAL(CIRON_OK, ciron_cipher_encrypt_batch(&ctx, cipher, cipher_jobs, NJOBS));
+			for (j = 0; j < NJOBS; j++) {
+				EXPECT_INT_EQUAL(CIRON_OK, ciron_cipher_encrypt(&ctx, cipher,
+						cipher_jobs[j].key, cipher_jobs[j].iv, cipher_jobs[j].data,
+						cipher_jobs[j].data_len, expected_encrypted, &expected_len));
+				EXPECT_SIZE_T_EQUAL(expected_len, cipher_jobs[j].len);
+				EXPECT_BYTE_EQUAL(expected_encrypted, encrypted[j], expected_len);
+			}
+			ciron_cipher_free(cipher);
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	RUNTEST(argv[0], test_sha_mb_implementations_match_sha);
+	RUNTEST(argv[0], test_batches_match_single_calls);
+	return 0;
+}